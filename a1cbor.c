@@ -1,10 +1,45 @@
+#if defined(__linux__) && !defined(_POSIX_C_SOURCE)
+// Needed for posix_madvise() in strict C mode.
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include "./a1cbor.h"
 
 #include <assert.h>
 #include <limits.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#if defined(__unix__) || defined(__APPLE__)
+#define A1C_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define A1C_HAS_MMAP 0
+#endif
+
+#if defined(__GNUC__) && defined(__SSE2__) && !defined(A1C_TEST_FALLBACK)
+#define A1C_HAS_SSE2 1
+#include <emmintrin.h>
+#else
+#define A1C_HAS_SSE2 0
+#endif
+
+// Extensions beyond the baseline are compiled with target attributes and
+// selected at runtime.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) &&        \
+    !defined(A1C_TEST_FALLBACK)
+#define A1C_HAS_F16C 1
+#define A1C_HAS_AVX2 A1C_HAS_SSE2
+#include <immintrin.h>
+#else
+#define A1C_HAS_F16C 0
+#define A1C_HAS_AVX2 0
+#endif
+
 ////////////////////////////////////////
 // Constants
 ////////////////////////////////////////
@@ -134,49 +169,860 @@ static uint64_t A1C_bigEndian64(uint64_t value) {
     }                                                                          \
   } while (0)
 
-const char A1C_kBase64Map[] = {
-    'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M',
-    'N', 'O', 'P', 'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X', 'Y', 'Z',
-    'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm',
-    'n', 'o', 'p', 'q', 'r', 's', 't', 'u', 'v', 'w', 'x', 'y', 'z',
-    '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', '+', '/'};
+/**
+ * Narrows the float64 with bit pattern @p bits to a float32, if it can be done
+ * exactly. Works on the bits so NaN payloads and signaling NaNs are preserved.
+ * @returns false if the value isn't exactly representable as a float32.
+ */
+static bool A1C_float64To32Exact(uint64_t bits, uint32_t *out) {
+  const uint32_t sign = (uint32_t)(bits >> 63) << 31;
+  const uint32_t exponent = (uint32_t)(bits >> 52) & 0x7FF;
+  const uint64_t mantissa = bits & ((((uint64_t)1) << 52) - 1);
+  const uint64_t droppedMask = (((uint64_t)1) << 29) - 1;
+  if (exponent == 0x7FF) {
+    // Infinity or NaN: the payload must survive.
+    if ((mantissa & droppedMask) != 0) {
+      return false;
+    }
+    *out = sign | (0xFFu << 23) | (uint32_t)(mantissa >> 29);
+    return true;
+  }
+  if (exponent == 0) {
+    // Zero, or a float64 subnormal, which is far below the float32 range.
+    if (mantissa != 0) {
+      return false;
+    }
+    *out = sign;
+    return true;
+  }
+  const int e = (int)exponent - 1023;
+  if (e >= -126 && e <= 127) {
+    if ((mantissa & droppedMask) != 0) {
+      return false;
+    }
+    *out = sign | ((uint32_t)(e + 127) << 23) | (uint32_t)(mantissa >> 29);
+    return true;
+  }
+  if (e >= -149 && e < -126) {
+    // Float32 subnormal: the value is m * 2^-149.
+    const uint64_t significand = (((uint64_t)1) << 52) | mantissa;
+    const unsigned shift = (unsigned)(-97 - e);
+    if ((significand & ((((uint64_t)1) << shift) - 1)) != 0) {
+      return false;
+    }
+    *out = sign | (uint32_t)(significand >> shift);
+    return true;
+  }
+  return false;
+}
 
-size_t A1C_base64EncodedSize(size_t srcSize) {
+/**
+ * Narrows the float32 with bit pattern @p bits to a float16, if it can be done
+ * exactly. Works on the bits so NaN payloads and signaling NaNs are preserved.
+ * @returns false if the value isn't exactly representable as a float16.
+ */
+static bool A1C_float32To16Exact(uint32_t bits, uint16_t *out) {
+  const uint16_t sign = (uint16_t)((bits >> 31) << 15);
+  const uint32_t exponent = (bits >> 23) & 0xFF;
+  const uint32_t mantissa = bits & ((1u << 23) - 1);
+  const uint32_t droppedMask = (1u << 13) - 1;
+  if (exponent == 0xFF) {
+    // Infinity or NaN: the payload must survive.
+    if ((mantissa & droppedMask) != 0) {
+      return false;
+    }
+    *out = (uint16_t)(sign | (0x1Fu << 10) | (mantissa >> 13));
+    return true;
+  }
+  if (exponent == 0) {
+    // Zero, or a float32 subnormal, which is far below the float16 range.
+    if (mantissa != 0) {
+      return false;
+    }
+    *out = sign;
+    return true;
+  }
+  const int e = (int)exponent - 127;
+  if (e >= -14 && e <= 15) {
+    if ((mantissa & droppedMask) != 0) {
+      return false;
+    }
+    *out = (uint16_t)(sign | ((uint32_t)(e + 15) << 10) | (mantissa >> 13));
+    return true;
+  }
+  if (e >= -24 && e < -14) {
+    // Float16 subnormal: the value is m * 2^-24.
+    const uint32_t significand = (1u << 23) | mantissa;
+    const unsigned shift = (unsigned)(-1 - e);
+    if ((significand & ((1u << shift) - 1)) != 0) {
+      return false;
+    }
+    *out = (uint16_t)(sign | (significand >> shift));
+    return true;
+  }
+  return false;
+}
+
+// Non-cryptographic 64-bit hashing, used for checksums and item hashes.
+
+#define A1C_HASH_PRIME1 0x9E3779B185EBCA87ULL
+#define A1C_HASH_PRIME2 0xC2B2AE3D27D4EB4FULL
+
+static uint64_t A1C_rotl64(uint64_t value, unsigned shift) {
+  return (value << shift) | (value >> (64 - shift));
+}
+
+/// Mixes the 64-bit @p word into the hash state @p hash.
+static uint64_t A1C_hashMix(uint64_t hash, uint64_t word) {
+  hash ^= A1C_rotl64(word * A1C_HASH_PRIME2, 31) * A1C_HASH_PRIME1;
+  return A1C_rotl64(hash, 27) * A1C_HASH_PRIME1 + A1C_HASH_PRIME2;
+}
+
+/// Finalizes the hash state @p hash so every input bit affects every output
+/// bit.
+static uint64_t A1C_hashFinish(uint64_t hash) {
+  hash ^= hash >> 33;
+  hash *= 0xFF51AFD7ED558CCDULL;
+  hash ^= hash >> 33;
+  hash *= 0xC4CEB9FE1A85EC53ULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+/// Mixes [data, data + size) into the hash state @p hash.
+static uint64_t A1C_hashBytes(uint64_t hash, const void *data, size_t size) {
+  const uint8_t *ptr = (const uint8_t *)data;
+  // Four independent lanes so the multiplies can overlap.
+  if (size >= 32) {
+    uint64_t lanes[4] = {hash, hash + A1C_HASH_PRIME1, hash + A1C_HASH_PRIME2,
+                         hash - A1C_HASH_PRIME1};
+    for (; size >= 32; ptr += 32, size -= 32) {
+      for (size_t i = 0; i < 4; ++i) {
+        uint64_t word;
+        memcpy(&word, ptr + 8 * i, sizeof(word));
+        lanes[i] = A1C_hashMix(lanes[i], word);
+      }
+    }
+    hash = A1C_rotl64(lanes[0], 1) + A1C_rotl64(lanes[1], 7) +
+           A1C_rotl64(lanes[2], 12) + A1C_rotl64(lanes[3], 18);
+  }
+  for (; size >= 8; ptr += 8, size -= 8) {
+    uint64_t word;
+    memcpy(&word, ptr, sizeof(word));
+    hash = A1C_hashMix(hash, word);
+  }
+  if (size > 0) {
+    uint64_t word = 0;
+    memcpy(&word, ptr, size);
+    hash = A1C_hashMix(hash, word ^ ((uint64_t)size << 56));
+  }
+  return hash;
+}
+
+////////////////////////////////////////
+// Text
+////////////////////////////////////////
+
+/**
+ * @returns The size of the valid UTF-8 sequence of 2 to 4 bytes starting at
+ * @p ptr, or 0 if it isn't valid. Overlong encodings, surrogates, and code
+ * points above U+10FFFF are invalid.
+ */
+static size_t A1C_utf8SequenceSize(const uint8_t *ptr, const uint8_t *end) {
+  const uint8_t lead = ptr[0];
+  size_t size;
+  uint8_t min = 0x80;
+  uint8_t max = 0xBF;
+  if (lead >= 0xC2 && lead <= 0xDF) {
+    size = 2;
+  } else if (lead >= 0xE0 && lead <= 0xEF) {
+    size = 3;
+    if (lead == 0xE0) {
+      min = 0xA0;
+    } else if (lead == 0xED) {
+      max = 0x9F;
+    }
+  } else if (lead >= 0xF0 && lead <= 0xF4) {
+    size = 4;
+    if (lead == 0xF0) {
+      min = 0x90;
+    } else if (lead == 0xF4) {
+      max = 0x8F;
+    }
+  } else {
+    return 0;
+  }
+  if ((size_t)(end - ptr) < size || ptr[1] < min || ptr[1] > max) {
+    return 0;
+  }
+  for (size_t i = 2; i < size; ++i) {
+    if ((ptr[i] & 0xC0) != 0x80) {
+      return 0;
+    }
+  }
+  return size;
+}
+
+/// Writes the UTF-8 encoding of @p codePoint to @p dst.
+/// @returns The number of bytes written.
+static size_t A1C_utf8Encode(uint32_t codePoint, char *dst) {
+  if (codePoint < 0x80) {
+    dst[0] = (char)codePoint;
+    return 1;
+  } else if (codePoint < 0x800) {
+    dst[0] = (char)(0xC0 | (codePoint >> 6));
+    dst[1] = (char)(0x80 | (codePoint & 0x3F));
+    return 2;
+  } else if (codePoint < 0x10000) {
+    dst[0] = (char)(0xE0 | (codePoint >> 12));
+    dst[1] = (char)(0x80 | ((codePoint >> 6) & 0x3F));
+    dst[2] = (char)(0x80 | (codePoint & 0x3F));
+    return 3;
+  } else {
+    assert(codePoint <= 0x10FFFF);
+    dst[0] = (char)(0xF0 | (codePoint >> 18));
+    dst[1] = (char)(0x80 | ((codePoint >> 12) & 0x3F));
+    dst[2] = (char)(0x80 | ((codePoint >> 6) & 0x3F));
+    dst[3] = (char)(0x80 | (codePoint & 0x3F));
+    return 4;
+  }
+}
+
+// Validating UTF-8 in bulk. Blocks are checked with the lookup algorithm of
+// Keiser and Lemire ("Validating UTF-8 In Less Than One Instruction Per
+// Byte", 2021) where AVX2 is available, and ASCII blocks are skipped with
+// SSE2 otherwise. Once a block fails, the scalar validator takes over from
+// the start of the character to find the exact offset.
+
+/// @returns The first byte of the first invalid sequence in [ptr, end), or
+/// @p end if it is all valid.
+static const uint8_t *A1C_validateUtf8Scalar(const uint8_t *ptr,
+                                             const uint8_t *end) {
+  while (ptr < end) {
+    if (end - ptr >= 8) {
+      uint64_t word;
+      memcpy(&word, ptr, sizeof(word));
+      if ((word & 0x8080808080808080ull) == 0) {
+        ptr += 8;
+        continue;
+      }
+    }
+    if (*ptr < 0x80) {
+      ++ptr;
+      continue;
+    }
+    const size_t size = A1C_utf8SequenceSize(ptr, end);
+    if (size == 0) {
+      return ptr;
+    }
+    ptr += size;
+  }
+  return ptr;
+}
+
+#if A1C_HAS_AVX2
+/// @returns The start of the character that the byte before @p ptr is in,
+/// assuming the bytes before that character are valid UTF-8.
+static const uint8_t *A1C_utf8LastCharStart(const uint8_t *begin,
+                                            const uint8_t *ptr) {
+  if (ptr == begin) {
+    return ptr;
+  }
+  --ptr;
+  for (int i = 0; i < 3 && ptr > begin && (*ptr & 0xC0) == 0x80; ++i) {
+    --ptr;
+  }
+  return ptr;
+}
+#endif
+
+#if A1C_HAS_SSE2
+static const uint8_t *A1C_validateUtf8SSE2(const uint8_t *begin,
+                                           const uint8_t *end) {
+  const uint8_t *ptr = begin;
+  while (end - ptr >= 16) {
+    const __m128i v = _mm_loadu_si128((const __m128i *)(const void *)ptr);
+    if (_mm_movemask_epi8(v) == 0) {
+      ptr += 16;
+      continue;
+    }
+    // Validate past the non-ASCII bytes, which leaves ptr on a character
+    // boundary.
+    const uint8_t *const blockEnd = ptr + 16;
+    while (ptr < blockEnd) {
+      if (*ptr < 0x80) {
+        ++ptr;
+        continue;
+      }
+      const size_t size = A1C_utf8SequenceSize(ptr, end);
+      if (size == 0) {
+        return ptr;
+      }
+      ptr += size;
+    }
+  }
+  return A1C_validateUtf8Scalar(ptr, end);
+}
+#endif
+
+#if A1C_HAS_AVX2
+static bool A1C_hasAVX2(void) { return __builtin_cpu_supports("avx2"); }
+
+// Error classes for the lookup tables, keyed by the high and low nibbles of
+// the previous byte and the high nibble of the current byte.
+#define A1C_UTF8_TOO_SHORT (1 << 0)
+#define A1C_UTF8_TOO_LONG (1 << 1)
+#define A1C_UTF8_OVERLONG_3 (1 << 2)
+#define A1C_UTF8_TOO_LARGE (1 << 3)
+#define A1C_UTF8_SURROGATE (1 << 4)
+#define A1C_UTF8_OVERLONG_2 (1 << 5)
+#define A1C_UTF8_TOO_LARGE_1000 (1 << 6)
+#define A1C_UTF8_OVERLONG_4 (1 << 6)
+#define A1C_UTF8_TWO_CONTS (1 << 7)
+#define A1C_UTF8_CARRY                                                         \
+  (A1C_UTF8_TOO_SHORT | A1C_UTF8_TOO_LONG | A1C_UTF8_TWO_CONTS)
+
+/// @returns The bytes of @p input shifted forward by @p N, with the last bytes
+/// of @p prev shifted in.
+#define A1C_AVX2_PREV(input, prev, N)                                          \
+  _mm256_alignr_epi8(                                                          \
+      (input), _mm256_permute2x128_si256((prev), (input), 0x21), 16 - (N))
+
+static const uint8_t A1C_kUtf8Byte1High[16] = {
+    // 0_______ ASCII
+    A1C_UTF8_TOO_LONG, A1C_UTF8_TOO_LONG, A1C_UTF8_TOO_LONG, A1C_UTF8_TOO_LONG,
+    A1C_UTF8_TOO_LONG, A1C_UTF8_TOO_LONG, A1C_UTF8_TOO_LONG, A1C_UTF8_TOO_LONG,
+    // 10______ continuation
+    A1C_UTF8_TWO_CONTS, A1C_UTF8_TWO_CONTS, A1C_UTF8_TWO_CONTS,
+    A1C_UTF8_TWO_CONTS,
+    // 1100____
+    A1C_UTF8_TOO_SHORT | A1C_UTF8_OVERLONG_2,
+    // 1101____
+    A1C_UTF8_TOO_SHORT,
+    // 1110____
+    A1C_UTF8_TOO_SHORT | A1C_UTF8_OVERLONG_3 | A1C_UTF8_SURROGATE,
+    // 1111____
+    A1C_UTF8_TOO_SHORT | A1C_UTF8_TOO_LARGE | A1C_UTF8_TOO_LARGE_1000 |
+        A1C_UTF8_OVERLONG_4,
+};
+
+static const uint8_t A1C_kUtf8Byte1Low[16] = {
+    // ____0000
+    A1C_UTF8_CARRY | A1C_UTF8_OVERLONG_3 | A1C_UTF8_OVERLONG_2 |
+        A1C_UTF8_OVERLONG_4,
+    // ____0001
+    A1C_UTF8_CARRY | A1C_UTF8_OVERLONG_2,
+    // ____001_
+    A1C_UTF8_CARRY, A1C_UTF8_CARRY,
+    // ____0100
+    A1C_UTF8_CARRY | A1C_UTF8_TOO_LARGE,
+    // ____0101 to ____1100
+    A1C_UTF8_CARRY | A1C_UTF8_TOO_LARGE | A1C_UTF8_TOO_LARGE_1000,
+    A1C_UTF8_CARRY | A1C_UTF8_TOO_LARGE | A1C_UTF8_TOO_LARGE_1000,
+    A1C_UTF8_CARRY | A1C_UTF8_TOO_LARGE | A1C_UTF8_TOO_LARGE_1000,
+    A1C_UTF8_CARRY | A1C_UTF8_TOO_LARGE | A1C_UTF8_TOO_LARGE_1000,
+    A1C_UTF8_CARRY | A1C_UTF8_TOO_LARGE | A1C_UTF8_TOO_LARGE_1000,
+    A1C_UTF8_CARRY | A1C_UTF8_TOO_LARGE | A1C_UTF8_TOO_LARGE_1000,
+    A1C_UTF8_CARRY | A1C_UTF8_TOO_LARGE | A1C_UTF8_TOO_LARGE_1000,
+    A1C_UTF8_CARRY | A1C_UTF8_TOO_LARGE | A1C_UTF8_TOO_LARGE_1000,
+    // ____1101
+    A1C_UTF8_CARRY | A1C_UTF8_TOO_LARGE | A1C_UTF8_TOO_LARGE_1000 |
+        A1C_UTF8_SURROGATE,
+    // ____111_
+    A1C_UTF8_CARRY | A1C_UTF8_TOO_LARGE | A1C_UTF8_TOO_LARGE_1000,
+    A1C_UTF8_CARRY | A1C_UTF8_TOO_LARGE | A1C_UTF8_TOO_LARGE_1000,
+};
+
+static const uint8_t A1C_kUtf8Byte2High[16] = {
+    // 0_______ ASCII
+    A1C_UTF8_TOO_SHORT, A1C_UTF8_TOO_SHORT, A1C_UTF8_TOO_SHORT,
+    A1C_UTF8_TOO_SHORT, A1C_UTF8_TOO_SHORT, A1C_UTF8_TOO_SHORT,
+    A1C_UTF8_TOO_SHORT, A1C_UTF8_TOO_SHORT,
+    // 1000____
+    A1C_UTF8_TOO_LONG | A1C_UTF8_OVERLONG_2 | A1C_UTF8_TWO_CONTS |
+        A1C_UTF8_OVERLONG_3 | A1C_UTF8_TOO_LARGE_1000 | A1C_UTF8_OVERLONG_4,
+    // 1001____
+    A1C_UTF8_TOO_LONG | A1C_UTF8_OVERLONG_2 | A1C_UTF8_TWO_CONTS |
+        A1C_UTF8_OVERLONG_3 | A1C_UTF8_TOO_LARGE,
+    // 101_____
+    A1C_UTF8_TOO_LONG | A1C_UTF8_OVERLONG_2 | A1C_UTF8_TWO_CONTS |
+        A1C_UTF8_SURROGATE | A1C_UTF8_TOO_LARGE,
+    A1C_UTF8_TOO_LONG | A1C_UTF8_OVERLONG_2 | A1C_UTF8_TWO_CONTS |
+        A1C_UTF8_SURROGATE | A1C_UTF8_TOO_LARGE,
+    // 11______ lead
+    A1C_UTF8_TOO_SHORT, A1C_UTF8_TOO_SHORT, A1C_UTF8_TOO_SHORT,
+    A1C_UTF8_TOO_SHORT,
+};
+
+/// @returns table[nibbles[i]] for each byte, where @p table has 16 entries.
+__attribute__((target("avx2"))) static __m256i
+A1C_utf8Lookup16(const uint8_t *table, __m256i nibbles) {
+  const __m256i lanes = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128((const __m128i *)(const void *)table));
+  return _mm256_shuffle_epi8(lanes, nibbles);
+}
+
+__attribute__((target("avx2"))) static __m256i A1C_utf8HighNibbles(__m256i v) {
+  return _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0F));
+}
+
+/// @returns Non-zero bytes wherever @p input is invalid given @p prevInput.
+__attribute__((target("avx2"))) static __m256i
+A1C_utf8BlockErrors(__m256i input, __m256i prevInput) {
+  const __m256i prev1 = A1C_AVX2_PREV(input, prevInput, 1);
+  const __m256i special = _mm256_and_si256(
+      _mm256_and_si256(
+          A1C_utf8Lookup16(A1C_kUtf8Byte1High, A1C_utf8HighNibbles(prev1)),
+          A1C_utf8Lookup16(A1C_kUtf8Byte1Low,
+                           _mm256_and_si256(prev1, _mm256_set1_epi8(0x0F)))),
+      A1C_utf8Lookup16(A1C_kUtf8Byte2High, A1C_utf8HighNibbles(input)));
+
+  // Third and fourth bytes of a sequence must be continuations, which the
+  // tables flag as two continuations in a row.
+  const __m256i prev2 = A1C_AVX2_PREV(input, prevInput, 2);
+  const __m256i prev3 = A1C_AVX2_PREV(input, prevInput, 3);
+  const __m256i isThird =
+      _mm256_subs_epu8(prev2, _mm256_set1_epi8((char)(0xE0 - 0x80)));
+  const __m256i isFourth =
+      _mm256_subs_epu8(prev3, _mm256_set1_epi8((char)(0xF0 - 0x80)));
+  const __m256i must23 =
+      _mm256_and_si256(_mm256_or_si256(isThird, isFourth),
+                       _mm256_set1_epi8((char)0x80));
+  return _mm256_xor_si256(must23, special);
+}
+
+__attribute__((target("avx2"))) static const uint8_t *
+A1C_validateUtf8AVX2(const uint8_t *begin, const uint8_t *end) {
+  const uint8_t *ptr = begin;
+  __m256i prevInput = _mm256_setzero_si256();
+  for (; end - ptr >= 32; ptr += 32) {
+    const __m256i input =
+        _mm256_loadu_si256((const __m256i *)(const void *)ptr);
+    __m256i errors;
+    if (_mm256_movemask_epi8(input) == 0) {
+      // An ASCII block is only invalid if the previous block ended in the
+      // middle of a sequence.
+      const __m256i maxValue = _mm256_setr_epi8(
+          -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, //
+          -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, (char)(0xF0 - 1),
+          (char)(0xE0 - 1), (char)(0xC0 - 1));
+      errors = _mm256_subs_epu8(prevInput, maxValue);
+    } else {
+      errors = A1C_utf8BlockErrors(input, prevInput);
+    }
+    if (!_mm256_testz_si256(errors, errors)) {
+      break;
+    }
+    prevInput = input;
+  }
+  // The tail, or the failing block, restarts from a character boundary.
+  // Errors are flagged on the byte after the one at fault, so back up to the
+  // character that the last byte of the previous block is in.
+  return A1C_validateUtf8Scalar(A1C_utf8LastCharStart(begin, ptr), end);
+}
+#endif
+
+/**
+ * Validates that [ptr, end) is UTF-8, rejecting overlong encodings,
+ * surrogates, and code points above U+10FFFF.
+ * @returns The first byte of the first invalid sequence, or @p end if the
+ * whole range is valid.
+ */
+static const uint8_t *A1C_validateUtf8(const uint8_t *ptr,
+                                       const uint8_t *end) {
+#if A1C_HAS_AVX2
+  if (A1C_hasAVX2()) {
+    return A1C_validateUtf8AVX2(ptr, end);
+  }
+#endif
+#if A1C_HAS_SSE2
+  return A1C_validateUtf8SSE2(ptr, end);
+#else
+  return A1C_validateUtf8Scalar(ptr, end);
+#endif
+}
+
+// Scanning JSON strings for the next byte that needs attention: a quote, a
+// backslash, a control character, or optionally a non-ASCII byte. The decoder
+// stops at non-ASCII bytes to validate them, while the encoder has already
+// validated the whole string and passes them through.
+
+static bool A1C_isJsonStringSpecial(uint8_t c, bool stopAtNonAscii) {
+  return c == '"' || c == '\\' || c < 0x20 || (stopAtNonAscii && c >= 0x80);
+}
+
+static const uint8_t *A1C_scanJsonStringScalar(const uint8_t *ptr,
+                                               const uint8_t *end,
+                                               bool stopAtNonAscii) {
+  while (ptr < end && !A1C_isJsonStringSpecial(*ptr, stopAtNonAscii)) {
+    ++ptr;
+  }
+  return ptr;
+}
+
+#if A1C_HAS_SSE2
+static const uint8_t *A1C_scanJsonStringSSE2(const uint8_t *ptr,
+                                             const uint8_t *end,
+                                             bool stopAtNonAscii) {
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i space = _mm_set1_epi8(0x20);
+  for (; end - ptr >= 16; ptr += 16) {
+    const __m128i v = _mm_loadu_si128((const __m128i *)(const void *)ptr);
+    // Signed compare, so bytes >= 0x80 are below space too. Only the top bit
+    // of each byte matters for the mask, so clearing it where v has its top
+    // bit set lets non-ASCII bytes through.
+    __m128i below = _mm_cmplt_epi8(v, space);
+    if (!stopAtNonAscii) {
+      below = _mm_andnot_si128(v, below);
+    }
+    const __m128i special = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+        below);
+    const unsigned mask = (unsigned)_mm_movemask_epi8(special);
+    if (mask != 0) {
+      return ptr + __builtin_ctz(mask);
+    }
+  }
+  return A1C_scanJsonStringScalar(ptr, end, stopAtNonAscii);
+}
+#endif
+
+#if A1C_HAS_AVX2
+__attribute__((target("avx2"))) static const uint8_t *
+A1C_scanJsonStringAVX2(const uint8_t *ptr, const uint8_t *end,
+                       bool stopAtNonAscii) {
+  const __m256i quote = _mm256_set1_epi8('"');
+  const __m256i backslash = _mm256_set1_epi8('\\');
+  const __m256i space = _mm256_set1_epi8(0x20);
+  for (; end - ptr >= 32; ptr += 32) {
+    const __m256i v = _mm256_loadu_si256((const __m256i *)(const void *)ptr);
+    __m256i below = _mm256_cmpgt_epi8(space, v);
+    if (!stopAtNonAscii) {
+      below = _mm256_andnot_si256(v, below);
+    }
+    const __m256i special =
+        _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, quote),
+                                        _mm256_cmpeq_epi8(v, backslash)),
+                        below);
+    const unsigned mask = (unsigned)_mm256_movemask_epi8(special);
+    if (mask != 0) {
+      return ptr + __builtin_ctz(mask);
+    }
+  }
+  return A1C_scanJsonStringSSE2(ptr, end, stopAtNonAscii);
+}
+#endif
+
+/// @returns The first byte in [ptr, end) that A1C_isJsonStringSpecial(), or
+/// @p end if there is none.
+static const uint8_t *A1C_scanJsonString(const uint8_t *ptr,
+                                         const uint8_t *end,
+                                         bool stopAtNonAscii) {
+#if A1C_HAS_AVX2
+  if (A1C_hasAVX2()) {
+    return A1C_scanJsonStringAVX2(ptr, end, stopAtNonAscii);
+  }
+#endif
+#if A1C_HAS_SSE2
+  return A1C_scanJsonStringSSE2(ptr, end, stopAtNonAscii);
+#else
+  return A1C_scanJsonStringScalar(ptr, end, stopAtNonAscii);
+#endif
+}
+
+////////////////////////////////////////
+// Base64
+////////////////////////////////////////
+
+// Blocks of 24 bytes are encoded and blocks of 32 characters decoded with
+// AVX2, following Muła and Lemire ("Faster Base64 Encoding and Decoding Using
+// AVX2 Instructions", 2018). Characters are classified by their nibbles:
+// a character is invalid if the class of its high nibble is set in the
+// invalid mask of its low nibble, and its value is the character plus an
+// offset picked by its high nibble. The one character sharing its high nibble
+// with letters is patched separately. The scalar code uses the same tables.
+
+typedef struct {
+  char map[64];
+  /// Bits of the high nibble classes that are invalid with this low nibble.
+  uint8_t invalidLo[16];
+  /// Class of each high nibble.
+  uint8_t classHi[16];
+  /// Offset from character to value, by high nibble.
+  int8_t offset[16];
+  /// Whether encoding pads to a multiple of 4 characters.
+  bool pad;
+} A1C_Base64Alphabet;
+
+static const A1C_Base64Alphabet A1C_kBase64 = {
+    .map = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/",
+    .invalidLo = {0x0B, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,
+                  0x07, 0x15, 0x17, 0x17, 0x17, 0x15},
+    .classHi = {0x01, 0x01, 0x02, 0x04, 0x08, 0x10, 0x08, 0x10, 0x01, 0x01,
+                0x01, 0x01, 0x01, 0x01, 0x01, 0x01},
+    .offset = {0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0},
+    .pad = true,
+};
+
+static const A1C_Base64Alphabet A1C_kBase64url = {
+    .map = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_",
+    .invalidLo = {0x0B, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,
+                  0x07, 0x37, 0x37, 0x35, 0x37, 0x27},
+    .classHi = {0x01, 0x01, 0x02, 0x04, 0x08, 0x10, 0x08, 0x20, 0x01, 0x01,
+                0x01, 0x01, 0x01, 0x01, 0x01, 0x01},
+    .offset = {0, 0, 17, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0},
+    .pad = false,
+};
+
+static size_t A1C_base64EncodedSizeImpl(size_t srcSize, bool pad) {
   size_t encodedSize = (srcSize / 3) * 4;
   if (srcSize % 3 != 0) {
-    encodedSize += 4;
+    encodedSize += pad ? 4 : srcSize % 3 + 1;
   }
   return encodedSize;
 }
 
-size_t A1C_base64Encode(char *dst, const uint8_t *src, size_t srcSize) {
+size_t A1C_base64EncodedSize(size_t srcSize) {
+  return A1C_base64EncodedSizeImpl(srcSize, true);
+}
+
+size_t A1C_base64urlEncodedSize(size_t srcSize) {
+  return A1C_base64EncodedSizeImpl(srcSize, false);
+}
+
+size_t A1C_base64DecodedSizeBound(size_t srcSize) {
+  const size_t remainder = srcSize % 4;
+  return (srcSize / 4) * 3 + (remainder == 0 ? 0 : remainder - 1);
+}
+
+#if A1C_HAS_AVX2
+__attribute__((target("avx2"))) static __m256i
+A1C_broadcast16(const void *table) {
+  return _mm256_broadcastsi128_si256(
+      _mm_loadu_si128((const __m128i *)table));
+}
+
+/// Encodes whole blocks of 24 bytes, advancing @p src and @p dst past them.
+__attribute__((target("avx2"))) static void
+A1C_base64EncodeAVX2(const A1C_Base64Alphabet *alphabet, const uint8_t **src,
+                     const uint8_t *srcEnd, char **dst) {
+  const uint8_t *in = *src;
+  char *out = *dst;
+  const __m256i spread = _mm256_setr_epi8(
+      1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10, //
+      1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+  // Offsets from index to character: 0 for indices 52-61, which reduce to
+  // 1-10, 11 and 12 for indices 62 and 63, 13 for capitals, and 0 for the
+  // lowercase letters.
+  const char digit = '0' - 52;
+  const char c62 = (char)(alphabet->map[62] - 62);
+  const char c63 = (char)(alphabet->map[63] - 63);
+  const __m256i offsets = _mm256_setr_epi8(
+      'a' - 26, digit, digit, digit, digit, digit, digit, digit, digit, digit,
+      digit, c62, c63, 'A', 0, 0, //
+      'a' - 26, digit, digit, digit, digit, digit, digit, digit, digit, digit,
+      digit, c62, c63, 'A', 0, 0);
+  // Each 12 byte half is loaded into its own lane, reading 4 bytes past the
+  // block.
+  for (; srcEnd - in >= 28; in += 24, out += 32) {
+    const __m128i first = _mm_loadu_si128((const __m128i *)(const void *)in);
+    const __m128i second =
+        _mm_loadu_si128((const __m128i *)(const void *)(in + 12));
+    __m256i v =
+        _mm256_inserti128_si256(_mm256_castsi128_si256(first), second, 1);
+    v = _mm256_shuffle_epi8(v, spread);
+    // Move each 6 bits into its own byte.
+    const __m256i hi = _mm256_mulhi_epu16(
+        _mm256_and_si256(v, _mm256_set1_epi32(0x0FC0FC00)),
+        _mm256_set1_epi32(0x04000040));
+    const __m256i lo = _mm256_mullo_epi16(
+        _mm256_and_si256(v, _mm256_set1_epi32(0x003F03F0)),
+        _mm256_set1_epi32(0x01000010));
+    const __m256i indices = _mm256_or_si256(hi, lo);
+
+    __m256i reduced = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+    const __m256i capital = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+    reduced = _mm256_or_si256(
+        reduced, _mm256_and_si256(capital, _mm256_set1_epi8(13)));
+    const __m256i chars =
+        _mm256_add_epi8(indices, _mm256_shuffle_epi8(offsets, reduced));
+    _mm256_storeu_si256((__m256i *)(void *)out, chars);
+  }
+  *src = in;
+  *dst = out;
+}
+
+/// Decodes whole blocks of 32 characters, advancing @p src and @p dst past
+/// them. Stops early at a block with an invalid character.
+__attribute__((target("avx2"))) static void
+A1C_base64DecodeAVX2(const A1C_Base64Alphabet *alphabet, const uint8_t **src,
+                     const uint8_t *srcEnd, uint8_t **dst) {
+  const uint8_t *in = *src;
+  uint8_t *out = *dst;
+  const __m256i invalidLo = A1C_broadcast16(alphabet->invalidLo);
+  const __m256i classHi = A1C_broadcast16(alphabet->classHi);
+  const __m256i offset = A1C_broadcast16(alphabet->offset);
+  const __m256i char63 = _mm256_set1_epi8(alphabet->map[63]);
+  const __m256i pack = _mm256_setr_epi8(
+      2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1, //
+      2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  for (; srcEnd - in >= 32; in += 32, out += 24) {
+    const __m256i v = _mm256_loadu_si256((const __m256i *)(const void *)in);
+    const __m256i hiNibbles =
+        _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0F));
+    const __m256i loNibbles = _mm256_and_si256(v, _mm256_set1_epi8(0x0F));
+    if (!_mm256_testz_si256(_mm256_shuffle_epi8(invalidLo, loNibbles),
+                            _mm256_shuffle_epi8(classHi, hiNibbles))) {
+      break;
+    }
+    __m256i values =
+        _mm256_add_epi8(v, _mm256_shuffle_epi8(offset, hiNibbles));
+    values = _mm256_blendv_epi8(values, _mm256_set1_epi8(63),
+                                _mm256_cmpeq_epi8(v, char63));
+    // Merge pairs of 6 bits into 12, then pairs of 12 into 24.
+    const __m256i pairs =
+        _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+    __m256i bytes = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00011000));
+    bytes = _mm256_shuffle_epi8(bytes, pack);
+    bytes = _mm256_permutevar8x32_epi32(
+        bytes, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+    _mm_storeu_si128((__m128i *)(void *)out, _mm256_castsi256_si128(bytes));
+    _mm_storel_epi64((__m128i *)(void *)(out + 16),
+                     _mm256_extracti128_si256(bytes, 1));
+  }
+  *src = in;
+  *dst = out;
+}
+#endif
+
+static size_t A1C_base64EncodeImpl(const A1C_Base64Alphabet *alphabet,
+                                   char *dst, const uint8_t *src,
+                                   size_t srcSize) {
+  const char *const map = alphabet->map;
   const char *const dstBegin = dst;
   const uint8_t *const srcEnd = src + srcSize;
+#if A1C_HAS_AVX2
+  if (A1C_hasAVX2()) {
+    A1C_base64EncodeAVX2(alphabet, &src, srcEnd, &dst);
+  }
+#endif
   for (; (srcEnd - src) >= 3; src += 3, dst += 4) {
-    dst[0] = A1C_kBase64Map[src[0] >> 2];
-    dst[1] = A1C_kBase64Map[((src[0] & 0x03) << 4) + ((src[1] >> 4))];
-    dst[2] = A1C_kBase64Map[((src[1] & 0x0f) << 2) + ((src[2] >> 6))];
-    dst[3] = A1C_kBase64Map[src[2] & 0x3f];
+    dst[0] = map[src[0] >> 2];
+    dst[1] = map[((src[0] & 0x03) << 4) + ((src[1] >> 4))];
+    dst[2] = map[((src[1] & 0x0f) << 2) + ((src[2] >> 6))];
+    dst[3] = map[src[2] & 0x3f];
   }
 
   if (src < srcEnd) {
     assert(src + 1 == srcEnd || src + 2 == srcEnd);
-    dst[0] = A1C_kBase64Map[src[0] >> 2];
+    *dst++ = map[src[0] >> 2];
     if (src + 1 == srcEnd) {
-      dst[1] = A1C_kBase64Map[(src[0] & 0x03) << 4];
-      dst[2] = '=';
+      *dst++ = map[(src[0] & 0x03) << 4];
+      if (alphabet->pad) {
+        *dst++ = '=';
+      }
     } else {
-      dst[1] = A1C_kBase64Map[((src[0] & 0x03) << 4) + (src[1] >> 4)];
-      dst[2] = A1C_kBase64Map[(src[1] & 0x0f) << 2];
+      *dst++ = map[((src[0] & 0x03) << 4) + (src[1] >> 4)];
+      *dst++ = map[(src[1] & 0x0f) << 2];
+    }
+    if (alphabet->pad) {
+      *dst++ = '=';
     }
-    dst[3] = '=';
-    dst += 4;
   }
   const size_t dstSize = (size_t)(dst - dstBegin);
-  assert(dstSize == A1C_base64EncodedSize(srcSize));
+  assert(dstSize == A1C_base64EncodedSizeImpl(srcSize, alphabet->pad));
   return dstSize;
 }
 
+size_t A1C_base64Encode(char *dst, const uint8_t *src, size_t srcSize) {
+  return A1C_base64EncodeImpl(&A1C_kBase64, dst, src, srcSize);
+}
+
+size_t A1C_base64urlEncode(char *dst, const uint8_t *src, size_t srcSize) {
+  return A1C_base64EncodeImpl(&A1C_kBase64url, dst, src, srcSize);
+}
+
+/// Looks up the 6-bit value of @p c.
+/// @returns false if @p c isn't in the alphabet.
+static bool A1C_base64Value(const A1C_Base64Alphabet *alphabet, uint8_t c,
+                            uint32_t *value) {
+  if ((alphabet->invalidLo[c & 0xF] & alphabet->classHi[c >> 4]) != 0) {
+    return false;
+  }
+  if (c == (uint8_t)alphabet->map[63]) {
+    *value = 63;
+  } else {
+    *value = (uint8_t)(c + alphabet->offset[c >> 4]);
+  }
+  return true;
+}
+
+/// Decodes @p count characters, 2 to 4, into their bits, left aligned in 24.
+static bool A1C_base64Group(const A1C_Base64Alphabet *alphabet,
+                            const uint8_t *src, size_t count,
+                            uint32_t *bits) {
+  *bits = 0;
+  for (size_t i = 0; i < count; ++i) {
+    uint32_t value;
+    A1C_RET_IF_ERR(A1C_base64Value(alphabet, src[i], &value));
+    *bits |= value << (18 - 6 * i);
+  }
+  return true;
+}
+
+static bool A1C_base64DecodeImpl(const A1C_Base64Alphabet *alphabet,
+                                 uint8_t *dst, size_t *dstSize,
+                                 const char *src, size_t srcSize) {
+  if (srcSize % 4 == 0 && srcSize > 0 && src[srcSize - 1] == '=') {
+    srcSize -= src[srcSize - 2] == '=' ? 2 : 1;
+  }
+  const uint8_t *in = (const uint8_t *)src;
+  const uint8_t *const end = in + srcSize;
+  uint8_t *out = dst;
+#if A1C_HAS_AVX2
+  if (A1C_hasAVX2()) {
+    A1C_base64DecodeAVX2(alphabet, &in, end, &out);
+  }
+#endif
+  uint32_t bits;
+  for (; end - in >= 4; in += 4, out += 3) {
+    A1C_RET_IF_ERR(A1C_base64Group(alphabet, in, 4, &bits));
+    out[0] = (uint8_t)(bits >> 16);
+    out[1] = (uint8_t)(bits >> 8);
+    out[2] = (uint8_t)bits;
+  }
+  const size_t remainder = (size_t)(end - in);
+  if (remainder == 1) {
+    return false;
+  }
+  if (remainder > 1) {
+    A1C_RET_IF_ERR(A1C_base64Group(alphabet, in, remainder, &bits));
+    // The unused bits must be zero, so every input has one decoding.
+    const uint32_t unused = remainder == 2 ? 0xFFFF : 0xFF;
+    if ((bits & unused) != 0) {
+      return false;
+    }
+    *out++ = (uint8_t)(bits >> 16);
+    if (remainder == 3) {
+      *out++ = (uint8_t)(bits >> 8);
+    }
+  }
+  *dstSize = (size_t)(out - dst);
+  assert(*dstSize <= A1C_base64DecodedSizeBound(srcSize));
+  return true;
+}
+
+bool A1C_NODISCARD A1C_base64Decode(uint8_t *dst, size_t *dstSize,
+                                    const char *src, size_t srcSize) {
+  return A1C_base64DecodeImpl(&A1C_kBase64, dst, dstSize, src, srcSize);
+}
+
+bool A1C_NODISCARD A1C_base64urlDecode(uint8_t *dst, size_t *dstSize,
+                                       const char *src, size_t srcSize) {
+  return A1C_base64DecodeImpl(&A1C_kBase64url, dst, dstSize, src, srcSize);
+}
+
 ////////////////////////////////////////
 // Errors
 ////////////////////////////////////////
@@ -213,6 +1059,14 @@ const char *A1C_ErrorType_getString(A1C_ErrorType type) {
     return "trailingData";
   case A1C_ErrorType_jsonUTF8Unsupported:
     return "jsonUTF8Unsupported";
+  case A1C_ErrorType_invalidImage:
+    return "invalidImage";
+  case A1C_ErrorType_fileError:
+    return "fileError";
+  case A1C_ErrorType_invalidJson:
+    return "invalidJson";
+  case A1C_ErrorType_invalidUtf8:
+    return "invalidUtf8";
   }
 }
 
@@ -231,6 +1085,13 @@ static void *A1C_Arena_calloc(A1C_Arena *arena, size_t count, size_t size) {
   return arena->calloc(arena->opaque, bytes);
 }
 
+/// Calloc for arenas that must never allocate.
+static void *A1C_nullCalloc(void *opaque, size_t bytes) {
+  (void)opaque;
+  (void)bytes;
+  return NULL;
+}
+
 static void *A1C_LimitedArena_calloc(void *opaque, size_t bytes) {
   A1C_LimitedArena *arena = (A1C_LimitedArena *)opaque;
   if (arena == NULL) {
@@ -277,52 +1138,277 @@ void A1C_LimitedArena_reset(A1C_LimitedArena *limitedArena) {
 }
 
 ////////////////////////////////////////
-// Item Helpers
+// Float16
 ////////////////////////////////////////
 
-bool A1C_Item_eq(const A1C_Item *a, const A1C_Item *b) {
-  if (a->type != b->type) {
-    return false;
+float A1C_Float16_toFloat32(A1C_Float16 value) {
+  const uint32_t sign = (uint32_t)(value & 0x8000) << 16;
+  const uint32_t exponent = (value >> 10) & 0x1F;
+  uint32_t mantissa = value & 0x3FF;
+  uint32_t bits;
+  if (exponent == 0x1F) {
+    // Infinity or NaN, NaNs are quieted like the hardware conversion.
+    bits = sign | 0x7F800000 | (mantissa << 13);
+    if (mantissa != 0) {
+      bits |= 0x400000;
+    }
+  } else if (exponent == 0) {
+    if (mantissa == 0) {
+      bits = sign;
+    } else {
+      // Subnormal: normalize into a float32 normal.
+      int e = -14;
+      while ((mantissa & 0x400) == 0) {
+        mantissa <<= 1;
+        --e;
+      }
+      mantissa &= 0x3FF;
+      bits = sign | ((uint32_t)(e + 127) << 23) | (mantissa << 13);
+    }
+  } else {
+    bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
   }
+  float result;
+  memcpy(&result, &bits, sizeof(result));
+  return result;
+}
 
-  switch (a->type) {
-  case A1C_ItemType_int64:
-    return a->int64 == b->int64;
-  case A1C_ItemType_float16:
-    return a->float16 == b->float16;
-  case A1C_ItemType_float32: {
-    uint32_t aBits, bBits;
-    memcpy(&aBits, &a->float64, sizeof(aBits));
-    memcpy(&bBits, &b->float64, sizeof(bBits));
-    return aBits == bBits;
+/// Shifts @p significand right by @p shift, rounding to nearest even.
+static uint32_t A1C_roundShift(uint32_t significand, unsigned shift) {
+  const uint32_t result = significand >> shift;
+  const uint32_t remainder = significand & ((1u << shift) - 1);
+  const uint32_t halfway = 1u << (shift - 1);
+  if (remainder > halfway || (remainder == halfway && (result & 1) != 0)) {
+    return result + 1;
   }
-  case A1C_ItemType_float64: {
-    uint64_t aBits, bBits;
-    memcpy(&aBits, &a->float64, sizeof(aBits));
-    memcpy(&bBits, &b->float64, sizeof(bBits));
-    return aBits == bBits;
+  return result;
+}
+
+A1C_Float16 A1C_Float16_fromFloat32(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  const uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+  const uint32_t exponent = (bits >> 23) & 0xFF;
+  const uint32_t mantissa = bits & 0x7FFFFF;
+  if (exponent == 0xFF) {
+    if (mantissa != 0) {
+      return (uint16_t)(sign | 0x7E00 | (mantissa >> 13));
+    }
+    return (uint16_t)(sign | 0x7C00);
   }
-  case A1C_ItemType_boolean:
-  case A1C_ItemType_null:
-  case A1C_ItemType_undefined:
-  case A1C_ItemType_simple:
-    return a->simple == b->simple;
-  case A1C_ItemType_bytes:
-    return a->bytes.size == b->bytes.size &&
-           memcmp(a->bytes.data, b->bytes.data, a->bytes.size) == 0;
-  case A1C_ItemType_string:
-    return a->string.size == b->string.size &&
-           memcmp(a->string.data, b->string.data, a->string.size) == 0;
-  case A1C_ItemType_array:
-    if (a->array.size != b->array.size) {
+  const int e = (int)exponent - 127;
+  if (e > 15) {
+    return (uint16_t)(sign | 0x7C00);
+  }
+  if (e >= -14) {
+    // A carry out of the mantissa bumps the exponent, up to infinity.
+    const uint32_t half = ((uint32_t)(e + 15) << 10) | (mantissa >> 13);
+    return (uint16_t)(sign | A1C_roundShift((half << 13) | (mantissa & 0x1FFF),
+                                            13));
+  }
+  if (e < -25) {
+    return sign;
+  }
+  // Subnormal: the result is m * 2^-24, and may round up to the first normal.
+  const uint32_t significand = mantissa | 0x800000;
+  return (uint16_t)(sign | A1C_roundShift(significand, (unsigned)(-1 - e)));
+}
+
+#if A1C_HAS_F16C
+__attribute__((target("avx,f16c"))) static void
+A1C_Float16_toFloat32ArrayF16C(float *dst, const A1C_Float16 *src,
+                               size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m128i half =
+        _mm_loadu_si128((const __m128i *)(const void *)(src + i));
+    _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(half));
+  }
+  for (; i < count; ++i) {
+    dst[i] = A1C_Float16_toFloat32(src[i]);
+  }
+}
+
+__attribute__((target("avx,f16c"))) static void
+A1C_Float16_fromFloat32ArrayF16C(A1C_Float16 *dst, const float *src,
+                                 size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m128i half =
+        _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+    _mm_storeu_si128((__m128i *)(void *)(dst + i), half);
+  }
+  for (; i < count; ++i) {
+    dst[i] = A1C_Float16_fromFloat32(src[i]);
+  }
+}
+
+static bool A1C_hasF16C(void) {
+  return __builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c");
+}
+#endif
+
+void A1C_Float16_toFloat32Array(float *dst, const A1C_Float16 *src,
+                                size_t count) {
+#if A1C_HAS_F16C
+  if (A1C_hasF16C()) {
+    A1C_Float16_toFloat32ArrayF16C(dst, src, count);
+    return;
+  }
+#endif
+  for (size_t i = 0; i < count; ++i) {
+    dst[i] = A1C_Float16_toFloat32(src[i]);
+  }
+}
+
+void A1C_Float16_fromFloat32Array(A1C_Float16 *dst, const float *src,
+                                  size_t count) {
+#if A1C_HAS_F16C
+  if (A1C_hasF16C()) {
+    A1C_Float16_fromFloat32ArrayF16C(dst, src, count);
+    return;
+  }
+#endif
+  for (size_t i = 0; i < count; ++i) {
+    dst[i] = A1C_Float16_fromFloat32(src[i]);
+  }
+}
+
+////////////////////////////////////////
+// Item Helpers
+////////////////////////////////////////
+
+bool A1C_PackedArray_get(const A1C_PackedArray *array, size_t index,
+                         A1C_Item *out) {
+  if (index >= array->size) {
+    return false;
+  }
+  switch (array->type) {
+  case A1C_ElementType_int64:
+    A1C_Item_int64(out, ((const int64_t *)array->data)[index]);
+    break;
+  case A1C_ElementType_float16:
+    A1C_Item_float16(out, ((const A1C_Float16 *)array->data)[index]);
+    break;
+  case A1C_ElementType_float32:
+    A1C_Item_float32(out, ((const float *)array->data)[index]);
+    break;
+  case A1C_ElementType_float64:
+    A1C_Item_float64(out, ((const double *)array->data)[index]);
+    break;
+  case A1C_ElementType_uint8:
+  case A1C_ElementType_uint8Clamped:
+  case A1C_ElementType_uint16:
+  case A1C_ElementType_uint32:
+  case A1C_ElementType_uint64:
+  case A1C_ElementType_int8:
+  case A1C_ElementType_int16:
+  case A1C_ElementType_int32:
+    assert(false);
+    return false;
+  }
+  out->parent = NULL;
+  return true;
+}
+
+/// @returns The size of the elements of @p array, rounded up so that items
+/// stored after them stay aligned.
+static size_t A1C_PackedArray_paddedSize(const A1C_PackedArray *array) {
+  const size_t size = array->size * A1C_ElementType_size(array->type);
+  return (size + _Alignof(A1C_Item) - 1) & ~(size_t)(_Alignof(A1C_Item) - 1);
+}
+
+/// @returns The type @p item compares as, which is A1C_ItemType_array for
+/// packed arrays.
+static A1C_ItemType A1C_Item_logicalType(const A1C_Item *item) {
+  if (item->type == A1C_ItemType_packedArray) {
+    return A1C_ItemType_array;
+  }
+  return item->type;
+}
+
+/// @returns The number of elements of the array or packed array @p item.
+static size_t A1C_Item_arraySize(const A1C_Item *item) {
+  if (item->type == A1C_ItemType_packedArray) {
+    return item->packedArray.size;
+  }
+  assert(item->type == A1C_ItemType_array);
+  return item->array.size;
+}
+
+/// @returns The element at @p index of the array or packed array @p item.
+/// Packed elements are unpacked into @p scratch.
+static const A1C_Item *A1C_Item_arrayAt(const A1C_Item *item, size_t index,
+                                        A1C_Item *scratch) {
+  if (item->type == A1C_ItemType_packedArray) {
+    const bool inBounds =
+        A1C_PackedArray_get(&item->packedArray, index, scratch);
+    (void)inBounds;
+    assert(inBounds);
+    return scratch;
+  }
+  return &item->array.items[index];
+}
+
+static bool A1C_Item_arrayEq(const A1C_Item *a, const A1C_Item *b) {
+  const size_t size = A1C_Item_arraySize(a);
+  if (size != A1C_Item_arraySize(b)) {
+    return false;
+  }
+  if (a->type == A1C_ItemType_packedArray &&
+      b->type == A1C_ItemType_packedArray &&
+      a->packedArray.type == b->packedArray.type) {
+    // Elements of the same type are equal when their bits are.
+    return size == 0 ||
+           memcmp(a->packedArray.data, b->packedArray.data,
+                  size * A1C_ElementType_size(a->packedArray.type)) == 0;
+  }
+  for (size_t i = 0; i < size; i++) {
+    A1C_Item aScratch, bScratch;
+    if (!A1C_Item_eq(A1C_Item_arrayAt(a, i, &aScratch),
+                     A1C_Item_arrayAt(b, i, &bScratch))) {
       return false;
     }
-    for (size_t i = 0; i < a->array.size; i++) {
-      if (!A1C_Item_eq(&a->array.items[i], &b->array.items[i])) {
-        return false;
-      }
-    }
-    return true;
+  }
+  return true;
+}
+
+bool A1C_Item_eq(const A1C_Item *a, const A1C_Item *b) {
+  if (A1C_Item_logicalType(a) != A1C_Item_logicalType(b)) {
+    return false;
+  }
+
+  switch (a->type) {
+  case A1C_ItemType_int64:
+    return a->int64 == b->int64;
+  case A1C_ItemType_float16:
+    return a->float16 == b->float16;
+  case A1C_ItemType_float32: {
+    uint32_t aBits, bBits;
+    memcpy(&aBits, &a->float64, sizeof(aBits));
+    memcpy(&bBits, &b->float64, sizeof(bBits));
+    return aBits == bBits;
+  }
+  case A1C_ItemType_float64: {
+    uint64_t aBits, bBits;
+    memcpy(&aBits, &a->float64, sizeof(aBits));
+    memcpy(&bBits, &b->float64, sizeof(bBits));
+    return aBits == bBits;
+  }
+  case A1C_ItemType_boolean:
+  case A1C_ItemType_null:
+  case A1C_ItemType_undefined:
+  case A1C_ItemType_simple:
+    return a->simple == b->simple;
+  case A1C_ItemType_bytes:
+    return a->bytes.size == b->bytes.size &&
+           memcmp(a->bytes.data, b->bytes.data, a->bytes.size) == 0;
+  case A1C_ItemType_string:
+    return a->string.size == b->string.size &&
+           memcmp(a->string.data, b->string.data, a->string.size) == 0;
+  case A1C_ItemType_array:
+  case A1C_ItemType_packedArray:
+    return A1C_Item_arrayEq(a, b);
   case A1C_ItemType_map:
     if (a->map.size != b->map.size) {
       return false;
@@ -341,6 +1427,63 @@ bool A1C_Item_eq(const A1C_Item *a, const A1C_Item *b) {
   }
 }
 
+/// Mixes @p item into the hash state @p hash, mirroring A1C_Item_eq().
+static uint64_t A1C_Item_hashInto(const A1C_Item *item, uint64_t hash) {
+  hash = A1C_hashMix(hash, (uint64_t)A1C_Item_logicalType(item));
+  switch (item->type) {
+  case A1C_ItemType_int64:
+    return A1C_hashMix(hash, (uint64_t)item->int64);
+  case A1C_ItemType_float16:
+    return A1C_hashMix(hash, item->float16);
+  case A1C_ItemType_float32: {
+    uint32_t bits;
+    memcpy(&bits, &item->float32, sizeof(bits));
+    return A1C_hashMix(hash, bits);
+  }
+  case A1C_ItemType_float64: {
+    uint64_t bits;
+    memcpy(&bits, &item->float64, sizeof(bits));
+    return A1C_hashMix(hash, bits);
+  }
+  case A1C_ItemType_boolean:
+  case A1C_ItemType_null:
+  case A1C_ItemType_undefined:
+  case A1C_ItemType_simple:
+    return A1C_hashMix(hash, item->simple);
+  case A1C_ItemType_bytes:
+    hash = A1C_hashMix(hash, item->bytes.size);
+    return A1C_hashBytes(hash, item->bytes.data, item->bytes.size);
+  case A1C_ItemType_string:
+    hash = A1C_hashMix(hash, item->string.size);
+    return A1C_hashBytes(hash, item->string.data, item->string.size);
+  case A1C_ItemType_array:
+  case A1C_ItemType_packedArray: {
+    const size_t size = A1C_Item_arraySize(item);
+    hash = A1C_hashMix(hash, size);
+    for (size_t i = 0; i < size; i++) {
+      A1C_Item scratch;
+      hash = A1C_Item_hashInto(A1C_Item_arrayAt(item, i, &scratch), hash);
+    }
+    return hash;
+  }
+  case A1C_ItemType_map:
+    hash = A1C_hashMix(hash, item->map.size);
+    for (size_t i = 0; i < item->map.size; i++) {
+      hash = A1C_Item_hashInto(&item->map.items[i].key, hash);
+      hash = A1C_Item_hashInto(&item->map.items[i].value, hash);
+    }
+    return hash;
+  case A1C_ItemType_tag:
+    hash = A1C_hashMix(hash, item->tag.tag);
+    return A1C_Item_hashInto(item->tag.item, hash);
+  }
+  return hash;
+}
+
+uint64_t A1C_Item_hash(const A1C_Item *item, uint64_t seed) {
+  return A1C_hashFinish(A1C_Item_hashInto(item, seed + A1C_HASH_PRIME1));
+}
+
 const A1C_Item *A1C_Map_get(const A1C_Map *map, const A1C_Item *key) {
   for (size_t i = 0; i < map->size; i++) {
     if (A1C_Item_eq(&map->items[i].key, key)) {
@@ -527,833 +1670,6571 @@ A1C_Item *A1C_Item_array(A1C_Item *item, size_t size, A1C_Arena *arena) {
   return items;
 }
 
+bool A1C_NODISCARD A1C_Item_packedArray_ref(A1C_Item *item,
+                                            A1C_ElementType type,
+                                            const void *data, size_t size) {
+  switch (type) {
+  case A1C_ElementType_int64:
+  case A1C_ElementType_float16:
+  case A1C_ElementType_float32:
+  case A1C_ElementType_float64:
+    break;
+  case A1C_ElementType_uint8:
+  case A1C_ElementType_uint8Clamped:
+  case A1C_ElementType_uint16:
+  case A1C_ElementType_uint32:
+  case A1C_ElementType_uint64:
+  case A1C_ElementType_int8:
+  case A1C_ElementType_int16:
+  case A1C_ElementType_int32:
+    return false;
+  }
+  if (size > UINT32_MAX) {
+    return false;
+  }
+  item->type = A1C_ItemType_packedArray;
+  item->packedArray.data = data;
+  item->packedArray.size = (uint32_t)size;
+  item->packedArray.type = type;
+  return true;
+}
+
 ////////////////////////////////////////
-// Shared Coder Helpers
+// Typed Arrays
 ////////////////////////////////////////
 
-typedef enum {
-  A1C_MajorType_uint = 0,
-  A1C_MajorType_int = 1,
-  A1C_MajorType_bytes = 2,
-  A1C_MajorType_string = 3,
-  A1C_MajorType_array = 4,
-  A1C_MajorType_map = 5,
-  A1C_MajorType_tag = 6,
-  A1C_MajorType_special = 7,
-} A1C_MajorType;
-
-typedef struct {
-  uint8_t header;
-} A1C_ItemHeader;
-
-A1C_ItemHeader A1C_ItemHeader_make(A1C_MajorType type, uint8_t shortCount) {
-  A1C_ItemHeader header;
-  header.header = (uint8_t)(type << 5) | shortCount;
-  return header;
+#define A1C_TYPED_ARRAY_TAG_MIN 64
+#define A1C_TYPED_ARRAY_TAG_MAX 87
+/// Set in the tag of a little endian typed array with elements wider than a
+/// byte.
+#define A1C_TYPED_ARRAY_TAG_LITTLE_ENDIAN 4
+
+/// Element types indexed by tag - A1C_TYPED_ARRAY_TAG_MIN, or -1 for tags
+/// that are reserved or hold float128 elements.
+static const int8_t A1C_kTypedArrayElementTypes[] = {
+    A1C_ElementType_uint8,        // 64
+    A1C_ElementType_uint16,       // 65
+    A1C_ElementType_uint32,       // 66
+    A1C_ElementType_uint64,       // 67
+    A1C_ElementType_uint8Clamped, // 68
+    A1C_ElementType_uint16,       // 69
+    A1C_ElementType_uint32,       // 70
+    A1C_ElementType_uint64,       // 71
+    A1C_ElementType_int8,         // 72
+    A1C_ElementType_int16,        // 73
+    A1C_ElementType_int32,        // 74
+    A1C_ElementType_int64,        // 75
+    -1,                           // 76
+    A1C_ElementType_int16,        // 77
+    A1C_ElementType_int32,        // 78
+    A1C_ElementType_int64,        // 79
+    A1C_ElementType_float16,      // 80
+    A1C_ElementType_float32,      // 81
+    A1C_ElementType_float64,      // 82
+    -1,                           // 83
+    A1C_ElementType_float16,      // 84
+    A1C_ElementType_float32,      // 85
+    A1C_ElementType_float64,      // 86
+    -1,                           // 87
+};
+
+size_t A1C_ElementType_size(A1C_ElementType type) {
+  switch (type) {
+  case A1C_ElementType_uint8:
+  case A1C_ElementType_uint8Clamped:
+  case A1C_ElementType_int8:
+    return 1;
+  case A1C_ElementType_uint16:
+  case A1C_ElementType_int16:
+  case A1C_ElementType_float16:
+    return 2;
+  case A1C_ElementType_uint32:
+  case A1C_ElementType_int32:
+  case A1C_ElementType_float32:
+    return 4;
+  case A1C_ElementType_uint64:
+  case A1C_ElementType_int64:
+  case A1C_ElementType_float64:
+    return 8;
+  }
+  assert(false);
+  return 1;
 }
 
-A1C_MajorType A1C_ItemHeader_majorType(A1C_ItemHeader header) {
-  return (A1C_MajorType)(header.header >> 5);
+/// @returns The big endian tag for @p type.
+static uint64_t A1C_ElementType_tag(A1C_ElementType type) {
+  switch (type) {
+  case A1C_ElementType_uint8:
+    return 64;
+  case A1C_ElementType_uint16:
+    return 65;
+  case A1C_ElementType_uint32:
+    return 66;
+  case A1C_ElementType_uint64:
+    return 67;
+  case A1C_ElementType_uint8Clamped:
+    return 68;
+  case A1C_ElementType_int8:
+    return 72;
+  case A1C_ElementType_int16:
+    return 73;
+  case A1C_ElementType_int32:
+    return 74;
+  case A1C_ElementType_int64:
+    return 75;
+  case A1C_ElementType_float16:
+    return 80;
+  case A1C_ElementType_float32:
+    return 81;
+  case A1C_ElementType_float64:
+    return 82;
+  }
+  assert(false);
+  return 64;
 }
 
-uint8_t A1C_ItemHeader_shortCount(A1C_ItemHeader header) {
-  return header.header & 0x1F;
+#if A1C_HAS_AVX2
+/// Byte swaps 32 bytes at a time, and returns the number of bytes swapped.
+__attribute__((target("avx2"))) static size_t
+A1C_byteswapArrayAVX2(uint8_t *dst, const uint8_t *src, size_t bytes,
+                      size_t size) {
+  static const uint8_t kShuffles[3][16] = {
+      {1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14},
+      {3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12},
+      {7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8},
+  };
+  const size_t shuffle = size == 2 ? 0 : size == 4 ? 1 : 2;
+  const __m256i mask = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128((const __m128i *)(const void *)kShuffles[shuffle]));
+  size_t offset = 0;
+  for (; bytes - offset >= 32; offset += 32) {
+    const __m256i v =
+        _mm256_loadu_si256((const __m256i *)(const void *)(src + offset));
+    _mm256_storeu_si256((__m256i *)(void *)(dst + offset),
+                        _mm256_shuffle_epi8(v, mask));
+  }
+  return offset;
 }
+#endif
 
-bool A1C_ItemHeader_isBreak(A1C_ItemHeader header) {
-  return header.header == 0xFF;
+/// Copies @p count elements of @p size bytes from @p src to @p dst, reversing
+/// the bytes of each element.
+static void A1C_byteswapArray(void *dst, const void *src, size_t count,
+                              size_t size) {
+  uint8_t *out = (uint8_t *)dst;
+  const uint8_t *in = (const uint8_t *)src;
+  const size_t bytes = count * size;
+  size_t offset = 0;
+#if A1C_HAS_AVX2
+  if (A1C_hasAVX2()) {
+    offset = A1C_byteswapArrayAVX2(out, in, bytes, size);
+  }
+#endif
+  for (; offset < bytes; offset += size) {
+    if (size == 2) {
+      uint16_t value;
+      memcpy(&value, in + offset, sizeof(value));
+      value = A1C_byteswap16(value);
+      memcpy(out + offset, &value, sizeof(value));
+    } else if (size == 4) {
+      uint32_t value;
+      memcpy(&value, in + offset, sizeof(value));
+      value = A1C_byteswap32(value);
+      memcpy(out + offset, &value, sizeof(value));
+    } else {
+      uint64_t value;
+      assert(size == 8);
+      memcpy(&value, in + offset, sizeof(value));
+      value = A1C_byteswap64(value);
+      memcpy(out + offset, &value, sizeof(value));
+    }
+  }
 }
 
-bool A1C_ItemHeader_isIndefinite(A1C_ItemHeader header) {
-  return A1C_ItemHeader_shortCount(header) == 31;
+bool A1C_NODISCARD A1C_Item_asTypedArray(const A1C_Item *item,
+                                         A1C_Arena *arena,
+                                         A1C_TypedArray *out) {
+  if (item->type != A1C_ItemType_tag ||
+      item->tag.tag < A1C_TYPED_ARRAY_TAG_MIN ||
+      item->tag.tag > A1C_TYPED_ARRAY_TAG_MAX ||
+      item->tag.item->type != A1C_ItemType_bytes) {
+    return false;
+  }
+  const uint64_t index = item->tag.tag - A1C_TYPED_ARRAY_TAG_MIN;
+  const int8_t type = A1C_kTypedArrayElementTypes[index];
+  if (type < 0) {
+    return false;
+  }
+
+  const A1C_Bytes bytes = item->tag.item->bytes;
+  const size_t size = A1C_ElementType_size((A1C_ElementType)type);
+  if (bytes.size % size != 0) {
+    return false;
+  }
+  out->type = (A1C_ElementType)type;
+  out->data = bytes.data;
+  out->count = bytes.size / size;
+
+  const bool littleEndian =
+      (item->tag.tag & A1C_TYPED_ARRAY_TAG_LITTLE_ENDIAN) != 0;
+  const bool swap = size > 1 && littleEndian != A1C_isLittleEndian();
+  const bool aligned = ((uintptr_t)bytes.data % size) == 0;
+  if (out->count == 0 || (!swap && aligned)) {
+    return true;
+  }
+
+  void *data = A1C_Arena_calloc(arena, out->count, size);
+  if (data == NULL) {
+    return false;
+  }
+  if (swap) {
+    A1C_byteswapArray(data, bytes.data, out->count, size);
+  } else {
+    memcpy(data, bytes.data, bytes.size);
+  }
+  out->data = data;
+  return true;
 }
 
-bool A1C_ItemHeader_isLegal(A1C_ItemHeader header) {
-  const A1C_MajorType majorType = A1C_ItemHeader_majorType(header);
-  const uint8_t shortCount = A1C_ItemHeader_shortCount(header);
-  if (shortCount >= 28) {
-    if (shortCount < 31) {
-      return false;
-    }
-    assert(shortCount == 31);
-    return !(majorType == A1C_MajorType_uint ||
-             majorType == A1C_MajorType_int || majorType == A1C_MajorType_tag);
+bool A1C_NODISCARD A1C_Item_typedArray_ref(A1C_Item *item,
+                                           A1C_ElementType type,
+                                           const void *data, size_t count,
+                                           A1C_Arena *arena) {
+  const size_t size = A1C_ElementType_size(type);
+  size_t bytes;
+  if (A1C_overflowMul(count, size, &bytes)) {
+    return false;
+  }
+  uint64_t tag = A1C_ElementType_tag(type);
+  if (size > 1 && A1C_isLittleEndian()) {
+    tag |= A1C_TYPED_ARRAY_TAG_LITTLE_ENDIAN;
+  }
+  A1C_Item *child = A1C_Item_tag(item, tag, arena);
+  if (child == NULL) {
+    return false;
   }
+  A1C_Item_bytes_ref(child, (const uint8_t *)data, bytes);
   return true;
 }
 
 ////////////////////////////////////////
-// Decoder
+// Compact Item
 ////////////////////////////////////////
 
-void A1C_Decoder_init(A1C_Decoder *decoder, A1C_Arena arena,
-                      A1C_DecoderConfig config) {
-  memset(decoder, 0, sizeof(A1C_Decoder));
-  assert(arena.calloc != NULL);
-  decoder->limitedArena = A1C_LimitedArena_init(arena, config.limitBytes);
-  decoder->arena = A1C_LimitedArena_arena(&decoder->limitedArena);
-  if (config.maxDepth == 0) {
-    decoder->maxDepth = A1C_MAX_DEPTH_DEFAULT;
-  } else {
-    decoder->maxDepth = config.maxDepth;
+#define A1C_COMPACT_MAX_SIZE ((size_t)UINT32_MAX)
+
+typedef struct {
+  size_t items;
+  size_t bytes;
+  /// Elements of packed arrays, which compact trees store as items, so they
+  /// are also counted in `items`.
+  size_t packedElements;
+  /// The padded size of the packed elements, for clones that keep them packed.
+  size_t packedBytes;
+} A1C_CompactFootprint;
+
+static void A1C_CompactFootprint_add(A1C_CompactFootprint *footprint,
+                                     const A1C_Item *item) {
+  switch (item->type) {
+  case A1C_ItemType_bytes:
+    footprint->bytes += item->bytes.size;
+    break;
+  case A1C_ItemType_string:
+    footprint->bytes += item->string.size;
+    break;
+  case A1C_ItemType_array:
+    footprint->items += item->array.size;
+    for (size_t i = 0; i < item->array.size; ++i) {
+      A1C_CompactFootprint_add(footprint, &item->array.items[i]);
+    }
+    break;
+  case A1C_ItemType_map:
+    footprint->items += 2 * item->map.size;
+    for (size_t i = 0; i < item->map.size; ++i) {
+      A1C_CompactFootprint_add(footprint, &item->map.items[i].key);
+      A1C_CompactFootprint_add(footprint, &item->map.items[i].value);
+    }
+    break;
+  case A1C_ItemType_tag:
+    footprint->items += 1;
+    A1C_CompactFootprint_add(footprint, item->tag.item);
+    break;
+  case A1C_ItemType_packedArray:
+    footprint->items += item->packedArray.size;
+    footprint->packedElements += item->packedArray.size;
+    footprint->packedBytes += A1C_PackedArray_paddedSize(&item->packedArray);
+    break;
+  case A1C_ItemType_undefined:
+  case A1C_ItemType_int64:
+  case A1C_ItemType_boolean:
+  case A1C_ItemType_null:
+  case A1C_ItemType_float16:
+  case A1C_ItemType_float32:
+  case A1C_ItemType_float64:
+  case A1C_ItemType_simple:
+    break;
   }
-  decoder->referenceSource = config.referenceSource;
-  decoder->rejectUnknownSimple = config.rejectUnknownSimple;
 }
 
-A1C_Error A1C_Decoder_getError(const A1C_Decoder *decoder) {
-  return decoder->error;
+/// @returns The compact size of the footprint, or 0 if it exceeds the limit.
+static size_t A1C_CompactFootprint_size(const A1C_CompactFootprint *footprint) {
+  // Item counts are bounded by memory, so only the final sum can overflow.
+  if (footprint->items > A1C_COMPACT_MAX_SIZE / sizeof(A1C_CompactItem)) {
+    return 0;
+  }
+  size_t size = footprint->items * sizeof(A1C_CompactItem);
+  if (A1C_overflowAdd(size, footprint->bytes, &size) ||
+      size > A1C_COMPACT_MAX_SIZE) {
+    return 0;
+  }
+  return size;
 }
 
-static void A1C_Decoder_reset(A1C_Decoder *decoder, const uint8_t *start,
-                              size_t size) {
-  memset(&decoder->error, 0, sizeof(A1C_Error));
-  decoder->start = start;
-  decoder->ptr = start;
-  decoder->end = start + size;
-  decoder->parent = NULL;
-  decoder->depth = 0;
-  A1C_LimitedArena_reset(&decoder->limitedArena);
+static A1C_CompactFootprint A1C_Item_compactFootprint(const A1C_Item *item) {
+  A1C_CompactFootprint footprint = {.items = 1, .bytes = 0};
+  A1C_CompactFootprint_add(&footprint, item);
+  return footprint;
 }
 
-static A1C_Item *A1C_NODISCARD A1C_Decoder_decodeOne(A1C_Decoder *decoder);
-static bool A1C_NODISCARD A1C_Decoder_decodeOneInto(A1C_Decoder *decoder,
-                                                    A1C_Item *item);
-
-bool A1C_NODISCARD A1C_Decoder_errorImpl(A1C_Decoder *decoder,
-                                         A1C_ErrorType errorType,
-                                         const char *file, int line) {
-  assert(decoder->ptr >= decoder->start);
-  assert(decoder->ptr <= decoder->end);
-  decoder->error.type = errorType;
-  decoder->error.srcPos = (size_t)(decoder->ptr - decoder->start);
-  decoder->error.depth = decoder->depth;
-  decoder->error.item = decoder->parent;
-  decoder->error.file = file;
-  decoder->error.line = line;
-  return false;
+size_t A1C_Item_compactSize(const A1C_Item *item) {
+  const A1C_CompactFootprint footprint = A1C_Item_compactFootprint(item);
+  return A1C_CompactFootprint_size(&footprint);
 }
 
-#define A1C_Decoder_error(decoder, errorType)                                  \
-  A1C_Decoder_errorImpl((decoder), (errorType), __FILE__, __LINE__)
+typedef struct {
+  A1C_CompactItem *nextItem;
+  uint8_t *nextByte;
+} A1C_CompactWriter;
+
+static uint32_t A1C_CompactItem_offsetTo(const A1C_CompactItem *item,
+                                         const void *target) {
+  const uint8_t *from = (const uint8_t *)item;
+  assert((const uint8_t *)target >= from);
+  assert((size_t)((const uint8_t *)target - from) <= A1C_COMPACT_MAX_SIZE);
+  return (uint32_t)((const uint8_t *)target - from);
+}
 
-size_t A1C_Decoder_remaining(const A1C_Decoder *decoder) {
-  assert(decoder->ptr <= decoder->end);
-  return (size_t)(decoder->end - decoder->ptr);
+static const void *A1C_CompactItem_at(const A1C_CompactItem *item,
+                                      uint64_t offset) {
+  return (const uint8_t *)item + offset;
 }
 
-bool A1C_NODISCARD A1C_Decoder_peek(A1C_Decoder *decoder, void *out,
-                                    size_t size) {
-  assert(out != NULL);
-  assert(decoder->ptr <= decoder->end);
-  if ((size_t)(decoder->end - decoder->ptr) < size) {
-    return A1C_Decoder_error(decoder, A1C_ErrorType_truncated);
-  }
+static void A1C_CompactWriter_data(A1C_CompactWriter *writer,
+                                   A1C_CompactItem *dst, const void *data,
+                                   size_t size) {
+  dst->size = (uint32_t)size;
+  dst->payload = A1C_CompactItem_offsetTo(dst, writer->nextByte);
   if (size > 0) {
-    memcpy(out, decoder->ptr, size);
+    memcpy(writer->nextByte, data, size);
+    writer->nextByte += size;
   }
-  return true;
 }
 
-bool A1C_NODISCARD A1C_Decoder_skip(A1C_Decoder *decoder, size_t size) {
-  assert(decoder->ptr <= decoder->end);
-  if ((size_t)(decoder->end - decoder->ptr) < size) {
-    return A1C_Decoder_error(decoder, A1C_ErrorType_truncated);
+static void A1C_CompactWriter_write(A1C_CompactWriter *writer,
+                                    A1C_CompactItem *dst,
+                                    const A1C_Item *src) {
+  dst->meta = (uint32_t)src->type;
+  dst->size = 0;
+  dst->payload = 0;
+  switch (src->type) {
+  case A1C_ItemType_int64:
+    dst->payload = (uint64_t)src->int64;
+    break;
+  case A1C_ItemType_float16:
+    dst->payload = src->float16;
+    break;
+  case A1C_ItemType_float32: {
+    uint32_t bits;
+    memcpy(&bits, &src->float32, sizeof(bits));
+    dst->payload = bits;
+    break;
+  }
+  case A1C_ItemType_float64:
+    memcpy(&dst->payload, &src->float64, sizeof(dst->payload));
+    break;
+  case A1C_ItemType_boolean:
+    dst->payload = src->boolean;
+    break;
+  case A1C_ItemType_simple:
+    dst->payload = src->simple;
+    break;
+  case A1C_ItemType_undefined:
+  case A1C_ItemType_null:
+    break;
+  case A1C_ItemType_bytes:
+    A1C_CompactWriter_data(writer, dst, src->bytes.data, src->bytes.size);
+    break;
+  case A1C_ItemType_string:
+    A1C_CompactWriter_data(writer, dst, src->string.data, src->string.size);
+    break;
+  case A1C_ItemType_array: {
+    A1C_CompactItem *children = writer->nextItem;
+    writer->nextItem += src->array.size;
+    dst->size = (uint32_t)src->array.size;
+    dst->payload = A1C_CompactItem_offsetTo(dst, children);
+    for (size_t i = 0; i < src->array.size; ++i) {
+      A1C_CompactWriter_write(writer, &children[i], &src->array.items[i]);
+    }
+    break;
+  }
+  case A1C_ItemType_map: {
+    A1C_CompactItem *children = writer->nextItem;
+    writer->nextItem += 2 * src->map.size;
+    dst->size = (uint32_t)src->map.size;
+    dst->payload = A1C_CompactItem_offsetTo(dst, children);
+    for (size_t i = 0; i < src->map.size; ++i) {
+      A1C_CompactWriter_write(writer, &children[2 * i], &src->map.items[i].key);
+      A1C_CompactWriter_write(writer, &children[2 * i + 1],
+                              &src->map.items[i].value);
+    }
+    break;
+  }
+  case A1C_ItemType_tag: {
+    A1C_CompactItem *child = writer->nextItem;
+    writer->nextItem += 1;
+    dst->size = A1C_CompactItem_offsetTo(dst, child);
+    dst->payload = src->tag.tag;
+    A1C_CompactWriter_write(writer, child, src->tag.item);
+    break;
+  }
+  case A1C_ItemType_packedArray: {
+    A1C_CompactItem *children = writer->nextItem;
+    writer->nextItem += src->packedArray.size;
+    dst->meta = (uint32_t)A1C_ItemType_array;
+    dst->size = src->packedArray.size;
+    dst->payload = A1C_CompactItem_offsetTo(dst, children);
+    for (size_t i = 0; i < src->packedArray.size; ++i) {
+      A1C_Item element;
+      (void)A1C_PackedArray_get(&src->packedArray, i, &element);
+      A1C_CompactWriter_write(writer, &children[i], &element);
+    }
+    break;
   }
-  if (size > 0) {
-    decoder->ptr += size;
   }
-  return true;
 }
 
-bool A1C_NODISCARD A1C_Decoder_read(A1C_Decoder *decoder, void *out,
-                                    size_t size) {
-  A1C_RET_IF_ERR(A1C_Decoder_peek(decoder, out, size));
-  return A1C_Decoder_skip(decoder, size);
+/**
+ * Writes the compact tree for @p item into @p dst, which must be
+ * A1C_CompactFootprint_size(footprint) bytes. Items come first, followed by
+ * the data.
+ */
+static const A1C_CompactItem *
+A1C_Item_writeCompact(const A1C_Item *item,
+                      const A1C_CompactFootprint *footprint, void *dst) {
+  A1C_CompactItem *root = (A1C_CompactItem *)dst;
+  A1C_CompactWriter writer = {
+      .nextItem = root + 1,
+      .nextByte = (uint8_t *)(root + footprint->items),
+  };
+  A1C_CompactWriter_write(&writer, root, item);
+  assert(writer.nextItem == root + footprint->items);
+  assert(writer.nextByte ==
+         (uint8_t *)dst + A1C_CompactFootprint_size(footprint));
+  return root;
 }
 
-bool A1C_NODISCARD A1C_Decoder_readCount(A1C_Decoder *decoder,
-                                         A1C_ItemHeader header, uint64_t *out) {
-  assert(A1C_ItemHeader_isLegal(header));
-  const uint8_t shortCount = A1C_ItemHeader_shortCount(header);
-  if (shortCount < 24 || shortCount == 31) {
-    *out = shortCount;
-    return true;
-  } else if (shortCount == 24) {
-    uint8_t value;
-    A1C_RET_IF_ERR(A1C_Decoder_read(decoder, &value, sizeof(value)));
-    *out = value;
-  } else if (shortCount == 25) {
-    uint16_t value;
-    A1C_RET_IF_ERR(A1C_Decoder_read(decoder, &value, sizeof(value)));
-    *out = A1C_bigEndian16(value);
-  } else if (shortCount == 26) {
-    uint32_t value;
-    A1C_RET_IF_ERR(A1C_Decoder_read(decoder, &value, sizeof(value)));
-    *out = A1C_bigEndian32(value);
-  } else if (shortCount == 27) {
-    uint64_t value;
-    A1C_RET_IF_ERR(A1C_Decoder_read(decoder, &value, sizeof(value)));
-    *out = A1C_bigEndian64(value);
-  } else {
-    assert(false);
+const A1C_CompactItem *A1C_Item_toCompact(const A1C_Item *item,
+                                          A1C_Arena *arena) {
+  const A1C_CompactFootprint footprint = A1C_Item_compactFootprint(item);
+  const size_t size = A1C_CompactFootprint_size(&footprint);
+  if (size == 0) {
+    return NULL;
   }
-  return true;
+  void *dst = A1C_Arena_calloc(arena, size, 1);
+  if (dst == NULL) {
+    return NULL;
+  }
+  return A1C_Item_writeCompact(item, &footprint, dst);
 }
 
-bool A1C_NODISCARD A1C_Decoder_readSize(A1C_Decoder *decoder,
-                                        A1C_ItemHeader header, size_t *out) {
-  uint64_t tmp;
-  A1C_RET_IF_ERR(A1C_Decoder_readCount(decoder, header, &tmp));
-  if (tmp > SIZE_MAX) {
-    return A1C_Decoder_error(decoder, A1C_ErrorType_integerOverflow);
-  }
-  *(out) = (size_t)tmp;
-  return true;
+A1C_ItemType A1C_CompactItem_type(const A1C_CompactItem *item) {
+  return (A1C_ItemType)(item->meta & 0xFF);
 }
 
-static bool A1C_NODISCARD A1C_Decoder_decodeUInt(A1C_Decoder *decoder,
-                                                 A1C_ItemHeader header,
-                                                 A1C_Item *item) {
-  uint64_t pos;
-  A1C_RET_IF_ERR(A1C_Decoder_readCount(decoder, header, &pos));
-  if (pos > (uint64_t)INT64_MAX) {
-    return A1C_Decoder_error(decoder, A1C_ErrorType_largeIntegersUnsupported);
-  }
-  A1C_Item_int64(item, (int64_t)pos);
-  return true;
+A1C_Int64 A1C_CompactItem_int64(const A1C_CompactItem *item) {
+  assert(A1C_CompactItem_type(item) == A1C_ItemType_int64);
+  return (A1C_Int64)item->payload;
 }
 
-static bool A1C_NODISCARD A1C_Decoder_decodeInt(A1C_Decoder *decoder,
-                                                A1C_ItemHeader header,
-                                                A1C_Item *item) {
+A1C_Bool A1C_CompactItem_boolean(const A1C_CompactItem *item) {
+  assert(A1C_CompactItem_type(item) == A1C_ItemType_boolean);
+  return item->payload != 0;
+}
 
-  uint64_t neg;
-  A1C_RET_IF_ERR(A1C_Decoder_readCount(decoder, header, &neg));
-  if (neg >= ((uint64_t)1 << 63)) {
-    return A1C_Decoder_error(decoder, A1C_ErrorType_largeIntegersUnsupported);
+A1C_Float16 A1C_CompactItem_float16(const A1C_CompactItem *item) {
+  assert(A1C_CompactItem_type(item) == A1C_ItemType_float16);
+  return (A1C_Float16)item->payload;
+}
+
+A1C_Float32 A1C_CompactItem_float32(const A1C_CompactItem *item) {
+  assert(A1C_CompactItem_type(item) == A1C_ItemType_float32);
+  const uint32_t bits = (uint32_t)item->payload;
+  A1C_Float32 value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+A1C_Float64 A1C_CompactItem_float64(const A1C_CompactItem *item) {
+  assert(A1C_CompactItem_type(item) == A1C_ItemType_float64);
+  A1C_Float64 value;
+  memcpy(&value, &item->payload, sizeof(value));
+  return value;
+}
+
+A1C_Simple A1C_CompactItem_simple(const A1C_CompactItem *item) {
+  assert(A1C_CompactItem_type(item) == A1C_ItemType_simple);
+  return (A1C_Simple)item->payload;
+}
+
+A1C_Bytes A1C_CompactItem_bytes(const A1C_CompactItem *item) {
+  assert(A1C_CompactItem_type(item) == A1C_ItemType_bytes);
+  A1C_Bytes bytes = {
+      .data = (const uint8_t *)A1C_CompactItem_at(item, item->payload),
+      .size = item->size,
+  };
+  return bytes;
+}
+
+A1C_String A1C_CompactItem_string(const A1C_CompactItem *item) {
+  assert(A1C_CompactItem_type(item) == A1C_ItemType_string);
+  A1C_String string = {
+      .data = (const char *)A1C_CompactItem_at(item, item->payload),
+      .size = item->size,
+  };
+  return string;
+}
+
+uint64_t A1C_CompactItem_tag(const A1C_CompactItem *item) {
+  assert(A1C_CompactItem_type(item) == A1C_ItemType_tag);
+  return item->payload;
+}
+
+const A1C_CompactItem *A1C_CompactItem_tagItem(const A1C_CompactItem *item) {
+  assert(A1C_CompactItem_type(item) == A1C_ItemType_tag);
+  return (const A1C_CompactItem *)A1C_CompactItem_at(item, item->size);
+}
+
+size_t A1C_CompactItem_size(const A1C_CompactItem *item) {
+  assert(A1C_CompactItem_type(item) == A1C_ItemType_array ||
+         A1C_CompactItem_type(item) == A1C_ItemType_map);
+  return item->size;
+}
+
+/// @returns The first child of an array or map.
+static const A1C_CompactItem *
+A1C_CompactItem_children(const A1C_CompactItem *item) {
+  return (const A1C_CompactItem *)A1C_CompactItem_at(item, item->payload);
+}
+
+const A1C_CompactItem *A1C_CompactItem_arrayGet(const A1C_CompactItem *item,
+                                                size_t index) {
+  assert(A1C_CompactItem_type(item) == A1C_ItemType_array);
+  if (index >= item->size) {
+    return NULL;
   }
-  A1C_Item_int64(item, (int64_t)~neg);
-  return true;
+  return A1C_CompactItem_children(item) + index;
 }
 
-static bool A1C_NODISCARD A1C_Decoder_decodeDataDefinite(A1C_Decoder *decoder,
-                                                         A1C_ItemHeader header,
-                                                         A1C_Item *item,
-                                                         bool referenceSource) {
-  size_t size;
-  A1C_RET_IF_ERR(A1C_Decoder_readSize(decoder, header, &size));
-  if (A1C_Decoder_remaining(decoder) < size) {
-    // Check before allocating to avoid allocating huge amounts of memory
-    return A1C_Decoder_error(decoder, A1C_ErrorType_truncated);
+const A1C_CompactItem *A1C_CompactItem_mapKey(const A1C_CompactItem *item,
+                                              size_t index) {
+  assert(A1C_CompactItem_type(item) == A1C_ItemType_map);
+  if (index >= item->size) {
+    return NULL;
   }
-  const uint8_t *data;
-  if (referenceSource) {
-    data = decoder->ptr;
-    A1C_RET_IF_ERR(A1C_Decoder_skip(decoder, size));
-  } else {
-    uint8_t *buf = A1C_Arena_calloc(&decoder->arena, size, 1);
-    if (buf == NULL) {
-      return A1C_Decoder_error(decoder, A1C_ErrorType_badAlloc);
-    }
-    A1C_RET_IF_ERR(A1C_Decoder_read(decoder, buf, size));
-    data = buf;
+  return A1C_CompactItem_children(item) + 2 * index;
+}
+
+const A1C_CompactItem *A1C_CompactItem_mapValue(const A1C_CompactItem *item,
+                                                size_t index) {
+  assert(A1C_CompactItem_type(item) == A1C_ItemType_map);
+  if (index >= item->size) {
+    return NULL;
   }
-  if (A1C_ItemHeader_majorType(header) == A1C_MajorType_bytes) {
-    A1C_Item_bytes_ref(item, data, size);
-  } else {
-    A1C_Item_string_ref(item, (const char *)data, size);
+  return A1C_CompactItem_children(item) + 2 * index + 1;
+}
+
+const A1C_CompactItem *A1C_CompactItem_mapGet(const A1C_CompactItem *item,
+                                              const A1C_Item *key) {
+  assert(A1C_CompactItem_type(item) == A1C_ItemType_map);
+  const A1C_CompactItem *children = A1C_CompactItem_children(item);
+  for (size_t i = 0; i < item->size; ++i) {
+    if (A1C_CompactItem_eqItem(&children[2 * i], key)) {
+      return &children[2 * i + 1];
+    }
   }
-  return true;
+  return NULL;
 }
 
-static bool A1C_NODISCARD A1C_Decoder_decodeData(A1C_Decoder *decoder,
-                                                 A1C_ItemHeader header,
-                                                 A1C_Item *item) {
-  if (!A1C_ItemHeader_isIndefinite(header)) {
-    return A1C_Decoder_decodeDataDefinite(decoder, header, item,
-                                          decoder->referenceSource);
+const A1C_CompactItem *A1C_CompactItem_mapGet_cstr(const A1C_CompactItem *item,
+                                                   const char *key) {
+  A1C_Item keyItem;
+  A1C_Item_string_refCStr(&keyItem, key);
+  return A1C_CompactItem_mapGet(item, &keyItem);
+}
+
+const A1C_CompactItem *A1C_CompactItem_mapGet_int(const A1C_CompactItem *item,
+                                                  A1C_Int64 key) {
+  A1C_Item keyItem;
+  A1C_Item_int64(&keyItem, key);
+  return A1C_CompactItem_mapGet(item, &keyItem);
+}
+
+bool A1C_CompactItem_eqItem(const A1C_CompactItem *a, const A1C_Item *b) {
+  const A1C_ItemType type = A1C_CompactItem_type(a);
+  if (type != A1C_Item_logicalType(b)) {
+    return false;
   }
 
-  const A1C_MajorType majorType = A1C_ItemHeader_majorType(header);
-  size_t totalSize = 0;
-  const A1C_Item *previous = NULL;
-  for (;;) {
-    A1C_ItemHeader childHeader;
-    A1C_RET_IF_ERR(
-        A1C_Decoder_read(decoder, &childHeader, sizeof(childHeader)));
-    if (!A1C_ItemHeader_isLegal(childHeader)) {
-      return A1C_Decoder_error(decoder, A1C_ErrorType_invalidItemHeader);
-    }
-    if (A1C_ItemHeader_isBreak(childHeader)) {
-      break;
+  switch (type) {
+  case A1C_ItemType_int64:
+    return A1C_CompactItem_int64(a) == b->int64;
+  case A1C_ItemType_float16:
+    return A1C_CompactItem_float16(a) == b->float16;
+  case A1C_ItemType_float32: {
+    uint32_t bBits;
+    memcpy(&bBits, &b->float32, sizeof(bBits));
+    return (uint32_t)a->payload == bBits;
+  }
+  case A1C_ItemType_float64: {
+    uint64_t bBits;
+    memcpy(&bBits, &b->float64, sizeof(bBits));
+    return a->payload == bBits;
+  }
+  case A1C_ItemType_boolean:
+    return A1C_CompactItem_boolean(a) == b->boolean;
+  case A1C_ItemType_simple:
+    return A1C_CompactItem_simple(a) == b->simple;
+  case A1C_ItemType_null:
+  case A1C_ItemType_undefined:
+    return true;
+  case A1C_ItemType_bytes: {
+    const A1C_Bytes bytes = A1C_CompactItem_bytes(a);
+    return bytes.size == b->bytes.size &&
+           (bytes.size == 0 ||
+            memcmp(bytes.data, b->bytes.data, bytes.size) == 0);
+  }
+  case A1C_ItemType_string: {
+    const A1C_String string = A1C_CompactItem_string(a);
+    return string.size == b->string.size &&
+           (string.size == 0 ||
+            memcmp(string.data, b->string.data, string.size) == 0);
+  }
+  case A1C_ItemType_array:
+    if (a->size != A1C_Item_arraySize(b)) {
+      return false;
     }
-
-    if (A1C_ItemHeader_majorType(childHeader) != majorType ||
-        A1C_ItemHeader_isIndefinite(childHeader)) {
-      return A1C_Decoder_error(decoder, A1C_ErrorType_invalidChunkedString);
+    for (size_t i = 0; i < a->size; i++) {
+      A1C_Item scratch;
+      if (!A1C_CompactItem_eqItem(A1C_CompactItem_arrayGet(a, i),
+                                  A1C_Item_arrayAt(b, i, &scratch))) {
+        return false;
+      }
     }
-    A1C_Item *child = A1C_Arena_calloc(&decoder->arena, 1, sizeof(A1C_Item));
-    if (child == NULL) {
-      return A1C_Decoder_error(decoder, A1C_ErrorType_badAlloc);
+    return true;
+  case A1C_ItemType_map:
+    if (a->size != b->map.size) {
+      return false;
     }
-    A1C_RET_IF_ERR(
+    for (size_t i = 0; i < b->map.size; i++) {
+      if (!A1C_CompactItem_eqItem(A1C_CompactItem_mapKey(a, i),
+                                  &b->map.items[i].key)) {
+        return false;
+      }
+      if (!A1C_CompactItem_eqItem(A1C_CompactItem_mapValue(a, i),
+                                  &b->map.items[i].value)) {
+        return false;
+      }
+    }
+    return true;
+  case A1C_ItemType_tag:
+    return A1C_CompactItem_tag(a) == b->tag.tag &&
+           A1C_CompactItem_eqItem(A1C_CompactItem_tagItem(a), b->tag.item);
+  case A1C_ItemType_packedArray:
+    // Compact trees store packed arrays as arrays.
+    break;
+  }
+  return false;
+}
+
+////////////////////////////////////////
+// Clone
+////////////////////////////////////////
+
+typedef struct {
+  uint8_t *nextItem;
+  uint8_t *nextByte;
+} A1C_CloneWriter;
+
+/// Takes the next @p size bytes of the items region.
+static void *A1C_CloneWriter_items(A1C_CloneWriter *writer, size_t size) {
+  void *items = writer->nextItem;
+  writer->nextItem += size;
+  return items;
+}
+
+static const uint8_t *A1C_CloneWriter_copyData(A1C_CloneWriter *writer,
+                                               const void *data, size_t size) {
+  uint8_t *dst = writer->nextByte;
+  if (size > 0) {
+    memcpy(dst, data, size);
+  }
+  writer->nextByte += size;
+  return dst;
+}
+
+static void A1C_CloneWriter_write(A1C_CloneWriter *writer, A1C_Item *dst,
+                                  const A1C_Item *src,
+                                  const A1C_Item *parent) {
+  *dst = *src;
+  dst->parent = parent;
+  switch (src->type) {
+  case A1C_ItemType_bytes:
+    dst->bytes.data =
+        A1C_CloneWriter_copyData(writer, src->bytes.data, src->bytes.size);
+    break;
+  case A1C_ItemType_string:
+    dst->string.data = (const char *)A1C_CloneWriter_copyData(
+        writer, src->string.data, src->string.size);
+    break;
+  case A1C_ItemType_array: {
+    A1C_Item *items =
+        A1C_CloneWriter_items(writer, src->array.size * sizeof(A1C_Item));
+    for (size_t i = 0; i < src->array.size; ++i) {
+      A1C_CloneWriter_write(writer, &items[i], &src->array.items[i], dst);
+    }
+    dst->array.items = items;
+    break;
+  }
+  case A1C_ItemType_map: {
+    A1C_Pair *items =
+        A1C_CloneWriter_items(writer, src->map.size * sizeof(A1C_Pair));
+    for (size_t i = 0; i < src->map.size; ++i) {
+      A1C_CloneWriter_write(writer, &items[i].key, &src->map.items[i].key,
+                            dst);
+      A1C_CloneWriter_write(writer, &items[i].value, &src->map.items[i].value,
+                            dst);
+    }
+    dst->map.items = items;
+    break;
+  }
+  case A1C_ItemType_tag: {
+    A1C_Item *child = A1C_CloneWriter_items(writer, sizeof(A1C_Item));
+    A1C_CloneWriter_write(writer, child, src->tag.item, dst);
+    dst->tag.item = child;
+    break;
+  }
+  case A1C_ItemType_packedArray: {
+    // Packed elements live among the items to keep them aligned.
+    void *data = A1C_CloneWriter_items(
+        writer, A1C_PackedArray_paddedSize(&src->packedArray));
+    if (src->packedArray.size > 0) {
+      memcpy(data, src->packedArray.data,
+             src->packedArray.size *
+                 A1C_ElementType_size(src->packedArray.type));
+    }
+    dst->packedArray.data = data;
+    break;
+  }
+  case A1C_ItemType_undefined:
+  case A1C_ItemType_int64:
+  case A1C_ItemType_boolean:
+  case A1C_ItemType_null:
+  case A1C_ItemType_float16:
+  case A1C_ItemType_float32:
+  case A1C_ItemType_float64:
+  case A1C_ItemType_simple:
+    break;
+  }
+}
+
+A1C_Item *A1C_Item_clone(const A1C_Item *item, A1C_Arena *arena) {
+  assert(sizeof(A1C_Pair) == 2 * sizeof(A1C_Item));
+  // The compact footprint counts items and bytes the same way, except that
+  // clones keep packed arrays packed.
+  const A1C_CompactFootprint footprint = A1C_Item_compactFootprint(item);
+  size_t itemsSize;
+  size_t size;
+  if (A1C_overflowMul(footprint.items - footprint.packedElements,
+                      sizeof(A1C_Item), &itemsSize) ||
+      A1C_overflowAdd(itemsSize, footprint.packedBytes, &itemsSize) ||
+      A1C_overflowAdd(itemsSize, footprint.bytes, &size)) {
+    return NULL;
+  }
+  A1C_Item *root = A1C_Arena_calloc(arena, size, 1);
+  if (root == NULL) {
+    return NULL;
+  }
+  A1C_CloneWriter writer = {
+      .nextItem = (uint8_t *)(root + 1),
+      .nextByte = (uint8_t *)root + itemsSize,
+  };
+  A1C_CloneWriter_write(&writer, root, item, NULL);
+  assert(writer.nextItem == (uint8_t *)root + itemsSize);
+  assert(writer.nextByte == (uint8_t *)root + size);
+  return root;
+}
+
+// Compaction stores each container's children in one block, followed by the
+// data of those children, padded so the next block stays aligned.
+
+#define A1C_ITEM_ALIGNMENT _Alignof(A1C_Item)
+
+static size_t A1C_alignItem(size_t size) {
+  return (size + A1C_ITEM_ALIGNMENT - 1) & ~(size_t)(A1C_ITEM_ALIGNMENT - 1);
+}
+
+/// @returns The padded size of the data @p item owns.
+static size_t A1C_Item_paddedDataSize(const A1C_Item *item) {
+  if (item->type == A1C_ItemType_bytes) {
+    return A1C_alignItem(item->bytes.size);
+  } else if (item->type == A1C_ItemType_string) {
+    return A1C_alignItem(item->string.size);
+  } else if (item->type == A1C_ItemType_packedArray) {
+    return A1C_PackedArray_paddedSize(&item->packedArray);
+  }
+  return 0;
+}
+
+/// @returns The children of @p item as a flat array of @p count items. Map
+/// pairs are flattened into keys and values.
+static const A1C_Item *A1C_Item_children(const A1C_Item *item, size_t *count) {
+  switch (item->type) {
+  case A1C_ItemType_array:
+    *count = item->array.size;
+    return item->array.items;
+  case A1C_ItemType_map:
+    *count = 2 * item->map.size;
+    return (const void *)item->map.items;
+  case A1C_ItemType_tag:
+    *count = 1;
+    return item->tag.item;
+  case A1C_ItemType_undefined:
+  case A1C_ItemType_int64:
+  case A1C_ItemType_bytes:
+  case A1C_ItemType_string:
+  case A1C_ItemType_boolean:
+  case A1C_ItemType_null:
+  case A1C_ItemType_float16:
+  case A1C_ItemType_float32:
+  case A1C_ItemType_float64:
+  case A1C_ItemType_simple:
+  case A1C_ItemType_packedArray:
+    break;
+  }
+  *count = 0;
+  return NULL;
+}
+
+static void A1C_Item_setChildren(A1C_Item *item, A1C_Item *children) {
+  if (item->type == A1C_ItemType_array) {
+    item->array.items = children;
+  } else if (item->type == A1C_ItemType_map) {
+    item->map.items = (void *)children;
+  } else {
+    assert(item->type == A1C_ItemType_tag);
+    item->tag.item = children;
+  }
+}
+
+/// @returns false on overflow.
+static bool A1C_NODISCARD A1C_Item_compactedSize(const A1C_Item *item,
+                                                 size_t *size) {
+  if (A1C_overflowAdd(*size, A1C_Item_paddedDataSize(item), size)) {
+    return false;
+  }
+  size_t count;
+  const A1C_Item *children = A1C_Item_children(item, &count);
+  size_t childrenSize;
+  if (A1C_overflowMul(count, sizeof(A1C_Item), &childrenSize) ||
+      A1C_overflowAdd(*size, childrenSize, size)) {
+    return false;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    A1C_RET_IF_ERR(A1C_Item_compactedSize(&children[i], size));
+  }
+  return true;
+}
+
+/**
+ * Writes a block of @p count items copied from @p src at @p *next, followed by
+ * their data, and advances @p *next past the block. Children of the copies
+ * still point into the source tree.
+ */
+static A1C_Item *A1C_Item_writeBlock(uint8_t **next, const A1C_Item *src,
+                                     size_t count, const A1C_Item *parent) {
+  A1C_Item *block = (void *)*next;
+  *next += count * sizeof(A1C_Item);
+  for (size_t i = 0; i < count; ++i) {
+    A1C_Item *item = &block[i];
+    *item = src[i];
+    item->parent = parent;
+    if (item->type == A1C_ItemType_bytes) {
+      if (item->bytes.size > 0) {
+        memcpy(*next, item->bytes.data, item->bytes.size);
+      }
+      item->bytes.data = *next;
+    } else if (item->type == A1C_ItemType_string) {
+      if (item->string.size > 0) {
+        memcpy(*next, item->string.data, item->string.size);
+      }
+      item->string.data = (const char *)*next;
+    } else if (item->type == A1C_ItemType_packedArray) {
+      if (item->packedArray.size > 0) {
+        memcpy(*next, item->packedArray.data,
+               item->packedArray.size *
+                   A1C_ElementType_size(item->packedArray.type));
+      }
+      item->packedArray.data = *next;
+    }
+    *next += A1C_Item_paddedDataSize(item);
+  }
+  return block;
+}
+
+/// Moves the children of @p item, which is already written, into a new block.
+/// @returns The new block of @p *count children.
+static A1C_Item *A1C_Item_writeChildren(uint8_t **next, A1C_Item *item,
+                                        size_t *count) {
+  const A1C_Item *children = A1C_Item_children(item, count);
+  if (*count == 0) {
+    return NULL;
+  }
+  A1C_Item *block = A1C_Item_writeBlock(next, children, *count, item);
+  A1C_Item_setChildren(item, block);
+  return block;
+}
+
+static void A1C_Item_compactDepthFirst(uint8_t **next, A1C_Item *item) {
+  size_t count;
+  A1C_Item *block = A1C_Item_writeChildren(next, item, &count);
+  for (size_t i = 0; i < count; ++i) {
+    A1C_Item_compactDepthFirst(next, &block[i]);
+  }
+}
+
+/// Cheney-style scan over the written blocks, which also serve as the queue.
+static void A1C_Item_compactBreadthFirst(uint8_t **next, A1C_Item *root) {
+  uint8_t *scan = (uint8_t *)root;
+  while (scan < *next) {
+    A1C_Item *block = (void *)scan;
+    size_t count = 1;
+    if (block->parent != NULL) {
+      // Empty containers have no block, so every block has a first item.
+      (void)A1C_Item_children(block->parent, &count);
+    }
+    scan += count * sizeof(A1C_Item);
+    for (size_t i = 0; i < count; ++i) {
+      scan += A1C_Item_paddedDataSize(&block[i]);
+      size_t childCount;
+      (void)A1C_Item_writeChildren(next, &block[i], &childCount);
+    }
+  }
+}
+
+A1C_Item *A1C_Item_compact(const A1C_Item *root, A1C_Arena *arena,
+                           A1C_Layout layout) {
+  size_t size = sizeof(A1C_Item);
+  if (!A1C_Item_compactedSize(root, &size)) {
+    return NULL;
+  }
+  uint8_t *start = A1C_Arena_calloc(arena, size, 1);
+  if (start == NULL) {
+    return NULL;
+  }
+  uint8_t *next = start;
+  A1C_Item *result = A1C_Item_writeBlock(&next, root, 1, NULL);
+  switch (layout) {
+  case A1C_Layout_depthFirst:
+    A1C_Item_compactDepthFirst(&next, result);
+    break;
+  case A1C_Layout_breadthFirst:
+    A1C_Item_compactBreadthFirst(&next, result);
+    break;
+  }
+  assert(next == start + size);
+  return result;
+}
+
+////////////////////////////////////////
+// Image
+////////////////////////////////////////
+
+/// "A1CI" when read as a little-endian integer.
+#define A1C_IMAGE_MAGIC 0x49433141u
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  /// Size in bytes of the compact tree following the header.
+  uint64_t treeSize;
+  /// Number of items at the start of the tree, before the data.
+  uint64_t numItems;
+  /// Checksum of the other header fields and the tree.
+  uint64_t checksum;
+} A1C_ImageHeader;
+
+static uint64_t A1C_ImageHeader_checksum(const A1C_ImageHeader *header,
+                                         const void *tree) {
+  uint64_t hash = A1C_hashMix(A1C_HASH_PRIME1, header->version);
+  hash = A1C_hashMix(hash, header->treeSize);
+  hash = A1C_hashMix(hash, header->numItems);
+  hash = A1C_hashBytes(hash, tree, (size_t)header->treeSize);
+  return A1C_hashFinish(hash);
+}
+
+static bool A1C_Image_errorImpl(A1C_Error *error, size_t srcPos,
+                                const char *file, int line) {
+  if (error != NULL) {
+    memset(error, 0, sizeof(*error));
+    error->type = A1C_ErrorType_invalidImage;
+    error->srcPos = srcPos;
+    error->file = file;
+    error->line = line;
+  }
+  return false;
+}
+
+#define A1C_Image_error(error, srcPos)                                         \
+  A1C_Image_errorImpl((error), (srcPos), __FILE__, __LINE__)
+
+size_t A1C_Item_imageSize(const A1C_Item *item) {
+  const size_t treeSize = A1C_Item_compactSize(item);
+  if (treeSize == 0) {
+    return 0;
+  }
+  return sizeof(A1C_ImageHeader) + treeSize;
+}
+
+size_t A1C_Item_writeImage(const A1C_Item *item, void *dst,
+                           size_t dstCapacity) {
+  const A1C_CompactFootprint footprint = A1C_Item_compactFootprint(item);
+  const size_t treeSize = A1C_CompactFootprint_size(&footprint);
+  if (treeSize == 0 || dstCapacity < sizeof(A1C_ImageHeader) ||
+      dstCapacity - sizeof(A1C_ImageHeader) < treeSize) {
+    return 0;
+  }
+  if (((uintptr_t)dst & (sizeof(uint64_t) - 1)) != 0) {
+    return 0;
+  }
+  uint8_t *const tree = (uint8_t *)dst + sizeof(A1C_ImageHeader);
+  (void)A1C_Item_writeCompact(item, &footprint, tree);
+
+  A1C_ImageHeader header = {
+      .magic = A1C_IMAGE_MAGIC,
+      .version = A1C_IMAGE_VERSION,
+      .treeSize = treeSize,
+      .numItems = footprint.items,
+      .checksum = 0,
+  };
+  header.checksum = A1C_ImageHeader_checksum(&header, tree);
+  memcpy(dst, &header, sizeof(header));
+  return sizeof(A1C_ImageHeader) + treeSize;
+}
+
+/// Validates the offsets of the @p index'th item in the tree, so that
+/// everything it references stays within the tree and is strictly after it.
+static bool A1C_Image_validateItem(const A1C_ImageHeader *header,
+                                   const A1C_CompactItem *root, size_t index,
+                                   A1C_Error *error) {
+  const A1C_CompactItem *item = root + index;
+  const size_t srcPos =
+      sizeof(A1C_ImageHeader) + index * sizeof(A1C_CompactItem);
+  const uint64_t self = index * sizeof(A1C_CompactItem);
+  const uint64_t itemsEnd = header->numItems * sizeof(A1C_CompactItem);
+
+  if (item->meta > (uint32_t)A1C_ItemType_tag) {
+    return A1C_Image_error(error, srcPos);
+  }
+  uint64_t payloadLimit = 0;
+  switch (A1C_CompactItem_type(item)) {
+  case A1C_ItemType_int64:
+  case A1C_ItemType_float64:
+    payloadLimit = UINT64_MAX;
+    break;
+  case A1C_ItemType_float16:
+    payloadLimit = UINT16_MAX;
+    break;
+  case A1C_ItemType_float32:
+    payloadLimit = UINT32_MAX;
+    break;
+  case A1C_ItemType_boolean:
+    payloadLimit = 1;
+    break;
+  case A1C_ItemType_simple:
+    payloadLimit = UINT8_MAX;
+    break;
+  case A1C_ItemType_undefined:
+  case A1C_ItemType_null:
+    break;
+  case A1C_ItemType_bytes:
+  case A1C_ItemType_string:
+    // Data lives after all the items.
+    if (item->payload > header->treeSize - self ||
+        self + item->payload < itemsEnd ||
+        item->size > header->treeSize - self - item->payload) {
+      return A1C_Image_error(error, srcPos);
+    }
+    return true;
+  case A1C_ItemType_array:
+  case A1C_ItemType_map: {
+    const uint64_t children =
+        (uint64_t)item->size *
+        (A1C_CompactItem_type(item) == A1C_ItemType_map ? 2 : 1);
+    if (item->payload < sizeof(A1C_CompactItem) ||
+        item->payload % sizeof(A1C_CompactItem) != 0 ||
+        item->payload > itemsEnd - self ||
+        children > (itemsEnd - self - item->payload) /
+                       sizeof(A1C_CompactItem)) {
+      return A1C_Image_error(error, srcPos);
+    }
+    return true;
+  }
+  case A1C_ItemType_tag:
+    if (item->size < sizeof(A1C_CompactItem) ||
+        item->size % sizeof(A1C_CompactItem) != 0 ||
+        item->size >= itemsEnd - self) {
+      return A1C_Image_error(error, srcPos);
+    }
+    return true;
+  case A1C_ItemType_packedArray:
+    // Compact trees store packed arrays as arrays.
+    return A1C_Image_error(error, srcPos);
+  }
+  if (item->size != 0 || item->payload > payloadLimit) {
+    return A1C_Image_error(error, srcPos);
+  }
+  return true;
+}
+
+const A1C_CompactItem *A1C_Image_open(const void *data, size_t size,
+                                      A1C_Error *error) {
+  if (error != NULL) {
+    memset(error, 0, sizeof(*error));
+  }
+  if (data == NULL || size < sizeof(A1C_ImageHeader) ||
+      ((uintptr_t)data & (sizeof(uint64_t) - 1)) != 0) {
+    (void)A1C_Image_error(error, 0);
+    return NULL;
+  }
+  A1C_ImageHeader header;
+  memcpy(&header, data, sizeof(header));
+  // A byteswapped magic means the image was written with the other byte order.
+  if (header.magic != A1C_IMAGE_MAGIC) {
+    (void)A1C_Image_error(error, offsetof(A1C_ImageHeader, magic));
+    return NULL;
+  }
+  if (header.version != A1C_IMAGE_VERSION) {
+    (void)A1C_Image_error(error, offsetof(A1C_ImageHeader, version));
+    return NULL;
+  }
+  if (header.treeSize != size - sizeof(A1C_ImageHeader) ||
+      header.treeSize > A1C_COMPACT_MAX_SIZE) {
+    (void)A1C_Image_error(error, offsetof(A1C_ImageHeader, treeSize));
+    return NULL;
+  }
+  if (header.numItems == 0 ||
+      header.numItems > header.treeSize / sizeof(A1C_CompactItem)) {
+    (void)A1C_Image_error(error, offsetof(A1C_ImageHeader, numItems));
+    return NULL;
+  }
+  const uint8_t *const tree = (const uint8_t *)data + sizeof(A1C_ImageHeader);
+  if (header.checksum != A1C_ImageHeader_checksum(&header, tree)) {
+    (void)A1C_Image_error(error, offsetof(A1C_ImageHeader, checksum));
+    return NULL;
+  }
+
+  const A1C_CompactItem *root = (const A1C_CompactItem *)(const void *)tree;
+  for (size_t i = 0; i < header.numItems; ++i) {
+    if (!A1C_Image_validateItem(&header, root, i, error)) {
+      return NULL;
+    }
+  }
+  return root;
+}
+
+////////////////////////////////////////
+// Shared Coder Helpers
+////////////////////////////////////////
+
+typedef enum {
+  A1C_MajorType_uint = 0,
+  A1C_MajorType_int = 1,
+  A1C_MajorType_bytes = 2,
+  A1C_MajorType_string = 3,
+  A1C_MajorType_array = 4,
+  A1C_MajorType_map = 5,
+  A1C_MajorType_tag = 6,
+  A1C_MajorType_special = 7,
+} A1C_MajorType;
+
+typedef struct {
+  uint8_t header;
+} A1C_ItemHeader;
+
+A1C_ItemHeader A1C_ItemHeader_make(A1C_MajorType type, uint8_t shortCount) {
+  A1C_ItemHeader header;
+  header.header = (uint8_t)(type << 5) | shortCount;
+  return header;
+}
+
+A1C_MajorType A1C_ItemHeader_majorType(A1C_ItemHeader header) {
+  return (A1C_MajorType)(header.header >> 5);
+}
+
+uint8_t A1C_ItemHeader_shortCount(A1C_ItemHeader header) {
+  return header.header & 0x1F;
+}
+
+bool A1C_ItemHeader_isBreak(A1C_ItemHeader header) {
+  return header.header == 0xFF;
+}
+
+bool A1C_ItemHeader_isIndefinite(A1C_ItemHeader header) {
+  return A1C_ItemHeader_shortCount(header) == 31;
+}
+
+bool A1C_ItemHeader_isLegal(A1C_ItemHeader header) {
+  const A1C_MajorType majorType = A1C_ItemHeader_majorType(header);
+  const uint8_t shortCount = A1C_ItemHeader_shortCount(header);
+  if (shortCount >= 28) {
+    if (shortCount < 31) {
+      return false;
+    }
+    assert(shortCount == 31);
+    return !(majorType == A1C_MajorType_uint ||
+             majorType == A1C_MajorType_int || majorType == A1C_MajorType_tag);
+  }
+  return true;
+}
+
+////////////////////////////////////////
+// Decoder
+////////////////////////////////////////
+
+void A1C_Decoder_init(A1C_Decoder *decoder, A1C_Arena arena,
+                      A1C_DecoderConfig config) {
+  memset(decoder, 0, sizeof(A1C_Decoder));
+  assert(arena.calloc != NULL);
+  decoder->limitedArena = A1C_LimitedArena_init(arena, config.limitBytes);
+  decoder->arena = A1C_LimitedArena_arena(&decoder->limitedArena);
+  if (config.maxDepth == 0) {
+    decoder->maxDepth = A1C_MAX_DEPTH_DEFAULT;
+  } else {
+    decoder->maxDepth = config.maxDepth;
+  }
+  decoder->referenceSource = config.referenceSource;
+  decoder->rejectUnknownSimple = config.rejectUnknownSimple;
+  decoder->skipParents = config.skipParents;
+  decoder->validateUtf8 = config.validateUtf8;
+  decoder->packArrays = config.packArrays;
+}
+
+A1C_Error A1C_Decoder_getError(const A1C_Decoder *decoder) {
+  return decoder->error;
+}
+
+/// Points the decoder at a new source, without resetting the arena.
+static void A1C_Decoder_resetSource(A1C_Decoder *decoder, const uint8_t *start,
+                                    size_t size) {
+  memset(&decoder->error, 0, sizeof(A1C_Error));
+  decoder->start = start;
+  decoder->ptr = start;
+  decoder->end = start + size;
+  decoder->parent = NULL;
+  decoder->stack = NULL;
+  decoder->stackSize = 0;
+  decoder->stackCapacity = 0;
+  decoder->depth = 0;
+}
+
+static void A1C_Decoder_reset(A1C_Decoder *decoder, const uint8_t *start,
+                              size_t size) {
+  A1C_Decoder_resetSource(decoder, start, size);
+  A1C_LimitedArena_reset(&decoder->limitedArena);
+}
+
+static A1C_Item *A1C_NODISCARD A1C_Decoder_decodeOne(A1C_Decoder *decoder);
+static bool A1C_NODISCARD A1C_Decoder_decodeOneInto(A1C_Decoder *decoder,
+                                                    A1C_Item *item);
+static bool A1C_NODISCARD A1C_Decoder_skipOne(A1C_Decoder *decoder);
+
+bool A1C_NODISCARD A1C_Decoder_errorImpl(A1C_Decoder *decoder,
+                                         A1C_ErrorType errorType,
+                                         const char *file, int line) {
+  assert(decoder->ptr >= decoder->start);
+  assert(decoder->ptr <= decoder->end);
+  decoder->error.type = errorType;
+  decoder->error.srcPos = (size_t)(decoder->ptr - decoder->start);
+  decoder->error.depth = decoder->depth;
+  decoder->error.item = decoder->parent;
+  decoder->error.file = file;
+  decoder->error.line = line;
+  return false;
+}
+
+#define A1C_Decoder_error(decoder, errorType)                                  \
+  A1C_Decoder_errorImpl((decoder), (errorType), __FILE__, __LINE__)
+
+size_t A1C_Decoder_remaining(const A1C_Decoder *decoder) {
+  assert(decoder->ptr <= decoder->end);
+  return (size_t)(decoder->end - decoder->ptr);
+}
+
+bool A1C_NODISCARD A1C_Decoder_peek(A1C_Decoder *decoder, void *out,
+                                    size_t size) {
+  assert(out != NULL);
+  assert(decoder->ptr <= decoder->end);
+  if ((size_t)(decoder->end - decoder->ptr) < size) {
+    return A1C_Decoder_error(decoder, A1C_ErrorType_truncated);
+  }
+  if (size > 0) {
+    memcpy(out, decoder->ptr, size);
+  }
+  return true;
+}
+
+bool A1C_NODISCARD A1C_Decoder_skip(A1C_Decoder *decoder, size_t size) {
+  assert(decoder->ptr <= decoder->end);
+  if ((size_t)(decoder->end - decoder->ptr) < size) {
+    return A1C_Decoder_error(decoder, A1C_ErrorType_truncated);
+  }
+  if (size > 0) {
+    decoder->ptr += size;
+  }
+  return true;
+}
+
+bool A1C_NODISCARD A1C_Decoder_read(A1C_Decoder *decoder, void *out,
+                                    size_t size) {
+  A1C_RET_IF_ERR(A1C_Decoder_peek(decoder, out, size));
+  return A1C_Decoder_skip(decoder, size);
+}
+
+bool A1C_NODISCARD A1C_Decoder_readCount(A1C_Decoder *decoder,
+                                         A1C_ItemHeader header, uint64_t *out) {
+  assert(A1C_ItemHeader_isLegal(header));
+  const uint8_t shortCount = A1C_ItemHeader_shortCount(header);
+  if (shortCount < 24 || shortCount == 31) {
+    *out = shortCount;
+    return true;
+  } else if (shortCount == 24) {
+    uint8_t value;
+    A1C_RET_IF_ERR(A1C_Decoder_read(decoder, &value, sizeof(value)));
+    *out = value;
+  } else if (shortCount == 25) {
+    uint16_t value;
+    A1C_RET_IF_ERR(A1C_Decoder_read(decoder, &value, sizeof(value)));
+    *out = A1C_bigEndian16(value);
+  } else if (shortCount == 26) {
+    uint32_t value;
+    A1C_RET_IF_ERR(A1C_Decoder_read(decoder, &value, sizeof(value)));
+    *out = A1C_bigEndian32(value);
+  } else if (shortCount == 27) {
+    uint64_t value;
+    A1C_RET_IF_ERR(A1C_Decoder_read(decoder, &value, sizeof(value)));
+    *out = A1C_bigEndian64(value);
+  } else {
+    assert(false);
+  }
+  return true;
+}
+
+bool A1C_NODISCARD A1C_Decoder_readSize(A1C_Decoder *decoder,
+                                        A1C_ItemHeader header, size_t *out) {
+  uint64_t tmp;
+  A1C_RET_IF_ERR(A1C_Decoder_readCount(decoder, header, &tmp));
+  if (tmp > SIZE_MAX) {
+    return A1C_Decoder_error(decoder, A1C_ErrorType_integerOverflow);
+  }
+  *(out) = (size_t)tmp;
+  return true;
+}
+
+static bool A1C_NODISCARD A1C_Decoder_decodeUInt(A1C_Decoder *decoder,
+                                                 A1C_ItemHeader header,
+                                                 A1C_Item *item) {
+  uint64_t pos;
+  A1C_RET_IF_ERR(A1C_Decoder_readCount(decoder, header, &pos));
+  if (pos > (uint64_t)INT64_MAX) {
+    return A1C_Decoder_error(decoder, A1C_ErrorType_largeIntegersUnsupported);
+  }
+  A1C_Item_int64(item, (int64_t)pos);
+  return true;
+}
+
+static bool A1C_NODISCARD A1C_Decoder_decodeInt(A1C_Decoder *decoder,
+                                                A1C_ItemHeader header,
+                                                A1C_Item *item) {
+
+  uint64_t neg;
+  A1C_RET_IF_ERR(A1C_Decoder_readCount(decoder, header, &neg));
+  if (neg >= ((uint64_t)1 << 63)) {
+    return A1C_Decoder_error(decoder, A1C_ErrorType_largeIntegersUnsupported);
+  }
+  A1C_Item_int64(item, (int64_t)~neg);
+  return true;
+}
+
+static bool A1C_NODISCARD A1C_Decoder_decodeDataDefinite(A1C_Decoder *decoder,
+                                                         A1C_ItemHeader header,
+                                                         A1C_Item *item,
+                                                         bool referenceSource) {
+  size_t size;
+  A1C_RET_IF_ERR(A1C_Decoder_readSize(decoder, header, &size));
+  if (A1C_Decoder_remaining(decoder) < size) {
+    // Check before allocating to avoid allocating huge amounts of memory
+    return A1C_Decoder_error(decoder, A1C_ErrorType_truncated);
+  }
+  if (decoder->validateUtf8 &&
+      A1C_ItemHeader_majorType(header) == A1C_MajorType_string) {
+    // Validate before the copy, while the source is in cache anyway.
+    const uint8_t *const end = decoder->ptr + size;
+    const uint8_t *const invalid = A1C_validateUtf8(decoder->ptr, end);
+    if (invalid != end) {
+      decoder->ptr = invalid;
+      return A1C_Decoder_error(decoder, A1C_ErrorType_invalidUtf8);
+    }
+  }
+  const uint8_t *data;
+  if (referenceSource) {
+    data = decoder->ptr;
+    A1C_RET_IF_ERR(A1C_Decoder_skip(decoder, size));
+  } else {
+    uint8_t *buf = A1C_Arena_calloc(&decoder->arena, size, 1);
+    if (buf == NULL) {
+      return A1C_Decoder_error(decoder, A1C_ErrorType_badAlloc);
+    }
+    A1C_RET_IF_ERR(A1C_Decoder_read(decoder, buf, size));
+    data = buf;
+  }
+  if (A1C_ItemHeader_majorType(header) == A1C_MajorType_bytes) {
+    A1C_Item_bytes_ref(item, data, size);
+  } else {
+    A1C_Item_string_ref(item, (const char *)data, size);
+  }
+  return true;
+}
+
+static bool A1C_NODISCARD A1C_Decoder_decodeData(A1C_Decoder *decoder,
+                                                 A1C_ItemHeader header,
+                                                 A1C_Item *item) {
+  if (!A1C_ItemHeader_isIndefinite(header)) {
+    return A1C_Decoder_decodeDataDefinite(decoder, header, item,
+                                          decoder->referenceSource);
+  }
+
+  const A1C_MajorType majorType = A1C_ItemHeader_majorType(header);
+  size_t totalSize = 0;
+  const A1C_Item *previous = NULL;
+  for (;;) {
+    A1C_ItemHeader childHeader;
+    A1C_RET_IF_ERR(
+        A1C_Decoder_read(decoder, &childHeader, sizeof(childHeader)));
+    if (!A1C_ItemHeader_isLegal(childHeader)) {
+      return A1C_Decoder_error(decoder, A1C_ErrorType_invalidItemHeader);
+    }
+    if (A1C_ItemHeader_isBreak(childHeader)) {
+      break;
+    }
+
+    if (A1C_ItemHeader_majorType(childHeader) != majorType ||
+        A1C_ItemHeader_isIndefinite(childHeader)) {
+      return A1C_Decoder_error(decoder, A1C_ErrorType_invalidChunkedString);
+    }
+    A1C_Item *child = A1C_Arena_calloc(&decoder->arena, 1, sizeof(A1C_Item));
+    if (child == NULL) {
+      return A1C_Decoder_error(decoder, A1C_ErrorType_badAlloc);
+    }
+    A1C_RET_IF_ERR(
         A1C_Decoder_decodeDataDefinite(decoder, childHeader, child, true));
     const size_t size = majorType == A1C_MajorType_bytes ? child->bytes.size
                                                          : child->string.size;
     if (A1C_overflowAdd(totalSize, size, &totalSize)) {
       return A1C_Decoder_error(decoder, A1C_ErrorType_integerOverflow);
     }
-    child->parent = previous;
-    previous = child;
+    child->parent = previous;
+    previous = child;
+  }
+  uint8_t *data = A1C_Arena_calloc(&decoder->arena, totalSize, 1);
+  if (data == NULL) {
+    return A1C_Decoder_error(decoder, A1C_ErrorType_badAlloc);
+  }
+  uint8_t *dataEnd = data + totalSize;
+  while (previous != NULL) {
+    const uint8_t *chunkPtr = majorType == A1C_MajorType_bytes
+                                  ? previous->bytes.data
+                                  : (const uint8_t *)previous->string.data;
+    const size_t chunkSize = majorType == A1C_MajorType_bytes
+                                 ? previous->bytes.size
+                                 : previous->string.size;
+    if (chunkSize > 0) {
+      dataEnd -= chunkSize;
+      assert(dataEnd >= data);
+      memcpy(dataEnd, chunkPtr, chunkSize);
+    }
+    previous = previous->parent;
+  }
+  assert(dataEnd == data);
+  if (majorType == A1C_MajorType_bytes) {
+    A1C_Item_bytes_ref(item, data, totalSize);
+  } else {
+    A1C_Item_string_ref(item, (const char *)data, totalSize);
+  }
+  return true;
+}
+
+/// Allocates the children of an array, setting their parent unless the decoder
+/// is configured with `skipParents`.
+static A1C_Item *A1C_Decoder_array(A1C_Decoder *decoder, A1C_Item *item,
+                                   size_t size) {
+  if (!decoder->skipParents) {
+    return A1C_Item_array(item, size, &decoder->arena);
+  }
+  A1C_Item *items = A1C_Arena_calloc(&decoder->arena, size, sizeof(A1C_Item));
+  if (items == NULL) {
+    return NULL;
+  }
+  item->type = A1C_ItemType_array;
+  item->array.items = items;
+  item->array.size = size;
+  return items;
+}
+
+/// Allocates the children of a map, setting their parent unless the decoder
+/// is configured with `skipParents`.
+static A1C_Pair *A1C_Decoder_map(A1C_Decoder *decoder, A1C_Item *item,
+                                 size_t size) {
+  if (!decoder->skipParents) {
+    return A1C_Item_map(item, size, &decoder->arena);
+  }
+  A1C_Pair *items = A1C_Arena_calloc(&decoder->arena, size, sizeof(A1C_Pair));
+  if (items == NULL) {
+    return NULL;
+  }
+  item->type = A1C_ItemType_map;
+  item->map.items = items;
+  item->map.size = size;
+  return items;
+}
+
+/// Pushes a zeroed item onto the scratch stack of @p decoder, growing it in
+/// the arena like A1C_JsonParser_push(). Every item takes at least one byte,
+/// so the capacity never exceeds the items the remaining input could hold,
+/// plus one, which keeps the stack within 2 * sizeof(A1C_Item) per byte.
+/// @returns The index of the new item, or SIZE_MAX on allocation failure.
+static size_t A1C_Decoder_push(A1C_Decoder *decoder) {
+  if (decoder->stackSize == decoder->stackCapacity) {
+    size_t capacity =
+        decoder->stackCapacity == 0 ? 64 : 2 * decoder->stackCapacity;
+    // The value of a map may be pushed after its key used the last byte, and
+    // then fails as truncated, so there is always room for one more item.
+    const size_t remaining = A1C_Decoder_remaining(decoder);
+    const size_t maxCapacity =
+        decoder->stackSize + (remaining > 0 ? remaining : 1);
+    if (capacity > maxCapacity) {
+      capacity = maxCapacity;
+    }
+    A1C_Item *stack =
+        A1C_Arena_calloc(&decoder->arena, capacity, sizeof(A1C_Item));
+    if (stack == NULL) {
+      return SIZE_MAX;
+    }
+    if (decoder->stackSize > 0) {
+      memcpy(stack, decoder->stack, decoder->stackSize * sizeof(A1C_Item));
+    }
+    decoder->stack = stack;
+    decoder->stackCapacity = capacity;
+  }
+  memset(&decoder->stack[decoder->stackSize], 0, sizeof(A1C_Item));
+  return decoder->stackSize++;
+}
+
+/// Decodes the children of an indefinite length array or map onto the scratch
+/// stack, then moves them into an exactly sized array once the break byte is
+/// consumed. Used when `skipParents` is set, so there is no parent list to
+/// thread the children through, and nothing points at the children while
+/// they move.
+static bool A1C_NODISCARD A1C_Decoder_decodeIndefiniteInPlace(
+    A1C_Decoder *decoder, A1C_Item *item, bool isMap) {
+  const size_t itemsPerEntry = isMap ? 2 : 1;
+  const size_t base = decoder->stackSize;
+  for (;;) {
+    A1C_ItemHeader header;
+    A1C_RET_IF_ERR(A1C_Decoder_peek(decoder, &header, sizeof(header)));
+    if (A1C_ItemHeader_isBreak(header)) {
+      A1C_RET_IF_ERR(A1C_Decoder_skip(decoder, sizeof(header)));
+      break;
+    }
+    for (size_t j = 0; j < itemsPerEntry; ++j) {
+      const size_t index = A1C_Decoder_push(decoder);
+      if (index == SIZE_MAX) {
+        return A1C_Decoder_error(decoder, A1C_ErrorType_badAlloc);
+      }
+      // Nested containers may move the stack, but arena memory is never
+      // freed, so the child stays valid and is copied back afterwards.
+      A1C_Item *child = &decoder->stack[index];
+      A1C_RET_IF_ERR(A1C_Decoder_decodeOneInto(decoder, child));
+      decoder->stack[index] = *child;
+    }
+  }
+  const size_t count = decoder->stackSize - base;
+  void *items;
+  if (isMap) {
+    items = A1C_Decoder_map(decoder, item, count / 2);
+  } else {
+    items = A1C_Decoder_array(decoder, item, count);
+  }
+  if (items == NULL) {
+    return A1C_Decoder_error(decoder, A1C_ErrorType_badAlloc);
+  }
+  if (count > 0) {
+    memcpy(items, decoder->stack + base, count * sizeof(A1C_Item));
+  }
+  decoder->stackSize = base;
+  return true;
+}
+
+// Packed arrays are decoded in two passes: a scan that checks that all the
+// elements are integers or floats of one width without allocating, then a
+// specialized loop that decodes them. Arrays that can't be packed are left to
+// the generic path, which reports any errors.
+
+#if A1C_HAS_SSE2
+/// @returns A mask with a bit set for each of the 16 bytes at @p ptr that is
+/// a whole integer item, with a value from -24 to 23.
+static uint32_t A1C_smallIntMaskSSE2(const uint8_t *ptr) {
+  const __m128i v = _mm_loadu_si128((const __m128i *)(const void *)ptr);
+  const __m128i max = _mm_set1_epi8(23);
+  const __m128i negative = _mm_sub_epi8(v, _mm_set1_epi8(0x20));
+  const __m128i isUint = _mm_cmpeq_epi8(_mm_min_epu8(v, max), v);
+  const __m128i isInt =
+      _mm_cmpeq_epi8(_mm_min_epu8(negative, max), negative);
+  return (uint32_t)_mm_movemask_epi8(_mm_or_si128(isUint, isInt));
+}
+
+/// Decodes 16 small integers at @p ptr, which must all be whole items.
+static void A1C_decodeSmallIntsSSE2(int64_t *dst, const uint8_t *ptr) {
+  const __m128i v = _mm_loadu_si128((const __m128i *)(const void *)ptr);
+  // Negative integers n are encoded as 0x20 + (-1 - n), so n = 0x1f - byte.
+  const __m128i isInt = _mm_cmpgt_epi8(v, _mm_set1_epi8(0x1f));
+  const __m128i negated = _mm_sub_epi8(_mm_set1_epi8(0x1f), v);
+  const __m128i bytes = _mm_or_si128(_mm_and_si128(isInt, negated),
+                                     _mm_andnot_si128(isInt, v));
+  // Sign extend to 64 bits by interleaving with the sign bits.
+  const __m128i sign8 = _mm_cmpgt_epi8(_mm_setzero_si128(), bytes);
+  const __m128i words[2] = {_mm_unpacklo_epi8(bytes, sign8),
+                            _mm_unpackhi_epi8(bytes, sign8)};
+  for (size_t w = 0; w < 2; ++w) {
+    const __m128i sign16 = _mm_srai_epi16(words[w], 15);
+    const __m128i dwords[2] = {_mm_unpacklo_epi16(words[w], sign16),
+                               _mm_unpackhi_epi16(words[w], sign16)};
+    for (size_t d = 0; d < 2; ++d) {
+      const __m128i sign32 = _mm_srai_epi32(dwords[d], 31);
+      __m128i *out = (__m128i *)(void *)(dst + 8 * w + 4 * d);
+      _mm_storeu_si128(out, _mm_unpacklo_epi32(dwords[d], sign32));
+      _mm_storeu_si128(out + 1, _mm_unpackhi_epi32(dwords[d], sign32));
+    }
+  }
+}
+#endif
+
+/// @returns The end of the @p count integer items starting at @p ptr, or NULL
+/// if another item comes first, an integer doesn't fit in an int64, or the
+/// input ends.
+static const uint8_t *A1C_scanPackedInts(const uint8_t *ptr,
+                                         const uint8_t *end, size_t count) {
+  size_t i = 0;
+  while (i < count) {
+#if A1C_HAS_SSE2
+    if (count - i >= 16 && end - ptr >= 16 &&
+        A1C_smallIntMaskSSE2(ptr) == 0xFFFF) {
+      ptr += 16;
+      i += 16;
+      continue;
+    }
+#endif
+    if (ptr == end || *ptr >= 0x40) {
+      return NULL;
+    }
+    const uint8_t shortCount = *ptr & 0x1F;
+    if (shortCount < 24) {
+      ++ptr;
+    } else if (shortCount <= 27) {
+      const size_t bytes = (size_t)1 << (shortCount - 24);
+      if ((size_t)(end - ptr) <= bytes) {
+        return NULL;
+      }
+      if (shortCount == 27 && (ptr[1] & 0x80) != 0) {
+        // Larger than INT64_MAX.
+        return NULL;
+      }
+      ptr += 1 + bytes;
+    } else {
+      return NULL;
+    }
+    ++i;
+  }
+  return ptr;
+}
+
+/// Decodes the @p count integer items at @p ptr, which have been scanned.
+static void A1C_decodePackedInts(int64_t *dst, const uint8_t *ptr,
+                                 size_t count) {
+  size_t i = 0;
+  while (i < count) {
+#if A1C_HAS_SSE2
+    if (count - i >= 16 && A1C_smallIntMaskSSE2(ptr) == 0xFFFF) {
+      A1C_decodeSmallIntsSSE2(dst + i, ptr);
+      ptr += 16;
+      i += 16;
+      continue;
+    }
+#endif
+    const uint8_t header = *ptr++;
+    const uint8_t shortCount = header & 0x1F;
+    uint64_t value = shortCount;
+    if (shortCount == 24) {
+      value = *ptr++;
+    } else if (shortCount == 25) {
+      uint16_t value16;
+      memcpy(&value16, ptr, sizeof(value16));
+      value = A1C_bigEndian16(value16);
+      ptr += sizeof(value16);
+    } else if (shortCount == 26) {
+      uint32_t value32;
+      memcpy(&value32, ptr, sizeof(value32));
+      value = A1C_bigEndian32(value32);
+      ptr += sizeof(value32);
+    } else if (shortCount == 27) {
+      memcpy(&value, ptr, sizeof(value));
+      value = A1C_bigEndian64(value);
+      ptr += sizeof(value);
+    }
+    dst[i++] = header < 0x20 ? (int64_t)value : (int64_t)~value;
+  }
+}
+
+/// Decodes the @p count float items at @p ptr, which have been scanned, into
+/// @p dst, which holds elements of @p size bytes.
+static void A1C_decodePackedFloats(void *dst, const uint8_t *ptr,
+                                   size_t count, size_t size) {
+  uint8_t *out = (uint8_t *)dst;
+  const size_t stride = 1 + size;
+  if (size == 2) {
+    for (size_t i = 0; i < count; ++i, ptr += stride, out += size) {
+      uint16_t value;
+      memcpy(&value, ptr + 1, sizeof(value));
+      value = A1C_bigEndian16(value);
+      memcpy(out, &value, sizeof(value));
+    }
+  } else if (size == 4) {
+    for (size_t i = 0; i < count; ++i, ptr += stride, out += size) {
+      uint32_t value;
+      memcpy(&value, ptr + 1, sizeof(value));
+      value = A1C_bigEndian32(value);
+      memcpy(out, &value, sizeof(value));
+    }
+  } else {
+    assert(size == 8);
+    for (size_t i = 0; i < count; ++i, ptr += stride, out += size) {
+      uint64_t value;
+      memcpy(&value, ptr + 1, sizeof(value));
+      value = A1C_bigEndian64(value);
+      memcpy(out, &value, sizeof(value));
+    }
+  }
+}
+
+/**
+ * Scans the @p size elements of an array at the decoder's position, without
+ * allocating or moving it.
+ * @returns The end of the elements if they are all integers or all floats of
+ * one width, and can be packed as @p type, or NULL otherwise.
+ */
+static const uint8_t *A1C_Decoder_scanPacked(const A1C_Decoder *decoder,
+                                             size_t size,
+                                             A1C_ElementType *type) {
+  // Leave reporting that the elements are too deep to the generic path.
+  if (size == 0 || size > UINT32_MAX ||
+      decoder->depth >= decoder->maxDepth) {
+    return NULL;
+  }
+  const uint8_t *const ptr = decoder->ptr;
+  const size_t remaining = A1C_Decoder_remaining(decoder);
+  if (*ptr < 0x40) {
+    *type = A1C_ElementType_int64;
+    return A1C_scanPackedInts(ptr, decoder->end, size);
+  }
+  if (*ptr < 0xF9 || *ptr > 0xFB) {
+    return NULL;
+  }
+  *type = *ptr == 0xF9   ? A1C_ElementType_float16
+          : *ptr == 0xFA ? A1C_ElementType_float32
+                         : A1C_ElementType_float64;
+  const size_t stride = 1 + A1C_ElementType_size(*type);
+  if (remaining / stride < size) {
+    return NULL;
+  }
+  const uint8_t *const end = ptr + size * stride;
+  for (const uint8_t *p = ptr; p < end; p += stride) {
+    if (*p != *ptr) {
+      return NULL;
+    }
+  }
+  return end;
+}
+
+/**
+ * Decodes the @p size elements of an array into a packed array, if they are
+ * all integers or all floats of one width.
+ * Sets @p packed to false and leaves the input untouched otherwise.
+ */
+static bool A1C_NODISCARD A1C_Decoder_decodePacked(A1C_Decoder *decoder,
+                                                   A1C_Item *item, size_t size,
+                                                   bool *packed) {
+  *packed = false;
+  A1C_ElementType type;
+  const uint8_t *const end = A1C_Decoder_scanPacked(decoder, size, &type);
+  if (end == NULL) {
+    return true;
+  }
+  const uint8_t *const ptr = decoder->ptr;
+  void *data =
+      A1C_Arena_calloc(&decoder->arena, size, A1C_ElementType_size(type));
+  if (data == NULL) {
+    return A1C_Decoder_error(decoder, A1C_ErrorType_badAlloc);
+  }
+  if (type == A1C_ElementType_int64) {
+    A1C_decodePackedInts(data, ptr, size);
+  } else {
+    A1C_decodePackedFloats(data, ptr, size, A1C_ElementType_size(type));
+  }
+  const bool success = A1C_Item_packedArray_ref(item, type, data, size);
+  (void)success;
+  assert(success);
+  decoder->ptr = end;
+  *packed = true;
+  return true;
+}
+
+static bool A1C_NODISCARD A1C_Decoder_decodeArray(A1C_Decoder *decoder,
+                                                  A1C_ItemHeader header,
+                                                  A1C_Item *item) {
+  size_t size;
+  A1C_RET_IF_ERR(A1C_Decoder_readSize(decoder, header, &size));
+  A1C_Item *const parent = decoder->parent;
+  decoder->parent = item;
+  if (A1C_ItemHeader_isIndefinite(header) && decoder->skipParents) {
+    A1C_RET_IF_ERR(A1C_Decoder_decodeIndefiniteInPlace(decoder, item, false));
+  } else if (A1C_ItemHeader_isIndefinite(header)) {
+    size = 0;
+    const A1C_Item *previous = NULL;
+    for (;;) {
+      A1C_ItemHeader childHeader;
+      A1C_RET_IF_ERR(
+          A1C_Decoder_peek(decoder, &childHeader, sizeof(childHeader)));
+      if (A1C_ItemHeader_isBreak(childHeader)) {
+        A1C_RET_IF_ERR(A1C_Decoder_skip(decoder, sizeof(childHeader)));
+        break;
+      }
+      A1C_Item *child = A1C_Decoder_decodeOne(decoder);
+      if (child == NULL) {
+        return NULL;
+      }
+      child->parent = previous;
+      previous = child;
+      ++size;
+    }
+    A1C_Item *array = A1C_Item_array(item, size, &decoder->arena);
+    if (array == NULL) {
+      return A1C_Decoder_error(decoder, A1C_ErrorType_badAlloc);
+    }
+    while (previous != NULL) {
+      const A1C_Item *child = previous;
+      previous = previous->parent;
+
+      --size;
+      array[size] = *child;
+      array[size].parent = item;
+    }
+    assert(size == 0);
+  } else {
+    if (A1C_Decoder_remaining(decoder) < size) {
+      // Each item must be at least one byte
+      // Check remaining before allocation to avoid huge allocations.
+      return A1C_Decoder_error(decoder, A1C_ErrorType_truncated);
+    }
+    bool packed = false;
+    if (decoder->packArrays) {
+      A1C_RET_IF_ERR(A1C_Decoder_decodePacked(decoder, item, size, &packed));
+    }
+    if (!packed) {
+      A1C_Item *array = A1C_Decoder_array(decoder, item, size);
+      if (array == NULL) {
+        return A1C_Decoder_error(decoder, A1C_ErrorType_badAlloc);
+      }
+      for (size_t i = 0; i < size; i++) {
+        A1C_RET_IF_ERR(A1C_Decoder_decodeOneInto(decoder, array + i));
+      }
+    }
+  }
+  decoder->parent = parent;
+  return true;
+}
+
+static bool A1C_NODISCARD A1C_Decoder_decodeMap(A1C_Decoder *decoder,
+                                                A1C_ItemHeader header,
+                                                A1C_Item *item) {
+  size_t size;
+  A1C_RET_IF_ERR(A1C_Decoder_readSize(decoder, header, &size));
+  A1C_Item *const parent = decoder->parent;
+  decoder->parent = item;
+  if (A1C_ItemHeader_isIndefinite(header) && decoder->skipParents) {
+    A1C_RET_IF_ERR(A1C_Decoder_decodeIndefiniteInPlace(decoder, item, true));
+  } else if (A1C_ItemHeader_isIndefinite(header)) {
+    size = 0;
+    const A1C_Item *prevKey = NULL;
+    const A1C_Item *prevVal = NULL;
+    for (;;) {
+      A1C_ItemHeader keyHeader;
+      A1C_RET_IF_ERR(A1C_Decoder_peek(decoder, &keyHeader, sizeof(keyHeader)));
+      if (A1C_ItemHeader_isBreak(keyHeader)) {
+        A1C_RET_IF_ERR(A1C_Decoder_skip(decoder, sizeof(keyHeader)));
+        break;
+      }
+      A1C_Item *key = A1C_Decoder_decodeOne(decoder);
+      if (key == NULL) {
+        return NULL;
+      }
+      A1C_Item *value = A1C_Decoder_decodeOne(decoder);
+      if (value == NULL) {
+        return NULL;
+      }
+      key->parent = prevKey;
+      prevKey = key;
+
+      value->parent = prevVal;
+      prevVal = value;
+
+      ++size;
+    }
+    A1C_Pair *map = A1C_Item_map(item, size, &decoder->arena);
+    if (map == NULL) {
+      return A1C_Decoder_error(decoder, A1C_ErrorType_badAlloc);
+    }
+    while (prevKey != NULL) {
+      const A1C_Item *key = prevKey;
+      prevKey = prevKey->parent;
+
+      assert(prevVal != NULL);
+      const A1C_Item *value = prevVal;
+      prevVal = prevVal->parent;
+
+      --size;
+      map[size].key = *key;
+      map[size].key.parent = item;
+      map[size].value = *value;
+      map[size].value.parent = item;
+    }
+    assert(size == 0);
+  } else {
+    if (A1C_Decoder_remaining(decoder) < size) {
+      // Each item must be at least one byte
+      // Check remaining before allocation to avoid huge allocations.
+      return A1C_Decoder_error(decoder, A1C_ErrorType_truncated);
+    }
+    A1C_Pair *map = A1C_Decoder_map(decoder, item, size);
+    if (map == NULL) {
+      return A1C_Decoder_error(decoder, A1C_ErrorType_badAlloc);
+    }
+    for (size_t i = 0; i < size; i++) {
+      A1C_RET_IF_ERR(A1C_Decoder_decodeOneInto(decoder, &map[i].key));
+      A1C_RET_IF_ERR(A1C_Decoder_decodeOneInto(decoder, &map[i].value));
+    }
+  }
+  decoder->parent = parent;
+  return true;
+}
+
+static bool A1C_NODISCARD A1C_Decoder_decodeTag(A1C_Decoder *decoder,
+                                                A1C_ItemHeader header,
+                                                A1C_Item *item) {
+  uint64_t value;
+  A1C_RET_IF_ERR(A1C_Decoder_readCount(decoder, header, &value));
+  A1C_Item *child;
+  if (decoder->skipParents) {
+    child = A1C_Arena_calloc(&decoder->arena, 1, sizeof(A1C_Item));
+    if (child != NULL) {
+      item->type = A1C_ItemType_tag;
+      item->tag.tag = value;
+      item->tag.item = child;
+    }
+  } else {
+    child = A1C_Item_tag(item, value, &decoder->arena);
+  }
+  if (child == NULL) {
+    return A1C_Decoder_error(decoder, A1C_ErrorType_badAlloc);
+  }
+  A1C_Item *const parent = decoder->parent;
+  decoder->parent = item;
+  A1C_RET_IF_ERR(A1C_Decoder_decodeOneInto(decoder, child));
+  assert(decoder->skipParents || child->parent == item);
+  decoder->parent = parent;
+
+  return true;
+}
+
+static bool A1C_NODISCARD A1C_Decoder_decodeSpecial(A1C_Decoder *decoder,
+                                                    A1C_ItemHeader header,
+                                                    A1C_Item *item) {
+  const size_t shortCount = A1C_ItemHeader_shortCount(header);
+  if (shortCount == 20 || shortCount == 21) {
+    A1C_Item_boolean(item, shortCount == 21);
+  } else if (shortCount == 22) {
+    A1C_Item_null(item);
+  } else if (shortCount == 23) {
+    A1C_Item_undefined(item);
+  } else if (shortCount == 24) {
+    if (decoder->rejectUnknownSimple) {
+      return A1C_Decoder_error(decoder, A1C_ErrorType_invalidSimpleEncoding);
+    }
+    uint8_t value;
+    A1C_RET_IF_ERR(A1C_Decoder_read(decoder, &value, sizeof(value)));
+    if (value < 32) {
+      return A1C_Decoder_error(decoder, A1C_ErrorType_invalidSimpleEncoding);
+    }
+    A1C_Item_simple(item, value);
+  } else if (shortCount == 25) {
+    uint16_t value;
+    A1C_RET_IF_ERR(A1C_Decoder_read(decoder, &value, sizeof(value)));
+    value = A1C_bigEndian16(value);
+    A1C_Item_float16(item, value);
+  } else if (shortCount == 26) {
+    uint32_t value;
+    A1C_RET_IF_ERR(A1C_Decoder_read(decoder, &value, sizeof(value)));
+    value = A1C_bigEndian32(value);
+    float float32;
+    memcpy(&float32, &value, sizeof(float32));
+    A1C_Item_float32(item, float32);
+  } else if (shortCount == 27) {
+    uint64_t value;
+    A1C_RET_IF_ERR(A1C_Decoder_read(decoder, &value, sizeof(value)));
+    value = A1C_bigEndian64(value);
+    double float64;
+    memcpy(&float64, &value, sizeof(float64));
+    A1C_Item_float64(item, float64);
+  } else if (shortCount < 20) {
+    if (decoder->rejectUnknownSimple) {
+      return A1C_Decoder_error(decoder, A1C_ErrorType_invalidSimpleEncoding);
+    }
+    A1C_Item_simple(item, (uint8_t)shortCount);
+  } else if (shortCount == 31) {
+    return A1C_Decoder_error(decoder, A1C_ErrorType_breakNotAllowed);
+  } else {
+    assert(shortCount >= 28 && shortCount <= 30);
+    assert(false);
+  }
+  return true;
+}
+
+static A1C_Item *A1C_NODISCARD A1C_Decoder_decodeOne(A1C_Decoder *decoder) {
+  A1C_Item *item = A1C_Arena_calloc(&decoder->arena, 1, sizeof(A1C_Item));
+  if (item == NULL) {
+    (void)A1C_Decoder_error(decoder, A1C_ErrorType_badAlloc);
+    return NULL;
+  }
+  if (!A1C_Decoder_decodeOneInto(decoder, item)) {
+    return NULL;
+  }
+  return item;
+}
+
+static bool A1C_NODISCARD A1C_Decoder_decodeOneInto(A1C_Decoder *decoder,
+                                                    A1C_Item *item) {
+  if (++decoder->depth > decoder->maxDepth) {
+    return A1C_Decoder_error(decoder, A1C_ErrorType_maxDepthExceeded);
+  }
+
+  A1C_ItemHeader header;
+  A1C_RET_IF_ERR(A1C_Decoder_read(decoder, &header, sizeof(header)));
+
+  if (!A1C_ItemHeader_isLegal(header)) {
+    return A1C_Decoder_error(decoder, A1C_ErrorType_invalidItemHeader);
+  }
+
+  switch (A1C_ItemHeader_majorType(header)) {
+  case A1C_MajorType_uint:
+    A1C_RET_IF_ERR(A1C_Decoder_decodeUInt(decoder, header, item));
+    break;
+  case A1C_MajorType_int:
+    A1C_RET_IF_ERR(A1C_Decoder_decodeInt(decoder, header, item));
+    break;
+  case A1C_MajorType_bytes:
+    A1C_RET_IF_ERR(A1C_Decoder_decodeData(decoder, header, item));
+    break;
+  case A1C_MajorType_string:
+    A1C_RET_IF_ERR(A1C_Decoder_decodeData(decoder, header, item));
+    break;
+  case A1C_MajorType_array:
+    A1C_RET_IF_ERR(A1C_Decoder_decodeArray(decoder, header, item));
+    break;
+  case A1C_MajorType_map:
+    A1C_RET_IF_ERR(A1C_Decoder_decodeMap(decoder, header, item));
+    break;
+  case A1C_MajorType_tag:
+    A1C_RET_IF_ERR(A1C_Decoder_decodeTag(decoder, header, item));
+    break;
+  case A1C_MajorType_special:
+    A1C_RET_IF_ERR(A1C_Decoder_decodeSpecial(decoder, header, item));
+    break;
+  }
+  --decoder->depth;
+  return true;
+}
+
+/// Skips over the next item without allocating, applying exactly the same
+/// validation as A1C_Decoder_decodeOneInto().
+static bool A1C_NODISCARD A1C_Decoder_skipOne(A1C_Decoder *decoder) {
+  if (++decoder->depth > decoder->maxDepth) {
+    return A1C_Decoder_error(decoder, A1C_ErrorType_maxDepthExceeded);
+  }
+
+  A1C_ItemHeader header;
+  A1C_RET_IF_ERR(A1C_Decoder_read(decoder, &header, sizeof(header)));
+
+  if (!A1C_ItemHeader_isLegal(header)) {
+    return A1C_Decoder_error(decoder, A1C_ErrorType_invalidItemHeader);
+  }
+
+  // Scalars never allocate, so they are decoded into a scratch item.
+  A1C_Item scratch;
+  const A1C_MajorType majorType = A1C_ItemHeader_majorType(header);
+  switch (majorType) {
+  case A1C_MajorType_uint:
+    A1C_RET_IF_ERR(A1C_Decoder_decodeUInt(decoder, header, &scratch));
+    break;
+  case A1C_MajorType_int:
+    A1C_RET_IF_ERR(A1C_Decoder_decodeInt(decoder, header, &scratch));
+    break;
+  case A1C_MajorType_bytes:
+  case A1C_MajorType_string:
+    if (!A1C_ItemHeader_isIndefinite(header)) {
+      A1C_RET_IF_ERR(
+          A1C_Decoder_decodeDataDefinite(decoder, header, &scratch, true));
+      break;
+    }
+    for (;;) {
+      A1C_ItemHeader childHeader;
+      A1C_RET_IF_ERR(
+          A1C_Decoder_read(decoder, &childHeader, sizeof(childHeader)));
+      if (!A1C_ItemHeader_isLegal(childHeader)) {
+        return A1C_Decoder_error(decoder, A1C_ErrorType_invalidItemHeader);
+      }
+      if (A1C_ItemHeader_isBreak(childHeader)) {
+        break;
+      }
+      if (A1C_ItemHeader_majorType(childHeader) != majorType ||
+          A1C_ItemHeader_isIndefinite(childHeader)) {
+        return A1C_Decoder_error(decoder, A1C_ErrorType_invalidChunkedString);
+      }
+      A1C_RET_IF_ERR(
+          A1C_Decoder_decodeDataDefinite(decoder, childHeader, &scratch, true));
+    }
+    break;
+  case A1C_MajorType_array:
+  case A1C_MajorType_map: {
+    size_t size;
+    A1C_RET_IF_ERR(A1C_Decoder_readSize(decoder, header, &size));
+    const size_t itemsPerEntry = majorType == A1C_MajorType_map ? 2 : 1;
+    if (A1C_ItemHeader_isIndefinite(header)) {
+      for (;;) {
+        A1C_ItemHeader childHeader;
+        A1C_RET_IF_ERR(
+            A1C_Decoder_peek(decoder, &childHeader, sizeof(childHeader)));
+        if (A1C_ItemHeader_isBreak(childHeader)) {
+          A1C_RET_IF_ERR(A1C_Decoder_skip(decoder, sizeof(childHeader)));
+          break;
+        }
+        for (size_t j = 0; j < itemsPerEntry; ++j) {
+          A1C_RET_IF_ERR(A1C_Decoder_skipOne(decoder));
+        }
+      }
+    } else {
+      if (A1C_Decoder_remaining(decoder) < size) {
+        // Match the error reported by A1C_Decoder_decodeArray/Map().
+        return A1C_Decoder_error(decoder, A1C_ErrorType_truncated);
+      }
+      for (size_t i = 0; i < size; ++i) {
+        for (size_t j = 0; j < itemsPerEntry; ++j) {
+          A1C_RET_IF_ERR(A1C_Decoder_skipOne(decoder));
+        }
+      }
+    }
+    break;
+  }
+  case A1C_MajorType_tag: {
+    uint64_t value;
+    A1C_RET_IF_ERR(A1C_Decoder_readCount(decoder, header, &value));
+    A1C_RET_IF_ERR(A1C_Decoder_skipOne(decoder));
+    break;
+  }
+  case A1C_MajorType_special:
+    A1C_RET_IF_ERR(A1C_Decoder_decodeSpecial(decoder, header, &scratch));
+    break;
+  }
+  --decoder->depth;
+  return true;
+}
+
+/// Decodes [data, data + size) without resetting the arena.
+static const A1C_Item *A1C_Decoder_decodeSource(A1C_Decoder *decoder,
+                                                const uint8_t *data,
+                                                size_t size) {
+  A1C_Decoder_resetSource(decoder, data, size);
+  if (data == NULL) {
+    decoder->error.type = A1C_ErrorType_truncated;
+    decoder->error.srcPos = 0;
+    return NULL;
+  }
+  A1C_Item *item = A1C_Decoder_decodeOne(decoder);
+  if (item != NULL && decoder->ptr < decoder->end) {
+    (void)A1C_Decoder_error(decoder, A1C_ErrorType_trailingData);
+    return NULL;
+  }
+  return item;
+}
+
+const A1C_Item *A1C_Decoder_decode(A1C_Decoder *decoder, const uint8_t *data,
+                                   size_t size) {
+  A1C_LimitedArena_reset(&decoder->limitedArena);
+  return A1C_Decoder_decodeSource(decoder, data, size);
+}
+
+size_t A1C_Decoder_decodeBatch(A1C_Decoder *decoder, const A1C_Bytes *spans,
+                               size_t numSpans, const A1C_Item **items,
+                               A1C_Error *errors) {
+  A1C_LimitedArena_reset(&decoder->limitedArena);
+  size_t numDecoded = 0;
+  for (size_t i = 0; i < numSpans; ++i) {
+    items[i] = A1C_Decoder_decodeSource(decoder, spans[i].data, spans[i].size);
+    if (items[i] != NULL) {
+      ++numDecoded;
+    }
+    if (errors != NULL) {
+      errors[i] = decoder->error;
+    }
+  }
+  return numDecoded;
+}
+
+/// Number of bytes at the start of a file to prefetch before decoding.
+#define A1C_FILE_PREFETCH_BYTES ((size_t)4 << 20)
+
+static bool A1C_Decoder_fileErrorImpl(A1C_Decoder *decoder,
+                                      A1C_ErrorType errorType,
+                                      const char *file, int line) {
+  memset(&decoder->error, 0, sizeof(decoder->error));
+  decoder->error.type = errorType;
+  decoder->error.file = file;
+  decoder->error.line = line;
+  return false;
+}
+
+#define A1C_Decoder_fileError(decoder, errorType)                              \
+  A1C_Decoder_fileErrorImpl((decoder), (errorType), __FILE__, __LINE__)
+
+/// Maps the file at @p path read-only into @p mapping.
+static bool A1C_NODISCARD A1C_Decoder_mapFile(A1C_Decoder *decoder,
+                                              const char *path,
+                                              A1C_FileMapping *mapping) {
+#if A1C_HAS_MMAP
+  const int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return A1C_Decoder_fileError(decoder, A1C_ErrorType_fileError);
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    (void)close(fd);
+    return A1C_Decoder_fileError(decoder, A1C_ErrorType_fileError);
+  }
+  if (st.st_size <= 0) {
+    // Empty files can't be mapped, and are never valid CBOR.
+    (void)close(fd);
+    return A1C_Decoder_fileError(decoder, A1C_ErrorType_truncated);
+  }
+  if ((uintmax_t)st.st_size > SIZE_MAX) {
+    (void)close(fd);
+    return A1C_Decoder_fileError(decoder, A1C_ErrorType_fileError);
+  }
+  const size_t size = (size_t)st.st_size;
+  void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping keeps its own reference to the file.
+  (void)close(fd);
+  if (data == MAP_FAILED) {
+    return A1C_Decoder_fileError(decoder, A1C_ErrorType_fileError);
+  }
+  mapping->data = data;
+  mapping->size = size;
+  return true;
+#else
+  (void)path;
+  (void)mapping;
+  return A1C_Decoder_fileError(decoder, A1C_ErrorType_fileError);
+#endif
+}
+
+const A1C_Item *A1C_Decoder_decodeFile(A1C_Decoder *decoder, const char *path,
+                                       A1C_FileMapping *mapping) {
+  memset(mapping, 0, sizeof(*mapping));
+  if (!A1C_Decoder_mapFile(decoder, path, mapping)) {
+    return NULL;
+  }
+#if A1C_HAS_MMAP
+  // The decoder reads the file front to back, so ask for aggressive
+  // readahead, and start reading the first chunk immediately. The advice is
+  // best effort, so failures are ignored.
+  (void)posix_madvise(mapping->data, mapping->size, POSIX_MADV_SEQUENTIAL);
+  (void)posix_madvise(mapping->data,
+                      mapping->size < A1C_FILE_PREFETCH_BYTES
+                          ? mapping->size
+                          : A1C_FILE_PREFETCH_BYTES,
+                      POSIX_MADV_WILLNEED);
+#endif
+
+  const bool referenceSource = decoder->referenceSource;
+  decoder->referenceSource = true;
+  const A1C_Item *item = A1C_Decoder_decode(
+      decoder, (const uint8_t *)mapping->data, mapping->size);
+  decoder->referenceSource = referenceSource;
+
+  if (item == NULL) {
+    A1C_FileMapping_unmap(mapping);
+    return NULL;
+  }
+#if A1C_HAS_MMAP
+  // Items are accessed in any order from now on.
+  (void)posix_madvise(mapping->data, mapping->size, POSIX_MADV_NORMAL);
+#endif
+  return item;
+}
+
+void A1C_FileMapping_unmap(A1C_FileMapping *mapping) {
+#if A1C_HAS_MMAP
+  if (mapping->data != NULL) {
+    (void)munmap(mapping->data, mapping->size);
+  }
+#endif
+  memset(mapping, 0, sizeof(*mapping));
+}
+
+////////////////////////////////////////
+// Parallel Decoder
+////////////////////////////////////////
+
+/// Maximum number of tasks a container is split into.
+#define A1C_PARALLEL_MAX_TASKS 256
+
+/**
+ * Bump allocator over a chunk of memory reserved for a single task, so tasks
+ * never share an arena. It counts the requested bytes like A1C_LimitedArena,
+ * so the total matches A1C_Decoder_decode(). Allocations fail once the chunk
+ * runs out.
+ */
+typedef struct {
+  uint8_t *ptr;
+  uint8_t *end;
+  size_t allocatedBytes;
+} A1C_ParallelArena;
+
+static void *A1C_ParallelArena_calloc(void *opaque, size_t bytes) {
+  A1C_ParallelArena *arena = (A1C_ParallelArena *)opaque;
+  const size_t align = _Alignof(A1C_Item);
+  const size_t padding = (size_t)(-(uintptr_t)arena->ptr & (align - 1));
+  if (arena->ptr == NULL || (size_t)(arena->end - arena->ptr) < padding ||
+      (size_t)(arena->end - arena->ptr) - padding < bytes) {
+    return NULL;
+  }
+  uint8_t *result = arena->ptr + padding;
+  arena->ptr = result + bytes;
+  arena->allocatedBytes += bytes;
+  return result;
+}
+
+/// The first child of a range of children decoded by one task.
+typedef struct {
+  const uint8_t *ptr;
+  size_t index;
+} A1C_ParallelChunk;
+
+typedef struct {
+  A1C_ParallelChunk chunks[A1C_PARALLEL_MAX_TASKS];
+  size_t numChunks;
+  /// Number of children, or pairs for maps.
+  size_t size;
+  bool isMap;
+  bool indefinite;
+} A1C_ParallelSplit;
+
+/**
+ * Skips over the top-level array or map, validating it exactly like
+ * A1C_Decoder_decodeOneInto() would, and splits its children into at most
+ * @p maxChunks ranges of roughly equal count. Every `stride` children start a
+ * new range, and the stride doubles whenever the ranges run out.
+ */
+static bool A1C_NODISCARD A1C_Decoder_parallelSplit(A1C_Decoder *decoder,
+                                                    size_t maxChunks,
+                                                    A1C_ParallelSplit *split) {
+  assert(maxChunks >= 2 && maxChunks % 2 == 0);
+  assert(maxChunks <= A1C_PARALLEL_MAX_TASKS);
+  if (++decoder->depth > decoder->maxDepth) {
+    return A1C_Decoder_error(decoder, A1C_ErrorType_maxDepthExceeded);
+  }
+  A1C_ItemHeader header;
+  A1C_RET_IF_ERR(A1C_Decoder_read(decoder, &header, sizeof(header)));
+  assert(A1C_ItemHeader_isLegal(header));
+  split->isMap = A1C_ItemHeader_majorType(header) == A1C_MajorType_map;
+  const size_t itemsPerEntry = split->isMap ? 2 : 1;
+  size_t size;
+  A1C_RET_IF_ERR(A1C_Decoder_readSize(decoder, header, &size));
+  split->indefinite = A1C_ItemHeader_isIndefinite(header);
+  if (!split->indefinite && A1C_Decoder_remaining(decoder) < size) {
+    // Match the error reported by A1C_Decoder_decodeArray/Map().
+    return A1C_Decoder_error(decoder, A1C_ErrorType_truncated);
+  }
+
+  split->numChunks = 0;
+  size_t stride = 1;
+  size_t i;
+  for (i = 0; split->indefinite || i < size; ++i) {
+    if (split->indefinite) {
+      A1C_ItemHeader childHeader;
+      A1C_RET_IF_ERR(
+          A1C_Decoder_peek(decoder, &childHeader, sizeof(childHeader)));
+      if (A1C_ItemHeader_isBreak(childHeader)) {
+        A1C_RET_IF_ERR(A1C_Decoder_skip(decoder, sizeof(childHeader)));
+        break;
+      }
+    }
+    if (i % stride == 0) {
+      if (split->numChunks == maxChunks) {
+        for (size_t j = 0; j < maxChunks / 2; ++j) {
+          split->chunks[j] = split->chunks[2 * j];
+        }
+        split->numChunks = maxChunks / 2;
+        stride *= 2;
+      }
+      if (i % stride == 0) {
+        split->chunks[split->numChunks].ptr = decoder->ptr;
+        split->chunks[split->numChunks].index = i;
+        ++split->numChunks;
+      }
+    }
+    for (size_t j = 0; j < itemsPerEntry; ++j) {
+      A1C_RET_IF_ERR(A1C_Decoder_skipOne(decoder));
+    }
+  }
+  split->size = i;
+  --decoder->depth;
+
+  if (decoder->ptr < decoder->end) {
+    return A1C_Decoder_error(decoder, A1C_ErrorType_trailingData);
+  }
+  return true;
+}
+
+typedef struct {
+  A1C_ParallelArena arena;
+  /// The first child that the task didn't decode, and its encoding.
+  size_t next;
+  const uint8_t *nextPtr;
+} A1C_ParallelTask;
+
+typedef struct {
+  const A1C_Decoder *decoder;
+  const A1C_ParallelSplit *split;
+  A1C_Item *item;
+  /// The children of the item, only one is set.
+  A1C_Item *array;
+  A1C_Pair *map;
+  A1C_ParallelTask tasks[A1C_PARALLEL_MAX_TASKS];
+} A1C_ParallelDecode;
+
+/// @returns The index one past the last child decoded by task @p index.
+static size_t A1C_ParallelDecode_end(const A1C_ParallelDecode *ctx,
+                                     size_t index) {
+  const A1C_ParallelSplit *split = ctx->split;
+  return index + 1 < split->numChunks ? split->chunks[index + 1].index
+                                      : split->size;
+}
+
+/// Decodes the child (or pair) @p i of the top-level item with @p worker.
+static bool A1C_NODISCARD A1C_ParallelDecode_child(
+    const A1C_ParallelDecode *ctx, A1C_Decoder *worker, size_t i) {
+  if (ctx->map != NULL) {
+    return A1C_Decoder_decodeOneInto(worker, &ctx->map[i].key) &&
+           A1C_Decoder_decodeOneInto(worker, &ctx->map[i].value);
+  }
+  return A1C_Decoder_decodeOneInto(worker, &ctx->array[i]);
+}
+
+/**
+ * Decodes the range of children of task @p index using only the task's own
+ * arena. When the arena runs out the task stops, and the calling thread
+ * finishes the range from `next`.
+ */
+static void A1C_ParallelDecode_task(void *opaque, size_t index) {
+  A1C_ParallelDecode *ctx = (A1C_ParallelDecode *)opaque;
+  assert(index < ctx->split->numChunks);
+  A1C_ParallelTask *task = &ctx->tasks[index];
+  const size_t end = A1C_ParallelDecode_end(ctx, index);
+
+  A1C_Decoder worker = *ctx->decoder;
+  worker.arena.calloc = A1C_ParallelArena_calloc;
+  worker.arena.opaque = &task->arena;
+  worker.ptr = ctx->split->chunks[index].ptr;
+  worker.parent = ctx->item;
+  worker.depth = 1;
+
+  size_t i;
+  for (i = ctx->split->chunks[index].index; i < end; ++i) {
+    const uint8_t *ptr = worker.ptr;
+    const size_t allocatedBytes = task->arena.allocatedBytes;
+    if (!A1C_ParallelDecode_child(ctx, &worker, i)) {
+      // Forget the partially decoded child, it is decoded again.
+      task->nextPtr = ptr;
+      task->arena.allocatedBytes = allocatedBytes;
+      break;
+    }
+  }
+  task->next = i;
+}
+
+/**
+ * Reserves the arena of every task from the backing arena of @p decoder on the
+ * calling thread. Each task gets the decoder's worst case of sizeof(A1C_Item)
+ * per byte of its range, excluding the headers of the children, which live in
+ * the top-level item. With a memory limit the remaining budget is shared
+ * evenly between the tasks instead.
+ */
+static void A1C_ParallelDecode_reserve(A1C_ParallelDecode *ctx,
+                                       const uint8_t *end) {
+  const A1C_Decoder *decoder = ctx->decoder;
+  const A1C_ParallelSplit *split = ctx->split;
+  const A1C_LimitedArena *limitedArena = &decoder->limitedArena;
+  size_t share = SIZE_MAX;
+  if (limitedArena->limitBytes > 0) {
+    share = (limitedArena->limitBytes - limitedArena->allocatedBytes) /
+            split->numChunks;
+  }
+  const size_t itemsPerEntry = split->isMap ? 2 : 1;
+  for (size_t i = 0; i < split->numChunks; ++i) {
+    const uint8_t *rangeEnd =
+        i + 1 < split->numChunks ? split->chunks[i + 1].ptr : end;
+    const size_t rangeBytes = (size_t)(rangeEnd - split->chunks[i].ptr);
+    const size_t headers =
+        (A1C_ParallelDecode_end(ctx, i) - split->chunks[i].index) *
+        itemsPerEntry;
+    size_t bytes = 0;
+    if (rangeBytes > headers &&
+        A1C_overflowMul(rangeBytes - headers, sizeof(A1C_Item), &bytes)) {
+      bytes = SIZE_MAX;
+    }
+    if (bytes > share) {
+      bytes = share;
+    }
+    if (bytes == 0) {
+      continue;
+    }
+    uint8_t *chunk = (uint8_t *)limitedArena->backingArena.calloc(
+        limitedArena->backingArena.opaque, bytes);
+    if (chunk != NULL) {
+      ctx->tasks[i].arena.ptr = chunk;
+      ctx->tasks[i].arena.end = chunk + bytes;
+    }
+  }
+}
+
+/**
+ * @returns true if A1C_Decoder_decode() would decode the top-level item as a
+ * single packed array: `packArrays` is set, and it is a definite length array
+ * of elements that can be packed.
+ */
+static bool A1C_Decoder_isPackedRoot(const A1C_Decoder *decoder) {
+  if (!decoder->packArrays) {
+    return false;
+  }
+  A1C_Decoder probe = *decoder;
+  A1C_ItemHeader header;
+  if (!A1C_Decoder_read(&probe, &header, sizeof(header)) ||
+      A1C_ItemHeader_majorType(header) != A1C_MajorType_array ||
+      A1C_ItemHeader_isIndefinite(header)) {
+    return false;
+  }
+  size_t size;
+  if (!A1C_Decoder_readSize(&probe, header, &size) ||
+      A1C_Decoder_remaining(&probe) < size) {
+    return false;
+  }
+  // The elements of the top-level item are decoded at depth 1.
+  probe.depth = 1;
+  A1C_ElementType type;
+  return A1C_Decoder_scanPacked(&probe, size, &type) != NULL;
+}
+
+/// Decodes the top-level container in parallel.
+/// @returns NULL on any failure, without setting the error.
+static const A1C_Item *A1C_Decoder_decodeParallelImpl(
+    A1C_Decoder *decoder, const A1C_Executor *executor) {
+  if (A1C_Decoder_isPackedRoot(decoder)) {
+    // Packing is one allocation and a tight loop, so the serial decoder does
+    // it, which also gives the same packed item.
+    return NULL;
+  }
+  size_t maxChunks = A1C_PARALLEL_MAX_TASKS;
+  if (executor->concurrency < A1C_PARALLEL_MAX_TASKS / 4) {
+    // Over-split so uneven ranges still balance across the workers.
+    maxChunks = executor->concurrency * 4;
+  }
+  A1C_ParallelSplit split;
+  if (!A1C_Decoder_parallelSplit(decoder, maxChunks, &split)) {
+    return NULL;
+  }
+  if ((split.indefinite || decoder->skipParents) &&
+      decoder->limitedArena.limitBytes > 0) {
+    // A1C_Decoder_decode() uses extra memory for indefinite containers, and
+    // with `skipParents` one scratch stack for all of them instead of one per
+    // task, which could make the memory limit fail where this wouldn't.
+    return NULL;
+  }
+
+  A1C_ParallelDecode ctx;
+  memset(&ctx, 0, sizeof(ctx));
+  A1C_Item *item = A1C_Arena_calloc(&decoder->arena, 1, sizeof(A1C_Item));
+  if (item == NULL) {
+    return NULL;
+  }
+  if (split.isMap) {
+    ctx.map = A1C_Decoder_map(decoder, item, split.size);
+    if (ctx.map == NULL) {
+      return NULL;
+    }
+  } else {
+    ctx.array = A1C_Decoder_array(decoder, item, split.size);
+    if (ctx.array == NULL) {
+      return NULL;
+    }
+  }
+
+  ctx.decoder = decoder;
+  ctx.split = &split;
+  ctx.item = item;
+  A1C_ParallelDecode_reserve(&ctx, decoder->end);
+  executor->parallelFor(executor->opaque, split.numChunks,
+                        A1C_ParallelDecode_task, &ctx);
+
+  // Account for the tasks' allocations exactly like A1C_Decoder_decode().
+  A1C_LimitedArena *limitedArena = &decoder->limitedArena;
+  for (size_t i = 0; i < split.numChunks; ++i) {
+    size_t allocatedBytes;
+    if (A1C_overflowAdd(limitedArena->allocatedBytes,
+                        ctx.tasks[i].arena.allocatedBytes, &allocatedBytes) ||
+        (limitedArena->limitBytes > 0 &&
+         allocatedBytes > limitedArena->limitBytes)) {
+      return NULL;
+    }
+    limitedArena->allocatedBytes = allocatedBytes;
+  }
+  // Finish the ranges whose tasks ran out of memory with the decoder's arena.
+  for (size_t i = 0; i < split.numChunks; ++i) {
+    const size_t end = A1C_ParallelDecode_end(&ctx, i);
+    A1C_Decoder worker = *decoder;
+    worker.ptr = ctx.tasks[i].nextPtr;
+    worker.parent = item;
+    worker.depth = 1;
+    for (size_t j = ctx.tasks[i].next; j < end; ++j) {
+      if (ctx.map != NULL) {
+        memset(&ctx.map[j], 0, sizeof(ctx.map[j]));
+      } else {
+        memset(&ctx.array[j], 0, sizeof(ctx.array[j]));
+      }
+      if (!A1C_ParallelDecode_child(&ctx, &worker, j)) {
+        return NULL;
+      }
+    }
+  }
+  decoder->ptr = decoder->end;
+  return item;
+}
+
+
+const A1C_Item *A1C_Decoder_decodeParallel(A1C_Decoder *decoder,
+                                           const uint8_t *data, size_t size,
+                                           const A1C_Executor *executor) {
+  if (data != NULL && size > 0 && executor->parallelFor != NULL &&
+      executor->concurrency > 1) {
+    A1C_ItemHeader header;
+    memcpy(&header, data, sizeof(header));
+    const A1C_MajorType majorType = A1C_ItemHeader_majorType(header);
+    if (A1C_ItemHeader_isLegal(header) &&
+        (majorType == A1C_MajorType_array || majorType == A1C_MajorType_map)) {
+      A1C_Decoder_reset(decoder, data, size);
+      const A1C_Item *item = A1C_Decoder_decodeParallelImpl(decoder, executor);
+      if (item != NULL) {
+        return item;
+      }
+    }
+  }
+  // Serial decoding also reports the exact error upon failure.
+  return A1C_Decoder_decode(decoder, data, size);
+}
+
+////////////////////////////////////////
+// JSON Decoder
+////////////////////////////////////////
+
+// Recursive descent straight into A1C_Items. Strings dominate most JSON, so
+// they are scanned with SIMD for the few bytes that need attention, and UTF-8
+// is validated only where a non-ASCII byte is found.
+//
+// Container sizes aren't known up front, so children are parsed onto a
+// scratch stack in the arena, then copied into an exactly sized array when
+// the container closes. The children of a child move with it, so their
+// parents are fixed up as each array lands in its final place.
+
+typedef struct {
+  A1C_Decoder *decoder;
+  A1C_Item *stack;
+  size_t stackSize;
+  size_t stackCapacity;
+} A1C_JsonParser;
+
+static bool A1C_NODISCARD A1C_JsonParser_value(A1C_JsonParser *parser,
+                                               A1C_Item *item);
+
+static bool A1C_NODISCARD A1C_JsonParser_push(A1C_JsonParser *parser,
+                                              const A1C_Item *item) {
+  if (parser->stackSize == parser->stackCapacity) {
+    const size_t capacity =
+        parser->stackCapacity == 0 ? 64 : 2 * parser->stackCapacity;
+    A1C_Item *stack = A1C_Arena_calloc(&parser->decoder->arena, capacity,
+                                       sizeof(A1C_Item));
+    if (stack == NULL) {
+      return A1C_Decoder_error(parser->decoder, A1C_ErrorType_badAlloc);
+    }
+    if (parser->stackSize > 0) {
+      memcpy(stack, parser->stack, parser->stackSize * sizeof(A1C_Item));
+    }
+    parser->stack = stack;
+    parser->stackCapacity = capacity;
+  }
+  parser->stack[parser->stackSize++] = *item;
+  return true;
+}
+
+/// Points the children of @p item at it. The decoder owns the children, so it
+/// may write through the const pointers stored in the item.
+static void A1C_JsonParser_setParents(A1C_Item *item) {
+  if (item->type == A1C_ItemType_array) {
+    A1C_Item *items = (A1C_Item *)(uintptr_t)item->array.items;
+    for (size_t i = 0; i < item->array.size; ++i) {
+      items[i].parent = item;
+    }
+  } else if (item->type == A1C_ItemType_map) {
+    A1C_Pair *items = (A1C_Pair *)(uintptr_t)item->map.items;
+    for (size_t i = 0; i < item->map.size; ++i) {
+      items[i].key.parent = item;
+      items[i].value.parent = item;
+    }
+  }
+}
+
+/// Moves the items pushed since @p base into a new array owned by @p item,
+/// which becomes an array or, if @p isMap, a map of the pushed key value
+/// pairs.
+static bool A1C_NODISCARD A1C_JsonParser_pop(A1C_JsonParser *parser,
+                                             size_t base, A1C_Item *item,
+                                             bool isMap) {
+  A1C_Decoder *decoder = parser->decoder;
+  const size_t count = parser->stackSize - base;
+  A1C_Item *items = A1C_Arena_calloc(&decoder->arena, count, sizeof(A1C_Item));
+  if (items == NULL) {
+    return A1C_Decoder_error(decoder, A1C_ErrorType_badAlloc);
+  }
+  if (count > 0) {
+    memcpy(items, parser->stack + base, count * sizeof(A1C_Item));
+  }
+  parser->stackSize = base;
+  if (!decoder->skipParents) {
+    for (size_t i = 0; i < count; ++i) {
+      A1C_JsonParser_setParents(&items[i]);
+    }
+  }
+  if (isMap) {
+    assert(count % 2 == 0);
+    item->type = A1C_ItemType_map;
+    item->map.items = (const void *)items;
+    item->map.size = count / 2;
+  } else {
+    item->type = A1C_ItemType_array;
+    item->array.items = items;
+    item->array.size = count;
+  }
+  return true;
+}
+
+static void A1C_JsonParser_skipWhitespace(A1C_JsonParser *parser) {
+  A1C_Decoder *decoder = parser->decoder;
+  while (decoder->ptr < decoder->end) {
+    const uint8_t c = *decoder->ptr;
+    if (c != ' ' && c != '\n' && c != '\r' && c != '\t') {
+      break;
+    }
+    ++decoder->ptr;
+  }
+}
+
+/// Reports the byte at the current position as unexpected, or truncation if
+/// the input ended.
+static bool A1C_NODISCARD A1C_JsonParser_unexpected(A1C_JsonParser *parser) {
+  A1C_Decoder *decoder = parser->decoder;
+  if (decoder->ptr == decoder->end) {
+    return A1C_Decoder_error(decoder, A1C_ErrorType_truncated);
+  }
+  return A1C_Decoder_error(decoder, A1C_ErrorType_invalidJson);
+}
+
+static bool A1C_NODISCARD A1C_JsonParser_literal(A1C_JsonParser *parser,
+                                                 const char *literal) {
+  A1C_Decoder *decoder = parser->decoder;
+  const size_t size = strlen(literal);
+  const size_t remaining = A1C_Decoder_remaining(decoder);
+  const size_t toCompare = remaining < size ? remaining : size;
+  if (memcmp(decoder->ptr, literal, toCompare) != 0) {
+    return A1C_Decoder_error(decoder, A1C_ErrorType_invalidJson);
+  }
+  if (remaining < size) {
+    decoder->ptr = decoder->end;
+    return A1C_Decoder_error(decoder, A1C_ErrorType_truncated);
+  }
+  decoder->ptr += size;
+  return true;
+}
+
+static int A1C_hexValue(uint8_t c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  } else if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  } else if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+/// Parses the 4 hex digits of a `\u` escape at @p ptr.
+/// @returns false if there aren't 4 hex digits before @p end.
+static bool A1C_parseHex4(const uint8_t *ptr, const uint8_t *end,
+                          uint32_t *value) {
+  if (end - ptr < 4) {
+    return false;
+  }
+  *value = 0;
+  for (size_t i = 0; i < 4; ++i) {
+    const int digit = A1C_hexValue(ptr[i]);
+    if (digit < 0) {
+      return false;
+    }
+    *value = (*value << 4) | (uint32_t)digit;
+  }
+  return true;
+}
+
+/**
+ * Unescapes the string contents [src, srcEnd), which are known to hold no
+ * unescaped quotes or control characters, into @p dst. Escapes never expand,
+ * so @p dst needs at most `srcEnd - src` bytes.
+ */
+static bool A1C_NODISCARD A1C_JsonParser_unescape(A1C_JsonParser *parser,
+                                                  const uint8_t *src,
+                                                  const uint8_t *srcEnd,
+                                                  char *dst, size_t *size) {
+  A1C_Decoder *decoder = parser->decoder;
+  char *out = dst;
+  while (src < srcEnd) {
+    const uint8_t *escape = memchr(src, '\\', (size_t)(srcEnd - src));
+    const uint8_t *runEnd = escape == NULL ? srcEnd : escape;
+    memcpy(out, src, (size_t)(runEnd - src));
+    out += runEnd - src;
+    if (escape == NULL) {
+      break;
+    }
+    decoder->ptr = escape;
+    src = escape + 2;
+    switch (escape[1]) {
+    case '"':
+    case '\\':
+    case '/':
+      *out++ = (char)escape[1];
+      break;
+    case 'b':
+      *out++ = '\b';
+      break;
+    case 'f':
+      *out++ = '\f';
+      break;
+    case 'n':
+      *out++ = '\n';
+      break;
+    case 'r':
+      *out++ = '\r';
+      break;
+    case 't':
+      *out++ = '\t';
+      break;
+    case 'u': {
+      uint32_t codePoint;
+      if (!A1C_parseHex4(src, srcEnd, &codePoint)) {
+        return A1C_Decoder_error(decoder, A1C_ErrorType_invalidJson);
+      }
+      src += 4;
+      if (codePoint >= 0xDC00 && codePoint <= 0xDFFF) {
+        // Unpaired low surrogate
+        return A1C_Decoder_error(decoder, A1C_ErrorType_invalidJson);
+      }
+      if (codePoint >= 0xD800 && codePoint <= 0xDBFF) {
+        uint32_t low;
+        if (srcEnd - src < 2 || src[0] != '\\' || src[1] != 'u' ||
+            !A1C_parseHex4(src + 2, srcEnd, &low) || low < 0xDC00 ||
+            low > 0xDFFF) {
+          return A1C_Decoder_error(decoder, A1C_ErrorType_invalidJson);
+        }
+        src += 6;
+        codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+      }
+      out += A1C_utf8Encode(codePoint, out);
+      break;
+    }
+    default:
+      return A1C_Decoder_error(decoder, A1C_ErrorType_invalidJson);
+    }
+  }
+  *size = (size_t)(out - dst);
+  return true;
+}
+
+static bool A1C_NODISCARD A1C_JsonParser_string(A1C_JsonParser *parser,
+                                                A1C_Item *item) {
+  A1C_Decoder *decoder = parser->decoder;
+  assert(*decoder->ptr == '"');
+  const uint8_t *const start = decoder->ptr + 1;
+  const uint8_t *const end = decoder->end;
+  const uint8_t *ptr = start;
+  bool hasEscapes = false;
+  for (;;) {
+    ptr = A1C_scanJsonString(ptr, end, true);
+    if (ptr == end) {
+      decoder->ptr = end;
+      return A1C_Decoder_error(decoder, A1C_ErrorType_truncated);
+    }
+    const uint8_t c = *ptr;
+    if (c == '"') {
+      break;
+    } else if (c == '\\') {
+      // The escape itself is validated while unescaping.
+      if (end - ptr < 2) {
+        decoder->ptr = end;
+        return A1C_Decoder_error(decoder, A1C_ErrorType_truncated);
+      }
+      hasEscapes = true;
+      ptr += 2;
+    } else if (c < 0x20) {
+      decoder->ptr = ptr;
+      return A1C_Decoder_error(decoder, A1C_ErrorType_invalidJson);
+    } else {
+      const size_t size = A1C_utf8SequenceSize(ptr, end);
+      if (size == 0) {
+        decoder->ptr = ptr;
+        return A1C_Decoder_error(decoder, A1C_ErrorType_invalidUtf8);
+      }
+      ptr += size;
+    }
+  }
+
+  const size_t rawSize = (size_t)(ptr - start);
+  if (!hasEscapes && decoder->referenceSource) {
+    A1C_Item_string_ref(item, (const char *)start, rawSize);
+  } else {
+    char *data = A1C_Arena_calloc(&decoder->arena, rawSize, 1);
+    if (data == NULL) {
+      return A1C_Decoder_error(decoder, A1C_ErrorType_badAlloc);
+    }
+    size_t size = rawSize;
+    if (hasEscapes) {
+      A1C_RET_IF_ERR(A1C_JsonParser_unescape(parser, start, ptr, data, &size));
+    } else if (rawSize > 0) {
+      memcpy(data, start, rawSize);
+    }
+    A1C_Item_string_ref(item, data, size);
+  }
+  decoder->ptr = ptr + 1;
+  return true;
+}
+
+static bool A1C_isDigit(uint8_t c) { return c >= '0' && c <= '9'; }
+
+/// Exactly representable powers of ten for the fast float path.
+static const double A1C_kPowersOf10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+/**
+ * Arbitrary precision decimal, used to correctly round the floats the fast
+ * path can't handle, without depending on the locale like strtod() does. This
+ * is the simple decimal conversion from Go's strconv package: the decimal is
+ * shifted by powers of two until it is in [0.5, 1), then the mantissa bits are
+ * read off. It is slow, but rarely needed.
+ *
+ * 800 digits is more than the 767 significant digits a double can need to be
+ * rounded correctly, and dropped digits are remembered to break ties.
+ */
+#define A1C_BIG_DECIMAL_MAX_DIGITS 800
+/// Largest shift that can't overflow the 64-bit accumulator.
+#define A1C_BIG_DECIMAL_MAX_SHIFT 60
+
+typedef struct {
+  /// Digit values, without leading or trailing zeros. The extra room holds
+  /// the digits a left shift adds before they are truncated.
+  uint8_t digits[A1C_BIG_DECIMAL_MAX_DIGITS + 19];
+  int32_t numDigits;
+  /// The value is 0.digits * 10^decimalPoint.
+  int64_t decimalPoint;
+  /// Whether nonzero digits were dropped after the last digit.
+  bool truncated;
+} A1C_BigDecimal;
+
+static void A1C_BigDecimal_pushDigit(A1C_BigDecimal *decimal, uint8_t digit) {
+  if (decimal->numDigits < A1C_BIG_DECIMAL_MAX_DIGITS) {
+    decimal->digits[decimal->numDigits++] = digit;
+  } else {
+    decimal->truncated |= digit != 0;
+  }
+}
+
+static void A1C_BigDecimal_trim(A1C_BigDecimal *decimal) {
+  while (decimal->numDigits > 0 &&
+         decimal->digits[decimal->numDigits - 1] == 0) {
+    --decimal->numDigits;
+  }
+  if (decimal->numDigits == 0) {
+    decimal->decimalPoint = 0;
+  }
+}
+
+/// Parses [begin, end), a valid JSON number without its sign.
+static void A1C_BigDecimal_init(A1C_BigDecimal *decimal, const uint8_t *begin,
+                             const uint8_t *end) {
+  memset(decimal, 0, sizeof(*decimal));
+  const uint8_t *ptr = begin;
+  for (; ptr < end && A1C_isDigit(*ptr); ++ptr) {
+    // Leading zeros aren't significant.
+    if (decimal->numDigits > 0 || *ptr != '0') {
+      A1C_BigDecimal_pushDigit(decimal, (uint8_t)(*ptr - '0'));
+      ++decimal->decimalPoint;
+    }
+  }
+  if (ptr < end && *ptr == '.') {
+    for (++ptr; ptr < end && A1C_isDigit(*ptr); ++ptr) {
+      if (decimal->numDigits > 0 || *ptr != '0') {
+        A1C_BigDecimal_pushDigit(decimal, (uint8_t)(*ptr - '0'));
+      } else {
+        --decimal->decimalPoint;
+      }
+    }
+  }
+  if (ptr < end && (*ptr == 'e' || *ptr == 'E')) {
+    ++ptr;
+    const bool negative = *ptr == '-';
+    if (*ptr == '+' || *ptr == '-') {
+      ++ptr;
+    }
+    int64_t exponent = 0;
+    for (; ptr < end && A1C_isDigit(*ptr); ++ptr) {
+      // Saturate far outside the range of a double.
+      if (exponent < 100000) {
+        exponent = exponent * 10 + (*ptr - '0');
+      }
+    }
+    decimal->decimalPoint += negative ? -exponent : exponent;
+  }
+  A1C_BigDecimal_trim(decimal);
+}
+
+/// Divides @p decimal, which isn't zero, by 2^@p shift.
+static void A1C_BigDecimal_shiftRight(A1C_BigDecimal *decimal, unsigned shift) {
+  int32_t read = 0;
+  int32_t write = 0;
+  uint64_t n = 0;
+  // Read enough leading digits for the first output digit.
+  for (; (n >> shift) == 0; ++read) {
+    if (read >= decimal->numDigits) {
+      for (; (n >> shift) == 0; ++read) {
+        n *= 10;
+      }
+      break;
+    }
+    n = n * 10 + decimal->digits[read];
+  }
+  decimal->decimalPoint -= read - 1;
+
+  const uint64_t mask = ((uint64_t)1 << shift) - 1;
+  for (; read < decimal->numDigits; ++read) {
+    decimal->digits[write++] = (uint8_t)(n >> shift);
+    n = (n & mask) * 10 + decimal->digits[read];
+  }
+  decimal->numDigits = write;
+  while (n > 0) {
+    A1C_BigDecimal_pushDigit(decimal, (uint8_t)(n >> shift));
+    n = (n & mask) * 10;
+  }
+  A1C_BigDecimal_trim(decimal);
+}
+
+/// Multiplies @p decimal, which isn't zero, by 2^@p shift.
+static void A1C_BigDecimal_shiftLeft(A1C_BigDecimal *decimal, unsigned shift) {
+  // The product gains as many digits as 2^shift has, or one less.
+  // (shift * 1233) >> 12 is floor(shift * log10(2)) for shifts up to 60.
+  const int32_t maxNewDigits = (int32_t)((shift * 1233) >> 12) + 1;
+  int32_t read = decimal->numDigits;
+  int32_t write = decimal->numDigits + maxNewDigits;
+  uint64_t n = 0;
+  while (read > 0) {
+    n += (uint64_t)decimal->digits[--read] << shift;
+    const uint64_t quotient = n / 10;
+    decimal->digits[--write] = (uint8_t)(n - 10 * quotient);
+    n = quotient;
+  }
+  while (n > 0) {
+    const uint64_t quotient = n / 10;
+    decimal->digits[--write] = (uint8_t)(n - 10 * quotient);
+    n = quotient;
+  }
+  // The first digit is nonzero, so the product starts at write 0 or 1.
+  const int32_t newDigits = maxNewDigits - write;
+  int32_t numDigits = decimal->numDigits + newDigits;
+  if (write > 0) {
+    memmove(decimal->digits, decimal->digits + write, (size_t)numDigits);
+  }
+  for (; numDigits > A1C_BIG_DECIMAL_MAX_DIGITS; --numDigits) {
+    decimal->truncated |= decimal->digits[numDigits - 1] != 0;
+  }
+  decimal->numDigits = numDigits;
+  decimal->decimalPoint += newDigits;
+  A1C_BigDecimal_trim(decimal);
+}
+
+/// Multiplies @p decimal by 2^@p shift, which may be negative.
+static void A1C_BigDecimal_shift(A1C_BigDecimal *decimal, int32_t shift) {
+  if (decimal->numDigits == 0) {
+    return;
+  }
+  while (shift > A1C_BIG_DECIMAL_MAX_SHIFT) {
+    A1C_BigDecimal_shiftLeft(decimal, A1C_BIG_DECIMAL_MAX_SHIFT);
+    shift -= A1C_BIG_DECIMAL_MAX_SHIFT;
+  }
+  while (shift < -A1C_BIG_DECIMAL_MAX_SHIFT) {
+    A1C_BigDecimal_shiftRight(decimal, A1C_BIG_DECIMAL_MAX_SHIFT);
+    shift += A1C_BIG_DECIMAL_MAX_SHIFT;
+  }
+  if (shift > 0) {
+    A1C_BigDecimal_shiftLeft(decimal, (unsigned)shift);
+  } else if (shift < 0) {
+    A1C_BigDecimal_shiftRight(decimal, (unsigned)-shift);
+  }
+}
+
+/// @returns The integer part of @p decimal, which must be below 2^64,
+/// rounded to nearest with ties to even.
+static uint64_t A1C_BigDecimal_roundedInteger(const A1C_BigDecimal *decimal) {
+  const int32_t integerDigits = (int32_t)decimal->decimalPoint;
+  uint64_t n = 0;
+  for (int32_t i = 0; i < integerDigits; ++i) {
+    n = n * 10 + (i < decimal->numDigits ? decimal->digits[i] : 0);
+  }
+  if (integerDigits < 0 || integerDigits >= decimal->numDigits) {
+    return n;
+  }
+  const uint8_t next = decimal->digits[integerDigits];
+  if (next == 5 && integerDigits + 1 == decimal->numDigits &&
+      !decimal->truncated) {
+    // Exactly halfway.
+    return n + (n & 1);
+  }
+  return n + (next >= 5);
+}
+
+/// @returns The double nearest to @p decimal, with ties to even.
+static double A1C_BigDecimal_toDouble(A1C_BigDecimal *decimal, bool negative) {
+  // Binary shifts by decimal point that scale the decimal towards [0.5, 1).
+  static const int32_t kShifts[] = {1, 3, 6, 9, 13, 16, 19, 23, 26};
+  const int32_t kNumShifts = (int32_t)(sizeof(kShifts) / sizeof(kShifts[0]));
+  uint64_t bits = 0;
+  if (decimal->numDigits == 0 || decimal->decimalPoint < -330) {
+    // Zero, or far below the smallest subnormal.
+  } else if (decimal->decimalPoint > 310) {
+    bits = (uint64_t)0x7FF << 52;
+  } else {
+    // Scale into [0.5, 1) by powers of two.
+    int32_t exponent = 0;
+    while (decimal->decimalPoint > 0) {
+      const int32_t shift = decimal->decimalPoint < kNumShifts
+                                ? kShifts[decimal->decimalPoint]
+                                : 27;
+      A1C_BigDecimal_shift(decimal, -shift);
+      exponent += shift;
+    }
+    while (decimal->decimalPoint < 0 ||
+           (decimal->decimalPoint == 0 && decimal->digits[0] < 5)) {
+      const int32_t shift = -decimal->decimalPoint < kNumShifts
+                                ? kShifts[-decimal->decimalPoint]
+                                : 27;
+      A1C_BigDecimal_shift(decimal, shift);
+      exponent -= shift;
+    }
+    // The value is now in [1, 2) * 2^exponent.
+    --exponent;
+    if (exponent < -1022) {
+      // Subnormal: keep the exponent of the smallest normal.
+      A1C_BigDecimal_shift(decimal, exponent + 1022);
+      exponent = -1022;
+    }
+    A1C_BigDecimal_shift(decimal, 53);
+    uint64_t mantissa = A1C_BigDecimal_roundedInteger(decimal);
+    if (mantissa == (uint64_t)1 << 53) {
+      // Rounding carried into a new bit.
+      mantissa >>= 1;
+      ++exponent;
+    }
+    if (exponent > 1023) {
+      bits = (uint64_t)0x7FF << 52;
+    } else if ((mantissa >> 52) == 0) {
+      bits = mantissa;
+    } else {
+      bits = ((uint64_t)(exponent + 1023) << 52) |
+             (mantissa & (((uint64_t)1 << 52) - 1));
+    }
+  }
+  if (negative) {
+    bits |= (uint64_t)1 << 63;
+  }
+  double value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+static bool A1C_NODISCARD A1C_JsonParser_number(A1C_JsonParser *parser,
+                                                A1C_Item *item) {
+  A1C_Decoder *decoder = parser->decoder;
+  const uint8_t *const begin = decoder->ptr;
+  const uint8_t *const end = decoder->end;
+  const uint8_t *ptr = begin;
+
+  // Up to 19 significant digits are kept in the mantissa, the rest only
+  // shift the decimal exponent.
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int64_t exponent = 0;
+  bool inexact = false;
+  bool isInteger = true;
+
+  const bool negative = *ptr == '-';
+  if (negative) {
+    ++ptr;
+  }
+  if (ptr < end && *ptr == '0') {
+    ++ptr;
+  } else if (ptr < end && A1C_isDigit(*ptr)) {
+    for (; ptr < end && A1C_isDigit(*ptr); ++ptr) {
+      if (digits < 19) {
+        mantissa = mantissa * 10 + (uint64_t)(*ptr - '0');
+        ++digits;
+      } else {
+        ++exponent;
+        inexact |= *ptr != '0';
+      }
+    }
+  } else {
+    decoder->ptr = ptr;
+    return A1C_JsonParser_unexpected(parser);
+  }
+  if (ptr < end && *ptr == '.') {
+    isInteger = false;
+    ++ptr;
+    if (ptr == end || !A1C_isDigit(*ptr)) {
+      decoder->ptr = ptr;
+      return A1C_JsonParser_unexpected(parser);
+    }
+    for (; ptr < end && A1C_isDigit(*ptr); ++ptr) {
+      if (digits < 19) {
+        mantissa = mantissa * 10 + (uint64_t)(*ptr - '0');
+        // Leading zeros aren't significant.
+        digits += mantissa != 0;
+        --exponent;
+      } else {
+        inexact |= *ptr != '0';
+      }
+    }
+  }
+  if (ptr < end && (*ptr == 'e' || *ptr == 'E')) {
+    isInteger = false;
+    ++ptr;
+    bool negativeExponent = false;
+    if (ptr < end && (*ptr == '+' || *ptr == '-')) {
+      negativeExponent = *ptr == '-';
+      ++ptr;
+    }
+    if (ptr == end || !A1C_isDigit(*ptr)) {
+      decoder->ptr = ptr;
+      return A1C_JsonParser_unexpected(parser);
+    }
+    int64_t explicitExponent = 0;
+    for (; ptr < end && A1C_isDigit(*ptr); ++ptr) {
+      // Saturate far outside the range of a double.
+      if (explicitExponent < 100000) {
+        explicitExponent = explicitExponent * 10 + (*ptr - '0');
+      }
+    }
+    exponent += negativeExponent ? -explicitExponent : explicitExponent;
+  }
+  decoder->ptr = ptr;
+
+  if (isInteger && !inexact && exponent == 0) {
+    if (!negative && mantissa <= (uint64_t)INT64_MAX) {
+      A1C_Item_int64(item, (A1C_Int64)mantissa);
+      return true;
+    }
+    if (negative && mantissa <= (uint64_t)INT64_MAX + 1) {
+      A1C_Item_int64(item, (A1C_Int64)(0 - mantissa));
+      return true;
+    }
+  }
+
+  double value = 0.0;
+  if (!inexact && mantissa <= ((uint64_t)1 << 53) && exponent >= -22 &&
+      exponent <= 22) {
+    // Both operands are exact, so the result is correctly rounded.
+    value = (double)mantissa;
+    if (exponent < 0) {
+      value /= A1C_kPowersOf10[-exponent];
+    } else {
+      value *= A1C_kPowersOf10[exponent];
+    }
+    if (negative) {
+      value = -value;
+    }
+  } else {
+    A1C_BigDecimal decimal;
+    A1C_BigDecimal_init(&decimal, begin + negative, ptr);
+    value = A1C_BigDecimal_toDouble(&decimal, negative);
+  }
+  A1C_Item_float64(item, value);
+  return true;
+}
+
+static bool A1C_NODISCARD A1C_JsonParser_array(A1C_JsonParser *parser,
+                                               A1C_Item *item) {
+  A1C_Decoder *decoder = parser->decoder;
+  assert(*decoder->ptr == '[');
+  ++decoder->ptr;
+  const size_t base = parser->stackSize;
+  A1C_JsonParser_skipWhitespace(parser);
+  if (decoder->ptr < decoder->end && *decoder->ptr == ']') {
+    ++decoder->ptr;
+    return A1C_JsonParser_pop(parser, base, item, false);
+  }
+  for (;;) {
+    A1C_Item child;
+    memset(&child, 0, sizeof(child));
+    A1C_RET_IF_ERR(A1C_JsonParser_value(parser, &child));
+    A1C_RET_IF_ERR(A1C_JsonParser_push(parser, &child));
+    A1C_JsonParser_skipWhitespace(parser);
+    if (decoder->ptr < decoder->end && *decoder->ptr == ']') {
+      ++decoder->ptr;
+      break;
+    }
+    if (decoder->ptr == decoder->end || *decoder->ptr != ',') {
+      return A1C_JsonParser_unexpected(parser);
+    }
+    ++decoder->ptr;
+    A1C_JsonParser_skipWhitespace(parser);
+  }
+  return A1C_JsonParser_pop(parser, base, item, false);
+}
+
+static bool A1C_NODISCARD A1C_JsonParser_object(A1C_JsonParser *parser,
+                                                A1C_Item *item) {
+  A1C_Decoder *decoder = parser->decoder;
+  assert(*decoder->ptr == '{');
+  ++decoder->ptr;
+  const size_t base = parser->stackSize;
+  A1C_JsonParser_skipWhitespace(parser);
+  if (decoder->ptr < decoder->end && *decoder->ptr == '}') {
+    ++decoder->ptr;
+    return A1C_JsonParser_pop(parser, base, item, true);
+  }
+  for (;;) {
+    if (decoder->ptr == decoder->end || *decoder->ptr != '"') {
+      return A1C_JsonParser_unexpected(parser);
+    }
+    A1C_Item child;
+    memset(&child, 0, sizeof(child));
+    A1C_RET_IF_ERR(A1C_JsonParser_string(parser, &child));
+    A1C_RET_IF_ERR(A1C_JsonParser_push(parser, &child));
+    A1C_JsonParser_skipWhitespace(parser);
+    if (decoder->ptr == decoder->end || *decoder->ptr != ':') {
+      return A1C_JsonParser_unexpected(parser);
+    }
+    ++decoder->ptr;
+    A1C_JsonParser_skipWhitespace(parser);
+    memset(&child, 0, sizeof(child));
+    A1C_RET_IF_ERR(A1C_JsonParser_value(parser, &child));
+    A1C_RET_IF_ERR(A1C_JsonParser_push(parser, &child));
+    A1C_JsonParser_skipWhitespace(parser);
+    if (decoder->ptr < decoder->end && *decoder->ptr == '}') {
+      ++decoder->ptr;
+      break;
+    }
+    if (decoder->ptr == decoder->end || *decoder->ptr != ',') {
+      return A1C_JsonParser_unexpected(parser);
+    }
+    ++decoder->ptr;
+    A1C_JsonParser_skipWhitespace(parser);
+  }
+  return A1C_JsonParser_pop(parser, base, item, true);
+}
+
+/// Parses the value at the current position, which must not be whitespace,
+/// into @p item.
+static bool A1C_NODISCARD A1C_JsonParser_value(A1C_JsonParser *parser,
+                                               A1C_Item *item) {
+  A1C_Decoder *decoder = parser->decoder;
+  if (++decoder->depth > decoder->maxDepth) {
+    return A1C_Decoder_error(decoder, A1C_ErrorType_maxDepthExceeded);
+  }
+  if (decoder->ptr == decoder->end) {
+    return A1C_Decoder_error(decoder, A1C_ErrorType_truncated);
+  }
+  switch (*decoder->ptr) {
+  case '{':
+    A1C_RET_IF_ERR(A1C_JsonParser_object(parser, item));
+    break;
+  case '[':
+    A1C_RET_IF_ERR(A1C_JsonParser_array(parser, item));
+    break;
+  case '"':
+    A1C_RET_IF_ERR(A1C_JsonParser_string(parser, item));
+    break;
+  case 't':
+    A1C_RET_IF_ERR(A1C_JsonParser_literal(parser, "true"));
+    A1C_Item_boolean(item, true);
+    break;
+  case 'f':
+    A1C_RET_IF_ERR(A1C_JsonParser_literal(parser, "false"));
+    A1C_Item_boolean(item, false);
+    break;
+  case 'n':
+    A1C_RET_IF_ERR(A1C_JsonParser_literal(parser, "null"));
+    A1C_Item_null(item);
+    break;
+  default:
+    if (*decoder->ptr != '-' && !A1C_isDigit(*decoder->ptr)) {
+      return A1C_Decoder_error(decoder, A1C_ErrorType_invalidJson);
+    }
+    A1C_RET_IF_ERR(A1C_JsonParser_number(parser, item));
+    break;
+  }
+  --decoder->depth;
+  return true;
+}
+
+static bool A1C_NODISCARD A1C_JsonParser_root(A1C_JsonParser *parser,
+                                              A1C_Item **root) {
+  A1C_Decoder *decoder = parser->decoder;
+  *root = A1C_Item_root(&decoder->arena);
+  if (*root == NULL) {
+    return A1C_Decoder_error(decoder, A1C_ErrorType_badAlloc);
+  }
+  A1C_JsonParser_skipWhitespace(parser);
+  A1C_RET_IF_ERR(A1C_JsonParser_value(parser, *root));
+  if (!decoder->skipParents) {
+    A1C_JsonParser_setParents(*root);
+  }
+  A1C_JsonParser_skipWhitespace(parser);
+  if (decoder->ptr < decoder->end) {
+    return A1C_Decoder_error(decoder, A1C_ErrorType_trailingData);
+  }
+  return true;
+}
+
+const A1C_Item *A1C_Decoder_decodeJson(A1C_Decoder *decoder,
+                                       const uint8_t *data, size_t size) {
+  A1C_Decoder_reset(decoder, data, size);
+  if (data == NULL) {
+    decoder->error.type = A1C_ErrorType_truncated;
+    decoder->error.srcPos = 0;
+    return NULL;
+  }
+  A1C_JsonParser parser = {
+      .decoder = decoder,
+      .stack = NULL,
+      .stackSize = 0,
+      .stackCapacity = 0,
+  };
+  A1C_Item *root;
+  if (!A1C_JsonParser_root(&parser, &root)) {
+    return NULL;
+  }
+  return root;
+}
+
+////////////////////////////////////////
+// Extract
+////////////////////////////////////////
+
+/// @returns True if the item with @p header can be decoded without allocating.
+static bool A1C_ItemHeader_isScalar(A1C_ItemHeader header) {
+  switch (A1C_ItemHeader_majorType(header)) {
+  case A1C_MajorType_uint:
+  case A1C_MajorType_int:
+  case A1C_MajorType_special:
+    return true;
+  case A1C_MajorType_bytes:
+  case A1C_MajorType_string:
+    return !A1C_ItemHeader_isIndefinite(header);
+  case A1C_MajorType_array:
+  case A1C_MajorType_map:
+  case A1C_MajorType_tag:
+    return false;
+  }
+  return false;
+}
+
+/// Consumes the next map key and sets @p match if it is equal to @p key.
+static bool A1C_NODISCARD A1C_Decoder_extractKey(A1C_Decoder *decoder,
+                                                 const A1C_Item *key,
+                                                 bool *match) {
+  A1C_ItemHeader header;
+  A1C_RET_IF_ERR(A1C_Decoder_peek(decoder, &header, sizeof(header)));
+  if (!A1C_ItemHeader_isLegal(header) || !A1C_ItemHeader_isScalar(header)) {
+    *match = false;
+    return A1C_Decoder_skipOne(decoder);
+  }
+  A1C_Item scratch;
+  memset(&scratch, 0, sizeof(scratch));
+  A1C_RET_IF_ERR(A1C_Decoder_decodeOneInto(decoder, &scratch));
+  *match = A1C_Item_eq(&scratch, key);
+  return true;
+}
+
+/**
+ * Moves the decoder from the start of the current item to the start of its
+ * child selected by @p key. Sets @p found to false if there is no such child.
+ */
+static bool A1C_NODISCARD A1C_Decoder_extractChild(A1C_Decoder *decoder,
+                                                   const A1C_Item *key,
+                                                   bool *found) {
+  *found = false;
+  A1C_ItemHeader header;
+  memset(&header, 0, sizeof(header));
+  for (;;) {
+    if (++decoder->depth > decoder->maxDepth) {
+      return A1C_Decoder_error(decoder, A1C_ErrorType_maxDepthExceeded);
+    }
+    A1C_RET_IF_ERR(A1C_Decoder_read(decoder, &header, sizeof(header)));
+    if (!A1C_ItemHeader_isLegal(header)) {
+      return A1C_Decoder_error(decoder, A1C_ErrorType_invalidItemHeader);
+    }
+    if (A1C_ItemHeader_majorType(header) != A1C_MajorType_tag) {
+      break;
+    }
+    uint64_t tag;
+    A1C_RET_IF_ERR(A1C_Decoder_readCount(decoder, header, &tag));
+  }
+
+  const A1C_MajorType majorType = A1C_ItemHeader_majorType(header);
+  if (majorType != A1C_MajorType_array && majorType != A1C_MajorType_map) {
+    return true;
+  }
+  size_t size;
+  A1C_RET_IF_ERR(A1C_Decoder_readSize(decoder, header, &size));
+  const bool indefinite = A1C_ItemHeader_isIndefinite(header);
+
+  if (majorType == A1C_MajorType_array) {
+    if (key->type != A1C_ItemType_int64 || key->int64 < 0) {
+      return true;
+    }
+    const uint64_t index = (uint64_t)key->int64;
+    for (uint64_t i = 0; indefinite || i < size; ++i) {
+      if (indefinite) {
+        A1C_ItemHeader childHeader;
+        A1C_RET_IF_ERR(
+            A1C_Decoder_peek(decoder, &childHeader, sizeof(childHeader)));
+        if (A1C_ItemHeader_isBreak(childHeader)) {
+          return true;
+        }
+      }
+      if (i == index) {
+        *found = true;
+        return true;
+      }
+      A1C_RET_IF_ERR(A1C_Decoder_skipOne(decoder));
+    }
+    return true;
+  }
+
+  for (size_t i = 0; indefinite || i < size; ++i) {
+    if (indefinite) {
+      A1C_ItemHeader keyHeader;
+      A1C_RET_IF_ERR(A1C_Decoder_peek(decoder, &keyHeader, sizeof(keyHeader)));
+      if (A1C_ItemHeader_isBreak(keyHeader)) {
+        return true;
+      }
+    }
+    bool match;
+    A1C_RET_IF_ERR(A1C_Decoder_extractKey(decoder, key, &match));
+    if (match) {
+      *found = true;
+      return true;
+    }
+    A1C_RET_IF_ERR(A1C_Decoder_skipOne(decoder));
+  }
+  return true;
+}
+
+bool A1C_Extract(const uint8_t *data, size_t size, const A1C_Array *path,
+                 A1C_Extraction *out) {
+  memset(out, 0, sizeof(*out));
+
+  A1C_Decoder decoder;
+  A1C_Arena nullArena = {.calloc = A1C_nullCalloc, .opaque = NULL};
+  A1C_DecoderConfig config = {.referenceSource = true};
+  A1C_Decoder_init(&decoder, nullArena, config);
+  A1C_Decoder_reset(&decoder, data, size);
+  if (data == NULL) {
+    out->error.type = A1C_ErrorType_truncated;
+    return false;
+  }
+
+  bool found = true;
+  for (size_t i = 0; i < path->size && found; ++i) {
+    if (!A1C_Decoder_extractChild(&decoder, &path->items[i], &found)) {
+      out->error = decoder.error;
+      return false;
+    }
+  }
+  if (!found) {
+    return false;
+  }
+
+  const uint8_t *const start = decoder.ptr;
+  A1C_ItemHeader header;
+  if (!A1C_Decoder_peek(&decoder, &header, sizeof(header)) ||
+      !A1C_Decoder_skipOne(&decoder)) {
+    out->error = decoder.error;
+    return false;
+  }
+  out->encoded.data = start;
+  out->encoded.size = (size_t)(decoder.ptr - start);
+  if (A1C_ItemHeader_isScalar(header)) {
+    decoder.ptr = start;
+    if (!A1C_Decoder_decodeOneInto(&decoder, &out->item)) {
+      out->error = decoder.error;
+      return false;
+    }
+    out->decoded = true;
+  }
+  return true;
+}
+
+////////////////////////////////////////
+// Tape
+////////////////////////////////////////
+
+// Each entry holds the item type in the top byte and a 56-bit payload.
+//
+// | Type                  | Payload             | Second entry     |
+// |-----------------------|---------------------|------------------|
+// | int64                 | 0                   | value            |
+// | float64               | 0                   | bits             |
+// | float16, float32      | bits                |                  |
+// | boolean, simple       | value               |                  |
+// | null, undefined       | 0                   |                  |
+// | bytes, string         | offset in data      | size             |
+// | array, map            | index past the end  | number of items  |
+// | tag                   | index past the end  | tag number       |
+//
+// Most items fit in a single entry instead, marked by the top bit of the type
+// byte. Integers store their 56-bit two's complement value in the payload.
+// The other items store their offset or index in the low 40 bits, and their
+// size, number of items or tag number in the high 16 bits. Indefinite length
+// items take two entries, because their size isn't known up front.
+#define A1C_TAPE_TYPE_SHIFT 56
+#define A1C_TAPE_TYPE_MASK 0x7f
+#define A1C_TAPE_PAYLOAD_MASK ((((uint64_t)1) << A1C_TAPE_TYPE_SHIFT) - 1)
+#define A1C_TAPE_INLINE (((uint64_t)1) << 63)
+#define A1C_TAPE_INDEX_BITS 40
+#define A1C_TAPE_INDEX_MASK ((((uint64_t)1) << A1C_TAPE_INDEX_BITS) - 1)
+#define A1C_TAPE_INLINE_MAX                                                    \
+  ((((uint64_t)1) << (A1C_TAPE_TYPE_SHIFT - A1C_TAPE_INDEX_BITS)) - 1)
+#define A1C_TAPE_INT_SIGN (((uint64_t)1) << (A1C_TAPE_TYPE_SHIFT - 1))
+
+static uint64_t A1C_Tape_entry(A1C_ItemType type, uint64_t payload) {
+  assert(payload <= A1C_TAPE_PAYLOAD_MASK);
+  return ((uint64_t)type << A1C_TAPE_TYPE_SHIFT) | payload;
+}
+
+/// @returns The single entry of an item with an offset or index @p index, and
+/// a size, number of items or tag number @p value.
+static uint64_t A1C_Tape_inlineEntry(A1C_ItemType type, uint64_t index,
+                                     uint64_t value) {
+  assert(index <= A1C_TAPE_INDEX_MASK);
+  assert(value <= A1C_TAPE_INLINE_MAX);
+  return A1C_TAPE_INLINE |
+         A1C_Tape_entry(type, (value << A1C_TAPE_INDEX_BITS) | index);
+}
+
+/// Builds a tape in two passes. The first pass has NULL `entries` and `data`
+/// and only counts, and the second pass fills in the exactly sized buffers.
+typedef struct {
+  uint64_t *entries;
+  size_t numEntries;
+  uint8_t *data;
+  size_t dataSize;
+  /// Every index and offset fits in A1C_TAPE_INDEX_BITS, so items may be
+  /// stored in a single entry.
+  bool compact;
+} A1C_TapeBuilder;
+
+/// @returns true if an item whose size, number of items or tag number is
+/// @p value is stored in a single entry.
+static bool A1C_TapeBuilder_fitsInline(const A1C_TapeBuilder *builder,
+                                       uint64_t value) {
+  return builder->compact && value <= A1C_TAPE_INLINE_MAX;
+}
+
+static void A1C_TapeBuilder_push(A1C_TapeBuilder *builder, uint64_t entry) {
+  if (builder->entries != NULL) {
+    builder->entries[builder->numEntries] = entry;
+  }
+  ++builder->numEntries;
+}
+
+static void A1C_TapeBuilder_set(A1C_TapeBuilder *builder, size_t index,
+                                uint64_t entry) {
+  if (builder->entries != NULL) {
+    assert(index < builder->numEntries);
+    builder->entries[index] = entry;
+  }
+}
+
+static void A1C_TapeBuilder_append(A1C_TapeBuilder *builder,
+                                   const A1C_Item *chunk) {
+  const uint8_t *data = chunk->type == A1C_ItemType_bytes
+                            ? chunk->bytes.data
+                            : (const uint8_t *)chunk->string.data;
+  const size_t size = chunk->type == A1C_ItemType_bytes ? chunk->bytes.size
+                                                        : chunk->string.size;
+  if (builder->data != NULL && size > 0) {
+    memcpy(builder->data + builder->dataSize, data, size);
+  }
+  builder->dataSize += size;
+}
+
+static bool A1C_NODISCARD A1C_Decoder_tapeOne(A1C_Decoder *decoder,
+                                              A1C_TapeBuilder *builder);
+
+static bool A1C_NODISCARD A1C_Decoder_tapeData(A1C_Decoder *decoder,
+                                               A1C_ItemHeader header,
+                                               A1C_TapeBuilder *builder) {
+  const A1C_MajorType majorType = A1C_ItemHeader_majorType(header);
+  const A1C_ItemType type = majorType == A1C_MajorType_bytes
+                                ? A1C_ItemType_bytes
+                                : A1C_ItemType_string;
+  const size_t offset = builder->dataSize;
+
+  A1C_Item chunk;
+  if (!A1C_ItemHeader_isIndefinite(header)) {
+    A1C_RET_IF_ERR(
+        A1C_Decoder_decodeDataDefinite(decoder, header, &chunk, true));
+    A1C_TapeBuilder_append(builder, &chunk);
+  } else {
+    for (;;) {
+      A1C_ItemHeader childHeader;
+      A1C_RET_IF_ERR(
+          A1C_Decoder_read(decoder, &childHeader, sizeof(childHeader)));
+      if (!A1C_ItemHeader_isLegal(childHeader)) {
+        return A1C_Decoder_error(decoder, A1C_ErrorType_invalidItemHeader);
+      }
+      if (A1C_ItemHeader_isBreak(childHeader)) {
+        break;
+      }
+      if (A1C_ItemHeader_majorType(childHeader) != majorType ||
+          A1C_ItemHeader_isIndefinite(childHeader)) {
+        return A1C_Decoder_error(decoder, A1C_ErrorType_invalidChunkedString);
+      }
+      A1C_RET_IF_ERR(
+          A1C_Decoder_decodeDataDefinite(decoder, childHeader, &chunk, true));
+      A1C_TapeBuilder_append(builder, &chunk);
+    }
+  }
+  // The data lives in its own buffer, so the entries are pushed afterwards.
+  const size_t size = builder->dataSize - offset;
+  if (!A1C_ItemHeader_isIndefinite(header) &&
+      A1C_TapeBuilder_fitsInline(builder, size)) {
+    A1C_TapeBuilder_push(builder, A1C_Tape_inlineEntry(type, offset, size));
+  } else {
+    A1C_TapeBuilder_push(builder, A1C_Tape_entry(type, offset));
+    A1C_TapeBuilder_push(builder, size);
+  }
+  return true;
+}
+
+static bool A1C_NODISCARD A1C_Decoder_tapeContainer(A1C_Decoder *decoder,
+                                                    A1C_ItemHeader header,
+                                                    A1C_TapeBuilder *builder) {
+  const A1C_ItemType type =
+      A1C_ItemHeader_majorType(header) == A1C_MajorType_map
+          ? A1C_ItemType_map
+          : A1C_ItemType_array;
+  const size_t itemsPerEntry = type == A1C_ItemType_map ? 2 : 1;
+  size_t size;
+  A1C_RET_IF_ERR(A1C_Decoder_readSize(decoder, header, &size));
+
+  const size_t index = builder->numEntries;
+  const bool isInline = !A1C_ItemHeader_isIndefinite(header) &&
+                        A1C_TapeBuilder_fitsInline(builder, size);
+  A1C_TapeBuilder_push(builder, 0);
+  if (!isInline) {
+    A1C_TapeBuilder_push(builder, 0);
+  }
+  if (A1C_ItemHeader_isIndefinite(header)) {
+    size = 0;
+    for (;;) {
+      A1C_ItemHeader childHeader;
+      A1C_RET_IF_ERR(
+          A1C_Decoder_peek(decoder, &childHeader, sizeof(childHeader)));
+      if (A1C_ItemHeader_isBreak(childHeader)) {
+        A1C_RET_IF_ERR(A1C_Decoder_skip(decoder, sizeof(childHeader)));
+        break;
+      }
+      for (size_t j = 0; j < itemsPerEntry; ++j) {
+        A1C_RET_IF_ERR(A1C_Decoder_tapeOne(decoder, builder));
+      }
+      ++size;
+    }
+  } else {
+    if (A1C_Decoder_remaining(decoder) < size) {
+      // Match the error reported by A1C_Decoder_decodeArray/Map().
+      return A1C_Decoder_error(decoder, A1C_ErrorType_truncated);
+    }
+    for (size_t i = 0; i < size; ++i) {
+      for (size_t j = 0; j < itemsPerEntry; ++j) {
+        A1C_RET_IF_ERR(A1C_Decoder_tapeOne(decoder, builder));
+      }
+    }
+  }
+  if (isInline) {
+    A1C_TapeBuilder_set(builder, index,
+                        A1C_Tape_inlineEntry(type, builder->numEntries, size));
+  } else {
+    A1C_TapeBuilder_set(builder, index,
+                        A1C_Tape_entry(type, builder->numEntries));
+    A1C_TapeBuilder_set(builder, index + 1, size);
+  }
+  return true;
+}
+
+static bool A1C_NODISCARD A1C_Decoder_tapeSpecial(A1C_Decoder *decoder,
+                                                  A1C_ItemHeader header,
+                                                  A1C_TapeBuilder *builder) {
+  A1C_Item item;
+  A1C_RET_IF_ERR(A1C_Decoder_decodeSpecial(decoder, header, &item));
+  switch (item.type) {
+  case A1C_ItemType_boolean:
+    A1C_TapeBuilder_push(builder, A1C_Tape_entry(item.type, item.boolean));
+    break;
+  case A1C_ItemType_simple:
+    A1C_TapeBuilder_push(builder, A1C_Tape_entry(item.type, item.simple));
+    break;
+  case A1C_ItemType_float16:
+    A1C_TapeBuilder_push(builder, A1C_Tape_entry(item.type, item.float16));
+    break;
+  case A1C_ItemType_float32: {
+    uint32_t bits;
+    memcpy(&bits, &item.float32, sizeof(bits));
+    A1C_TapeBuilder_push(builder, A1C_Tape_entry(item.type, bits));
+    break;
+  }
+  case A1C_ItemType_float64: {
+    uint64_t bits;
+    memcpy(&bits, &item.float64, sizeof(bits));
+    A1C_TapeBuilder_push(builder, A1C_Tape_entry(item.type, 0));
+    A1C_TapeBuilder_push(builder, bits);
+    break;
+  }
+  case A1C_ItemType_null:
+  case A1C_ItemType_undefined:
+    A1C_TapeBuilder_push(builder, A1C_Tape_entry(item.type, 0));
+    break;
+  case A1C_ItemType_int64:
+  case A1C_ItemType_bytes:
+  case A1C_ItemType_string:
+  case A1C_ItemType_array:
+  case A1C_ItemType_map:
+  case A1C_ItemType_tag:
+  case A1C_ItemType_packedArray:
+    assert(false);
+    break;
+  }
+  return true;
+}
+
+static bool A1C_NODISCARD A1C_Decoder_tapeOne(A1C_Decoder *decoder,
+                                              A1C_TapeBuilder *builder) {
+  if (++decoder->depth > decoder->maxDepth) {
+    return A1C_Decoder_error(decoder, A1C_ErrorType_maxDepthExceeded);
+  }
+
+  A1C_ItemHeader header;
+  memset(&header, 0, sizeof(header));
+  A1C_RET_IF_ERR(A1C_Decoder_read(decoder, &header, sizeof(header)));
+
+  if (!A1C_ItemHeader_isLegal(header)) {
+    return A1C_Decoder_error(decoder, A1C_ErrorType_invalidItemHeader);
+  }
+
+  A1C_Item scratch;
+  switch (A1C_ItemHeader_majorType(header)) {
+  case A1C_MajorType_uint:
+  case A1C_MajorType_int:
+    // Keeps gcc from assuming the value may be read uninitialized.
+    memset(&scratch, 0, sizeof(scratch));
+    if (A1C_ItemHeader_majorType(header) == A1C_MajorType_uint) {
+      A1C_RET_IF_ERR(A1C_Decoder_decodeUInt(decoder, header, &scratch));
+    } else {
+      A1C_RET_IF_ERR(A1C_Decoder_decodeInt(decoder, header, &scratch));
+    }
+    if (scratch.int64 >= -(int64_t)A1C_TAPE_INT_SIGN &&
+        scratch.int64 < (int64_t)A1C_TAPE_INT_SIGN) {
+      const uint64_t payload = (uint64_t)scratch.int64 & A1C_TAPE_PAYLOAD_MASK;
+      const uint64_t entry = A1C_Tape_entry(A1C_ItemType_int64, payload);
+      A1C_TapeBuilder_push(builder, A1C_TAPE_INLINE | entry);
+    } else {
+      A1C_TapeBuilder_push(builder, A1C_Tape_entry(A1C_ItemType_int64, 0));
+      A1C_TapeBuilder_push(builder, (uint64_t)scratch.int64);
+    }
+    break;
+  case A1C_MajorType_bytes:
+  case A1C_MajorType_string:
+    A1C_RET_IF_ERR(A1C_Decoder_tapeData(decoder, header, builder));
+    break;
+  case A1C_MajorType_array:
+  case A1C_MajorType_map:
+    A1C_RET_IF_ERR(A1C_Decoder_tapeContainer(decoder, header, builder));
+    break;
+  case A1C_MajorType_tag: {
+    uint64_t value;
+    A1C_RET_IF_ERR(A1C_Decoder_readCount(decoder, header, &value));
+    const size_t index = builder->numEntries;
+    const bool isInline = A1C_TapeBuilder_fitsInline(builder, value);
+    A1C_TapeBuilder_push(builder, 0);
+    if (!isInline) {
+      A1C_TapeBuilder_push(builder, value);
+    }
+    A1C_RET_IF_ERR(A1C_Decoder_tapeOne(decoder, builder));
+    if (isInline) {
+      A1C_TapeBuilder_set(builder, index,
+                          A1C_Tape_inlineEntry(A1C_ItemType_tag,
+                                               builder->numEntries, value));
+    } else {
+      A1C_TapeBuilder_set(
+          builder, index,
+          A1C_Tape_entry(A1C_ItemType_tag, builder->numEntries));
+    }
+    break;
+  }
+  case A1C_MajorType_special:
+    A1C_RET_IF_ERR(A1C_Decoder_tapeSpecial(decoder, header, builder));
+    break;
+  }
+  --decoder->depth;
+  return true;
+}
+
+/// Builds the tape for the input the decoder was reset to, and sets @p out.
+static bool A1C_NODISCARD A1C_Decoder_buildTape(A1C_Decoder *decoder,
+                                                const A1C_Tape **out) {
+  // First pass: validate and count the entries and data bytes.
+  A1C_TapeBuilder builder;
+  memset(&builder, 0, sizeof(builder));
+  // Every item takes at least one byte and at most two entries, and the data
+  // is no larger than the input.
+  builder.compact = (uint64_t)A1C_Decoder_remaining(decoder) <
+                    (((uint64_t)1) << (A1C_TAPE_INDEX_BITS - 1));
+  A1C_RET_IF_ERR(A1C_Decoder_tapeOne(decoder, &builder));
+  if (decoder->ptr < decoder->end) {
+    return A1C_Decoder_error(decoder, A1C_ErrorType_trailingData);
+  }
+
+  size_t bytes;
+  if (A1C_overflowMul(builder.numEntries, sizeof(uint64_t), &bytes) ||
+      A1C_overflowAdd(bytes, sizeof(A1C_Tape), &bytes) ||
+      A1C_overflowAdd(bytes, builder.dataSize, &bytes)) {
+    return A1C_Decoder_error(decoder, A1C_ErrorType_badAlloc);
+  }
+  uint8_t *buffer = A1C_Arena_calloc(&decoder->arena, bytes, 1);
+  if (buffer == NULL) {
+    return A1C_Decoder_error(decoder, A1C_ErrorType_badAlloc);
+  }
+  A1C_Tape *tape = (A1C_Tape *)(void *)buffer;
+  uint64_t *entries = (uint64_t *)(void *)(buffer + sizeof(A1C_Tape));
+  uint8_t *data = buffer + sizeof(A1C_Tape) +
+                  builder.numEntries * sizeof(uint64_t);
+  tape->entries = entries;
+  tape->numEntries = builder.numEntries;
+  tape->data = data;
+  tape->dataSize = builder.dataSize;
+
+  // Second pass: fill in the tape. The input has already been validated.
+  decoder->ptr = decoder->start;
+  decoder->depth = 0;
+  builder.entries = entries;
+  builder.numEntries = 0;
+  builder.data = data;
+  builder.dataSize = 0;
+  A1C_RET_IF_ERR(A1C_Decoder_tapeOne(decoder, &builder));
+  assert(builder.numEntries == tape->numEntries);
+  assert(builder.dataSize == tape->dataSize);
+
+  *out = tape;
+  return true;
+}
+
+const A1C_Tape *A1C_Decoder_decodeTape(A1C_Decoder *decoder,
+                                       const uint8_t *data, size_t size) {
+  A1C_Decoder_reset(decoder, data, size);
+  if (data == NULL) {
+    decoder->error.type = A1C_ErrorType_truncated;
+    decoder->error.srcPos = 0;
+    return NULL;
+  }
+  const A1C_Tape *tape = NULL;
+  if (!A1C_Decoder_buildTape(decoder, &tape)) {
+    return NULL;
+  }
+  return tape;
+}
+
+A1C_TapeCursor A1C_Tape_root(const A1C_Tape *tape) {
+  A1C_TapeCursor cursor = {.tape = tape, .index = 0};
+  return cursor;
+}
+
+static uint64_t A1C_TapeCursor_payload(A1C_TapeCursor cursor) {
+  return cursor.tape->entries[cursor.index] & A1C_TAPE_PAYLOAD_MASK;
+}
+
+static bool A1C_TapeCursor_isInline(A1C_TapeCursor cursor) {
+  return (cursor.tape->entries[cursor.index] & A1C_TAPE_INLINE) != 0;
+}
+
+/// @returns The second entry of an item that has one.
+static uint64_t A1C_TapeCursor_extra(A1C_TapeCursor cursor) {
+  assert(!A1C_TapeCursor_isInline(cursor));
+  assert(cursor.index + 1 < cursor.tape->numEntries);
+  return cursor.tape->entries[cursor.index + 1];
+}
+
+/// @returns The offset in data of bytes and strings, or the index past the
+/// end of arrays, maps and tags.
+static uint64_t A1C_TapeCursor_index(A1C_TapeCursor cursor) {
+  const uint64_t payload = A1C_TapeCursor_payload(cursor);
+  return A1C_TapeCursor_isInline(cursor) ? payload & A1C_TAPE_INDEX_MASK
+                                         : payload;
+}
+
+/// @returns The size of bytes and strings, the number of items of arrays and
+/// maps, or the tag number of tags.
+static uint64_t A1C_TapeCursor_value(A1C_TapeCursor cursor) {
+  if (A1C_TapeCursor_isInline(cursor)) {
+    return A1C_TapeCursor_payload(cursor) >> A1C_TAPE_INDEX_BITS;
+  }
+  return A1C_TapeCursor_extra(cursor);
+}
+
+static A1C_TapeCursor A1C_TapeCursor_at(A1C_TapeCursor cursor, size_t index) {
+  assert(index <= cursor.tape->numEntries);
+  cursor.index = index;
+  return cursor;
+}
+
+/// @returns The entry after the one or two entries of the item, which is the
+/// first child of a container or tag.
+static A1C_TapeCursor A1C_TapeCursor_following(A1C_TapeCursor cursor) {
+  const size_t entries = A1C_TapeCursor_isInline(cursor) ? 1 : 2;
+  return A1C_TapeCursor_at(cursor, cursor.index + entries);
+}
+
+A1C_ItemType A1C_TapeCursor_type(A1C_TapeCursor cursor) {
+  assert(cursor.index < cursor.tape->numEntries);
+  return (A1C_ItemType)((cursor.tape->entries[cursor.index] >>
+                         A1C_TAPE_TYPE_SHIFT) &
+                        A1C_TAPE_TYPE_MASK);
+}
+
+A1C_Int64 A1C_TapeCursor_int64(A1C_TapeCursor cursor) {
+  assert(A1C_TapeCursor_type(cursor) == A1C_ItemType_int64);
+  if (A1C_TapeCursor_isInline(cursor)) {
+    // Sign extend the 56-bit payload.
+    const uint64_t payload = A1C_TapeCursor_payload(cursor);
+    return (A1C_Int64)((payload ^ A1C_TAPE_INT_SIGN) - A1C_TAPE_INT_SIGN);
+  }
+  return (A1C_Int64)A1C_TapeCursor_extra(cursor);
+}
+
+A1C_Bool A1C_TapeCursor_boolean(A1C_TapeCursor cursor) {
+  assert(A1C_TapeCursor_type(cursor) == A1C_ItemType_boolean);
+  return A1C_TapeCursor_payload(cursor) != 0;
+}
+
+A1C_Float16 A1C_TapeCursor_float16(A1C_TapeCursor cursor) {
+  assert(A1C_TapeCursor_type(cursor) == A1C_ItemType_float16);
+  return (A1C_Float16)A1C_TapeCursor_payload(cursor);
+}
+
+A1C_Float32 A1C_TapeCursor_float32(A1C_TapeCursor cursor) {
+  assert(A1C_TapeCursor_type(cursor) == A1C_ItemType_float32);
+  const uint32_t bits = (uint32_t)A1C_TapeCursor_payload(cursor);
+  A1C_Float32 value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+A1C_Float64 A1C_TapeCursor_float64(A1C_TapeCursor cursor) {
+  assert(A1C_TapeCursor_type(cursor) == A1C_ItemType_float64);
+  const uint64_t bits = A1C_TapeCursor_extra(cursor);
+  A1C_Float64 value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+A1C_Simple A1C_TapeCursor_simple(A1C_TapeCursor cursor) {
+  assert(A1C_TapeCursor_type(cursor) == A1C_ItemType_simple);
+  return (A1C_Simple)A1C_TapeCursor_payload(cursor);
+}
+
+A1C_Bytes A1C_TapeCursor_bytes(A1C_TapeCursor cursor) {
+  assert(A1C_TapeCursor_type(cursor) == A1C_ItemType_bytes);
+  A1C_Bytes bytes = {
+      .data = cursor.tape->data + A1C_TapeCursor_index(cursor),
+      .size = (size_t)A1C_TapeCursor_value(cursor),
+  };
+  return bytes;
+}
+
+A1C_String A1C_TapeCursor_string(A1C_TapeCursor cursor) {
+  assert(A1C_TapeCursor_type(cursor) == A1C_ItemType_string);
+  A1C_String string = {
+      .data = (const char *)cursor.tape->data + A1C_TapeCursor_index(cursor),
+      .size = (size_t)A1C_TapeCursor_value(cursor),
+  };
+  return string;
+}
+
+uint64_t A1C_TapeCursor_tag(A1C_TapeCursor cursor) {
+  assert(A1C_TapeCursor_type(cursor) == A1C_ItemType_tag);
+  return A1C_TapeCursor_value(cursor);
+}
+
+A1C_TapeCursor A1C_TapeCursor_tagItem(A1C_TapeCursor cursor) {
+  assert(A1C_TapeCursor_type(cursor) == A1C_ItemType_tag);
+  return A1C_TapeCursor_following(cursor);
+}
+
+size_t A1C_TapeCursor_size(A1C_TapeCursor cursor) {
+  assert(A1C_TapeCursor_type(cursor) == A1C_ItemType_array ||
+         A1C_TapeCursor_type(cursor) == A1C_ItemType_map);
+  return (size_t)A1C_TapeCursor_value(cursor);
+}
+
+A1C_TapeCursor A1C_TapeCursor_child(A1C_TapeCursor cursor) {
+  assert(A1C_TapeCursor_size(cursor) > 0);
+  return A1C_TapeCursor_following(cursor);
+}
+
+A1C_TapeCursor A1C_TapeCursor_next(A1C_TapeCursor cursor) {
+  switch (A1C_TapeCursor_type(cursor)) {
+  case A1C_ItemType_array:
+  case A1C_ItemType_map:
+  case A1C_ItemType_tag:
+    return A1C_TapeCursor_at(cursor, (size_t)A1C_TapeCursor_index(cursor));
+  case A1C_ItemType_int64:
+  case A1C_ItemType_float64:
+  case A1C_ItemType_bytes:
+  case A1C_ItemType_string:
+    return A1C_TapeCursor_following(cursor);
+  case A1C_ItemType_undefined:
+  case A1C_ItemType_boolean:
+  case A1C_ItemType_null:
+  case A1C_ItemType_float16:
+  case A1C_ItemType_float32:
+  case A1C_ItemType_simple:
+  case A1C_ItemType_packedArray:
+    break;
+  }
+  return A1C_TapeCursor_at(cursor, cursor.index + 1);
+}
+
+bool A1C_TapeCursor_arrayGet(A1C_TapeCursor cursor, size_t index,
+                             A1C_TapeCursor *out) {
+  assert(A1C_TapeCursor_type(cursor) == A1C_ItemType_array);
+  if (index >= A1C_TapeCursor_size(cursor)) {
+    return false;
+  }
+  A1C_TapeCursor child = A1C_TapeCursor_child(cursor);
+  for (size_t i = 0; i < index; ++i) {
+    child = A1C_TapeCursor_next(child);
+  }
+  *out = child;
+  return true;
+}
+
+bool A1C_TapeCursor_mapGet(A1C_TapeCursor cursor, const A1C_Item *key,
+                           A1C_TapeCursor *out) {
+  assert(A1C_TapeCursor_type(cursor) == A1C_ItemType_map);
+  const size_t size = A1C_TapeCursor_size(cursor);
+  if (size == 0) {
+    return false;
+  }
+  A1C_TapeCursor child = A1C_TapeCursor_child(cursor);
+  for (size_t i = 0; i < size; ++i) {
+    const bool match = A1C_TapeCursor_eqItem(child, key);
+    child = A1C_TapeCursor_next(child);
+    if (match) {
+      *out = child;
+      return true;
+    }
+    child = A1C_TapeCursor_next(child);
+  }
+  return false;
+}
+
+bool A1C_TapeCursor_mapGet_cstr(A1C_TapeCursor cursor, const char *key,
+                                A1C_TapeCursor *out) {
+  A1C_Item keyItem;
+  A1C_Item_string_refCStr(&keyItem, key);
+  return A1C_TapeCursor_mapGet(cursor, &keyItem, out);
+}
+
+bool A1C_TapeCursor_mapGet_int(A1C_TapeCursor cursor, A1C_Int64 key,
+                               A1C_TapeCursor *out) {
+  A1C_Item keyItem;
+  A1C_Item_int64(&keyItem, key);
+  return A1C_TapeCursor_mapGet(cursor, &keyItem, out);
+}
+
+bool A1C_TapeCursor_eqItem(A1C_TapeCursor a, const A1C_Item *b) {
+  const A1C_ItemType type = A1C_TapeCursor_type(a);
+  if (type != A1C_Item_logicalType(b)) {
+    return false;
+  }
+
+  switch (type) {
+  case A1C_ItemType_int64:
+    return A1C_TapeCursor_int64(a) == b->int64;
+  case A1C_ItemType_float16:
+    return A1C_TapeCursor_float16(a) == b->float16;
+  case A1C_ItemType_float32: {
+    uint32_t bBits;
+    memcpy(&bBits, &b->float32, sizeof(bBits));
+    return A1C_TapeCursor_payload(a) == bBits;
+  }
+  case A1C_ItemType_float64: {
+    uint64_t bBits;
+    memcpy(&bBits, &b->float64, sizeof(bBits));
+    return A1C_TapeCursor_extra(a) == bBits;
+  }
+  case A1C_ItemType_boolean:
+    return A1C_TapeCursor_boolean(a) == b->boolean;
+  case A1C_ItemType_simple:
+    return A1C_TapeCursor_simple(a) == b->simple;
+  case A1C_ItemType_null:
+  case A1C_ItemType_undefined:
+    return true;
+  case A1C_ItemType_bytes: {
+    const A1C_Bytes bytes = A1C_TapeCursor_bytes(a);
+    return bytes.size == b->bytes.size &&
+           (bytes.size == 0 ||
+            memcmp(bytes.data, b->bytes.data, bytes.size) == 0);
+  }
+  case A1C_ItemType_string: {
+    const A1C_String string = A1C_TapeCursor_string(a);
+    return string.size == b->string.size &&
+           (string.size == 0 ||
+            memcmp(string.data, b->string.data, string.size) == 0);
+  }
+  case A1C_ItemType_array: {
+    const size_t size = A1C_Item_arraySize(b);
+    if (A1C_TapeCursor_size(a) != size) {
+      return false;
+    }
+    A1C_TapeCursor child = A1C_TapeCursor_following(a);
+    for (size_t i = 0; i < size; i++) {
+      A1C_Item scratch;
+      if (!A1C_TapeCursor_eqItem(child, A1C_Item_arrayAt(b, i, &scratch))) {
+        return false;
+      }
+      child = A1C_TapeCursor_next(child);
+    }
+    return true;
+  }
+  case A1C_ItemType_map: {
+    if (A1C_TapeCursor_size(a) != b->map.size) {
+      return false;
+    }
+    A1C_TapeCursor child = A1C_TapeCursor_following(a);
+    for (size_t i = 0; i < b->map.size; i++) {
+      if (!A1C_TapeCursor_eqItem(child, &b->map.items[i].key)) {
+        return false;
+      }
+      child = A1C_TapeCursor_next(child);
+      if (!A1C_TapeCursor_eqItem(child, &b->map.items[i].value)) {
+        return false;
+      }
+      child = A1C_TapeCursor_next(child);
+    }
+    return true;
+  }
+  case A1C_ItemType_tag:
+    return A1C_TapeCursor_tag(a) == b->tag.tag &&
+           A1C_TapeCursor_eqItem(A1C_TapeCursor_tagItem(a), b->tag.item);
+  case A1C_ItemType_packedArray:
+    // Tapes store packed arrays as arrays.
+    break;
+  }
+  return false;
+}
+
+////////////////////////////////////////
+// Encoder
+////////////////////////////////////////
+
+static size_t A1C_noopWrite(void *opaque, const uint8_t *data, size_t size) {
+  (void)opaque;
+  (void)data;
+  return size;
+}
+
+typedef struct {
+  uint8_t *ptr;
+  uint8_t *end;
+} A1C_Buffer;
+
+static size_t A1C_bufferWrite(void *opaque, const uint8_t *data, size_t size) {
+  A1C_Buffer *buffer = (A1C_Buffer *)opaque;
+  assert(buffer->ptr <= buffer->end);
+  const size_t capacity = (size_t)(buffer->end - buffer->ptr);
+  if (size > capacity) {
+    size = capacity;
+  }
+  if (size > 0) {
+    memcpy(buffer->ptr, data, size);
+    buffer->ptr += size;
+  }
+  return size;
+}
+
+void A1C_Encoder_init(A1C_Encoder *encoder, A1C_Encoder_WriteCallback write,
+                      void *opaque) {
+  memset(encoder, 0, sizeof(*encoder));
+  encoder->write = write;
+  encoder->opaque = opaque;
+}
+
+void A1C_Encoder_initWithConfig(A1C_Encoder *encoder,
+                                A1C_Encoder_WriteCallback write, void *opaque,
+                                A1C_EncoderConfig config) {
+  A1C_Encoder_init(encoder, write, opaque);
+  encoder->deterministic = config.deterministic;
+  encoder->preferredFloats = config.preferredFloats || config.deterministic;
+  encoder->compactJson = config.compactJson;
+  encoder->scratchArena = config.scratchArena;
+}
+
+A1C_Error A1C_Encoder_getError(const A1C_Encoder *encoder) {
+  return encoder->error;
+}
+
+static void A1C_Encoder_reset(A1C_Encoder *encoder) {
+  memset(&encoder->error, 0, sizeof(A1C_Error));
+  encoder->bytesWritten = 0;
+  encoder->depth = 0;
+  encoder->currentItem = NULL;
+}
+
+bool A1C_Encoder_encodeOne(A1C_Encoder *encoder, const A1C_Item *item);
+
+bool A1C_NODISCARD A1C_Encoder_errorImpl(A1C_Encoder *encoder,
+                                         A1C_ErrorType errorType,
+                                         const char *file, int line) {
+  encoder->error.type = errorType;
+  encoder->error.srcPos = encoder->bytesWritten;
+  encoder->error.depth = encoder->depth;
+  encoder->error.item = encoder->currentItem;
+  encoder->error.file = file;
+  encoder->error.line = line;
+  return false;
+}
+
+#define A1C_Encoder_error(encoder, errorType)                                  \
+  A1C_Encoder_errorImpl((encoder), (errorType), __FILE__, __LINE__)
+
+static bool A1C_NODISCARD A1C_Encoder_write(A1C_Encoder *encoder,
+                                            const void *data, size_t size) {
+  if (size == 0) {
+    return true;
+  }
+  const size_t written = encoder->write(encoder->opaque, data, size);
+  encoder->bytesWritten += written;
+
+  if (written < size) {
+    return A1C_Encoder_error(encoder, A1C_ErrorType_writeFailed);
+  }
+  return true;
+}
+
+static bool A1C_NODISCARD A1C_Encoder_writeCStr(A1C_Encoder *encoder,
+                                                const char *cstr) {
+  return A1C_Encoder_write(encoder, cstr, strlen(cstr));
+}
+
+static bool A1C_NODISCARD A1C_Encoder_putc(A1C_Encoder *encoder, char c) {
+  return A1C_Encoder_write(encoder, &c, 1);
+}
+
+/// @returns The additional information for the shortest encoding of @p count.
+static uint8_t A1C_shortCount(uint64_t count) {
+  if (count < 24) {
+    return (uint8_t)count;
+  } else if (count <= UINT8_MAX) {
+    return 24;
+  } else if (count <= UINT16_MAX) {
+    return 25;
+  } else if (count <= UINT32_MAX) {
+    return 26;
+  } else {
+    return 27;
+  }
+}
+
+/// The longest encoding of an item head, or of a number.
+#define A1C_MAX_HEAD_SIZE 9
+
+/**
+ * Writes the head of an item of @p majorType with the shortest encoding of
+ * @p count to @p dst.
+ * @returns The number of bytes written, at most A1C_MAX_HEAD_SIZE.
+ */
+static size_t A1C_encodeHead(uint8_t *dst, A1C_MajorType majorType,
+                             uint64_t count) {
+  const uint8_t shortCount = A1C_shortCount(count);
+  dst[0] = A1C_ItemHeader_make(majorType, shortCount).header;
+  if (shortCount == 24) {
+    dst[1] = (uint8_t)count;
+    return 2;
+  } else if (shortCount == 25) {
+    const uint16_t count16 = A1C_bigEndian16((uint16_t)count);
+    memcpy(dst + 1, &count16, sizeof(count16));
+    return 3;
+  } else if (shortCount == 26) {
+    const uint32_t count32 = A1C_bigEndian32((uint32_t)count);
+    memcpy(dst + 1, &count32, sizeof(count32));
+    return 5;
+  } else if (shortCount == 27) {
+    const uint64_t count64 = A1C_bigEndian64(count);
+    memcpy(dst + 1, &count64, sizeof(count64));
+    return 9;
+  }
+  return 1;
+}
+
+/// Writes the shortest encoding of @p value to @p dst.
+/// @returns The number of bytes written.
+static size_t A1C_encodeInt64(uint8_t *dst, int64_t value) {
+  if (value >= 0) {
+    return A1C_encodeHead(dst, A1C_MajorType_uint, (uint64_t)value);
+  }
+  return A1C_encodeHead(dst, A1C_MajorType_int, (uint64_t)~value);
+}
+
+static size_t A1C_encodeFloat16(uint8_t *dst, uint16_t bits) {
+  dst[0] = A1C_ItemHeader_make(A1C_MajorType_special, 25).header;
+  const uint16_t value = A1C_bigEndian16(bits);
+  memcpy(dst + 1, &value, sizeof(value));
+  return 1 + sizeof(value);
+}
+
+/// Writes the float32 with bit pattern @p bits to @p dst, narrowing it to a
+/// float16 if @p preferredFloats and it is exact.
+/// @returns The number of bytes written.
+static size_t A1C_encodeFloat32(uint8_t *dst, uint32_t bits,
+                                bool preferredFloats) {
+  uint16_t narrow;
+  if (preferredFloats && A1C_float32To16Exact(bits, &narrow)) {
+    return A1C_encodeFloat16(dst, narrow);
+  }
+  dst[0] = A1C_ItemHeader_make(A1C_MajorType_special, 26).header;
+  const uint32_t value = A1C_bigEndian32(bits);
+  memcpy(dst + 1, &value, sizeof(value));
+  return 1 + sizeof(value);
+}
+
+/// Writes the float64 with bit pattern @p bits to @p dst, narrowing it if
+/// @p preferredFloats and it is exact.
+/// @returns The number of bytes written.
+static size_t A1C_encodeFloat64(uint8_t *dst, uint64_t bits,
+                                bool preferredFloats) {
+  uint32_t narrow;
+  if (preferredFloats && A1C_float64To32Exact(bits, &narrow)) {
+    return A1C_encodeFloat32(dst, narrow, true);
+  }
+  dst[0] = A1C_ItemHeader_make(A1C_MajorType_special, 27).header;
+  const uint64_t value = A1C_bigEndian64(bits);
+  memcpy(dst + 1, &value, sizeof(value));
+  return 1 + sizeof(value);
+}
+
+static bool A1C_NODISCARD A1C_Encoder_encodeHeaderAndCount(
+    A1C_Encoder *encoder, A1C_MajorType majorType, uint64_t count) {
+  uint8_t head[A1C_MAX_HEAD_SIZE];
+  return A1C_Encoder_write(encoder, head,
+                           A1C_encodeHead(head, majorType, count));
+}
+
+static bool A1C_NODISCARD A1C_Encoder_encodeInt(A1C_Encoder *encoder,
+                                                const A1C_Item *item) {
+  assert(item->type == A1C_ItemType_int64);
+  uint8_t head[A1C_MAX_HEAD_SIZE];
+  return A1C_Encoder_write(encoder, head, A1C_encodeInt64(head, item->int64));
+}
+
+static bool A1C_NODISCARD A1C_Encoder_encodeData(A1C_Encoder *encoder,
+                                                 const A1C_Item *item) {
+  assert(item->type == A1C_ItemType_bytes || item->type == A1C_ItemType_string);
+  const A1C_MajorType majorType = item->type == A1C_ItemType_bytes
+                                      ? A1C_MajorType_bytes
+                                      : A1C_MajorType_string;
+  const size_t count =
+      item->type == A1C_ItemType_bytes ? item->bytes.size : item->string.size;
+  if (!A1C_Encoder_encodeHeaderAndCount(encoder, majorType, count)) {
+    return false;
+  }
+  const void *data = item->type == A1C_ItemType_bytes
+                         ? (const void *)item->bytes.data
+                         : (const void *)item->string.data;
+  return A1C_Encoder_write(encoder, data, count);
+}
+
+static bool A1C_NODISCARD A1C_Encoder_encodeArray(A1C_Encoder *encoder,
+                                                  const A1C_Item *item) {
+  assert(item->type == A1C_ItemType_array);
+  const size_t count = item->array.size;
+  if (!A1C_Encoder_encodeHeaderAndCount(encoder, A1C_MajorType_array, count)) {
+    return false;
+  }
+  for (size_t i = 0; i < count; i++) {
+    const A1C_Item *child = &item->array.items[i];
+    if (!A1C_Encoder_encodeOne(encoder, child)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Integer elements are encoded in groups of four. The head widths of a group
+// are classified together, with AVX2 where available, and when they agree,
+// which is typical of numeric vectors, the group is written with a fixed
+// stride and no per element branches. Other groups fall back to
+// A1C_encodeInt64().
+
+#define A1C_INT64_GROUP_SIZE 4
+
+/// @returns The count in the head of @p value, which is ~value if negative.
+static uint64_t A1C_int64Magnitude(int64_t value) {
+  return (uint64_t)value ^ (0 - ((uint64_t)value >> 63));
+}
+
+/// @returns The width class of the head of a value with @p magnitude: 0 if it
+/// fits in the head byte, or 1 to 4 if it follows in 1, 2, 4 or 8 bytes.
+static unsigned A1C_int64WidthClass(uint64_t magnitude) {
+  return (unsigned)(magnitude > 23) + (unsigned)(magnitude > UINT8_MAX) +
+         (unsigned)(magnitude > UINT16_MAX) +
+         (unsigned)(magnitude > UINT32_MAX);
+}
+
+/// @returns The width class shared by the A1C_INT64_GROUP_SIZE @p values, or
+/// -1 if they differ.
+static int A1C_int64GroupClass(const int64_t *values) {
+  const unsigned widthClass =
+      A1C_int64WidthClass(A1C_int64Magnitude(values[0]));
+  for (size_t i = 1; i < A1C_INT64_GROUP_SIZE; ++i) {
+    if (A1C_int64WidthClass(A1C_int64Magnitude(values[i])) != widthClass) {
+      return -1;
+    }
+  }
+  return (int)widthClass;
+}
+
+/**
+ * Writes the shortest encoding of @p value to @p dst like A1C_encodeInt64(),
+ * but without branches on its width, so it always writes A1C_MAX_HEAD_SIZE
+ * bytes. The bytes after the encoding are overwritten by the next one.
+ * @returns The length of the encoding.
+ */
+static size_t A1C_encodeInt64Padded(uint8_t *dst, int64_t value) {
+  static const uint8_t kExtraBytes[5] = {0, 1, 2, 4, 8};
+  const uint64_t magnitude = A1C_int64Magnitude(value);
+  const unsigned widthClass = A1C_int64WidthClass(magnitude);
+  const unsigned extra = kExtraBytes[widthClass];
+  const uint8_t shortCount =
+      widthClass == 0 ? (uint8_t)magnitude : (uint8_t)(23 + widthClass);
+  dst[0] = (uint8_t)((((uint64_t)value >> 63) << 5) | shortCount);
+  // Left align the extra bytes, so they're first in big-endian order.
+  const uint64_t bytes = A1C_bigEndian64(magnitude << ((64 - 8 * extra) & 63));
+  memcpy(dst + 1, &bytes, sizeof(bytes));
+  return 1 + extra;
+}
+
+/// Writes the A1C_INT64_GROUP_SIZE @p values, which all have @p widthClass,
+/// to @p dst.
+/// @returns The number of bytes written.
+static size_t A1C_encodeInt64Group(uint8_t *dst, const int64_t *values,
+                                   int widthClass) {
+  uint8_t headers[A1C_INT64_GROUP_SIZE];
+  uint64_t magnitudes[A1C_INT64_GROUP_SIZE];
+  for (size_t i = 0; i < A1C_INT64_GROUP_SIZE; ++i) {
+    // The major type is 1 for negative integers and 0 otherwise.
+    headers[i] = (uint8_t)(((uint64_t)values[i] >> 63) << 5);
+    magnitudes[i] = A1C_int64Magnitude(values[i]);
+  }
+  switch (widthClass) {
+  case 0:
+    for (size_t i = 0; i < A1C_INT64_GROUP_SIZE; ++i) {
+      dst[i] = (uint8_t)(headers[i] | magnitudes[i]);
+    }
+    return A1C_INT64_GROUP_SIZE;
+  case 1:
+    for (size_t i = 0; i < A1C_INT64_GROUP_SIZE; ++i) {
+      dst[2 * i] = headers[i] | 24;
+      dst[2 * i + 1] = (uint8_t)magnitudes[i];
+    }
+    return 2 * A1C_INT64_GROUP_SIZE;
+  case 2:
+    for (size_t i = 0; i < A1C_INT64_GROUP_SIZE; ++i) {
+      const uint16_t value = A1C_bigEndian16((uint16_t)magnitudes[i]);
+      dst[3 * i] = headers[i] | 25;
+      memcpy(dst + 3 * i + 1, &value, sizeof(value));
+    }
+    return 3 * A1C_INT64_GROUP_SIZE;
+  case 3:
+    for (size_t i = 0; i < A1C_INT64_GROUP_SIZE; ++i) {
+      const uint32_t value = A1C_bigEndian32((uint32_t)magnitudes[i]);
+      dst[5 * i] = headers[i] | 26;
+      memcpy(dst + 5 * i + 1, &value, sizeof(value));
+    }
+    return 5 * A1C_INT64_GROUP_SIZE;
+  default:
+    assert(widthClass == 4);
+    for (size_t i = 0; i < A1C_INT64_GROUP_SIZE; ++i) {
+      const uint64_t value = A1C_bigEndian64(magnitudes[i]);
+      dst[9 * i] = headers[i] | 27;
+      memcpy(dst + 9 * i + 1, &value, sizeof(value));
+    }
+    return 9 * A1C_INT64_GROUP_SIZE;
+  }
+}
+
+/// Writes the shortest encodings of the @p count @p values to @p dst.
+/// @returns The number of bytes written, at most count * A1C_MAX_HEAD_SIZE.
+static size_t A1C_encodeInt64s(uint8_t *dst, const int64_t *values,
+                               size_t count) {
+  uint8_t *const begin = dst;
+  size_t i = 0;
+  for (; count - i >= A1C_INT64_GROUP_SIZE; i += A1C_INT64_GROUP_SIZE) {
+    const int widthClass = A1C_int64GroupClass(values + i);
+    if (widthClass >= 0) {
+      dst += A1C_encodeInt64Group(dst, values + i, widthClass);
+    } else {
+      for (size_t j = 0; j < A1C_INT64_GROUP_SIZE; ++j) {
+        dst += A1C_encodeInt64Padded(dst, values[i + j]);
+      }
+    }
+  }
+  for (; i < count; ++i) {
+    dst += A1C_encodeInt64(dst, values[i]);
+  }
+  return (size_t)(dst - begin);
+}
+
+#if A1C_HAS_AVX2
+/// Classifies a group of four values with one comparison per width limit.
+/// @returns The width class shared by the four @p values, or -1 if they
+/// differ.
+__attribute__((target("avx2"))) static int
+A1C_int64GroupClassAVX2(const int64_t *values) {
+  static const int64_t kLimits[4] = {23, UINT8_MAX, UINT16_MAX, UINT32_MAX};
+  const __m256i v =
+      _mm256_loadu_si256((const __m256i *)(const void *)values);
+  // Flipping the bits of negative values leaves non-negative magnitudes, so
+  // the signed comparisons are exact.
+  const __m256i magnitude =
+      _mm256_xor_si256(v, _mm256_cmpgt_epi64(_mm256_setzero_si256(), v));
+  int widthClass = 0;
+  for (size_t i = 0; i < 4; ++i) {
+    const __m256i above =
+        _mm256_cmpgt_epi64(magnitude, _mm256_set1_epi64x(kLimits[i]));
+    const int mask = _mm256_movemask_pd(_mm256_castsi256_pd(above));
+    if (mask == 0xF) {
+      ++widthClass;
+    } else if (mask != 0) {
+      return -1;
+    }
+  }
+  return widthClass;
+}
+
+/// Like A1C_encodeInt64s(), but classifies the groups with AVX2.
+__attribute__((target("avx2"))) static size_t
+A1C_encodeInt64sAVX2(uint8_t *dst, const int64_t *values, size_t count) {
+  uint8_t *const begin = dst;
+  size_t i = 0;
+  for (; count - i >= A1C_INT64_GROUP_SIZE; i += A1C_INT64_GROUP_SIZE) {
+    const int widthClass = A1C_int64GroupClassAVX2(values + i);
+    if (widthClass >= 0) {
+      dst += A1C_encodeInt64Group(dst, values + i, widthClass);
+    } else {
+      for (size_t j = 0; j < A1C_INT64_GROUP_SIZE; ++j) {
+        dst += A1C_encodeInt64Padded(dst, values[i + j]);
+      }
+    }
+  }
+  for (; i < count; ++i) {
+    dst += A1C_encodeInt64(dst, values[i]);
+  }
+  return (size_t)(dst - begin);
+}
+#endif
+
+// Packed elements are encoded in chunks into a stack buffer, which is written
+// once per chunk.
+
+#define A1C_ELEMENT_CHUNK_SIZE 128
+
+static bool A1C_NODISCARD A1C_Encoder_int64Elements(A1C_Encoder *encoder,
+                                                    const int64_t *values,
+                                                    size_t count) {
+  uint8_t buffer[A1C_ELEMENT_CHUNK_SIZE * A1C_MAX_HEAD_SIZE];
+#if A1C_HAS_AVX2
+  const bool avx2 = A1C_hasAVX2();
+#endif
+  while (count > 0) {
+    const size_t chunk =
+        count < A1C_ELEMENT_CHUNK_SIZE ? count : A1C_ELEMENT_CHUNK_SIZE;
+    uint8_t *dst = buffer;
+#if A1C_HAS_AVX2
+    if (avx2) {
+      dst += A1C_encodeInt64sAVX2(dst, values, chunk);
+    } else {
+      dst += A1C_encodeInt64s(dst, values, chunk);
+    }
+#else
+    dst += A1C_encodeInt64s(dst, values, chunk);
+#endif
+    A1C_RET_IF_ERR(A1C_Encoder_write(encoder, buffer, (size_t)(dst - buffer)));
+    values += chunk;
+    count -= chunk;
+  }
+  return true;
+}
+
+static bool A1C_NODISCARD A1C_Encoder_float16Elements(A1C_Encoder *encoder,
+                                                      const uint16_t *values,
+                                                      size_t count) {
+  uint8_t buffer[A1C_ELEMENT_CHUNK_SIZE * A1C_MAX_HEAD_SIZE];
+  while (count > 0) {
+    const size_t chunk =
+        count < A1C_ELEMENT_CHUNK_SIZE ? count : A1C_ELEMENT_CHUNK_SIZE;
+    uint8_t *dst = buffer;
+    for (size_t i = 0; i < chunk; ++i) {
+      dst += A1C_encodeFloat16(dst, values[i]);
+    }
+    A1C_RET_IF_ERR(A1C_Encoder_write(encoder, buffer, (size_t)(dst - buffer)));
+    values += chunk;
+    count -= chunk;
+  }
+  return true;
+}
+
+static bool A1C_NODISCARD A1C_Encoder_float32Elements(A1C_Encoder *encoder,
+                                                      const A1C_Float32 *values,
+                                                      size_t count) {
+  uint8_t buffer[A1C_ELEMENT_CHUNK_SIZE * A1C_MAX_HEAD_SIZE];
+  while (count > 0) {
+    const size_t chunk =
+        count < A1C_ELEMENT_CHUNK_SIZE ? count : A1C_ELEMENT_CHUNK_SIZE;
+    uint8_t *dst = buffer;
+    for (size_t i = 0; i < chunk; ++i) {
+      uint32_t bits;
+      memcpy(&bits, &values[i], sizeof(bits));
+      dst += A1C_encodeFloat32(dst, bits, encoder->preferredFloats);
+    }
+    A1C_RET_IF_ERR(A1C_Encoder_write(encoder, buffer, (size_t)(dst - buffer)));
+    values += chunk;
+    count -= chunk;
+  }
+  return true;
+}
+
+static bool A1C_NODISCARD A1C_Encoder_float64Elements(A1C_Encoder *encoder,
+                                                      const A1C_Float64 *values,
+                                                      size_t count) {
+  uint8_t buffer[A1C_ELEMENT_CHUNK_SIZE * A1C_MAX_HEAD_SIZE];
+  while (count > 0) {
+    const size_t chunk =
+        count < A1C_ELEMENT_CHUNK_SIZE ? count : A1C_ELEMENT_CHUNK_SIZE;
+    uint8_t *dst = buffer;
+    for (size_t i = 0; i < chunk; ++i) {
+      uint64_t bits;
+      memcpy(&bits, &values[i], sizeof(bits));
+      dst += A1C_encodeFloat64(dst, bits, encoder->preferredFloats);
+    }
+    A1C_RET_IF_ERR(A1C_Encoder_write(encoder, buffer, (size_t)(dst - buffer)));
+    values += chunk;
+    count -= chunk;
+  }
+  return true;
+}
+
+static bool A1C_NODISCARD A1C_Encoder_encodePackedArray(A1C_Encoder *encoder,
+                                                        const A1C_Item *item) {
+  assert(item->type == A1C_ItemType_packedArray);
+  const A1C_PackedArray *array = &item->packedArray;
+  A1C_RET_IF_ERR(A1C_Encoder_encodeHeaderAndCount(encoder, A1C_MajorType_array,
+                                                  array->size));
+  switch (array->type) {
+  case A1C_ElementType_int64:
+    return A1C_Encoder_int64Elements(encoder, array->data, array->size);
+  case A1C_ElementType_float16:
+    return A1C_Encoder_float16Elements(encoder, array->data, array->size);
+  case A1C_ElementType_float32:
+    return A1C_Encoder_float32Elements(encoder, array->data, array->size);
+  case A1C_ElementType_float64:
+    return A1C_Encoder_float64Elements(encoder, array->data, array->size);
+  case A1C_ElementType_uint8:
+  case A1C_ElementType_uint8Clamped:
+  case A1C_ElementType_uint16:
+  case A1C_ElementType_uint32:
+  case A1C_ElementType_uint64:
+  case A1C_ElementType_int8:
+  case A1C_ElementType_int16:
+  case A1C_ElementType_int32:
+    break;
+  }
+  assert(false);
+  return false;
+}
+
+/// A map key pre-encoded for sorting.
+typedef struct {
+  const uint8_t *data;
+  size_t size;
+  /// Index of the pair in the map.
+  size_t index;
+} A1C_EncodedKey;
+
+static A1C_Encoder A1C_Encoder_child(const A1C_Encoder *encoder,
+                                     A1C_Encoder_WriteCallback write,
+                                     void *opaque) {
+  A1C_Encoder child;
+  A1C_EncoderConfig config = {
+      .deterministic = encoder->deterministic,
+      .preferredFloats = encoder->preferredFloats,
+      .compactJson = encoder->compactJson,
+      .scratchArena = encoder->scratchArena,
+  };
+  A1C_Encoder_initWithConfig(&child, write, opaque, config);
+  child.depth = encoder->depth;
+  return child;
+}
+
+/// @returns true if @p a sorts strictly before @p b bytewise.
+static bool A1C_EncodedKey_less(const A1C_EncodedKey *a,
+                                const A1C_EncodedKey *b) {
+  const size_t size = a->size < b->size ? a->size : b->size;
+  const int cmp = size == 0 ? 0 : memcmp(a->data, b->data, size);
+  if (cmp != 0) {
+    return cmp < 0;
+  }
+  return a->size < b->size;
+}
+
+/// Stable bottom-up merge sort of @p keys, using @p tmp as scratch space.
+static void A1C_EncodedKey_sort(A1C_EncodedKey *keys, A1C_EncodedKey *tmp,
+                                size_t count) {
+  A1C_EncodedKey *src = keys;
+  A1C_EncodedKey *dst = tmp;
+  for (size_t width = 1; width < count; width *= 2) {
+    for (size_t begin = 0; begin < count; begin += 2 * width) {
+      const size_t mid = begin + width < count ? begin + width : count;
+      const size_t end = mid + width < count ? mid + width : count;
+      size_t l = begin;
+      size_t r = mid;
+      for (size_t i = begin; i < end; ++i) {
+        if (l < mid && (r == end || !A1C_EncodedKey_less(&src[r], &src[l]))) {
+          dst[i] = src[l++];
+        } else {
+          dst[i] = src[r++];
+        }
+      }
+    }
+    A1C_EncodedKey *const swap = src;
+    src = dst;
+    dst = swap;
+  }
+  if (src != keys) {
+    memcpy(keys, src, count * sizeof(A1C_EncodedKey));
+  }
+}
+
+/// Encodes the pairs of a map sorted by their encoded keys.
+static bool A1C_NODISCARD A1C_Encoder_encodeMapSorted(A1C_Encoder *encoder,
+                                                      const A1C_Item *item) {
+  const size_t count = item->map.size;
+  A1C_Arena *scratch = &encoder->scratchArena;
+  if (scratch->calloc == NULL) {
+    return A1C_Encoder_error(encoder, A1C_ErrorType_badAlloc);
+  }
+  A1C_EncodedKey *keys =
+      A1C_Arena_calloc(scratch, 2 * count, sizeof(A1C_EncodedKey));
+  if (keys == NULL) {
+    return A1C_Encoder_error(encoder, A1C_ErrorType_badAlloc);
+  }
+
+  // Measure the keys, then encode them into a single buffer.
+  size_t totalSize = 0;
+  for (size_t i = 0; i < count; ++i) {
+    A1C_Encoder sizer = A1C_Encoder_child(encoder, A1C_noopWrite, NULL);
+    if (!A1C_Encoder_encodeOne(&sizer, &item->map.items[i].key)) {
+      encoder->error = sizer.error;
+      encoder->error.srcPos = encoder->bytesWritten;
+      return false;
+    }
+    keys[i].size = sizer.bytesWritten;
+    keys[i].index = i;
+    if (A1C_overflowAdd(totalSize, keys[i].size, &totalSize)) {
+      return A1C_Encoder_error(encoder, A1C_ErrorType_badAlloc);
+    }
   }
-  uint8_t *data = A1C_Arena_calloc(&decoder->arena, totalSize, 1);
+  uint8_t *data = A1C_Arena_calloc(scratch, totalSize, 1);
   if (data == NULL) {
-    return A1C_Decoder_error(decoder, A1C_ErrorType_badAlloc);
+    return A1C_Encoder_error(encoder, A1C_ErrorType_badAlloc);
   }
-  uint8_t *dataEnd = data + totalSize;
-  while (previous != NULL) {
-    const uint8_t *chunkPtr = majorType == A1C_MajorType_bytes
-                                  ? previous->bytes.data
-                                  : (const uint8_t *)previous->string.data;
-    const size_t chunkSize = majorType == A1C_MajorType_bytes
-                                 ? previous->bytes.size
-                                 : previous->string.size;
-    if (chunkSize > 0) {
-      dataEnd -= chunkSize;
-      assert(dataEnd >= data);
-      memcpy(dataEnd, chunkPtr, chunkSize);
-    }
-    previous = previous->parent;
+  A1C_Buffer buffer = {.ptr = data, .end = data + totalSize};
+  for (size_t i = 0; i < count; ++i) {
+    keys[i].data = buffer.ptr;
+    A1C_Encoder keyEncoder =
+        A1C_Encoder_child(encoder, A1C_bufferWrite, &buffer);
+    const bool success =
+        A1C_Encoder_encodeOne(&keyEncoder, &item->map.items[i].key);
+    (void)success;
+    assert(success && keyEncoder.bytesWritten == keys[i].size);
   }
-  assert(dataEnd == data);
-  if (majorType == A1C_MajorType_bytes) {
-    A1C_Item_bytes_ref(item, data, totalSize);
-  } else {
-    A1C_Item_string_ref(item, (const char *)data, totalSize);
+
+  A1C_EncodedKey_sort(keys, keys + count, count);
+
+  for (size_t i = 0; i < count; ++i) {
+    encoder->currentItem = &item->map.items[keys[i].index].key;
+    A1C_RET_IF_ERR(A1C_Encoder_write(encoder, keys[i].data, keys[i].size));
+    A1C_RET_IF_ERR(
+        A1C_Encoder_encodeOne(encoder, &item->map.items[keys[i].index].value));
   }
   return true;
 }
 
-static bool A1C_NODISCARD A1C_Decoder_decodeArray(A1C_Decoder *decoder,
-                                                  A1C_ItemHeader header,
-                                                  A1C_Item *item) {
-  size_t size;
-  A1C_RET_IF_ERR(A1C_Decoder_readSize(decoder, header, &size));
-  if (A1C_ItemHeader_isIndefinite(header)) {
-    size = 0;
-    const A1C_Item *previous = NULL;
-    for (;;) {
-      A1C_ItemHeader childHeader;
-      A1C_RET_IF_ERR(
-          A1C_Decoder_peek(decoder, &childHeader, sizeof(childHeader)));
-      if (A1C_ItemHeader_isBreak(childHeader)) {
-        A1C_RET_IF_ERR(A1C_Decoder_skip(decoder, sizeof(childHeader)));
-        break;
-      }
-      A1C_Item *child = A1C_Decoder_decodeOne(decoder);
-      if (child == NULL) {
-        return NULL;
-      }
-      child->parent = previous;
-      previous = child;
-      ++size;
+static bool A1C_NODISCARD A1C_Encoder_encodeMap(A1C_Encoder *encoder,
+                                                const A1C_Item *item) {
+  assert(item->type == A1C_ItemType_map);
+  const size_t count = item->map.size;
+  if (!A1C_Encoder_encodeHeaderAndCount(encoder, A1C_MajorType_map, count)) {
+    return false;
+  }
+  if (encoder->deterministic && count > 1) {
+    return A1C_Encoder_encodeMapSorted(encoder, item);
+  }
+  for (size_t i = 0; i < count; i++) {
+    const A1C_Pair pair = item->map.items[i];
+    if (!A1C_Encoder_encodeOne(encoder, &pair.key)) {
+      return false;
     }
-    A1C_Item *array = A1C_Item_array(item, size, &decoder->arena);
-    if (array == NULL) {
-      return A1C_Decoder_error(decoder, A1C_ErrorType_badAlloc);
+    if (!A1C_Encoder_encodeOne(encoder, &pair.value)) {
+      return false;
     }
-    while (previous != NULL) {
-      const A1C_Item *child = previous;
-      previous = previous->parent;
+  }
+  return true;
+}
 
-      --size;
-      array[size] = *child;
-      array[size].parent = item;
-    }
-    assert(size == 0);
+static bool A1C_NODISCARD A1C_Encoder_encodeTag(A1C_Encoder *encoder,
+                                                const A1C_Item *item) {
+  assert(item->type == A1C_ItemType_tag);
+  const A1C_Tag *tag = &item->tag;
+  if (!A1C_Encoder_encodeHeaderAndCount(encoder, A1C_MajorType_tag, tag->tag)) {
+    return false;
+  }
+  if (!A1C_Encoder_encodeOne(encoder, tag->item)) {
+    return false;
+  }
+  return true;
+}
+
+static bool A1C_NODISCARD A1C_Encoder_encodeFloat(A1C_Encoder *encoder,
+                                                  const A1C_Item *item) {
+  uint8_t head[A1C_MAX_HEAD_SIZE];
+  size_t size;
+  if (item->type == A1C_ItemType_float16) {
+    size = A1C_encodeFloat16(head, item->float16);
+  } else if (item->type == A1C_ItemType_float32) {
+    uint32_t bits;
+    memcpy(&bits, &item->float32, sizeof(bits));
+    size = A1C_encodeFloat32(head, bits, encoder->preferredFloats);
   } else {
-    if (A1C_Decoder_remaining(decoder) < size) {
-      // Each item must be at least one byte
-      // Check remaining before allocation to avoid huge allocations.
-      return A1C_Decoder_error(decoder, A1C_ErrorType_truncated);
-    }
-    A1C_Item *array = A1C_Item_array(item, size, &decoder->arena);
-    if (array == NULL) {
-      return A1C_Decoder_error(decoder, A1C_ErrorType_badAlloc);
-    }
-    for (size_t i = 0; i < size; i++) {
-      A1C_RET_IF_ERR(A1C_Decoder_decodeOneInto(decoder, array + i));
-      array[i].parent = item;
+    assert(item->type == A1C_ItemType_float64);
+    uint64_t bits;
+    memcpy(&bits, &item->float64, sizeof(bits));
+    size = A1C_encodeFloat64(head, bits, encoder->preferredFloats);
+  }
+  return A1C_Encoder_write(encoder, head, size);
+}
+
+static bool A1C_NODISCARD A1C_Encoder_encodeSpecial(A1C_Encoder *encoder,
+                                                    const A1C_Item *item) {
+  if (item->type == A1C_ItemType_boolean) {
+    const uint64_t count = item->boolean ? 21 : 20;
+    return A1C_Encoder_encodeHeaderAndCount(encoder, A1C_MajorType_special,
+                                            count);
+  } else if (item->type == A1C_ItemType_null) {
+    return A1C_Encoder_encodeHeaderAndCount(encoder, A1C_MajorType_special, 22);
+  } else if (item->type == A1C_ItemType_undefined) {
+    return A1C_Encoder_encodeHeaderAndCount(encoder, A1C_MajorType_special, 23);
+  } else if (item->type == A1C_ItemType_simple) {
+    if (item->simple >= 20 && item->simple < 32) {
+      return A1C_Encoder_error(encoder, A1C_ErrorType_invalidSimpleValue);
     }
+    return A1C_Encoder_encodeHeaderAndCount(encoder, A1C_MajorType_special,
+                                            item->simple);
+  } else if (item->type == A1C_ItemType_float16 ||
+             item->type == A1C_ItemType_float32 ||
+             item->type == A1C_ItemType_float64) {
+    return A1C_Encoder_encodeFloat(encoder, item);
+  } else {
+    assert(false);
+    return false;
+  }
+}
+
+bool A1C_Encoder_encodeOne(A1C_Encoder *encoder, const A1C_Item *item) {
+  ++encoder->depth;
+  encoder->currentItem = item;
+  switch (item->type) {
+  case A1C_ItemType_int64:
+    A1C_RET_IF_ERR(A1C_Encoder_encodeInt(encoder, item));
+    break;
+  case A1C_ItemType_bytes:
+  case A1C_ItemType_string:
+    A1C_RET_IF_ERR(A1C_Encoder_encodeData(encoder, item));
+    break;
+  case A1C_ItemType_array:
+    A1C_RET_IF_ERR(A1C_Encoder_encodeArray(encoder, item));
+    break;
+  case A1C_ItemType_packedArray:
+    A1C_RET_IF_ERR(A1C_Encoder_encodePackedArray(encoder, item));
+    break;
+  case A1C_ItemType_map:
+    A1C_RET_IF_ERR(A1C_Encoder_encodeMap(encoder, item));
+    break;
+  case A1C_ItemType_tag:
+    A1C_RET_IF_ERR(A1C_Encoder_encodeTag(encoder, item));
+    break;
+  case A1C_ItemType_boolean:
+  case A1C_ItemType_null:
+  case A1C_ItemType_undefined:
+  case A1C_ItemType_float16:
+  case A1C_ItemType_float32:
+  case A1C_ItemType_float64:
+  case A1C_ItemType_simple:
+    A1C_RET_IF_ERR(A1C_Encoder_encodeSpecial(encoder, item));
+    break;
   }
+
+  --encoder->depth;
   return true;
 }
 
-static bool A1C_NODISCARD A1C_Decoder_decodeMap(A1C_Decoder *decoder,
-                                                A1C_ItemHeader header,
-                                                A1C_Item *item) {
-  size_t size;
-  A1C_RET_IF_ERR(A1C_Decoder_readSize(decoder, header, &size));
-  if (A1C_ItemHeader_isIndefinite(header)) {
-    size = 0;
-    const A1C_Item *prevKey = NULL;
-    const A1C_Item *prevVal = NULL;
-    for (;;) {
-      A1C_ItemHeader keyHeader;
-      A1C_RET_IF_ERR(A1C_Decoder_peek(decoder, &keyHeader, sizeof(keyHeader)));
-      if (A1C_ItemHeader_isBreak(keyHeader)) {
-        A1C_RET_IF_ERR(A1C_Decoder_skip(decoder, sizeof(keyHeader)));
-        break;
-      }
-      A1C_Item *key = A1C_Decoder_decodeOne(decoder);
-      if (key == NULL) {
-        return NULL;
-      }
-      A1C_Item *value = A1C_Decoder_decodeOne(decoder);
-      if (value == NULL) {
-        return NULL;
-      }
-      key->parent = prevKey;
-      prevKey = key;
+bool A1C_Encoder_encode(A1C_Encoder *encoder, const A1C_Item *item) {
+  A1C_Encoder_reset(encoder);
+  return A1C_Encoder_encodeOne(encoder, item);
+}
 
-      value->parent = prevVal;
-      prevVal = value;
+bool A1C_Encoder_int64Array(A1C_Encoder *encoder, const int64_t *values,
+                            size_t count) {
+  A1C_Encoder_reset(encoder);
+  A1C_RET_IF_ERR(A1C_Encoder_encodeHeaderAndCount(encoder, A1C_MajorType_array,
+                                                  count));
+  return A1C_Encoder_int64Elements(encoder, values, count);
+}
 
-      ++size;
-    }
-    A1C_Pair *map = A1C_Item_map(item, size, &decoder->arena);
-    if (map == NULL) {
-      return A1C_Decoder_error(decoder, A1C_ErrorType_badAlloc);
-    }
-    while (prevKey != NULL) {
-      const A1C_Item *key = prevKey;
-      prevKey = prevKey->parent;
+bool A1C_Encoder_float32Array(A1C_Encoder *encoder, const A1C_Float32 *values,
+                              size_t count) {
+  A1C_Encoder_reset(encoder);
+  A1C_RET_IF_ERR(A1C_Encoder_encodeHeaderAndCount(encoder, A1C_MajorType_array,
+                                                  count));
+  return A1C_Encoder_float32Elements(encoder, values, count);
+}
 
-      assert(prevVal != NULL);
-      const A1C_Item *value = prevVal;
-      prevVal = prevVal->parent;
+bool A1C_Encoder_float64Array(A1C_Encoder *encoder, const A1C_Float64 *values,
+                              size_t count) {
+  A1C_Encoder_reset(encoder);
+  A1C_RET_IF_ERR(A1C_Encoder_encodeHeaderAndCount(encoder, A1C_MajorType_array,
+                                                  count));
+  return A1C_Encoder_float64Elements(encoder, values, count);
+}
 
-      --size;
-      map[size].key = *key;
-      map[size].key.parent = item;
-      map[size].value = *value;
-      map[size].value.parent = item;
+// Ordering of deterministic encodings. CBOR heads are prefix free, so the
+// encoded bytes of two items compare like their heads, and then like their
+// contents, without ever writing them out.
+
+/// The head of the deterministic encoding of an item. Compares like its bytes
+/// when compared field by field.
+typedef struct {
+  A1C_MajorType majorType;
+  uint8_t shortCount;
+  uint64_t value;
+} A1C_ItemHead;
+
+static A1C_ItemHead A1C_ItemHead_make(A1C_MajorType majorType, uint64_t value) {
+  A1C_ItemHead head = {
+      .majorType = majorType,
+      .shortCount = A1C_shortCount(value),
+      .value = value,
+  };
+  return head;
+}
+
+static A1C_ItemHead A1C_ItemHead_float(uint8_t shortCount, uint64_t bits) {
+  A1C_ItemHead head = {
+      .majorType = A1C_MajorType_special,
+      .shortCount = shortCount,
+      .value = bits,
+  };
+  return head;
+}
+
+/// @returns The head of @p item, with floats narrowed as preferredFloats does.
+static A1C_ItemHead A1C_ItemHead_get(const A1C_Item *item) {
+  switch (item->type) {
+  case A1C_ItemType_int64:
+    if (item->int64 >= 0) {
+      return A1C_ItemHead_make(A1C_MajorType_uint, (uint64_t)item->int64);
     }
-    assert(size == 0);
-  } else {
-    if (A1C_Decoder_remaining(decoder) < size) {
-      // Each item must be at least one byte
-      // Check remaining before allocation to avoid huge allocations.
-      return A1C_Decoder_error(decoder, A1C_ErrorType_truncated);
+    return A1C_ItemHead_make(A1C_MajorType_int, (uint64_t)~item->int64);
+  case A1C_ItemType_bytes:
+    return A1C_ItemHead_make(A1C_MajorType_bytes, item->bytes.size);
+  case A1C_ItemType_string:
+    return A1C_ItemHead_make(A1C_MajorType_string, item->string.size);
+  case A1C_ItemType_array:
+    return A1C_ItemHead_make(A1C_MajorType_array, item->array.size);
+  case A1C_ItemType_packedArray:
+    return A1C_ItemHead_make(A1C_MajorType_array, item->packedArray.size);
+  case A1C_ItemType_map:
+    return A1C_ItemHead_make(A1C_MajorType_map, item->map.size);
+  case A1C_ItemType_tag:
+    return A1C_ItemHead_make(A1C_MajorType_tag, item->tag.tag);
+  case A1C_ItemType_boolean:
+    return A1C_ItemHead_make(A1C_MajorType_special, item->boolean ? 21 : 20);
+  case A1C_ItemType_null:
+    return A1C_ItemHead_make(A1C_MajorType_special, 22);
+  case A1C_ItemType_undefined:
+    return A1C_ItemHead_make(A1C_MajorType_special, 23);
+  case A1C_ItemType_simple:
+    return A1C_ItemHead_make(A1C_MajorType_special, item->simple);
+  case A1C_ItemType_float16:
+    return A1C_ItemHead_float(25, item->float16);
+  case A1C_ItemType_float32: {
+    uint32_t bits;
+    memcpy(&bits, &item->float32, sizeof(bits));
+    uint16_t narrow;
+    if (A1C_float32To16Exact(bits, &narrow)) {
+      return A1C_ItemHead_float(25, narrow);
     }
-    A1C_Pair *map = A1C_Item_map(item, size, &decoder->arena);
-    if (map == NULL) {
-      return A1C_Decoder_error(decoder, A1C_ErrorType_badAlloc);
+    return A1C_ItemHead_float(26, bits);
+  }
+  case A1C_ItemType_float64: {
+    uint64_t bits;
+    memcpy(&bits, &item->float64, sizeof(bits));
+    uint32_t narrow32;
+    if (!A1C_float64To32Exact(bits, &narrow32)) {
+      return A1C_ItemHead_float(27, bits);
     }
-    for (size_t i = 0; i < size; i++) {
-      A1C_RET_IF_ERR(A1C_Decoder_decodeOneInto(decoder, &map[i].key));
-      map[i].key.parent = item;
+    uint16_t narrow16;
+    if (A1C_float32To16Exact(narrow32, &narrow16)) {
+      return A1C_ItemHead_float(25, narrow16);
+    }
+    return A1C_ItemHead_float(26, narrow32);
+  }
+  }
+  return A1C_ItemHead_make(A1C_MajorType_special, 0);
+}
 
-      A1C_RET_IF_ERR(A1C_Decoder_decodeOneInto(decoder, &map[i].value));
-      map[i].value.parent = item;
+static int A1C_compareU64(uint64_t a, uint64_t b) {
+  return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+static int A1C_Item_compareImpl(const A1C_Item *a, const A1C_Item *b,
+                                A1C_Arena *scratch);
+
+/// @returns true if the keys of @p map are strictly increasing.
+static bool A1C_Map_isSorted(const A1C_Map *map, A1C_Arena *scratch) {
+  for (size_t i = 1; i < map->size; ++i) {
+    if (A1C_Item_compareImpl(&map->items[i - 1].key, &map->items[i].key,
+                             scratch) >= 0) {
+      return false;
     }
   }
   return true;
 }
 
-static bool A1C_NODISCARD A1C_Decoder_decodeTag(A1C_Decoder *decoder,
-                                                A1C_ItemHeader header,
-                                                A1C_Item *item) {
-  uint64_t value;
-  A1C_RET_IF_ERR(A1C_Decoder_readCount(decoder, header, &value));
-  A1C_Item *child = A1C_Item_tag(item, value, &decoder->arena);
-  if (child == NULL) {
-    return A1C_Decoder_error(decoder, A1C_ErrorType_badAlloc);
+/// Orders the pairs of @p map by key, then value, then index.
+static int A1C_Map_comparePairs(const A1C_Map *map, size_t a, size_t b,
+                                A1C_Arena *scratch) {
+  int cmp =
+      A1C_Item_compareImpl(&map->items[a].key, &map->items[b].key, scratch);
+  if (cmp == 0) {
+    cmp = A1C_Item_compareImpl(&map->items[a].value, &map->items[b].value,
+                               scratch);
   }
-  A1C_RET_IF_ERR(A1C_Decoder_decodeOneInto(decoder, child));
-  assert(child->parent == item);
-
-  return true;
+  if (cmp == 0) {
+    cmp = A1C_compareU64(a, b);
+  }
+  return cmp;
 }
 
-static bool A1C_NODISCARD A1C_Decoder_decodeSpecial(A1C_Decoder *decoder,
-                                                    A1C_ItemHeader header,
-                                                    A1C_Item *item) {
-  const size_t shortCount = A1C_ItemHeader_shortCount(header);
-  if (shortCount == 20 || shortCount == 21) {
-    A1C_Item_boolean(item, shortCount == 21);
-  } else if (shortCount == 22) {
-    A1C_Item_null(item);
-  } else if (shortCount == 23) {
-    A1C_Item_undefined(item);
-  } else if (shortCount == 24) {
-    if (decoder->rejectUnknownSimple) {
-      return A1C_Decoder_error(decoder, A1C_ErrorType_invalidSimpleEncoding);
-    }
-    uint8_t value;
-    A1C_RET_IF_ERR(A1C_Decoder_read(decoder, &value, sizeof(value)));
-    if (value < 32) {
-      return A1C_Decoder_error(decoder, A1C_ErrorType_invalidSimpleEncoding);
+/// @returns The index of the pair that follows @p prev in sorted order, or
+/// the first pair if @p prev is SIZE_MAX. Quadratic, so only used for
+/// unsorted maps when there is no scratch arena to sort them.
+static size_t A1C_Map_nextPair(const A1C_Map *map, size_t prev) {
+  size_t best = SIZE_MAX;
+  for (size_t i = 0; i < map->size; ++i) {
+    if (prev != SIZE_MAX && A1C_Map_comparePairs(map, i, prev, NULL) <= 0) {
+      continue;
     }
-    A1C_Item_simple(item, value);
-  } else if (shortCount == 25) {
-    uint16_t value;
-    A1C_RET_IF_ERR(A1C_Decoder_read(decoder, &value, sizeof(value)));
-    value = A1C_bigEndian16(value);
-    A1C_Item_float16(item, value);
-  } else if (shortCount == 26) {
-    uint32_t value;
-    A1C_RET_IF_ERR(A1C_Decoder_read(decoder, &value, sizeof(value)));
-    value = A1C_bigEndian32(value);
-    float float32;
-    memcpy(&float32, &value, sizeof(float32));
-    A1C_Item_float32(item, float32);
-  } else if (shortCount == 27) {
-    uint64_t value;
-    A1C_RET_IF_ERR(A1C_Decoder_read(decoder, &value, sizeof(value)));
-    value = A1C_bigEndian64(value);
-    double float64;
-    memcpy(&float64, &value, sizeof(float64));
-    A1C_Item_float64(item, float64);
-  } else if (shortCount < 20) {
-    if (decoder->rejectUnknownSimple) {
-      return A1C_Decoder_error(decoder, A1C_ErrorType_invalidSimpleEncoding);
+    if (best == SIZE_MAX || A1C_Map_comparePairs(map, i, best, NULL) < 0) {
+      best = i;
     }
-    A1C_Item_simple(item, (uint8_t)shortCount);
-  } else if (shortCount == 31) {
-    return A1C_Decoder_error(decoder, A1C_ErrorType_breakNotAllowed);
-  } else {
-    assert(shortCount >= 28 && shortCount <= 30);
-    assert(false);
   }
-  return true;
+  return best;
 }
 
-static A1C_Item *A1C_NODISCARD A1C_Decoder_decodeOne(A1C_Decoder *decoder) {
-  A1C_Item *item = A1C_Arena_calloc(&decoder->arena, 1, sizeof(A1C_Item));
-  if (item == NULL) {
-    (void)A1C_Decoder_error(decoder, A1C_ErrorType_badAlloc);
+/**
+ * Sorts the pair indices of @p map with a bottom-up merge sort. Pairs are
+ * ordered by index last, so this visits them in the same order as
+ * A1C_Map_nextPair().
+ * @returns The sorted indices allocated from @p scratch, or NULL if the
+ * allocation fails.
+ */
+static const size_t *A1C_Map_sortPairs(const A1C_Map *map,
+                                       A1C_Arena *scratch) {
+  const size_t count = map->size;
+  size_t *indices = A1C_Arena_calloc(scratch, count, 2 * sizeof(size_t));
+  if (indices == NULL) {
     return NULL;
   }
-  item->parent = decoder->parent;
-  if (!A1C_Decoder_decodeOneInto(decoder, item)) {
-    return NULL;
+  size_t *src = indices;
+  size_t *dst = indices + count;
+  for (size_t i = 0; i < count; ++i) {
+    src[i] = i;
   }
-  return item;
+  for (size_t width = 1; width < count; width *= 2) {
+    for (size_t begin = 0; begin < count; begin += 2 * width) {
+      const size_t mid = begin + width < count ? begin + width : count;
+      const size_t end = mid + width < count ? mid + width : count;
+      size_t l = begin;
+      size_t r = mid;
+      for (size_t i = begin; i < end; ++i) {
+        if (l < mid &&
+            (r == end ||
+             A1C_Map_comparePairs(map, src[r], src[l], scratch) > 0)) {
+          dst[i] = src[l++];
+        } else {
+          dst[i] = src[r++];
+        }
+      }
+    }
+    size_t *const swap = src;
+    src = dst;
+    dst = swap;
+  }
+  return src;
 }
 
-static bool A1C_NODISCARD A1C_Decoder_decodeOneInto(A1C_Decoder *decoder,
-                                                    A1C_Item *item) {
-  if (++decoder->depth > decoder->maxDepth) {
-    return A1C_Decoder_error(decoder, A1C_ErrorType_maxDepthExceeded);
+static int A1C_Map_compare(const A1C_Map *a, const A1C_Map *b,
+                           A1C_Arena *scratch) {
+  assert(a->size == b->size);
+  const bool aSorted = A1C_Map_isSorted(a, scratch);
+  const bool bSorted = A1C_Map_isSorted(b, scratch);
+  const size_t *aOrder = NULL;
+  const size_t *bOrder = NULL;
+  if (!aSorted && scratch != NULL) {
+    aOrder = A1C_Map_sortPairs(a, scratch);
   }
-
-  A1C_ItemHeader header;
-  A1C_RET_IF_ERR(A1C_Decoder_read(decoder, &header, sizeof(header)));
-
-  if (!A1C_ItemHeader_isLegal(header)) {
-    return A1C_Decoder_error(decoder, A1C_ErrorType_invalidItemHeader);
+  if (!bSorted && scratch != NULL) {
+    bOrder = A1C_Map_sortPairs(b, scratch);
   }
-
-  switch (A1C_ItemHeader_majorType(header)) {
-  case A1C_MajorType_uint:
-    A1C_RET_IF_ERR(A1C_Decoder_decodeUInt(decoder, header, item));
-    break;
-  case A1C_MajorType_int:
-    A1C_RET_IF_ERR(A1C_Decoder_decodeInt(decoder, header, item));
-    break;
-  case A1C_MajorType_bytes:
-    A1C_RET_IF_ERR(A1C_Decoder_decodeData(decoder, header, item));
-    break;
-  case A1C_MajorType_string:
-    A1C_RET_IF_ERR(A1C_Decoder_decodeData(decoder, header, item));
-    break;
-  case A1C_MajorType_array:
-    A1C_RET_IF_ERR(A1C_Decoder_decodeArray(decoder, header, item));
-    break;
-  case A1C_MajorType_map:
-    A1C_RET_IF_ERR(A1C_Decoder_decodeMap(decoder, header, item));
-    break;
-  case A1C_MajorType_tag:
-    A1C_RET_IF_ERR(A1C_Decoder_decodeTag(decoder, header, item));
-    break;
-  case A1C_MajorType_special:
-    A1C_RET_IF_ERR(A1C_Decoder_decodeSpecial(decoder, header, item));
-    break;
+  size_t aIndex = SIZE_MAX;
+  size_t bIndex = SIZE_MAX;
+  for (size_t i = 0; i < a->size; ++i) {
+    if (aSorted) {
+      aIndex = i;
+    } else {
+      aIndex = aOrder != NULL ? aOrder[i] : A1C_Map_nextPair(a, aIndex);
+    }
+    if (bSorted) {
+      bIndex = i;
+    } else {
+      bIndex = bOrder != NULL ? bOrder[i] : A1C_Map_nextPair(b, bIndex);
+    }
+    const A1C_Pair *aPair = &a->items[aIndex];
+    const A1C_Pair *bPair = &b->items[bIndex];
+    int cmp = A1C_Item_compareImpl(&aPair->key, &bPair->key, scratch);
+    if (cmp == 0) {
+      cmp = A1C_Item_compareImpl(&aPair->value, &bPair->value, scratch);
+    }
+    if (cmp != 0) {
+      return cmp;
+    }
   }
-  --decoder->depth;
-  return true;
+  return 0;
 }
 
-const A1C_Item *A1C_Decoder_decode(A1C_Decoder *decoder, const uint8_t *data,
-                                   size_t size) {
-  A1C_Decoder_reset(decoder, data, size);
-  if (data == NULL) {
-    decoder->error.type = A1C_ErrorType_truncated;
-    decoder->error.srcPos = 0;
-    return NULL;
+static int A1C_Item_compareImpl(const A1C_Item *a, const A1C_Item *b,
+                                A1C_Arena *scratch) {
+  const A1C_ItemHead aHead = A1C_ItemHead_get(a);
+  const A1C_ItemHead bHead = A1C_ItemHead_get(b);
+  if (aHead.majorType != bHead.majorType) {
+    return aHead.majorType < bHead.majorType ? -1 : 1;
   }
-  A1C_Item *item = A1C_Decoder_decodeOne(decoder);
-  if (item != NULL && decoder->ptr < decoder->end) {
-    (void)A1C_Decoder_error(decoder, A1C_ErrorType_trailingData);
-    return NULL;
+  if (aHead.shortCount != bHead.shortCount) {
+    return aHead.shortCount < bHead.shortCount ? -1 : 1;
   }
-  return item;
+  if (aHead.value != bHead.value) {
+    return A1C_compareU64(aHead.value, bHead.value);
+  }
+
+  // Equal heads have equal major types, so only the special types can differ,
+  // and those have no contents.
+  switch (a->type) {
+  case A1C_ItemType_bytes:
+    return a->bytes.size == 0
+               ? 0
+               : memcmp(a->bytes.data, b->bytes.data, a->bytes.size);
+  case A1C_ItemType_string:
+    return a->string.size == 0
+               ? 0
+               : memcmp(a->string.data, b->string.data, a->string.size);
+  case A1C_ItemType_array:
+  case A1C_ItemType_packedArray:
+    for (size_t i = 0; i < A1C_Item_arraySize(a); ++i) {
+      A1C_Item aScratch, bScratch;
+      const int cmp =
+          A1C_Item_compareImpl(A1C_Item_arrayAt(a, i, &aScratch),
+                               A1C_Item_arrayAt(b, i, &bScratch), scratch);
+      if (cmp != 0) {
+        return cmp;
+      }
+    }
+    return 0;
+  case A1C_ItemType_map:
+    return A1C_Map_compare(&a->map, &b->map, scratch);
+  case A1C_ItemType_tag:
+    return A1C_Item_compareImpl(a->tag.item, b->tag.item, scratch);
+  case A1C_ItemType_int64:
+  case A1C_ItemType_float16:
+  case A1C_ItemType_float32:
+  case A1C_ItemType_float64:
+  case A1C_ItemType_boolean:
+  case A1C_ItemType_null:
+  case A1C_ItemType_undefined:
+  case A1C_ItemType_simple:
+    return 0;
+  }
+  return 0;
+}
+
+int A1C_Item_compare(const A1C_Item *a, const A1C_Item *b) {
+  return A1C_Item_compareImpl(a, b, NULL);
+}
+
+int A1C_Item_compareWithArena(const A1C_Item *a, const A1C_Item *b,
+                              A1C_Arena *scratchArena) {
+  return A1C_Item_compareImpl(a, b, scratchArena);
 }
 
 ////////////////////////////////////////
-// Encoder
+// Number Formatting
 ////////////////////////////////////////
 
-void A1C_Encoder_init(A1C_Encoder *encoder, A1C_Encoder_WriteCallback write,
-                      void *opaque) {
-  memset(encoder, 0, sizeof(*encoder));
-  encoder->write = write;
-  encoder->opaque = opaque;
+// Integers are written two digits at a time from a digit pair table. Floats
+// are converted to the shortest decimal that parses back to the same value
+// with Ryu (Ulf Adams, "Ryū: fast float-to-string conversion", PLDI 2018),
+// then laid out like JavaScript's Number.prototype.toString(), except that
+// integral values keep a ".0" so they still read back as floats.
+
+static const char A1C_kDigitPairs[201] = "00010203040506070809"
+                                         "10111213141516171819"
+                                         "20212223242526272829"
+                                         "30313233343536373839"
+                                         "40414243444546474849"
+                                         "50515253545556575859"
+                                         "60616263646566676869"
+                                         "70717273747576777879"
+                                         "80818283848586878889"
+                                         "90919293949596979899";
+
+/// Enough for any int64 or float, including the sign and exponent.
+#define A1C_NUMBER_BUFFER_SIZE 32
+
+/**
+ * Writes the decimal digits of @p value so that they end just before @p end.
+ * @returns A pointer to the first digit.
+ */
+static char *A1C_formatDigitsBackward(char *end, uint64_t value) {
+  while (value >= 100) {
+    const size_t pair = (size_t)(value % 100) * 2;
+    value /= 100;
+    end -= 2;
+    memcpy(end, A1C_kDigitPairs + pair, 2);
+  }
+  if (value >= 10) {
+    end -= 2;
+    memcpy(end, A1C_kDigitPairs + (size_t)value * 2, 2);
+  } else {
+    *--end = (char)('0' + value);
+  }
+  return end;
 }
 
-A1C_Error A1C_Encoder_getError(const A1C_Encoder *encoder) {
-  return encoder->error;
+/// Formats @p value into @p buffer and returns the number of bytes written.
+static size_t A1C_formatInt64(char *buffer, int64_t value) {
+  char digits[A1C_NUMBER_BUFFER_SIZE];
+  char *const end = digits + sizeof(digits);
+  uint64_t magnitude = (uint64_t)value;
+  if (value < 0) {
+    magnitude = 0 - magnitude;
+  }
+  char *begin = A1C_formatDigitsBackward(end, magnitude);
+  if (value < 0) {
+    *--begin = '-';
+  }
+  const size_t size = (size_t)(end - begin);
+  memcpy(buffer, begin, size);
+  return size;
 }
 
-static void A1C_Encoder_reset(A1C_Encoder *encoder) {
-  memset(&encoder->error, 0, sizeof(A1C_Error));
-  encoder->bytesWritten = 0;
-  encoder->depth = 0;
+// Tables of 5^i and 2^k / 5^i scaled to 125 significant bits, stored as
+// {low, high} 64-bit halves. Float32 uses just the high halves.
+
+#define A1C_POW5_INV_BITCOUNT 125
+#define A1C_POW5_BITCOUNT 125
+#define A1C_FLOAT_POW5_INV_BITCOUNT (A1C_POW5_INV_BITCOUNT - 64)
+#define A1C_FLOAT_POW5_BITCOUNT (A1C_POW5_BITCOUNT - 64)
+
+static const uint64_t A1C_kPow5InvSplit[292][2] = {
+    {1u, 2305843009213693952u},
+    {11068046444225730970u, 1844674407370955161u},
+    {5165088340638674453u, 1475739525896764129u},
+    {7821419487252849886u, 1180591620717411303u},
+    {8824922364862649494u, 1888946593147858085u},
+    {7059937891890119595u, 1511157274518286468u},
+    {13026647942995916322u, 1208925819614629174u},
+    {9774590264567735146u, 1934281311383406679u},
+    {11509021026396098440u, 1547425049106725343u},
+    {16585914450600699399u, 1237940039285380274u},
+    {15469416676735388068u, 1980704062856608439u},
+    {16064882156130220778u, 1584563250285286751u},
+    {9162556910162266299u, 1267650600228229401u},
+    {7281393426775805432u, 2028240960365167042u},
+    {16893161185646375315u, 1622592768292133633u},
+    {2446482504291369283u, 1298074214633706907u},
+    {7603720821608101175u, 2076918743413931051u},
+    {2393627842544570617u, 1661534994731144841u},
+    {16672297533003297786u, 1329227995784915872u},
+    {11918280793837635165u, 2126764793255865396u},
+    {5845275820328197809u, 1701411834604692317u},
+    {15744267100488289217u, 1361129467683753853u},
+    {3054734472329800808u, 2177807148294006166u},
+    {17201182836831481939u, 1742245718635204932u},
+    {6382248639981364905u, 1393796574908163946u},
+    {2832900194486363201u, 2230074519853062314u},
+    {5955668970331000884u, 1784059615882449851u},
+    {1075186361522890384u, 1427247692705959881u},
+    {12788344622662355584u, 2283596308329535809u},
+    {13920024512871794791u, 1826877046663628647u},
+    {3757321980813615186u, 1461501637330902918u},
+    {10384555214134712795u, 1169201309864722334u},
+    {5547241898389809503u, 1870722095783555735u},
+    {4437793518711847602u, 1496577676626844588u},
+    {10928932444453298728u, 1197262141301475670u},
+    {17486291911125277965u, 1915619426082361072u},
+    {6610335899416401726u, 1532495540865888858u},
+    {12666966349016942027u, 1225996432692711086u},
+    {12888448528943286597u, 1961594292308337738u},
+    {17689456452638449924u, 1569275433846670190u},
+    {14151565162110759939u, 1255420347077336152u},
+    {7885109000409574610u, 2008672555323737844u},
+    {9997436015069570011u, 1606938044258990275u},
+    {7997948812055656009u, 1285550435407192220u},
+    {12796718099289049614u, 2056880696651507552u},
+    {2858676849947419045u, 1645504557321206042u},
+    {13354987924183666206u, 1316403645856964833u},
+    {17678631863951955605u, 2106245833371143733u},
+    {3074859046935833515u, 1684996666696914987u},
+    {13527933681774397782u, 1347997333357531989u},
+    {10576647446613305481u, 2156795733372051183u},
+    {15840015586774465031u, 1725436586697640946u},
+    {8982663654677661702u, 1380349269358112757u},
+    {18061610662226169046u, 2208558830972980411u},
+    {10759939715039024913u, 1766847064778384329u},
+    {12297300586773130254u, 1413477651822707463u},
+    {15986332124095098083u, 2261564242916331941u},
+    {9099716884534168143u, 1809251394333065553u},
+    {14658471137111155161u, 1447401115466452442u},
+    {4348079280205103483u, 1157920892373161954u},
+    {14335624477811986218u, 1852673427797059126u},
+    {7779150767507678651u, 1482138742237647301u},
+    {2533971799264232598u, 1185710993790117841u},
+    {15122401323048503126u, 1897137590064188545u},
+    {12097921058438802501u, 1517710072051350836u},
+    {5988988032009131678u, 1214168057641080669u},
+    {16961078480698431330u, 1942668892225729070u},
+    {13568862784558745064u, 1554135113780583256u},
+    {7165741412905085728u, 1243308091024466605u},
+    {11465186260648137165u, 1989292945639146568u},
+    {16550846638002330379u, 1591434356511317254u},
+    {16930026125143774626u, 1273147485209053803u},
+    {4951948911778577463u, 2037035976334486086u},
+    {272210314680951647u, 1629628781067588869u},
+    {3907117066486671641u, 1303703024854071095u},
+    {6251387306378674625u, 2085924839766513752u},
+    {16069156289328670670u, 1668739871813211001u},
+    {9165976216721026213u, 1334991897450568801u},
+    {7286864317269821294u, 2135987035920910082u},
+    {16897537898041588005u, 1708789628736728065u},
+    {13518030318433270404u, 1367031702989382452u},
+    {6871453250525591353u, 2187250724783011924u},
+    {9186511415162383406u, 1749800579826409539u},
+    {11038557946871817048u, 1399840463861127631u},
+    {10282995085511086630u, 2239744742177804210u},
+    {8226396068408869304u, 1791795793742243368u},
+    {13959814484210916090u, 1433436634993794694u},
+    {11267656730511734774u, 2293498615990071511u},
+    {5324776569667477496u, 1834798892792057209u},
+    {7949170070475892320u, 1467839114233645767u},
+    {17427382500606444826u, 1174271291386916613u},
+    {5747719112518849781u, 1878834066219066582u},
+    {15666221734240810795u, 1503067252975253265u},
+    {12532977387392648636u, 1202453802380202612u},
+    {5295368560860596524u, 1923926083808324180u},
+    {4236294848688477220u, 1539140867046659344u},
+    {7078384693692692099u, 1231312693637327475u},
+    {11325415509908307358u, 1970100309819723960u},
+    {9060332407926645887u, 1576080247855779168u},
+    {14626963555825137356u, 1260864198284623334u},
+    {12335095245094488799u, 2017382717255397335u},
+    {9868076196075591040u, 1613906173804317868u},
+    {15273158586344293478u, 1291124939043454294u},
+    {13369007293925138595u, 2065799902469526871u},
+    {7005857020398200553u, 1652639921975621497u},
+    {16672732060544291412u, 1322111937580497197u},
+    {11918976037903224966u, 2115379100128795516u},
+    {5845832015580669650u, 1692303280103036413u},
+    {12055363241948356366u, 1353842624082429130u},
+    {841837113407818570u, 2166148198531886609u},
+    {4362818505468165179u, 1732918558825509287u},
+    {14558301248600263113u, 1386334847060407429u},
+    {12225235553534690011u, 2218135755296651887u},
+    {2401490813343931363u, 1774508604237321510u},
+    {1921192650675145090u, 1419606883389857208u},
+    {17831303500047873437u, 2271371013423771532u},
+    {6886345170554478103u, 1817096810739017226u},
+    {1819727321701672159u, 1453677448591213781u},
+    {16213177116328979020u, 1162941958872971024u},
+    {14873036941900635463u, 1860707134196753639u},
+    {15587778368262418694u, 1488565707357402911u},
+    {8780873879868024632u, 1190852565885922329u},
+    {2981351763563108441u, 1905364105417475727u},
+    {13453127855076217722u, 1524291284333980581u},
+    {7073153469319063855u, 1219433027467184465u},
+    {11317045550910502167u, 1951092843947495144u},
+    {12742985255470312057u, 1560874275157996115u},
+    {10194388204376249646u, 1248699420126396892u},
+    {1553625868034358140u, 1997919072202235028u},
+    {8621598323911307159u, 1598335257761788022u},
+    {17965325103354776697u, 1278668206209430417u},
+    {13987124906400001422u, 2045869129935088668u},
+    {121653480894270168u, 1636695303948070935u},
+    {97322784715416134u, 1309356243158456748u},
+    {14913111714512307107u, 2094969989053530796u},
+    {8241140556867935363u, 1675975991242824637u},
+    {17660958889720079260u, 1340780792994259709u},
+    {17189487779326395846u, 2145249268790815535u},
+    {13751590223461116677u, 1716199415032652428u},
+    {18379969808252713988u, 1372959532026121942u},
+    {14650556434236701088u, 2196735251241795108u},
+    {652398703163629901u, 1757388200993436087u},
+    {11589965406756634890u, 1405910560794748869u},
+    {7475898206584884855u, 2249456897271598191u},
+    {2291369750525997561u, 1799565517817278553u},
+    {9211793429904618695u, 1439652414253822842u},
+    {18428218302589300235u, 2303443862806116547u},
+    {7363877012587619542u, 1842755090244893238u},
+    {13269799239553916280u, 1474204072195914590u},
+    {10615839391643133024u, 1179363257756731672u},
+    {2227947767661371545u, 1886981212410770676u},
+    {16539753473096738529u, 1509584969928616540u},
+    {13231802778477390823u, 1207667975942893232u},
+    {6413489186596184024u, 1932268761508629172u},
+    {16198837793502678189u, 1545815009206903337u},
+    {5580372605318321905u, 1236652007365522670u},
+    {8928596168509315048u, 1978643211784836272u},
+    {18210923379033183008u, 1582914569427869017u},
+    {7190041073742725760u, 1266331655542295214u},
+    {436019273762630246u, 2026130648867672343u},
+    {7727513048493924843u, 1620904519094137874u},
+    {9871359253537050198u, 1296723615275310299u},
+    {4726128361433549347u, 2074757784440496479u},
+    {7470251503888749801u, 1659806227552397183u},
+    {13354898832594820487u, 1327844982041917746u},
+    {13989140502667892133u, 2124551971267068394u},
+    {14880661216876224029u, 1699641577013654715u},
+    {11904528973500979224u, 1359713261610923772u},
+    {4289851098633925465u, 2175541218577478036u},
+    {18189276137874781665u, 1740432974861982428u},
+    {3483374466074094362u, 1392346379889585943u},
+    {1884050330976640656u, 2227754207823337509u},
+    {5196589079523222848u, 1782203366258670007u},
+    {15225317707844309248u, 1425762693006936005u},
+    {5913764258841343181u, 2281220308811097609u},
+    {8420360221814984868u, 1824976247048878087u},
+    {17804334621677718864u, 1459980997639102469u},
+    {17932816512084085415u, 1167984798111281975u},
+    {10245762345624985047u, 1868775676978051161u},
+    {4507261061758077715u, 1495020541582440929u},
+    {7295157664148372495u, 1196016433265952743u},
+    {7982903447895485668u, 1913626293225524389u},
+    {10075671573058298858u, 1530901034580419511u},
+    {4371188443704728763u, 1224720827664335609u},
+    {14372599139411386667u, 1959553324262936974u},
+    {15187428126271019657u, 1567642659410349579u},
+    {15839291315758726049u, 1254114127528279663u},
+    {3206773216762499739u, 2006582604045247462u},
+    {13633465017635730761u, 1605266083236197969u},
+    {14596120828850494932u, 1284212866588958375u},
+    {4907049252451240275u, 2054740586542333401u},
+    {236290587219081897u, 1643792469233866721u},
+    {14946427728742906810u, 1315033975387093376u},
+    {16535586736504830250u, 2104054360619349402u},
+    {5849771759720043554u, 1683243488495479522u},
+    {15747863852001765813u, 1346594790796383617u},
+    {10439186904235184007u, 2154551665274213788u},
+    {15730047152871967852u, 1723641332219371030u},
+    {12584037722297574282u, 1378913065775496824u},
+    {9066413911450387881u, 2206260905240794919u},
+    {10942479943902220628u, 1765008724192635935u},
+    {8753983955121776503u, 1412006979354108748u},
+    {10317025513452932081u, 2259211166966573997u},
+    {874922781278525018u, 1807368933573259198u},
+    {8078635854506640661u, 1445895146858607358u},
+    {13841606313089133175u, 1156716117486885886u},
+    {14767872471458792434u, 1850745787979017418u},
+    {746251532941302978u, 1480596630383213935u},
+    {597001226353042382u, 1184477304306571148u},
+    {15712597221132509104u, 1895163686890513836u},
+    {8880728962164096960u, 1516130949512411069u},
+    {10793931984473187891u, 1212904759609928855u},
+    {17270291175157100626u, 1940647615375886168u},
+    {2748186495899949531u, 1552518092300708935u},
+    {2198549196719959625u, 1242014473840567148u},
+    {18275073973719576693u, 1987223158144907436u},
+    {10930710364233751031u, 1589778526515925949u},
+    {12433917106128911148u, 1271822821212740759u},
+    {8826220925580526867u, 2034916513940385215u},
+    {7060976740464421494u, 1627933211152308172u},
+    {16716827836597268165u, 1302346568921846537u},
+    {11989529279587987770u, 2083754510274954460u},
+    {9591623423670390216u, 1667003608219963568u},
+    {15051996368420132820u, 1333602886575970854u},
+    {13015147745246481542u, 2133764618521553367u},
+    {3033420566713364587u, 1707011694817242694u},
+    {6116085268112601993u, 1365609355853794155u},
+    {9785736428980163188u, 2184974969366070648u},
+    {15207286772667951197u, 1747979975492856518u},
+    {1097782973908629988u, 1398383980394285215u},
+    {1756452758253807981u, 2237414368630856344u},
+    {5094511021344956708u, 1789931494904685075u},
+    {4075608817075965366u, 1431945195923748060u},
+    {6520974107321544586u, 2291112313477996896u},
+    {1527430471115325346u, 1832889850782397517u},
+    {12289990821117991246u, 1466311880625918013u},
+    {17210690286378213644u, 1173049504500734410u},
+    {9090360384495590213u, 1876879207201175057u},
+    {18340334751822203140u, 1501503365760940045u},
+    {14672267801457762512u, 1201202692608752036u},
+    {16096930852848599373u, 1921924308174003258u},
+    {1809498238053148529u, 1537539446539202607u},
+    {12515645034668249793u, 1230031557231362085u},
+    {1578287981759648052u, 1968050491570179337u},
+    {12330676829633449412u, 1574440393256143469u},
+    {13553890278448669853u, 1259552314604914775u},
+    {3239480371808320148u, 2015283703367863641u},
+    {17348979556414297411u, 1612226962694290912u},
+    {6500486015647617283u, 1289781570155432730u},
+    {10400777625036187652u, 2063650512248692368u},
+    {15699319729512770768u, 1650920409798953894u},
+    {16248804598352126938u, 1320736327839163115u},
+    {7551343283653851484u, 2113178124542660985u},
+    {6041074626923081187u, 1690542499634128788u},
+    {12211557331022285596u, 1352433999707303030u},
+    {1091747655926105338u, 2163894399531684849u},
+    {4562746939482794594u, 1731115519625347879u},
+    {7339546366328145998u, 1384892415700278303u},
+    {8053925371383123274u, 2215827865120445285u},
+    {6443140297106498619u, 1772662292096356228u},
+    {12533209867169019542u, 1418129833677084982u},
+    {5295740528502789974u, 2269007733883335972u},
+    {15304638867027962949u, 1815206187106668777u},
+    {4865013464138549713u, 1452164949685335022u},
+    {14960057215536570740u, 1161731959748268017u},
+    {9178696285890871890u, 1858771135597228828u},
+    {14721654658196518159u, 1487016908477783062u},
+    {4398626097073393881u, 1189613526782226450u},
+    {7037801755317430209u, 1903381642851562320u},
+    {5630241404253944167u, 1522705314281249856u},
+    {814844308661245011u, 1218164251424999885u},
+    {1303750893857992017u, 1949062802279999816u},
+    {15800395974054034906u, 1559250241823999852u},
+    {5261619149759407279u, 1247400193459199882u},
+    {12107939454356961969u, 1995840309534719811u},
+    {5997002748743659252u, 1596672247627775849u},
+    {8486951013736837725u, 1277337798102220679u},
+    {2511075177753209390u, 2043740476963553087u},
+    {13076906586428298482u, 1634992381570842469u},
+    {14150874083884549109u, 1307993905256673975u},
+    {4194654460505726958u, 2092790248410678361u},
+    {18113118827372222859u, 1674232198728542688u},
+    {3422448617672047318u, 1339385758982834151u},
+    {16543964232501006678u, 2143017214372534641u},
+    {9545822571258895019u, 1714413771498027713u},
+    {15015355686490936662u, 1371531017198422170u},
+    {5577825024675947042u, 2194449627517475473u},
+    {11840957649224578280u, 1755559702013980378u},
+    {16851463748863483271u, 1404447761611184302u},
+    {12204946739213931940u, 2247116418577894884u},
+    {13453306206113055875u, 1797693134862315907u},
+    {3383947335406624054u, 1438154507889852726u},
+};
+
+static const uint64_t A1C_kPow5Split[326][2] = {
+    {0u, 1152921504606846976u},
+    {0u, 1441151880758558720u},
+    {0u, 1801439850948198400u},
+    {0u, 2251799813685248000u},
+    {0u, 1407374883553280000u},
+    {0u, 1759218604441600000u},
+    {0u, 2199023255552000000u},
+    {0u, 1374389534720000000u},
+    {0u, 1717986918400000000u},
+    {0u, 2147483648000000000u},
+    {0u, 1342177280000000000u},
+    {0u, 1677721600000000000u},
+    {0u, 2097152000000000000u},
+    {0u, 1310720000000000000u},
+    {0u, 1638400000000000000u},
+    {0u, 2048000000000000000u},
+    {0u, 1280000000000000000u},
+    {0u, 1600000000000000000u},
+    {0u, 2000000000000000000u},
+    {0u, 1250000000000000000u},
+    {0u, 1562500000000000000u},
+    {0u, 1953125000000000000u},
+    {0u, 1220703125000000000u},
+    {0u, 1525878906250000000u},
+    {0u, 1907348632812500000u},
+    {0u, 1192092895507812500u},
+    {0u, 1490116119384765625u},
+    {4611686018427387904u, 1862645149230957031u},
+    {9799832789158199296u, 1164153218269348144u},
+    {12249790986447749120u, 1455191522836685180u},
+    {15312238733059686400u, 1818989403545856475u},
+    {14528612397897220096u, 2273736754432320594u},
+    {13692068767113150464u, 1421085471520200371u},
+    {12503399940464050176u, 1776356839400250464u},
+    {15629249925580062720u, 2220446049250313080u},
+    {9768281203487539200u, 1387778780781445675u},
+    {7598665485932036096u, 1734723475976807094u},
+    {274959820560269312u, 2168404344971008868u},
+    {9395221924704944128u, 1355252715606880542u},
+    {2520655369026404352u, 1694065894508600678u},
+    {12374191248137781248u, 2117582368135750847u},
+    {14651398557727195136u, 1323488980084844279u},
+    {13702562178731606016u, 1654361225106055349u},
+    {3293144668132343808u, 2067951531382569187u},
+    {18199116482078572544u, 1292469707114105741u},
+    {8913837547316051968u, 1615587133892632177u},
+    {15753982952572452864u, 2019483917365790221u},
+    {12152082354571476992u, 1262177448353618888u},
+    {15190102943214346240u, 1577721810442023610u},
+    {9764256642163156992u, 1972152263052529513u},
+    {17631875447420442880u, 1232595164407830945u},
+    {8204786253993389888u, 1540743955509788682u},
+    {1032610780636961552u, 1925929944387235853u},
+    {2951224747111794922u, 1203706215242022408u},
+    {3689030933889743652u, 1504632769052528010u},
+    {13834660704216955373u, 1880790961315660012u},
+    {17870034976990372916u, 1175494350822287507u},
+    {17725857702810578241u, 1469367938527859384u},
+    {3710578054803671186u, 1836709923159824231u},
+    {26536550077201078u, 2295887403949780289u},
+    {11545800389866720434u, 1434929627468612680u},
+    {14432250487333400542u, 1793662034335765850u},
+    {8816941072311974870u, 2242077542919707313u},
+    {17039803216263454053u, 1401298464324817070u},
+    {12076381983474541759u, 1751623080406021338u},
+    {5872105442488401391u, 2189528850507526673u},
+    {15199280947623720629u, 1368455531567204170u},
+    {9775729147674874978u, 1710569414459005213u},
+    {16831347453020981627u, 2138211768073756516u},
+    {1296220121283337709u, 1336382355046097823u},
+    {15455333206886335848u, 1670477943807622278u},
+    {10095794471753144002u, 2088097429759527848u},
+    {6309871544845715001u, 1305060893599704905u},
+    {12499025449484531656u, 1631326116999631131u},
+    {11012095793428276666u, 2039157646249538914u},
+    {11494245889320060820u, 1274473528905961821u},
+    {532749306367912313u, 1593091911132452277u},
+    {5277622651387278295u, 1991364888915565346u},
+    {7910200175544436838u, 1244603055572228341u},
+    {14499436237857933952u, 1555753819465285426u},
+    {8900923260467641632u, 1944692274331606783u},
+    {12480606065433357876u, 1215432671457254239u},
+    {10989071563364309441u, 1519290839321567799u},
+    {9124653435777998898u, 1899113549151959749u},
+    {8008751406574943263u, 1186945968219974843u},
+    {5399253239791291175u, 1483682460274968554u},
+    {15972438586593889776u, 1854603075343710692u},
+    {759402079766405302u, 1159126922089819183u},
+    {14784310654990170340u, 1448908652612273978u},
+    {9257016281882937117u, 1811135815765342473u},
+    {16182956370781059300u, 2263919769706678091u},
+    {7808504722524468110u, 1414949856066673807u},
+    {5148944884728197234u, 1768687320083342259u},
+    {1824495087482858639u, 2210859150104177824u},
+    {1140309429676786649u, 1381786968815111140u},
+    {1425386787095983311u, 1727233711018888925u},
+    {6393419502297367043u, 2159042138773611156u},
+    {13219259225790630210u, 1349401336733506972u},
+    {16524074032238287762u, 1686751670916883715u},
+    {16043406521870471799u, 2108439588646104644u},
+    {803757039314269066u, 1317774742903815403u},
+    {14839754354425000045u, 1647218428629769253u},
+    {4714634887749086344u, 2059023035787211567u},
+    {9864175832484260821u, 1286889397367007229u},
+    {16941905809032713930u, 1608611746708759036u},
+    {2730638187581340797u, 2010764683385948796u},
+    {10930020904093113806u, 1256727927116217997u},
+    {18274212148543780162u, 1570909908895272496u},
+    {4396021111970173586u, 1963637386119090621u},
+    {5053356204195052443u, 1227273366324431638u},
+    {15540067292098591362u, 1534091707905539547u},
+    {14813398096695851299u, 1917614634881924434u},
+    {13870059828862294966u, 1198509146801202771u},
+    {12725888767650480803u, 1498136433501503464u},
+    {15907360959563101004u, 1872670541876879330u},
+    {14553786618154326031u, 1170419088673049581u},
+    {4357175217410743827u, 1463023860841311977u},
+    {10058155040190817688u, 1828779826051639971u},
+    {7961007781811134206u, 2285974782564549964u},
+    {14199001900486734687u, 1428734239102843727u},
+    {13137066357181030455u, 1785917798878554659u},
+    {11809646928048900164u, 2232397248598193324u},
+    {16604401366885338411u, 1395248280373870827u},
+    {16143815690179285109u, 1744060350467338534u},
+    {10956397575869330579u, 2180075438084173168u},
+    {6847748484918331612u, 1362547148802608230u},
+    {17783057643002690323u, 1703183936003260287u},
+    {17617136035325974999u, 2128979920004075359u},
+    {17928239049719816230u, 1330612450002547099u},
+    {17798612793722382384u, 1663265562503183874u},
+    {13024893955298202172u, 2079081953128979843u},
+    {5834715712847682405u, 1299426220705612402u},
+    {16516766677914378815u, 1624282775882015502u},
+    {11422586310538197711u, 2030353469852519378u},
+    {11750802462513761473u, 1268970918657824611u},
+    {10076817059714813937u, 1586213648322280764u},
+    {12596021324643517422u, 1982767060402850955u},
+    {5566670318688504437u, 1239229412751781847u},
+    {2346651879933242642u, 1549036765939727309u},
+    {7545000868343941206u, 1936295957424659136u},
+    {4715625542714963254u, 1210184973390411960u},
+    {5894531928393704067u, 1512731216738014950u},
+    {16591536947346905892u, 1890914020922518687u},
+    {17287239619732898039u, 1181821263076574179u},
+    {16997363506238734644u, 1477276578845717724u},
+    {2799960309088866689u, 1846595723557147156u},
+    {10973347230035317489u, 1154122327223216972u},
+    {13716684037544146861u, 1442652909029021215u},
+    {12534169028502795672u, 1803316136286276519u},
+    {11056025267201106687u, 2254145170357845649u},
+    {18439230838069161439u, 1408840731473653530u},
+    {13825666510731675991u, 1761050914342066913u},
+    {3447025083132431277u, 2201313642927583642u},
+    {6766076695385157452u, 1375821026829739776u},
+    {8457595869231446815u, 1719776283537174720u},
+    {10571994836539308519u, 2149720354421468400u},
+    {6607496772837067824u, 1343575221513417750u},
+    {17482743002901110588u, 1679469026891772187u},
+    {17241742735199000331u, 2099336283614715234u},
+    {15387775227926763111u, 1312085177259197021u},
+    {5399660979626290177u, 1640106471573996277u},
+    {11361262242960250625u, 2050133089467495346u},
+    {11712474920277544544u, 1281333180917184591u},
+    {10028907631919542777u, 1601666476146480739u},
+    {7924448521472040567u, 2002083095183100924u},
+    {14176152362774801162u, 1251301934489438077u},
+    {3885132398186337741u, 1564127418111797597u},
+    {9468101516160310080u, 1955159272639746996u},
+    {15140935484454969608u, 1221974545399841872u},
+    {479425281859160394u, 1527468181749802341u},
+    {5210967620751338397u, 1909335227187252926u},
+    {17091912818251750210u, 1193334516992033078u},
+    {12141518985959911954u, 1491668146240041348u},
+    {15176898732449889943u, 1864585182800051685u},
+    {11791404716994875166u, 1165365739250032303u},
+    {10127569877816206054u, 1456707174062540379u},
+    {8047776328842869663u, 1820883967578175474u},
+    {836348374198811271u, 2276104959472719343u},
+    {7440246761515338900u, 1422565599670449589u},
+    {13911994470321561530u, 1778206999588061986u},
+    {8166621051047176104u, 2222758749485077483u},
+    {2798295147690791113u, 1389224218428173427u},
+    {17332926989895652603u, 1736530273035216783u},
+    {17054472718942177850u, 2170662841294020979u},
+    {8353202440125167204u, 1356664275808763112u},
+    {10441503050156459005u, 1695830344760953890u},
+    {3828506775840797949u, 2119787930951192363u},
+    {86973725686804766u, 1324867456844495227u},
+    {13943775212390669669u, 1656084321055619033u},
+    {3594660960206173375u, 2070105401319523792u},
+    {2246663100128858359u, 1293815875824702370u},
+    {12031700912015848757u, 1617269844780877962u},
+    {5816254103165035138u, 2021587305976097453u},
+    {5941001823691840913u, 1263492066235060908u},
+    {7426252279614801142u, 1579365082793826135u},
+    {4671129331091113523u, 1974206353492282669u},
+    {5225298841145639904u, 1233878970932676668u},
+    {6531623551432049880u, 1542348713665845835u},
+    {3552843420862674446u, 1927935892082307294u},
+    {16055585193321335241u, 1204959932551442058u},
+    {10846109454796893243u, 1506199915689302573u},
+    {18169322836923504458u, 1882749894611628216u},
+    {11355826773077190286u, 1176718684132267635u},
+    {9583097447919099954u, 1470898355165334544u},
+    {11978871809898874942u, 1838622943956668180u},
+    {14973589762373593678u, 2298278679945835225u},
+    {2440964573842414192u, 1436424174966147016u},
+    {3051205717303017741u, 1795530218707683770u},
+    {13037379183483547984u, 2244412773384604712u},
+    {8148361989677217490u, 1402757983365377945u},
+    {14797138505523909766u, 1753447479206722431u},
+    {13884737113477499304u, 2191809349008403039u},
+    {15595489723564518921u, 1369880843130251899u},
+    {14882676136028260747u, 1712351053912814874u},
+    {9379973133180550126u, 2140438817391018593u},
+    {17391698254306313589u, 1337774260869386620u},
+    {3292878744173340370u, 1672217826086733276u},
+    {4116098430216675462u, 2090272282608416595u},
+    {266718509671728212u, 1306420176630260372u},
+    {333398137089660265u, 1633025220787825465u},
+    {5028433689789463235u, 2041281525984781831u},
+    {10060300083759496378u, 1275800953740488644u},
+    {12575375104699370472u, 1594751192175610805u},
+    {1884160825592049379u, 1993438990219513507u},
+    {17318501580490888525u, 1245899368887195941u},
+    {7813068920331446945u, 1557374211108994927u},
+    {5154650131986920777u, 1946717763886243659u},
+    {915813323278131534u, 1216698602428902287u},
+    {14979824709379828129u, 1520873253036127858u},
+    {9501408849870009354u, 1901091566295159823u},
+    {12855909558809837702u, 1188182228934474889u},
+    {2234828893230133415u, 1485227786168093612u},
+    {2793536116537666769u, 1856534732710117015u},
+    {8663489100477123587u, 1160334207943823134u},
+    {1605989338741628675u, 1450417759929778918u},
+    {11230858710281811652u, 1813022199912223647u},
+    {9426887369424876662u, 2266277749890279559u},
+    {12809333633531629769u, 1416423593681424724u},
+    {16011667041914537212u, 1770529492101780905u},
+    {6179525747111007803u, 2213161865127226132u},
+    {13085575628799155685u, 1383226165704516332u},
+    {16356969535998944606u, 1729032707130645415u},
+    {15834525901571292854u, 2161290883913306769u},
+    {2979049660840976177u, 1350806802445816731u},
+    {17558870131333383934u, 1688508503057270913u},
+    {8113529608884566205u, 2110635628821588642u},
+    {9682642023980241782u, 1319147268013492901u},
+    {16714988548402690132u, 1648934085016866126u},
+    {11670363648648586857u, 2061167606271082658u},
+    {11905663298832754689u, 1288229753919426661u},
+    {1047021068258779650u, 1610287192399283327u},
+    {15143834390605638274u, 2012858990499104158u},
+    {4853210475701136017u, 1258036869061940099u},
+    {1454827076199032118u, 1572546086327425124u},
+    {1818533845248790147u, 1965682607909281405u},
+    {3442426662494187794u, 1228551629943300878u},
+    {13526405364972510550u, 1535689537429126097u},
+    {3072948650933474476u, 1919611921786407622u},
+    {15755650962115585259u, 1199757451116504763u},
+    {15082877684217093670u, 1499696813895630954u},
+    {9630225068416591280u, 1874621017369538693u},
+    {8324733676974063502u, 1171638135855961683u},
+    {5794231077790191473u, 1464547669819952104u},
+    {7242788847237739342u, 1830684587274940130u},
+    {18276858095901949986u, 2288355734093675162u},
+    {16034722328366106645u, 1430222333808546976u},
+    {1596658836748081690u, 1787777917260683721u},
+    {6607509564362490017u, 2234722396575854651u},
+    {1823850468512862308u, 1396701497859909157u},
+    {6891499104068465790u, 1745876872324886446u},
+    {17837745916940358045u, 2182346090406108057u},
+    {4231062170446641922u, 1363966306503817536u},
+    {5288827713058302403u, 1704957883129771920u},
+    {6611034641322878003u, 2131197353912214900u},
+    {13355268687681574560u, 1331998346195134312u},
+    {16694085859601968200u, 1664997932743917890u},
+    {11644235287647684442u, 2081247415929897363u},
+    {4971804045566108824u, 1300779634956185852u},
+    {6214755056957636030u, 1625974543695232315u},
+    {3156757802769657134u, 2032468179619040394u},
+    {6584659645158423613u, 1270292612261900246u},
+    {17454196593302805324u, 1587865765327375307u},
+    {17206059723201118751u, 1984832206659219134u},
+    {6142101308573311315u, 1240520129162011959u},
+    {3065940617289251240u, 1550650161452514949u},
+    {8444111790038951954u, 1938312701815643686u},
+    {665883850346957067u, 1211445438634777304u},
+    {832354812933696334u, 1514306798293471630u},
+    {10263815553021896226u, 1892883497866839537u},
+    {17944099766707154901u, 1183052186166774710u},
+    {13206752671529167818u, 1478815232708468388u},
+    {16508440839411459773u, 1848519040885585485u},
+    {12623618533845856310u, 1155324400553490928u},
+    {15779523167307320387u, 1444155500691863660u},
+    {1277659885424598868u, 1805194375864829576u},
+    {1597074856780748586u, 2256492969831036970u},
+    {5609857803915355770u, 1410308106144398106u},
+    {16235694291748970521u, 1762885132680497632u},
+    {1847873790976661535u, 2203606415850622041u},
+    {12684136165428883219u, 1377254009906638775u},
+    {11243484188358716120u, 1721567512383298469u},
+    {219297180166231438u, 2151959390479123087u},
+    {7054589765244976505u, 1344974619049451929u},
+    {13429923224983608535u, 1681218273811814911u},
+    {12175718012802122765u, 2101522842264768639u},
+    {14527352785642408584u, 1313451776415480399u},
+    {13547504963625622826u, 1641814720519350499u},
+    {12322695186104640628u, 2052268400649188124u},
+    {16925056528170176201u, 1282667750405742577u},
+    {7321262604930556539u, 1603334688007178222u},
+    {18374950293017971482u, 2004168360008972777u},
+    {4566814905495150320u, 1252605225005607986u},
+    {14931890668723713708u, 1565756531257009982u},
+    {9441491299049866327u, 1957195664071262478u},
+    {1289246043478778550u, 1223247290044539049u},
+    {6223243572775861092u, 1529059112555673811u},
+    {3167368447542438461u, 1911323890694592264u},
+    {1979605279714024038u, 1194577431684120165u},
+    {7086192618069917952u, 1493221789605150206u},
+    {18081112809442173248u, 1866527237006437757u},
+    {13606538515115052232u, 1166579523129023598u},
+    {7784801107039039482u, 1458224403911279498u},
+    {507629346944023544u, 1822780504889099373u},
+    {5246222702107417334u, 2278475631111374216u},
+    {3278889188817135834u, 1424047269444608885u},
+    {8710297504448807696u, 1780059086805761106u},
+};
+
+/// @returns ceil(log2(5^e)), or 1 when @p e is 0, for 0 <= e <= 3528.
+static int32_t A1C_pow5Bits(int32_t e) {
+  return (int32_t)(((uint32_t)e * 1217359) >> 19) + 1;
 }
 
-bool A1C_Encoder_encodeOne(A1C_Encoder *encoder, const A1C_Item *item);
-
-bool A1C_NODISCARD A1C_Encoder_errorImpl(A1C_Encoder *encoder,
-                                         A1C_ErrorType errorType,
-                                         const char *file, int line) {
-  encoder->error.type = errorType;
-  encoder->error.srcPos = encoder->bytesWritten;
-  encoder->error.depth = encoder->depth;
-  encoder->error.item = encoder->currentItem;
-  encoder->error.file = file;
-  encoder->error.line = line;
-  return false;
+/// @returns floor(log10(2^e)) for 0 <= e <= 1650.
+static uint32_t A1C_log10Pow2(int32_t e) {
+  return ((uint32_t)e * 78913) >> 18;
 }
 
-#define A1C_Encoder_error(encoder, errorType)                                  \
-  A1C_Encoder_errorImpl((encoder), (errorType), __FILE__, __LINE__)
-
-static bool A1C_NODISCARD A1C_Encoder_write(A1C_Encoder *encoder,
-                                            const void *data, size_t size) {
-  if (size == 0) {
-    return true;
-  }
-  const size_t written = encoder->write(encoder->opaque, data, size);
-  encoder->bytesWritten += written;
+/// @returns floor(log10(5^e)) for 0 <= e <= 2620.
+static uint32_t A1C_log10Pow5(int32_t e) {
+  return ((uint32_t)e * 732923) >> 20;
+}
 
-  if (written < size) {
-    return A1C_Encoder_error(encoder, A1C_ErrorType_writeFailed);
+static uint32_t A1C_pow5Factor(uint64_t value) {
+  uint32_t count = 0;
+  for (; value % 5 == 0; value /= 5) {
+    ++count;
   }
-  return true;
+  return count;
 }
 
-static bool A1C_NODISCARD A1C_Encoder_writeCStr(A1C_Encoder *encoder,
-                                                const char *cstr) {
-  return A1C_Encoder_write(encoder, cstr, strlen(cstr));
+/// @returns true if @p value is divisible by 5^p.
+static bool A1C_isMultipleOfPow5(uint64_t value, uint32_t p) {
+  return A1C_pow5Factor(value) >= p;
 }
 
-static bool A1C_NODISCARD A1C_Encoder_putc(A1C_Encoder *encoder, char c) {
-  return A1C_Encoder_write(encoder, &c, 1);
+/// @returns true if @p value is divisible by 2^p.
+static bool A1C_isMultipleOfPow2(uint64_t value, uint32_t p) {
+  return (value & ((((uint64_t)1) << p) - 1)) == 0;
 }
 
-static bool A1C_NODISCARD A1C_Encoder_encodeHeaderAndCount(
-    A1C_Encoder *encoder, A1C_MajorType majorType, uint64_t count) {
-  uint8_t shortCount;
-  if (count < 24) {
-    shortCount = (uint8_t)count;
-  } else if (count <= UINT8_MAX) {
-    shortCount = 24;
-  } else if (count <= UINT16_MAX) {
-    shortCount = 25;
-  } else if (count <= UINT32_MAX) {
-    shortCount = 26;
-  } else {
-    shortCount = 27;
-  }
-  A1C_ItemHeader header = A1C_ItemHeader_make(majorType, shortCount);
-  A1C_RET_IF_ERR(A1C_Encoder_write(encoder, &header, sizeof(header)));
-  if (shortCount == 24) {
-    uint8_t count8 = (uint8_t)count;
-    return A1C_Encoder_write(encoder, &count8, sizeof(count8));
-  } else if (shortCount == 25) {
-    uint16_t count16 = A1C_bigEndian16((uint16_t)count);
-    return A1C_Encoder_write(encoder, &count16, sizeof(count16));
-  } else if (shortCount == 26) {
-    uint32_t count32 = A1C_bigEndian32((uint32_t)count);
-    return A1C_Encoder_write(encoder, &count32, sizeof(count32));
-  } else if (shortCount == 27) {
-    uint64_t count64 = A1C_bigEndian64((uint64_t)count);
-    return A1C_Encoder_write(encoder, &count64, sizeof(count64));
-  }
-  return true;
+#if defined(__SIZEOF_INT128__)
+__extension__ typedef unsigned __int128 A1C_uint128;
+#endif
+
+/// @returns The high 64 bits of @p a * @p b.
+static uint64_t A1C_mulHigh64(uint64_t a, uint64_t b, uint64_t *low) {
+#if defined(__SIZEOF_INT128__)
+  const A1C_uint128 product = (A1C_uint128)a * b;
+  *low = (uint64_t)product;
+  return (uint64_t)(product >> 64);
+#else
+  const uint64_t aLo = (uint32_t)a;
+  const uint64_t aHi = a >> 32;
+  const uint64_t bLo = (uint32_t)b;
+  const uint64_t bHi = b >> 32;
+  const uint64_t loLo = aLo * bLo;
+  const uint64_t hiLo = aHi * bLo;
+  const uint64_t loHi = aLo * bHi;
+  const uint64_t hiHi = aHi * bHi;
+  const uint64_t mid = (loLo >> 32) + (uint32_t)hiLo + (uint32_t)loHi;
+  *low = (mid << 32) | (uint32_t)loLo;
+  return hiHi + (hiLo >> 32) + (loHi >> 32) + (mid >> 32);
+#endif
 }
 
-static bool A1C_NODISCARD A1C_Encoder_encodeInt(A1C_Encoder *encoder,
-                                                const A1C_Item *item) {
-  assert(item->type == A1C_ItemType_int64);
-  A1C_MajorType majorType;
-  uint64_t value;
-  if (item->int64 >= 0) {
-    majorType = A1C_MajorType_uint;
-    value = (uint64_t)item->int64;
-  } else {
-    majorType = A1C_MajorType_int;
-    value = (uint64_t)~item->int64;
+/// @returns (@p m * @p mul) >> @p shift, where 64 < shift < 128.
+static uint64_t A1C_mulShift64(uint64_t m, const uint64_t *mul,
+                               int32_t shift) {
+  uint64_t low1;
+  uint64_t high1 = A1C_mulHigh64(m, mul[1], &low1);
+  uint64_t low0;
+  const uint64_t high0 = A1C_mulHigh64(m, mul[0], &low0);
+  const uint64_t sum = high0 + low1;
+  if (sum < high0) {
+    ++high1;
   }
-  return A1C_Encoder_encodeHeaderAndCount(encoder, majorType, value);
+  const unsigned dist = (unsigned)(shift - 64);
+  assert(dist > 0 && dist < 64);
+  return (high1 << (64 - dist)) | (sum >> dist);
 }
 
-static bool A1C_NODISCARD A1C_Encoder_encodeData(A1C_Encoder *encoder,
-                                                 const A1C_Item *item) {
-  assert(item->type == A1C_ItemType_bytes || item->type == A1C_ItemType_string);
-  const A1C_MajorType majorType = item->type == A1C_ItemType_bytes
-                                      ? A1C_MajorType_bytes
-                                      : A1C_MajorType_string;
-  const size_t count =
-      item->type == A1C_ItemType_bytes ? item->bytes.size : item->string.size;
-  if (!A1C_Encoder_encodeHeaderAndCount(encoder, majorType, count)) {
-    return false;
-  }
-  const void *data = item->type == A1C_ItemType_bytes
-                         ? (const void *)item->bytes.data
-                         : (const void *)item->string.data;
-  return A1C_Encoder_write(encoder, data, count);
+/// @returns (@p m * @p factor) >> @p shift, where 32 <= shift.
+static uint32_t A1C_mulShift32(uint32_t m, uint64_t factor, int32_t shift) {
+  const uint64_t bits0 = (uint64_t)m * (uint32_t)factor;
+  const uint64_t bits1 = (uint64_t)m * (uint32_t)(factor >> 32);
+  const uint64_t sum = (bits0 >> 32) + bits1;
+  return (uint32_t)(sum >> (shift - 32));
 }
 
-static bool A1C_NODISCARD A1C_Encoder_encodeArray(A1C_Encoder *encoder,
-                                                  const A1C_Item *item) {
-  assert(item->type == A1C_ItemType_array);
-  const size_t count = item->array.size;
-  if (!A1C_Encoder_encodeHeaderAndCount(encoder, A1C_MajorType_array, count)) {
-    return false;
+/// A decimal floating point value: mantissa * 10^exponent.
+typedef struct {
+  uint64_t mantissa;
+  int32_t exponent;
+} A1C_Decimal;
+
+/**
+ * Finds the shortest decimal in the rounding interval of the finite, non-zero
+ * float64 with the given fields. Ties between equally short candidates go to
+ * the one closest to the exact value.
+ */
+static A1C_Decimal A1C_Decimal_fromFloat64(uint64_t ieeeMantissa,
+                                           uint32_t ieeeExponent) {
+  int32_t e2;
+  uint64_t m2;
+  if (ieeeExponent == 0) {
+    e2 = 1 - 1023 - 52 - 2;
+    m2 = ieeeMantissa;
+  } else {
+    e2 = (int32_t)ieeeExponent - 1023 - 52 - 2;
+    m2 = (((uint64_t)1) << 52) | ieeeMantissa;
   }
-  for (size_t i = 0; i < count; i++) {
-    const A1C_Item *child = &item->array.items[i];
-    if (!A1C_Encoder_encodeOne(encoder, child)) {
-      return false;
+  const bool acceptBounds = (m2 & 1) == 0;
+
+  // The interval of values that round to this float is (mm, mp) / 4 * 2^e2,
+  // closed if the mantissa is even. The lower gap is half as wide at powers
+  // of two.
+  const uint64_t mv = 4 * m2;
+  const uint32_t mmShift = ieeeMantissa != 0 || ieeeExponent <= 1;
+
+  // Scale the interval to a power of 10, keeping track of whether any
+  // non-zero digits were dropped.
+  uint64_t vr, vp, vm;
+  int32_t e10;
+  bool vmIsTrailingZeros = false;
+  bool vrIsTrailingZeros = false;
+  if (e2 >= 0) {
+    const uint32_t q = A1C_log10Pow2(e2) - (e2 > 3);
+    e10 = (int32_t)q;
+    const int32_t k = A1C_POW5_INV_BITCOUNT + A1C_pow5Bits((int32_t)q) - 1;
+    const int32_t i = -e2 + (int32_t)q + k;
+    const uint64_t *mul = A1C_kPow5InvSplit[q];
+    vr = A1C_mulShift64(mv, mul, i);
+    vp = A1C_mulShift64(mv + 2, mul, i);
+    vm = A1C_mulShift64(mv - 1 - mmShift, mul, i);
+    if (q <= 21) {
+      // Only one of mp, mv, and mm can be a multiple of 5, if any.
+      if (mv % 5 == 0) {
+        vrIsTrailingZeros = A1C_isMultipleOfPow5(mv, q);
+      } else if (acceptBounds) {
+        vmIsTrailingZeros = A1C_isMultipleOfPow5(mv - 1 - mmShift, q);
+      } else {
+        vp -= A1C_isMultipleOfPow5(mv + 2, q);
+      }
+    }
+  } else {
+    const uint32_t q = A1C_log10Pow5(-e2) - (-e2 > 1);
+    e10 = (int32_t)q + e2;
+    const int32_t i = -e2 - (int32_t)q;
+    const int32_t k = A1C_pow5Bits(i) - A1C_POW5_BITCOUNT;
+    const int32_t j = (int32_t)q - k;
+    const uint64_t *mul = A1C_kPow5Split[i];
+    vr = A1C_mulShift64(mv, mul, j);
+    vp = A1C_mulShift64(mv + 2, mul, j);
+    vm = A1C_mulShift64(mv - 1 - mmShift, mul, j);
+    if (q <= 1) {
+      // mv = 4 * m2, so it has at least two trailing zero bits.
+      vrIsTrailingZeros = true;
+      if (acceptBounds) {
+        vmIsTrailingZeros = mmShift == 1;
+      } else {
+        --vp;
+      }
+    } else if (q < 63) {
+      vrIsTrailingZeros = A1C_isMultipleOfPow2(mv, q);
     }
   }
-  return true;
-}
 
-static bool A1C_NODISCARD A1C_Encoder_encodeMap(A1C_Encoder *encoder,
-                                                const A1C_Item *item) {
-  assert(item->type == A1C_ItemType_map);
-  const size_t count = item->map.size;
-  if (!A1C_Encoder_encodeHeaderAndCount(encoder, A1C_MajorType_map, count)) {
-    return false;
-  }
-  for (size_t i = 0; i < count; i++) {
-    const A1C_Pair pair = item->map.items[i];
-    if (!A1C_Encoder_encodeOne(encoder, &pair.key)) {
-      return false;
+  // Drop digits while the interval still holds a shorter decimal.
+  int32_t removed = 0;
+  uint32_t lastRemovedDigit = 0;
+  uint64_t output;
+  if (vmIsTrailingZeros || vrIsTrailingZeros) {
+    // Exact midpoints and bounds need care, but are rare.
+    while (vp / 10 > vm / 10) {
+      vmIsTrailingZeros &= vm % 10 == 0;
+      vrIsTrailingZeros &= lastRemovedDigit == 0;
+      lastRemovedDigit = (uint32_t)(vr % 10);
+      vr /= 10;
+      vp /= 10;
+      vm /= 10;
+      ++removed;
     }
-    if (!A1C_Encoder_encodeOne(encoder, &pair.value)) {
-      return false;
+    if (vmIsTrailingZeros) {
+      while (vm % 10 == 0) {
+        vrIsTrailingZeros &= lastRemovedDigit == 0;
+        lastRemovedDigit = (uint32_t)(vr % 10);
+        vr /= 10;
+        vp /= 10;
+        vm /= 10;
+        ++removed;
+      }
     }
+    if (vrIsTrailingZeros && lastRemovedDigit == 5 && vr % 2 == 0) {
+      // Round half to even.
+      lastRemovedDigit = 4;
+    }
+    output = vr + ((vr == vm && (!acceptBounds || !vmIsTrailingZeros)) ||
+                   lastRemovedDigit >= 5);
+  } else {
+    bool roundUp = false;
+    if (vp / 100 > vm / 100) {
+      roundUp = vr % 100 >= 50;
+      vr /= 100;
+      vp /= 100;
+      vm /= 100;
+      removed += 2;
+    }
+    while (vp / 10 > vm / 10) {
+      roundUp = vr % 10 >= 5;
+      vr /= 10;
+      vp /= 10;
+      vm /= 10;
+      ++removed;
+    }
+    output = vr + (vr == vm || roundUp);
   }
-  return true;
+  return (A1C_Decimal){.mantissa = output, .exponent = e10 + removed};
 }
 
-static bool A1C_NODISCARD A1C_Encoder_encodeTag(A1C_Encoder *encoder,
-                                                const A1C_Item *item) {
-  assert(item->type == A1C_ItemType_tag);
-  const A1C_Tag *tag = &item->tag;
-  if (!A1C_Encoder_encodeHeaderAndCount(encoder, A1C_MajorType_tag, tag->tag)) {
-    return false;
+/// Float32 variant of A1C_Decimal_fromFloat64().
+static A1C_Decimal A1C_Decimal_fromFloat32(uint32_t ieeeMantissa,
+                                           uint32_t ieeeExponent) {
+  int32_t e2;
+  uint32_t m2;
+  if (ieeeExponent == 0) {
+    e2 = 1 - 127 - 23 - 2;
+    m2 = ieeeMantissa;
+  } else {
+    e2 = (int32_t)ieeeExponent - 127 - 23 - 2;
+    m2 = (1u << 23) | ieeeMantissa;
   }
-  if (!A1C_Encoder_encodeOne(encoder, tag->item)) {
-    return false;
+  const bool acceptBounds = (m2 & 1) == 0;
+
+  const uint32_t mv = 4 * m2;
+  const uint32_t mp = 4 * m2 + 2;
+  const uint32_t mmShift = ieeeMantissa != 0 || ieeeExponent <= 1;
+  const uint32_t mm = 4 * m2 - 1 - mmShift;
+
+  uint32_t vr, vp, vm;
+  int32_t e10;
+  bool vmIsTrailingZeros = false;
+  bool vrIsTrailingZeros = false;
+  uint32_t lastRemovedDigit = 0;
+  if (e2 >= 0) {
+    const uint32_t q = A1C_log10Pow2(e2);
+    e10 = (int32_t)q;
+    const int32_t k =
+        A1C_FLOAT_POW5_INV_BITCOUNT + A1C_pow5Bits((int32_t)q) - 1;
+    const int32_t i = -e2 + (int32_t)q + k;
+    // The table holds 2^k / 5^q + 1 at 125 bits, so the high half is
+    // truncated and needs the 1 added back.
+    const uint64_t mul = A1C_kPow5InvSplit[q][1] + 1;
+    vr = A1C_mulShift32(mv, mul, i);
+    vp = A1C_mulShift32(mp, mul, i);
+    vm = A1C_mulShift32(mm, mul, i);
+    if (q != 0 && (vp - 1) / 10 <= vm / 10) {
+      // One removed digit is needed for rounding even if the loop below
+      // won't remove any.
+      const int32_t l =
+          A1C_FLOAT_POW5_INV_BITCOUNT + A1C_pow5Bits((int32_t)q - 1) - 1;
+      lastRemovedDigit =
+          A1C_mulShift32(mv, A1C_kPow5InvSplit[q - 1][1] + 1,
+                         -e2 + (int32_t)q - 1 + l) %
+          10;
+    }
+    if (q <= 9) {
+      // Only one of mp, mv, and mm can be a multiple of 5, if any.
+      if (mv % 5 == 0) {
+        vrIsTrailingZeros = A1C_isMultipleOfPow5(mv, q);
+      } else if (acceptBounds) {
+        vmIsTrailingZeros = A1C_isMultipleOfPow5(mm, q);
+      } else {
+        vp -= A1C_isMultipleOfPow5(mp, q);
+      }
+    }
+  } else {
+    const uint32_t q = A1C_log10Pow5(-e2);
+    e10 = (int32_t)q + e2;
+    const int32_t i = -e2 - (int32_t)q;
+    const int32_t k = A1C_pow5Bits(i) - A1C_FLOAT_POW5_BITCOUNT;
+    int32_t j = (int32_t)q - k;
+    const uint64_t mul = A1C_kPow5Split[i][1];
+    vr = A1C_mulShift32(mv, mul, j);
+    vp = A1C_mulShift32(mp, mul, j);
+    vm = A1C_mulShift32(mm, mul, j);
+    if (q != 0 && (vp - 1) / 10 <= vm / 10) {
+      j = (int32_t)q - 1 - (A1C_pow5Bits(i + 1) - A1C_FLOAT_POW5_BITCOUNT);
+      lastRemovedDigit =
+          A1C_mulShift32(mv, A1C_kPow5Split[i + 1][1], j) % 10;
+    }
+    if (q <= 1) {
+      vrIsTrailingZeros = true;
+      if (acceptBounds) {
+        vmIsTrailingZeros = mmShift == 1;
+      } else {
+        --vp;
+      }
+    } else if (q < 31) {
+      vrIsTrailingZeros = A1C_isMultipleOfPow2(mv, q - 1);
+    }
   }
-  return true;
-}
 
-static bool A1C_NODISCARD A1C_Encoder_encodeSpecial(A1C_Encoder *encoder,
-                                                    const A1C_Item *item) {
-  if (item->type == A1C_ItemType_boolean) {
-    const uint64_t count = item->boolean ? 21 : 20;
-    return A1C_Encoder_encodeHeaderAndCount(encoder, A1C_MajorType_special,
-                                            count);
-  } else if (item->type == A1C_ItemType_null) {
-    return A1C_Encoder_encodeHeaderAndCount(encoder, A1C_MajorType_special, 22);
-  } else if (item->type == A1C_ItemType_undefined) {
-    return A1C_Encoder_encodeHeaderAndCount(encoder, A1C_MajorType_special, 23);
-  } else if (item->type == A1C_ItemType_simple) {
-    if (item->simple >= 20 && item->simple < 32) {
-      return A1C_Encoder_error(encoder, A1C_ErrorType_invalidSimpleValue);
+  int32_t removed = 0;
+  uint32_t output;
+  if (vmIsTrailingZeros || vrIsTrailingZeros) {
+    while (vp / 10 > vm / 10) {
+      vmIsTrailingZeros &= vm % 10 == 0;
+      vrIsTrailingZeros &= lastRemovedDigit == 0;
+      lastRemovedDigit = vr % 10;
+      vr /= 10;
+      vp /= 10;
+      vm /= 10;
+      ++removed;
     }
-    return A1C_Encoder_encodeHeaderAndCount(encoder, A1C_MajorType_special,
-                                            item->simple);
-  } else if (item->type == A1C_ItemType_float16) {
-    A1C_ItemHeader header = A1C_ItemHeader_make(A1C_MajorType_special, 25);
-    A1C_RET_IF_ERR(A1C_Encoder_write(encoder, &header, sizeof(header)));
-    const uint16_t value = A1C_bigEndian16(item->float16);
-    return A1C_Encoder_write(encoder, &value, sizeof(value));
-  } else if (item->type == A1C_ItemType_float32) {
-    A1C_ItemHeader header = A1C_ItemHeader_make(A1C_MajorType_special, 26);
-    A1C_RET_IF_ERR(A1C_Encoder_write(encoder, &header, sizeof(header)));
-    uint32_t value;
-    memcpy(&value, &item->float32, sizeof(item->float32));
-    value = A1C_bigEndian32(value);
-    return A1C_Encoder_write(encoder, &value, sizeof(value));
-  } else if (item->type == A1C_ItemType_float64) {
-    A1C_ItemHeader header = A1C_ItemHeader_make(A1C_MajorType_special, 27);
-    A1C_RET_IF_ERR(A1C_Encoder_write(encoder, &header, sizeof(header)));
-    uint64_t value;
-    memcpy(&value, &item->float64, sizeof(item->float64));
-    value = A1C_bigEndian64(value);
-    return A1C_Encoder_write(encoder, &value, sizeof(value));
+    if (vmIsTrailingZeros) {
+      while (vm % 10 == 0) {
+        vrIsTrailingZeros &= lastRemovedDigit == 0;
+        lastRemovedDigit = vr % 10;
+        vr /= 10;
+        vp /= 10;
+        vm /= 10;
+        ++removed;
+      }
+    }
+    if (vrIsTrailingZeros && lastRemovedDigit == 5 && vr % 2 == 0) {
+      lastRemovedDigit = 4;
+    }
+    output = vr + ((vr == vm && (!acceptBounds || !vmIsTrailingZeros)) ||
+                   lastRemovedDigit >= 5);
   } else {
-    assert(false);
-    return false;
+    while (vp / 10 > vm / 10) {
+      lastRemovedDigit = vr % 10;
+      vr /= 10;
+      vp /= 10;
+      vm /= 10;
+      ++removed;
+    }
+    output = vr + (vr == vm || lastRemovedDigit >= 5);
   }
+  return (A1C_Decimal){.mantissa = output, .exponent = e10 + removed};
 }
 
-bool A1C_Encoder_encodeOne(A1C_Encoder *encoder, const A1C_Item *item) {
-  ++encoder->depth;
-  encoder->currentItem = item;
-  switch (item->type) {
-  case A1C_ItemType_int64:
-    A1C_RET_IF_ERR(A1C_Encoder_encodeInt(encoder, item));
-    break;
-  case A1C_ItemType_bytes:
-  case A1C_ItemType_string:
-    A1C_RET_IF_ERR(A1C_Encoder_encodeData(encoder, item));
-    break;
-  case A1C_ItemType_array:
-    A1C_RET_IF_ERR(A1C_Encoder_encodeArray(encoder, item));
-    break;
-  case A1C_ItemType_map:
-    A1C_RET_IF_ERR(A1C_Encoder_encodeMap(encoder, item));
-    break;
-  case A1C_ItemType_tag:
-    A1C_RET_IF_ERR(A1C_Encoder_encodeTag(encoder, item));
-    break;
-  case A1C_ItemType_boolean:
-  case A1C_ItemType_null:
-  case A1C_ItemType_undefined:
-  case A1C_ItemType_float16:
-  case A1C_ItemType_float32:
-  case A1C_ItemType_float64:
-  case A1C_ItemType_simple:
-    A1C_RET_IF_ERR(A1C_Encoder_encodeSpecial(encoder, item));
-    break;
+/**
+ * Lays out @p decimal like JavaScript: plain notation unless the value is at
+ * least 1e21 or below 1e-6, and scientific notation otherwise.
+ * @returns The number of bytes written to @p buffer.
+ */
+static size_t A1C_formatDecimal(char *buffer, bool negative,
+                                A1C_Decimal decimal) {
+  char digits[A1C_NUMBER_BUFFER_SIZE];
+  char *const digitsEnd = digits + sizeof(digits);
+  const char *const digitsBegin =
+      A1C_formatDigitsBackward(digitsEnd, decimal.mantissa);
+  const int32_t length = (int32_t)(digitsEnd - digitsBegin);
+  // The value is 0.DIGITS * 10^point.
+  const int32_t point = length + decimal.exponent;
+
+  char *out = buffer;
+  if (negative) {
+    *out++ = '-';
+  }
+  if (decimal.exponent >= 0 && point <= 21) {
+    // Integral: DIGITS000.0
+    memcpy(out, digitsBegin, (size_t)length);
+    out += length;
+    memset(out, '0', (size_t)decimal.exponent);
+    out += decimal.exponent;
+    memcpy(out, ".0", 2);
+    out += 2;
+  } else if (point > 0 && point <= 21) {
+    // DIG.ITS
+    memcpy(out, digitsBegin, (size_t)point);
+    out += point;
+    *out++ = '.';
+    memcpy(out, digitsBegin + point, (size_t)(length - point));
+    out += length - point;
+  } else if (point > -6 && point <= 0) {
+    // 0.000DIGITS
+    memcpy(out, "0.", 2);
+    out += 2;
+    memset(out, '0', (size_t)-point);
+    out += -point;
+    memcpy(out, digitsBegin, (size_t)length);
+    out += length;
+  } else {
+    // D.IGITSe+X
+    *out++ = digitsBegin[0];
+    if (length > 1) {
+      *out++ = '.';
+      memcpy(out, digitsBegin + 1, (size_t)(length - 1));
+      out += length - 1;
+    }
+    const int32_t exponent = point - 1;
+    *out++ = 'e';
+    *out++ = exponent < 0 ? '-' : '+';
+    char *const expEnd = out + 3;
+    const char *const expBegin = A1C_formatDigitsBackward(
+        expEnd, (uint64_t)(exponent < 0 ? -exponent : exponent));
+    const size_t expLength = (size_t)(expEnd - expBegin);
+    memmove(out, expBegin, expLength);
+    out += expLength;
   }
+  assert(out - buffer <= A1C_NUMBER_BUFFER_SIZE);
+  return (size_t)(out - buffer);
+}
 
-  --encoder->depth;
-  return true;
+/// Writes the special values, which have no JSON representation, like "%g".
+static size_t A1C_formatNonFinite(char *buffer, bool negative, bool isNan) {
+  const char *const str = isNan ? "nan" : negative ? "-inf" : "inf";
+  const size_t size = strlen(str);
+  memcpy(buffer, str, size);
+  return size;
 }
 
-bool A1C_Encoder_encode(A1C_Encoder *encoder, const A1C_Item *item) {
-  A1C_Encoder_reset(encoder);
-  return A1C_Encoder_encodeOne(encoder, item);
+/**
+ * Formats @p value as the shortest decimal that parses back to exactly the
+ * same float64.
+ * @returns The number of bytes written to @p buffer.
+ */
+static size_t A1C_formatFloat64(char *buffer, double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  const bool negative = (bits >> 63) != 0;
+  const uint64_t mantissa = bits & ((((uint64_t)1) << 52) - 1);
+  const uint32_t exponent = (uint32_t)(bits >> 52) & 0x7FF;
+  if (exponent == 0x7FF) {
+    return A1C_formatNonFinite(buffer, negative, mantissa != 0);
+  }
+  if (exponent == 0 && mantissa == 0) {
+    const A1C_Decimal zero = {.mantissa = 0, .exponent = 0};
+    return A1C_formatDecimal(buffer, negative, zero);
+  }
+  return A1C_formatDecimal(buffer, negative,
+                           A1C_Decimal_fromFloat64(mantissa, exponent));
+}
+
+/// Float32 variant of A1C_formatFloat64().
+static size_t A1C_formatFloat32(char *buffer, float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  const bool negative = (bits >> 31) != 0;
+  const uint32_t mantissa = bits & ((1u << 23) - 1);
+  const uint32_t exponent = (bits >> 23) & 0xFF;
+  if (exponent == 0xFF) {
+    return A1C_formatNonFinite(buffer, negative, mantissa != 0);
+  }
+  if (exponent == 0 && mantissa == 0) {
+    const A1C_Decimal zero = {.mantissa = 0, .exponent = 0};
+    return A1C_formatDecimal(buffer, negative, zero);
+  }
+  return A1C_formatDecimal(buffer, negative,
+                           A1C_Decimal_fromFloat32(mantissa, exponent));
 }
 
 ////////////////////////////////////////
@@ -1369,22 +8250,30 @@ static bool A1C_Encoder_jsonIndent(A1C_Encoder *encoder) {
   return true;
 }
 
+/// Starts a new line for the next element when pretty printing.
+static bool A1C_Encoder_jsonNewline(A1C_Encoder *encoder) {
+  if (encoder->compactJson) {
+    return true;
+  }
+  A1C_RET_IF_ERR(A1C_Encoder_putc(encoder, '\n'));
+  return A1C_Encoder_jsonIndent(encoder);
+}
+
 static bool A1C_NODISCARD A1C_Encoder_jsonNumeric(A1C_Encoder *encoder,
                                                   const A1C_Item *item) {
-  char buffer[32];
-  int len;
+  char buffer[A1C_NUMBER_BUFFER_SIZE];
+  size_t len;
   if (item->type == A1C_ItemType_int64) {
-    len = snprintf(buffer, sizeof(buffer), "%lld", item->int64);
+    len = A1C_formatInt64(buffer, item->int64);
+  } else if (item->type == A1C_ItemType_float16) {
+    len = A1C_formatFloat32(buffer, A1C_Float16_toFloat32(item->float16));
   } else if (item->type == A1C_ItemType_float32) {
-    len = snprintf(buffer, sizeof(buffer), "%g", item->float32);
+    len = A1C_formatFloat32(buffer, item->float32);
   } else {
     assert(item->type == A1C_ItemType_float64);
-    len = snprintf(buffer, sizeof(buffer), "%g", item->float64);
-  }
-  if (len < 0 || (size_t)len >= sizeof(buffer)) {
-    return A1C_Encoder_error(encoder, A1C_ErrorType_formatError);
+    len = A1C_formatFloat64(buffer, item->float64);
   }
-  return A1C_Encoder_write(encoder, buffer, (size_t)len);
+  return A1C_Encoder_write(encoder, buffer, len);
 }
 
 static bool A1C_NODISCARD A1C_Encoder_jsonBytes(A1C_Encoder *encoder,
@@ -1393,10 +8282,10 @@ static bool A1C_NODISCARD A1C_Encoder_jsonBytes(A1C_Encoder *encoder,
   const uint8_t *data = item->bytes.data;
   const uint8_t *end = data + item->bytes.size;
   while (data < end) {
-    char buffer[256];
+    char buffer[1024];
     size_t toEncode = (size_t)(end - data);
-    if (toEncode > 192) {
-      toEncode = 192;
+    if (toEncode > 768) {
+      toEncode = 768;
     }
     assert(A1C_base64EncodedSize(toEncode) <= sizeof(buffer));
     const size_t base64Size = A1C_base64Encode(buffer, data, toEncode);
@@ -1408,35 +8297,59 @@ static bool A1C_NODISCARD A1C_Encoder_jsonBytes(A1C_Encoder *encoder,
   return true;
 }
 
+/// Writes the JSON escape for @p c, which A1C_isJsonStringSpecial().
+static bool A1C_NODISCARD A1C_Encoder_jsonEscape(A1C_Encoder *encoder,
+                                                 uint8_t c) {
+  char buffer[6] = {'\\', 0, '0', '0', 0, 0};
+  size_t size = 2;
+  switch (c) {
+  case '"':
+  case '\\':
+    buffer[1] = (char)c;
+    break;
+  case '\b':
+    buffer[1] = 'b';
+    break;
+  case '\f':
+    buffer[1] = 'f';
+    break;
+  case '\n':
+    buffer[1] = 'n';
+    break;
+  case '\r':
+    buffer[1] = 'r';
+    break;
+  case '\t':
+    buffer[1] = 't';
+    break;
+  default:
+    assert(c < 0x20);
+    buffer[1] = 'u';
+    buffer[4] = "0123456789abcdef"[c >> 4];
+    buffer[5] = "0123456789abcdef"[c & 0xF];
+    size = 6;
+    break;
+  }
+  return A1C_Encoder_write(encoder, buffer, size);
+}
+
 static bool A1C_NODISCARD A1C_Encoder_jsonString(A1C_Encoder *encoder,
                                                  const A1C_Item *item) {
+  const uint8_t *ptr = (const uint8_t *)item->string.data;
+  const uint8_t *const end = ptr + item->string.size;
+  if (A1C_validateUtf8(ptr, end) != end) {
+    return A1C_Encoder_error(encoder, A1C_ErrorType_invalidUtf8);
+  }
   A1C_RET_IF_ERR(A1C_Encoder_putc(encoder, '"'));
-  for (size_t i = 0; i < item->string.size; ++i) {
-    const char c = item->string.data[i];
-    if ((uint8_t)c >= 0x80) {
-      return A1C_Encoder_error(encoder, A1C_ErrorType_jsonUTF8Unsupported);
-    }
-    if (c == '"') {
-      A1C_RET_IF_ERR(A1C_Encoder_writeCStr(encoder, "\\\""));
-    } else if (c == '\\') {
-      A1C_RET_IF_ERR(A1C_Encoder_writeCStr(encoder, "\\\\"));
-    } else if (c == '\r') {
-      A1C_RET_IF_ERR(A1C_Encoder_writeCStr(encoder, "\\r"));
-    } else if (c == '\n') {
-      A1C_RET_IF_ERR(A1C_Encoder_writeCStr(encoder, "\\n"));
-    } else if (c == '\t') {
-      A1C_RET_IF_ERR(A1C_Encoder_writeCStr(encoder, "\\t"));
-    } else if (c < 0x20 || c > 0x7E) {
-      char buffer[7];
-      int len =
-          snprintf(buffer, sizeof(buffer), "\\u%04x", (unsigned int)(uint8_t)c);
-      if (len < 0 || (size_t)len >= sizeof(buffer)) {
-        return A1C_Encoder_error(encoder, A1C_ErrorType_formatError);
-      }
-      A1C_RET_IF_ERR(A1C_Encoder_write(encoder, buffer, (size_t)len));
-    } else {
-      A1C_RET_IF_ERR(A1C_Encoder_putc(encoder, c));
+  for (;;) {
+    // Valid UTF-8 passes through, so only escapes break up the string.
+    const uint8_t *const special = A1C_scanJsonString(ptr, end, false);
+    A1C_RET_IF_ERR(A1C_Encoder_write(encoder, ptr, (size_t)(special - ptr)));
+    if (special == end) {
+      break;
     }
+    A1C_RET_IF_ERR(A1C_Encoder_jsonEscape(encoder, *special));
+    ptr = special + 1;
   }
   A1C_RET_IF_ERR(A1C_Encoder_putc(encoder, '"'));
   return true;
@@ -1447,18 +8360,23 @@ static bool A1C_NODISCARD A1C_Encoder_jsonArray(A1C_Encoder *encoder,
   A1C_RET_IF_ERR(A1C_Encoder_writeCStr(encoder, "["));
 
   ++encoder->depth;
-  for (size_t i = 0; i < item->array.size; ++i) {
+  for (size_t i = 0; i < A1C_Item_arraySize(item); ++i) {
     if (i != 0) {
       A1C_RET_IF_ERR(A1C_Encoder_putc(encoder, ','));
     }
-    A1C_RET_IF_ERR(A1C_Encoder_putc(encoder, '\n'));
-    A1C_RET_IF_ERR(A1C_Encoder_jsonIndent(encoder));
-    A1C_RET_IF_ERR(A1C_Encoder_jsonOne(encoder, &item->array.items[i]));
+    A1C_RET_IF_ERR(A1C_Encoder_jsonNewline(encoder));
+    if (item->type == A1C_ItemType_packedArray) {
+      // Errors point at the packed array, since its elements aren't items.
+      A1C_Item element;
+      (void)A1C_PackedArray_get(&item->packedArray, i, &element);
+      A1C_RET_IF_ERR(A1C_Encoder_jsonNumeric(encoder, &element));
+    } else {
+      A1C_RET_IF_ERR(A1C_Encoder_jsonOne(encoder, &item->array.items[i]));
+    }
   }
   --encoder->depth;
 
-  A1C_RET_IF_ERR(A1C_Encoder_putc(encoder, '\n'));
-  A1C_RET_IF_ERR(A1C_Encoder_jsonIndent(encoder));
+  A1C_RET_IF_ERR(A1C_Encoder_jsonNewline(encoder));
   A1C_RET_IF_ERR(A1C_Encoder_writeCStr(encoder, "]"));
   return true;
 }
@@ -1472,16 +8390,15 @@ static bool A1C_NODISCARD A1C_Encoder_jsonMap(A1C_Encoder *encoder,
     if (i != 0) {
       A1C_RET_IF_ERR(A1C_Encoder_putc(encoder, ','));
     }
-    A1C_RET_IF_ERR(A1C_Encoder_putc(encoder, '\n'));
-    A1C_RET_IF_ERR(A1C_Encoder_jsonIndent(encoder));
+    A1C_RET_IF_ERR(A1C_Encoder_jsonNewline(encoder));
     A1C_RET_IF_ERR(A1C_Encoder_jsonOne(encoder, &item->map.items[i].key));
-    A1C_RET_IF_ERR(A1C_Encoder_writeCStr(encoder, ": "));
+    A1C_RET_IF_ERR(
+        A1C_Encoder_writeCStr(encoder, encoder->compactJson ? ":" : ": "));
     A1C_RET_IF_ERR(A1C_Encoder_jsonOne(encoder, &item->map.items[i].value));
   }
   --encoder->depth;
 
-  A1C_RET_IF_ERR(A1C_Encoder_putc(encoder, '\n'));
-  A1C_RET_IF_ERR(A1C_Encoder_jsonIndent(encoder));
+  A1C_RET_IF_ERR(A1C_Encoder_jsonNewline(encoder));
   A1C_RET_IF_ERR(A1C_Encoder_writeCStr(encoder, "}"));
   return true;
 }
@@ -1520,33 +8437,15 @@ static bool A1C_NODISCARD A1C_Encoder_jsonSimple(A1C_Encoder *encoder,
   return A1C_Encoder_jsonMap(encoder, &map);
 }
 
-static bool A1C_NODISCARD A1C_Encoder_jsonHalf(A1C_Encoder *encoder,
-                                               const A1C_Item *item) {
-  A1C_Pair items[2];
-  A1C_Item map;
-  map.type = A1C_ItemType_map;
-  map.map.items = items;
-  map.map.size = 2;
-
-  A1C_Item_string_refCStr(&items[0].key, "type");
-  A1C_Item_string_refCStr(&items[0].value, "half");
-  A1C_Item_string_refCStr(&items[1].key, "uint16");
-  A1C_Item_int64(&items[1].value, item->float16);
-
-  return A1C_Encoder_jsonMap(encoder, &map);
-}
-
 bool A1C_Encoder_jsonOne(A1C_Encoder *encoder, const A1C_Item *item) {
   encoder->currentItem = item;
   switch (item->type) {
   case A1C_ItemType_int64:
+  case A1C_ItemType_float16:
   case A1C_ItemType_float32:
   case A1C_ItemType_float64:
     A1C_RET_IF_ERR(A1C_Encoder_jsonNumeric(encoder, item));
     break;
-  case A1C_ItemType_float16:
-    A1C_RET_IF_ERR(A1C_Encoder_jsonHalf(encoder, item));
-    break;
   case A1C_ItemType_bytes:
     A1C_RET_IF_ERR(A1C_Encoder_jsonBytes(encoder, item));
     break;
@@ -1554,6 +8453,7 @@ bool A1C_Encoder_jsonOne(A1C_Encoder *encoder, const A1C_Item *item) {
     A1C_RET_IF_ERR(A1C_Encoder_jsonString(encoder, item));
     break;
   case A1C_ItemType_array:
+  case A1C_ItemType_packedArray:
     A1C_RET_IF_ERR(A1C_Encoder_jsonArray(encoder, item));
     break;
   case A1C_ItemType_map:
@@ -1592,12 +8492,6 @@ bool A1C_Encoder_json(A1C_Encoder *encoder, const A1C_Item *item) {
 // Simple Encoder
 ////////////////////////////////////////
 
-static size_t A1C_noopWrite(void *opaque, const uint8_t *data, size_t size) {
-  (void)opaque;
-  (void)data;
-  return size;
-}
-
 size_t A1C_Item_encodedSize(const A1C_Item *item) {
   A1C_Encoder encoder;
   A1C_Encoder_init(&encoder, A1C_noopWrite, NULL);
@@ -1607,23 +8501,17 @@ size_t A1C_Item_encodedSize(const A1C_Item *item) {
   return encoder.bytesWritten;
 }
 
-typedef struct {
-  uint8_t *ptr;
-  uint8_t *end;
-} A1C_Buffer;
-
-static size_t A1C_bufferWrite(void *opaque, const uint8_t *data, size_t size) {
-  A1C_Buffer *buffer = (A1C_Buffer *)opaque;
-  assert(buffer->ptr <= buffer->end);
-  const size_t capacity = (size_t)(buffer->end - buffer->ptr);
-  if (size > capacity) {
-    size = capacity;
+/// @returns The size written by @p encoder if @p success, or 0 after filling
+/// in @p error, if it isn't NULL.
+static size_t A1C_Encoder_result(const A1C_Encoder *encoder, bool success,
+                                 A1C_Error *error) {
+  if (success) {
+    return encoder->bytesWritten;
   }
-  if (size > 0) {
-    memcpy(buffer->ptr, data, size);
-    buffer->ptr += size;
+  if (error != NULL) {
+    *error = encoder->error;
   }
-  return size;
+  return 0;
 }
 
 size_t A1C_Item_encode(const A1C_Item *item, uint8_t *dst, size_t dstCapacity,
@@ -1636,11 +8524,177 @@ size_t A1C_Item_encode(const A1C_Item *item, uint8_t *dst, size_t dstCapacity,
   A1C_Encoder_init(&encoder, A1C_bufferWrite, &buf);
   bool success = A1C_Encoder_encode(&encoder, item);
   assert(encoder.bytesWritten == (size_t)(buf.ptr - dst));
-  if (success) {
-    return encoder.bytesWritten;
+  return A1C_Encoder_result(&encoder, success, error);
+}
+
+size_t A1C_encodeInt64Array(const int64_t *values, size_t count, uint8_t *dst,
+                            size_t dstCapacity, A1C_Error *error) {
+  A1C_Buffer buf = {
+      .ptr = dst,
+      .end = dst + dstCapacity,
+  };
+  A1C_Encoder encoder;
+  A1C_Encoder_init(&encoder, A1C_bufferWrite, &buf);
+  bool success = A1C_Encoder_int64Array(&encoder, values, count);
+  assert(encoder.bytesWritten == (size_t)(buf.ptr - dst));
+  return A1C_Encoder_result(&encoder, success, error);
+}
+
+size_t A1C_encodeFloat32Array(const A1C_Float32 *values, size_t count,
+                              uint8_t *dst, size_t dstCapacity,
+                              A1C_Error *error) {
+  A1C_Buffer buf = {
+      .ptr = dst,
+      .end = dst + dstCapacity,
+  };
+  A1C_Encoder encoder;
+  A1C_Encoder_init(&encoder, A1C_bufferWrite, &buf);
+  bool success = A1C_Encoder_float32Array(&encoder, values, count);
+  assert(encoder.bytesWritten == (size_t)(buf.ptr - dst));
+  return A1C_Encoder_result(&encoder, success, error);
+}
+
+size_t A1C_encodeFloat64Array(const A1C_Float64 *values, size_t count,
+                              uint8_t *dst, size_t dstCapacity,
+                              A1C_Error *error) {
+  A1C_Buffer buf = {
+      .ptr = dst,
+      .end = dst + dstCapacity,
+  };
+  A1C_Encoder encoder;
+  A1C_Encoder_init(&encoder, A1C_bufferWrite, &buf);
+  bool success = A1C_Encoder_float64Array(&encoder, values, count);
+  assert(encoder.bytesWritten == (size_t)(buf.ptr - dst));
+  return A1C_Encoder_result(&encoder, success, error);
+}
+
+typedef struct {
+  const A1C_Item *item;
+  uint8_t *dst;
+  size_t numTasks;
+  /// Encoded size of each task's children, and their offset into dst.
+  size_t sizes[A1C_PARALLEL_MAX_TASKS];
+  size_t offsets[A1C_PARALLEL_MAX_TASKS];
+  bool succeeded[A1C_PARALLEL_MAX_TASKS];
+} A1C_ParallelEncode;
+
+/// @returns The number of array items or map pairs in the top-level item.
+static size_t A1C_ParallelEncode_count(const A1C_ParallelEncode *ctx) {
+  return ctx->item->type == A1C_ItemType_map ? ctx->item->map.size
+                                              : ctx->item->array.size;
+}
+
+/// Encodes the children of task @p index with @p encoder.
+static bool A1C_ParallelEncode_children(const A1C_ParallelEncode *ctx,
+                                        size_t index, A1C_Encoder *encoder) {
+  const size_t count = A1C_ParallelEncode_count(ctx);
+  const size_t begin = index * count / ctx->numTasks;
+  const size_t end = (index + 1) * count / ctx->numTasks;
+  // Children are one level below the top-level item.
+  encoder->depth = 1;
+  for (size_t i = begin; i < end; ++i) {
+    if (ctx->item->type == A1C_ItemType_map) {
+      const A1C_Pair *pair = &ctx->item->map.items[i];
+      A1C_RET_IF_ERR(A1C_Encoder_encodeOne(encoder, &pair->key));
+      A1C_RET_IF_ERR(A1C_Encoder_encodeOne(encoder, &pair->value));
+    } else {
+      A1C_RET_IF_ERR(
+          A1C_Encoder_encodeOne(encoder, &ctx->item->array.items[i]));
+    }
   }
-  if (error != NULL) {
-    *error = encoder.error;
+  return true;
+}
+
+static void A1C_ParallelEncode_sizeTask(void *opaque, size_t index) {
+  A1C_ParallelEncode *ctx = (A1C_ParallelEncode *)opaque;
+  A1C_Encoder encoder;
+  A1C_Encoder_init(&encoder, A1C_noopWrite, NULL);
+  ctx->succeeded[index] = A1C_ParallelEncode_children(ctx, index, &encoder);
+  ctx->sizes[index] = encoder.bytesWritten;
+}
+
+static void A1C_ParallelEncode_encodeTask(void *opaque, size_t index) {
+  A1C_ParallelEncode *ctx = (A1C_ParallelEncode *)opaque;
+  uint8_t *dst = ctx->dst + ctx->offsets[index];
+  A1C_Buffer buf = {
+      .ptr = dst,
+      .end = dst + ctx->sizes[index],
+  };
+  A1C_Encoder encoder;
+  A1C_Encoder_init(&encoder, A1C_bufferWrite, &buf);
+  ctx->succeeded[index] = A1C_ParallelEncode_children(ctx, index, &encoder);
+  assert(!ctx->succeeded[index] || buf.ptr == buf.end);
+}
+
+/// @returns The size written, or 0 if the parallel encoding failed.
+static size_t A1C_Item_encodeParallelImpl(const A1C_Item *item, uint8_t *dst,
+                                          size_t dstCapacity,
+                                          const A1C_Executor *executor) {
+  A1C_ParallelEncode ctx;
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.item = item;
+  ctx.dst = dst;
+  ctx.numTasks = A1C_PARALLEL_MAX_TASKS;
+  if (executor->concurrency < A1C_PARALLEL_MAX_TASKS / 4) {
+    // Over-split so uneven ranges still balance across the workers.
+    ctx.numTasks = executor->concurrency * 4;
   }
-  return 0;
+  if (ctx.numTasks > A1C_ParallelEncode_count(&ctx)) {
+    ctx.numTasks = A1C_ParallelEncode_count(&ctx);
+  }
+
+  executor->parallelFor(executor->opaque, ctx.numTasks,
+                        A1C_ParallelEncode_sizeTask, &ctx);
+
+  // The header is written by the serial encoder to get the same bytes.
+  uint8_t header[9];
+  A1C_Buffer headerBuf = {.ptr = header, .end = header + sizeof(header)};
+  A1C_Encoder encoder;
+  A1C_Encoder_init(&encoder, A1C_bufferWrite, &headerBuf);
+  const A1C_MajorType majorType = item->type == A1C_ItemType_map
+                                      ? A1C_MajorType_map
+                                      : A1C_MajorType_array;
+  if (!A1C_Encoder_encodeHeaderAndCount(&encoder, majorType,
+                                        A1C_ParallelEncode_count(&ctx))) {
+    return 0;
+  }
+  size_t offset = encoder.bytesWritten;
+  for (size_t i = 0; i < ctx.numTasks; ++i) {
+    if (!ctx.succeeded[i]) {
+      return 0;
+    }
+    ctx.offsets[i] = offset;
+    if (A1C_overflowAdd(offset, ctx.sizes[i], &offset)) {
+      return 0;
+    }
+  }
+  if (offset > dstCapacity) {
+    return 0;
+  }
+  memcpy(dst, header, encoder.bytesWritten);
+
+  executor->parallelFor(executor->opaque, ctx.numTasks,
+                        A1C_ParallelEncode_encodeTask, &ctx);
+  for (size_t i = 0; i < ctx.numTasks; ++i) {
+    if (!ctx.succeeded[i]) {
+      return 0;
+    }
+  }
+  return offset;
+}
+
+size_t A1C_Item_encodeParallel(const A1C_Item *item, uint8_t *dst,
+                               size_t dstCapacity,
+                               const A1C_Executor *executor,
+                               A1C_Error *error) {
+  if ((item->type == A1C_ItemType_array || item->type == A1C_ItemType_map) &&
+      executor->parallelFor != NULL && executor->concurrency > 1) {
+    const size_t size =
+        A1C_Item_encodeParallelImpl(item, dst, dstCapacity, executor);
+    if (size > 0) {
+      return size;
+    }
+  }
+  // Serial encoding also reports the exact error upon failure.
+  return A1C_Item_encode(item, dst, dstCapacity, error);
 }
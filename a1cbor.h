@@ -48,15 +48,39 @@ typedef enum {
   A1C_ItemType_float64,
   A1C_ItemType_simple,
   A1C_ItemType_tag,
+  /// An array of numbers of one type, stored as a native C array. Only
+  /// produced by decoders configured with `packArrays`, or by
+  /// A1C_Item_packedArray_ref(). Packed arrays compare, hash and encode like
+  /// the arrays they represent.
+  A1C_ItemType_packedArray,
 } A1C_ItemType;
 
 typedef int64_t A1C_Int64;
 typedef bool A1C_Bool;
-/// @note Float16 is only supported by returning a 16-bit container.
+/// IEEE 754 binary16 bit pattern. Use A1C_Float16_toFloat32() and
+/// A1C_Float16_fromFloat32() to convert to and from native floats.
 typedef uint16_t A1C_Float16;
 typedef double A1C_Float64;
 typedef float A1C_Float32;
 
+/// Element types of RFC 8746 typed arrays and packed arrays.
+typedef enum {
+  A1C_ElementType_uint8,
+  /// Uint8 with clamped arithmetic, like JavaScript's Uint8ClampedArray.
+  A1C_ElementType_uint8Clamped,
+  A1C_ElementType_uint16,
+  A1C_ElementType_uint32,
+  A1C_ElementType_uint64,
+  A1C_ElementType_int8,
+  A1C_ElementType_int16,
+  A1C_ElementType_int32,
+  A1C_ElementType_int64,
+  /// Elements are A1C_Float16 bit patterns.
+  A1C_ElementType_float16,
+  A1C_ElementType_float32,
+  A1C_ElementType_float64,
+} A1C_ElementType;
+
 typedef struct {
   const uint8_t *data;
   size_t size;
@@ -82,6 +106,17 @@ typedef struct {
   const struct A1C_Item *item;
 } A1C_Tag;
 
+/// The elements of an A1C_ItemType_packedArray.
+typedef struct {
+  /// The elements in native byte order, aligned to the element size.
+  const void *data;
+  /// The number of elements. Larger arrays are never packed.
+  uint32_t size;
+  /// One of int64, float16, float32 or float64. The elements are unpacked
+  /// into items of the A1C_ItemType with the same name.
+  A1C_ElementType type;
+} A1C_PackedArray;
+
 typedef uint8_t A1C_Simple;
 
 /**
@@ -108,6 +143,7 @@ typedef struct A1C_Item {
     A1C_Array array;
     A1C_Simple simple;
     A1C_Tag tag;
+    A1C_PackedArray packedArray;
   };
   const struct A1C_Item *parent;
 } A1C_Item;
@@ -136,7 +172,12 @@ typedef enum {
   A1C_ErrorType_invalidSimpleValue,
   A1C_ErrorType_formatError,
   A1C_ErrorType_trailingData,
+  /// No longer reported, the JSON encoder supports UTF-8 strings.
   A1C_ErrorType_jsonUTF8Unsupported,
+  A1C_ErrorType_invalidImage,
+  A1C_ErrorType_fileError,
+  A1C_ErrorType_invalidJson,
+  A1C_ErrorType_invalidUtf8,
 } A1C_ErrorType;
 
 typedef struct {
@@ -191,6 +232,109 @@ A1C_Arena A1C_LimitedArena_arena(A1C_LimitedArena *limitedArena);
 /// @warning This does not free any memory.
 void A1C_LimitedArena_reset(A1C_LimitedArena *limitedArena);
 
+////////////////////////////////////////
+// Executor
+////////////////////////////////////////
+
+typedef void (*A1C_Executor_TaskCallback)(void *opaque, size_t index);
+
+/**
+ * Executor interface used by the parallel APIs, so callers can plug in their
+ * own thread pool. The library never creates threads itself.
+ */
+typedef struct {
+  /// Calls `task(taskOpaque, i)` for every i in [0, numTasks), possibly
+  /// concurrently, and returns once every call has completed.
+  void (*parallelFor)(void *opaque, size_t numTasks,
+                      A1C_Executor_TaskCallback task, void *taskOpaque);
+  /// Opaque pointer passed to parallelFor.
+  void *opaque;
+  /// The number of tasks that can run concurrently. Work is only split when
+  /// this is greater than 1.
+  size_t concurrency;
+} A1C_Executor;
+
+////////////////////////////////////////
+// Float16
+////////////////////////////////////////
+
+/**
+ * Converts a half-precision float to a float32. The conversion is exact.
+ * NaNs keep their sign and payload, but are returned quiet.
+ */
+float A1C_Float16_toFloat32(A1C_Float16 value);
+
+/**
+ * Converts a float32 to a half-precision float, rounding to nearest even.
+ * Values too large for float16 become infinities. NaNs keep their sign and
+ * the top bits of their payload, but are returned quiet.
+ */
+A1C_Float16 A1C_Float16_fromFloat32(float value);
+
+/**
+ * Converts @p count half-precision floats from @p src into @p dst.
+ * Same as calling A1C_Float16_toFloat32() on each element, but uses F16C
+ * instructions when the CPU supports them.
+ */
+void A1C_Float16_toFloat32Array(float *dst, const A1C_Float16 *src,
+                                size_t count);
+
+/**
+ * Converts @p count float32 values from @p src into @p dst.
+ * Same as calling A1C_Float16_fromFloat32() on each element, but uses F16C
+ * instructions when the CPU supports them.
+ */
+void A1C_Float16_fromFloat32Array(A1C_Float16 *dst, const float *src,
+                                  size_t count);
+
+////////////////////////////////////////
+// Base64
+////////////////////////////////////////
+
+/// @returns The size of the padded base64 encoding of @p srcSize bytes.
+size_t A1C_base64EncodedSize(size_t srcSize);
+
+/**
+ * Encodes @p srcSize bytes from @p src as base64 with the standard alphabet
+ * and padding (RFC 4648 section 4). @p dst must have room for
+ * A1C_base64EncodedSize() bytes, and isn't NUL terminated.
+ *
+ * @returns The number of bytes written to @p dst.
+ */
+size_t A1C_base64Encode(char *dst, const uint8_t *src, size_t srcSize);
+
+/// @returns The size of the unpadded base64url encoding of @p srcSize bytes.
+size_t A1C_base64urlEncodedSize(size_t srcSize);
+
+/**
+ * Encodes @p srcSize bytes from @p src as base64url without padding
+ * (RFC 4648 section 5), as CBOR expects for tag 21. @p dst must have room for
+ * A1C_base64urlEncodedSize() bytes, and isn't NUL terminated.
+ *
+ * @returns The number of bytes written to @p dst.
+ */
+size_t A1C_base64urlEncode(char *dst, const uint8_t *src, size_t srcSize);
+
+/// @returns The maximum size of the decoding of @p srcSize base64 characters.
+size_t A1C_base64DecodedSizeBound(size_t srcSize);
+
+/**
+ * Decodes @p srcSize characters of standard alphabet base64 from @p src into
+ * @p dst, which must have room for A1C_base64DecodedSizeBound() bytes.
+ * Padding is optional, but if present the input must be a multiple of 4
+ * characters. Whitespace, and unused trailing bits that aren't zero, are
+ * rejected.
+ *
+ * @returns True on success, setting @p dstSize to the number of bytes
+ * written, or false if the input isn't valid base64.
+ */
+bool A1C_NODISCARD A1C_base64Decode(uint8_t *dst, size_t *dstSize,
+                                    const char *src, size_t srcSize);
+
+/// Same as A1C_base64Decode(), but for the base64url alphabet.
+bool A1C_NODISCARD A1C_base64urlDecode(uint8_t *dst, size_t *dstSize,
+                                       const char *src, size_t srcSize);
+
 ////////////////////////////////////////
 // Decoder
 ////////////////////////////////////////
@@ -211,8 +355,10 @@ typedef struct {
    * Default (0) means unlimited.
    *
    * Unless the limit is lower, the maximum memory usage when decoding a source
-   * of N bytes is sizeof(A1C_Item) * N. The decoder will NEVER allocate more
-   * memory than this.
+   * of N bytes is sizeof(A1C_Item) * N, or 3 * sizeof(A1C_Item) * N if it
+   * contains indefinite length arrays or maps, whose children are collected
+   * before their final array is allocated. The decoder will NEVER allocate
+   * more memory than this.
    */
   size_t limitBytes;
   /**
@@ -225,6 +371,28 @@ typedef struct {
    * Otherwise A1C_ItemType_simple will not be used.
    */
   bool rejectUnknownSimple;
+  /**
+   * If true, the decoder will not set the `parent` field of decoded items,
+   * leaving it NULL. This saves a store per item, and indefinite length arrays
+   * and maps are decoded onto a scratch stack shared by all of them, and then
+   * copied, rather than being decoded into a list of individually allocated
+   * items.
+   */
+  bool skipParents;
+  /**
+   * If true, text strings are validated as UTF-8, as RFC 8949 requires, and
+   * decoding fails with `A1C_ErrorType_invalidUtf8` with `srcPos` set to the
+   * first byte of the invalid sequence. The chunks of indefinite length
+   * strings are validated individually, since a character can't span chunks.
+   */
+  bool validateUtf8;
+  /**
+   * If true, definite length arrays whose elements are all integers, or all
+   * floats of the same width, are decoded as A1C_ItemType_packedArray. The
+   * elements are stored as a native C array, which takes 4-16x less memory
+   * than an A1C_Item per element, and can be used directly by numeric code.
+   */
+  bool packArrays;
 } A1C_DecoderConfig;
 
 typedef struct {
@@ -236,10 +404,18 @@ typedef struct {
   const uint8_t *ptr;
   const uint8_t *end;
   A1C_Item *parent;
+  /// Scratch stack in the arena for the children of indefinite length
+  /// containers, used with `skipParents`.
+  A1C_Item *stack;
+  size_t stackSize;
+  size_t stackCapacity;
   size_t depth;
   size_t maxDepth;
   bool referenceSource;
   bool rejectUnknownSimple;
+  bool skipParents;
+  bool validateUtf8;
+  bool packArrays;
 } A1C_Decoder;
 
 /**
@@ -257,7 +433,8 @@ void A1C_Decoder_init(A1C_Decoder *decoder, A1C_Arena arena,
  * except that integers which do not fit in an int64_t are not supported.
  *
  * @note The memory usage of the decoder is at most sizeof(A1C_Item) * size,
- * unless the `limitBytes` configuration is lower.
+ * or three times that with indefinite length containers, unless the
+ * `limitBytes` configuration is lower.
  *
  * @returns The decoded item on success, or NULL on failure. Upon failure,
  * A1C_Decoder_getError() can be used to retrieve the error information.
@@ -266,11 +443,252 @@ const A1C_Item *A1C_NODISCARD A1C_Decoder_decode(A1C_Decoder *decoder,
                                                  const uint8_t *data,
                                                  size_t size);
 
+/**
+ * Decodes each of the @p numSpans buffers in @p spans independently, exactly
+ * like A1C_Decoder_decode() would, but in a single call. The arena is only
+ * reset once, so all the items share it, and `limitBytes` applies to the
+ * whole batch.
+ *
+ * @param[out] items Set to the decoded item for each span, or NULL if that
+ * span failed to decode. Must have room for @p numSpans items.
+ * @param[out] errors If not NULL, set to the error information for each span,
+ * which is `A1C_ErrorType_ok` on success. Must have room for @p numSpans
+ * errors.
+ *
+ * @returns The number of spans that were successfully decoded.
+ */
+size_t A1C_NODISCARD A1C_Decoder_decodeBatch(A1C_Decoder *decoder,
+                                             const A1C_Bytes *spans,
+                                             size_t numSpans,
+                                             const A1C_Item **items,
+                                             A1C_Error *errors);
+
 /**
  * @returns The error information from the last decode operation.
  */
 A1C_Error A1C_Decoder_getError(const A1C_Decoder *decoder);
 
+/// A read-only memory mapping of a file.
+typedef struct {
+  void *data;
+  size_t size;
+} A1C_FileMapping;
+
+/**
+ * Memory maps the file at @p path read-only and decodes it like
+ * A1C_Decoder_decode(), but always with `referenceSource` semantics: bytes and
+ * strings point into the mapping instead of being copied. This avoids reading
+ * the file into a heap buffer first.
+ *
+ * On success the mapping is stored in @p mapping, and must outlive the
+ * returned item. Release it with A1C_FileMapping_unmap() once the items are
+ * no longer needed.
+ *
+ * @note Only supported on POSIX systems. Elsewhere this always fails with
+ * `A1C_ErrorType_fileError`.
+ *
+ * @returns The decoded item on success, or NULL on failure. Upon failure the
+ * file is already unmapped, and A1C_Decoder_getError() returns
+ * `A1C_ErrorType_fileError` if the file couldn't be opened or mapped,
+ * `A1C_ErrorType_truncated` if it is empty, or the decoding error.
+ */
+const A1C_Item *A1C_NODISCARD A1C_Decoder_decodeFile(A1C_Decoder *decoder,
+                                                     const char *path,
+                                                     A1C_FileMapping *mapping);
+
+/// Unmaps a mapping created by A1C_Decoder_decodeFile(). It is safe to call on
+/// a zeroed mapping.
+void A1C_FileMapping_unmap(A1C_FileMapping *mapping);
+
+/**
+ * Decodes like A1C_Decoder_decode(), but when the top-level item is an array
+ * or map, its children are decoded concurrently using @p executor.
+ *
+ * A cheap skip pass over the encoding first validates the input and splits
+ * the children into ranges of roughly equal count. The calling thread then
+ * reserves one chunk per range from the decoder's arena, and each range is
+ * decoded by its own task directly into the final array, allocating only from
+ * its chunk. The arena is only ever used by the calling thread, so it need not
+ * be thread-safe. A range whose chunk runs out is finished by the calling
+ * thread.
+ *
+ * The result, error, and counted memory usage are identical to
+ * A1C_Decoder_decode(), except that with `skipParents` each task has its own
+ * scratch stack for indefinite length containers. Each chunk is at most
+ * sizeof(A1C_Item) per byte of its range, or an even share of the memory
+ * limit. Unused parts of the chunks aren't returned to the arena, and on
+ * failure the input is decoded again serially to report the exact same error,
+ * so the arena may be asked for up to three times the memory limit.
+ */
+const A1C_Item *A1C_NODISCARD A1C_Decoder_decodeParallel(
+    A1C_Decoder *decoder, const uint8_t *data, size_t size,
+    const A1C_Executor *executor);
+
+/**
+ * Decodes the JSON text (RFC 8259) in [data, data + size) directly into an
+ * A1C_Item tree, using the same arena, limits, and error reporting as
+ * A1C_Decoder_decode(). Leading and trailing whitespace is allowed, but
+ * nothing else may follow the value.
+ *
+ * Numbers without a fraction or exponent that fit in an int64_t become
+ * `A1C_ItemType_int64`, every other number becomes `A1C_ItemType_float64`.
+ * Strings are validated as UTF-8, and with `referenceSource` strings that
+ * contain no escapes point into the source. Object keys are strings, kept in
+ * source order, including duplicates.
+ *
+ * @returns The decoded item on success, or NULL on failure. Syntax errors are
+ * reported as `A1C_ErrorType_invalidJson`, and invalid UTF-8 as
+ * `A1C_ErrorType_invalidUtf8`, with `srcPos` set to the offending byte.
+ */
+const A1C_Item *A1C_NODISCARD A1C_Decoder_decodeJson(A1C_Decoder *decoder,
+                                                     const uint8_t *data,
+                                                     size_t size);
+
+////////////////////////////////////////
+// Extract
+////////////////////////////////////////
+
+typedef struct {
+  /// The encoded item found at the path, referencing the source buffer.
+  A1C_Bytes encoded;
+  /// True if the item found is a scalar, in which case it is decoded into
+  /// `item`. Definite length bytes and strings reference the source buffer.
+  /// Arrays, maps, tags, and indefinite length bytes & strings are not
+  /// decoded.
+  bool decoded;
+  /// The decoded item, only valid if `decoded` is true.
+  A1C_Item item;
+  /// The error information if the encoded data is malformed.
+  A1C_Error error;
+} A1C_Extraction;
+
+/**
+ * Looks up the item at @p path in the CBOR encoded value in
+ * [data, data + size) by walking the encoded bytes directly. No tree is built
+ * and no memory is allocated: sibling items are skipped by their encoded
+ * length.
+ *
+ * Each element of @p path selects a child of the current item. Arrays are
+ * indexed by `A1C_ItemType_int64` elements, and maps are searched for the
+ * first key that is A1C_Item_eq() to the element. Tags are followed
+ * transparently. Map keys that are arrays, maps, tags, or indefinite length
+ * bytes & strings never match.
+ *
+ * @note Only the encoded data up to the end of the found item is validated,
+ * and trailing data is not checked.
+ *
+ * @returns True if the item was found and false otherwise. If the path does
+ * not exist `out->error.type` is `A1C_ErrorType_ok`, otherwise it holds the
+ * error that was encountered.
+ */
+bool A1C_NODISCARD A1C_Extract(const uint8_t *data, size_t size,
+                               const A1C_Array *path, A1C_Extraction *out);
+
+////////////////////////////////////////
+// Tape
+////////////////////////////////////////
+
+/**
+ * A1C_Tape is a flat, read-only representation of a decoded CBOR item, as an
+ * alternative to a tree of A1C_Item.
+ *
+ * Every item is stored in pre-order as one or two 64-bit entries, so
+ * iterating over the document is a linear scan. Integers that fit in 56 bits,
+ * and definite length strings, arrays and maps with fewer than 2^16 bytes or
+ * items take a single entry, as do tags with small tag numbers. Arrays, maps
+ * and tags store the index one past their last entry, so skipping a subtree
+ * is O(1). Bytes and strings are copied into a single side buffer.
+ *
+ * The entry layout is private, use the A1C_TapeCursor_*() accessors.
+ */
+typedef struct {
+  const uint64_t *entries;
+  size_t numEntries;
+  const uint8_t *data;
+  size_t dataSize;
+} A1C_Tape;
+
+/// A reference to a single item within an A1C_Tape.
+typedef struct {
+  const A1C_Tape *tape;
+  size_t index;
+} A1C_TapeCursor;
+
+/**
+ * Decodes the CBOR encoded value in [data, data + size) into an A1C_Tape
+ * allocated in the decoder's arena. Validation and errors are exactly the same
+ * as A1C_Decoder_decode(), except that `referenceSource` and `skipParents`
+ * have no effect. `limitBytes` limits the size of the tape, which is a single
+ * allocation, so an input may exceed the limit with one decoder and not the
+ * other.
+ *
+ * @note The memory usage is at most 17 * size bytes plus a small constant,
+ * unless the `limitBytes` configuration is lower.
+ *
+ * @returns The decoded tape on success, or NULL on failure. Upon failure,
+ * A1C_Decoder_getError() can be used to retrieve the error information.
+ */
+const A1C_Tape *A1C_NODISCARD A1C_Decoder_decodeTape(A1C_Decoder *decoder,
+                                                     const uint8_t *data,
+                                                     size_t size);
+
+/// @returns A cursor pointing at the root item of the @p tape.
+A1C_TapeCursor A1C_Tape_root(const A1C_Tape *tape);
+
+A1C_ItemType A1C_TapeCursor_type(A1C_TapeCursor cursor);
+A1C_Int64 A1C_TapeCursor_int64(A1C_TapeCursor cursor);
+A1C_Bool A1C_TapeCursor_boolean(A1C_TapeCursor cursor);
+A1C_Float16 A1C_TapeCursor_float16(A1C_TapeCursor cursor);
+A1C_Float32 A1C_TapeCursor_float32(A1C_TapeCursor cursor);
+A1C_Float64 A1C_TapeCursor_float64(A1C_TapeCursor cursor);
+A1C_Simple A1C_TapeCursor_simple(A1C_TapeCursor cursor);
+A1C_Bytes A1C_TapeCursor_bytes(A1C_TapeCursor cursor);
+A1C_String A1C_TapeCursor_string(A1C_TapeCursor cursor);
+/// @returns The tag number of a tag item.
+uint64_t A1C_TapeCursor_tag(A1C_TapeCursor cursor);
+/// @returns The item wrapped by a tag item.
+A1C_TapeCursor A1C_TapeCursor_tagItem(A1C_TapeCursor cursor);
+
+/// @returns The number of items in an array, or the number of pairs in a map.
+size_t A1C_TapeCursor_size(A1C_TapeCursor cursor);
+
+/**
+ * @returns The first child of an array or map. Map children alternate between
+ * keys and values. Only valid if the container is not empty.
+ */
+A1C_TapeCursor A1C_TapeCursor_child(A1C_TapeCursor cursor);
+
+/**
+ * @returns The item following the subtree rooted at @p cursor, in O(1). This
+ * is the next sibling when iterating over the children of an array or map.
+ */
+A1C_TapeCursor A1C_TapeCursor_next(A1C_TapeCursor cursor);
+
+/// Sets @p out to the item at @p index in an array.
+/// @returns false if @p index is out of bounds.
+bool A1C_NODISCARD A1C_TapeCursor_arrayGet(A1C_TapeCursor cursor, size_t index,
+                                           A1C_TapeCursor *out);
+
+/// Sets @p out to the value in a map with the key @p key.
+/// @returns false if the key is not found.
+bool A1C_NODISCARD A1C_TapeCursor_mapGet(A1C_TapeCursor cursor,
+                                         const A1C_Item *key,
+                                         A1C_TapeCursor *out);
+/// Sets @p out to the value in a map with the key @p key.
+/// @returns false if the key is not found.
+bool A1C_NODISCARD A1C_TapeCursor_mapGet_cstr(A1C_TapeCursor cursor,
+                                              const char *key,
+                                              A1C_TapeCursor *out);
+/// Sets @p out to the value in a map with the key @p key.
+/// @returns false if the key is not found.
+bool A1C_NODISCARD A1C_TapeCursor_mapGet_int(A1C_TapeCursor cursor,
+                                             A1C_Int64 key,
+                                             A1C_TapeCursor *out);
+
+/// @returns true if @p a and @p b are equal, with the same semantics as
+/// A1C_Item_eq().
+bool A1C_TapeCursor_eqItem(A1C_TapeCursor a, const A1C_Item *b);
+
 ////////////////////////////////////////
 // Item Helpers
 ////////////////////////////////////////
@@ -291,9 +709,57 @@ const A1C_Item *A1C_Map_get_int(const A1C_Map *map, A1C_Int64 key);
 /// out of bounds.
 const A1C_Item *A1C_Array_get(const A1C_Array *array, size_t index);
 
-/// @returns true if @p a and @p b are equal
+/**
+ * Unpacks the element at index @p index of @p array into @p out, as an item
+ * with no parent.
+ *
+ * @returns false if @p index is out of bounds.
+ */
+bool A1C_PackedArray_get(const A1C_PackedArray *array, size_t index,
+                         A1C_Item *out);
+
+/// @returns true if @p a and @p b are equal. Packed arrays equal arrays with
+/// the same elements.
 bool A1C_Item_eq(const A1C_Item *a, const A1C_Item *b);
 
+/**
+ * @returns A 64-bit hash of @p item, seeded by @p seed. Items that are
+ * A1C_Item_eq() hash equal: floats hash by their bits, and maps are hashed in
+ * order, so the same pairs in a different order hash differently.
+ * @note Not cryptographic, don't use it to key tables with untrusted input
+ * unless the seed is secret.
+ */
+uint64_t A1C_Item_hash(const A1C_Item *item, uint64_t seed);
+
+/**
+ * Compares @p a and @p b with the same total order as the bytewise order of
+ * their deterministic encodings (RFC 8949 section 4.2.1), without encoding
+ * them: shortest heads first, then contents, with map pairs visited in sorted
+ * key order.
+ *
+ * @returns A negative value, zero, or a positive value if @p a orders before,
+ * the same as, or after @p b. Items that are A1C_Item_eq() compare equal, but
+ * so do floats of different widths with the same value, and maps whose pairs
+ * are permutations of each other.
+ * @note Maps whose keys aren't already sorted take quadratic time, at every
+ * level of nesting. Decoded maps usually aren't sorted, so prefer
+ * A1C_Item_compareWithArena() for large maps.
+ */
+int A1C_Item_compare(const A1C_Item *a, const A1C_Item *b);
+
+/**
+ * Compares like A1C_Item_compare(), but sorts the pairs of each map whose keys
+ * aren't already sorted once, in O(n log n), instead of scanning for each next
+ * pair.
+ *
+ * The sorted orders use 2 * sizeof(size_t) bytes per pair of each unsorted
+ * map compared, allocated from @p scratchArena. The memory is never reused,
+ * so reset the arena between comparisons. If an allocation fails, that map
+ * falls back to the quadratic scan, which gives the same result.
+ */
+int A1C_Item_compareWithArena(const A1C_Item *a, const A1C_Item *b,
+                              A1C_Arena *scratchArena);
+
 ////////////////////////////////////////
 // Creation
 ////////////////////////////////////////
@@ -409,6 +875,228 @@ A1C_Pair *A1C_NODISCARD A1C_Item_map(A1C_Item *item, size_t size,
 A1C_Item *A1C_NODISCARD A1C_Item_array(A1C_Item *item, size_t size,
                                        A1C_Arena *arena);
 
+/**
+ * Creates a packed array in the given @p item of @p size elements of @p type,
+ * referencing @p data, which must be in native byte order and aligned to the
+ * element size. The data must outlive @p item.
+ *
+ * @returns false if @p type isn't int64, float16, float32 or float64, or if
+ * @p size is larger than UINT32_MAX.
+ */
+bool A1C_NODISCARD A1C_Item_packedArray_ref(A1C_Item *item,
+                                            A1C_ElementType type,
+                                            const void *data, size_t size);
+
+/**
+ * Deep copies @p item into @p arena, so it no longer references the memory of
+ * the source tree. The clone is a single allocation sized to fit exactly:
+ * items are laid out contiguously in depth-first order with their `parent`
+ * pointers rewritten, followed by the bytes and strings, including those the
+ * source only referenced.
+ *
+ * The root of the clone has a NULL parent.
+ *
+ * @returns The root of the clone, or NULL on allocation failure.
+ */
+A1C_Item *A1C_NODISCARD A1C_Item_clone(const A1C_Item *item, A1C_Arena *arena);
+
+typedef enum {
+  /// Each container's children are followed by the subtrees of those children
+  /// in order, so walking one subtree touches one region of memory.
+  A1C_Layout_depthFirst,
+  /// Containers are laid out level by level, so the shallow levels of the tree
+  /// are packed together.
+  A1C_Layout_breadthFirst,
+} A1C_Layout;
+
+/**
+ * Rewrites the tree rooted at @p root into a single contiguous allocation in
+ * @p arena, ordered by @p layout, to improve cache locality of long-lived
+ * trees built through the creation API or decoded from indefinite containers.
+ *
+ * Children of each container are stored together, and the bytes and strings
+ * of those children are stored right after them. Nothing in the result
+ * references the source tree. The root of the result has a NULL parent.
+ *
+ * @returns The new root, or NULL on allocation failure.
+ */
+A1C_Item *A1C_NODISCARD A1C_Item_compact(const A1C_Item *root,
+                                         A1C_Arena *arena, A1C_Layout layout);
+
+////////////////////////////////////////
+// Typed Arrays
+////////////////////////////////////////
+
+/// @returns The size in bytes of one element of @p type.
+size_t A1C_ElementType_size(A1C_ElementType type);
+
+/// A view of a typed array as a native C array.
+typedef struct {
+  A1C_ElementType type;
+  /// The elements in native byte order, aligned to the element size.
+  const void *data;
+  /// The number of elements.
+  size_t count;
+} A1C_TypedArray;
+
+/**
+ * Views @p item as an RFC 8746 typed array, which is a tag from 64 to 87
+ * wrapping a byte string.
+ *
+ * The view references the byte string directly when it is aligned and in
+ * native byte order. Otherwise the elements are copied into @p arena, byte
+ * swapping them if needed.
+ *
+ * @returns True on success. Returns false if @p item isn't a typed array, if
+ * its size isn't a multiple of the element size, if it holds float128 values,
+ * or if allocation fails.
+ */
+bool A1C_NODISCARD A1C_Item_asTypedArray(const A1C_Item *item,
+                                         A1C_Arena *arena,
+                                         A1C_TypedArray *out);
+
+/**
+ * Sets @p item to an RFC 8746 typed array of @p count elements of @p type,
+ * read from @p data in native byte order. The tag uses the native byte order,
+ * so the data is referenced without copying and must outlive @p item. The
+ * tag's byte string child is allocated in @p arena.
+ *
+ * @returns True on success, false on allocation failure or overflow.
+ */
+bool A1C_NODISCARD A1C_Item_typedArray_ref(A1C_Item *item,
+                                           A1C_ElementType type,
+                                           const void *data, size_t count,
+                                           A1C_Arena *arena);
+
+////////////////////////////////////////
+// Compact Item
+////////////////////////////////////////
+
+/**
+ * A1C_CompactItem is a read-only, 16 byte alternative representation of an
+ * A1C_Item tree, half the size of A1C_Item.
+ *
+ * A compact tree lives in a single contiguous block. Children and
+ * bytes/string data are referenced by 32-bit offsets relative to the item that
+ * owns them, so a block can be at most 4 GB, and there is no parent pointer.
+ *
+ * The layout is private, use the A1C_CompactItem_*() accessors. The accessor
+ * for a value must only be called on an item of the matching type.
+ */
+typedef struct A1C_CompactItem {
+  uint32_t meta;
+  uint32_t size;
+  uint64_t payload;
+} A1C_CompactItem;
+
+/// @returns The size in bytes of the compact tree for @p item, or 0 if it
+/// would exceed the 4 GB limit.
+size_t A1C_NODISCARD A1C_Item_compactSize(const A1C_Item *item);
+
+/**
+ * Converts the tree rooted at @p item into a compact tree allocated in
+ * @p arena with a single allocation. Bytes and strings are copied.
+ *
+ * @returns The root of the compact tree, or NULL on allocation failure or if
+ * the tree exceeds the 4 GB limit.
+ */
+const A1C_CompactItem *A1C_NODISCARD A1C_Item_toCompact(const A1C_Item *item,
+                                                        A1C_Arena *arena);
+
+A1C_ItemType A1C_CompactItem_type(const A1C_CompactItem *item);
+A1C_Int64 A1C_CompactItem_int64(const A1C_CompactItem *item);
+A1C_Bool A1C_CompactItem_boolean(const A1C_CompactItem *item);
+A1C_Float16 A1C_CompactItem_float16(const A1C_CompactItem *item);
+A1C_Float32 A1C_CompactItem_float32(const A1C_CompactItem *item);
+A1C_Float64 A1C_CompactItem_float64(const A1C_CompactItem *item);
+A1C_Simple A1C_CompactItem_simple(const A1C_CompactItem *item);
+A1C_Bytes A1C_CompactItem_bytes(const A1C_CompactItem *item);
+A1C_String A1C_CompactItem_string(const A1C_CompactItem *item);
+/// @returns The tag number of a tag item.
+uint64_t A1C_CompactItem_tag(const A1C_CompactItem *item);
+/// @returns The item wrapped by a tag item.
+const A1C_CompactItem *A1C_CompactItem_tagItem(const A1C_CompactItem *item);
+
+/// @returns The number of items in an array, or the number of pairs in a map.
+size_t A1C_CompactItem_size(const A1C_CompactItem *item);
+
+/// @returns The item at @p index in an array, or NULL if @p index is out of
+/// bounds.
+const A1C_CompactItem *A1C_CompactItem_arrayGet(const A1C_CompactItem *item,
+                                                size_t index);
+
+/// @returns The key of the pair at @p index in a map, or NULL if @p index is
+/// out of bounds.
+const A1C_CompactItem *A1C_CompactItem_mapKey(const A1C_CompactItem *item,
+                                              size_t index);
+
+/// @returns The value of the pair at @p index in a map, or NULL if @p index is
+/// out of bounds.
+const A1C_CompactItem *A1C_CompactItem_mapValue(const A1C_CompactItem *item,
+                                                size_t index);
+
+/// @returns The value in the map with the key @p key or NULL if the key is not
+/// found.
+const A1C_CompactItem *A1C_CompactItem_mapGet(const A1C_CompactItem *item,
+                                              const A1C_Item *key);
+/// @returns The value in the map with the key @p key or NULL if the key is not
+/// found.
+const A1C_CompactItem *A1C_CompactItem_mapGet_cstr(const A1C_CompactItem *item,
+                                                   const char *key);
+/// @returns The value in the map with the key @p key or NULL if the key is not
+/// found.
+const A1C_CompactItem *A1C_CompactItem_mapGet_int(const A1C_CompactItem *item,
+                                                  A1C_Int64 key);
+
+/// @returns true if @p a and @p b are equal, with the same semantics as
+/// A1C_Item_eq().
+bool A1C_CompactItem_eqItem(const A1C_CompactItem *a, const A1C_Item *b);
+
+////////////////////////////////////////
+// Image
+////////////////////////////////////////
+
+/**
+ * An image is a compact tree (see A1C_CompactItem) preceded by a header, which
+ * can be written to disk and later loaded with a single read or mmap. Because
+ * compact trees only use relative offsets, no decoding or pointer fixup is
+ * needed to load an image.
+ *
+ * The header holds a magic number, a format version, the size of the tree and
+ * a checksum. Images use the native byte order of the machine that wrote
+ * them, and are rejected on machines with a different byte order.
+ */
+#define A1C_IMAGE_VERSION 1
+
+/// @returns The size in bytes of the image for @p item, or 0 if the compact
+/// tree would exceed the 4 GB limit.
+size_t A1C_NODISCARD A1C_Item_imageSize(const A1C_Item *item);
+
+/**
+ * Writes the image for @p item into @p dst, which must be 8-byte aligned.
+ *
+ * @returns The number of bytes written, or 0 if @p dst is misaligned,
+ * @p dstCapacity is smaller than A1C_Item_imageSize(), or the tree exceeds the
+ * 4 GB limit.
+ */
+size_t A1C_NODISCARD A1C_Item_writeImage(const A1C_Item *item, void *dst,
+                                         size_t dstCapacity);
+
+/**
+ * Opens the image in [data, data + size), which must be 8-byte aligned, as a
+ * memory mapping is. The header and checksum are verified, then a validation
+ * pass checks that every offset stays within the image and points strictly
+ * forward, so the accessors can't read out of bounds or loop on corrupt data.
+ * Validation is linear in the size of the image and does not recurse.
+ *
+ * @returns The root of the compact tree, which references @p data, or NULL
+ * if the image is invalid. Upon failure @p error is set if it is not NULL,
+ * and `srcPos` is the position of the invalid data within the image.
+ */
+const A1C_CompactItem *A1C_NODISCARD A1C_Image_open(const void *data,
+                                                    size_t size,
+                                                    A1C_Error *error);
+
 ////////////////////////////////////////
 // Encoder
 ////////////////////////////////////////
@@ -416,6 +1104,36 @@ A1C_Item *A1C_NODISCARD A1C_Item_array(A1C_Item *item, size_t size,
 typedef size_t (*A1C_Encoder_WriteCallback)(void *opaque, const uint8_t *data,
                                             size_t size);
 
+typedef struct {
+  /**
+   * If true, the encoder emits the deterministic encoding from RFC 8949
+   * section 4.2.1: map keys are sorted in bytewise lexicographic order of
+   * their deterministic encodings, and every value uses its preferred
+   * serialization.
+   *
+   * Sorting pre-encodes the keys of each map into `scratchArena`, which must
+   * be set. It uses about the encoded size of the keys plus
+   * 6 * sizeof(size_t) bytes per key, and the memory is never reused by the
+   * encoder, so reset the arena between encodings.
+   */
+  bool deterministic;
+  /**
+   * If true, float32 and float64 items are encoded with the shortest float
+   * width that represents the value exactly, per the preferred serialization
+   * in RFC 8949 section 4.1. Infinities, signed zeros, subnormals, and NaN
+   * payloads are preserved, so decoding gives the same value, but possibly
+   * in a narrower item type.
+   *
+   * Implied by `deterministic`.
+   */
+  bool preferredFloats;
+  /// If true, A1C_Encoder_json() writes compact JSON, with no whitespace
+  /// between tokens, instead of pretty printing it.
+  bool compactJson;
+  /// Arena for temporary allocations, only used when `deterministic` is set.
+  A1C_Arena scratchArena;
+} A1C_EncoderConfig;
+
 typedef struct {
   A1C_Error error;
   uint64_t bytesWritten;
@@ -423,6 +1141,10 @@ typedef struct {
   A1C_Encoder_WriteCallback write;
   void *opaque;
   size_t depth;
+  bool deterministic;
+  bool preferredFloats;
+  bool compactJson;
+  A1C_Arena scratchArena;
 } A1C_Encoder;
 
 /**
@@ -437,6 +1159,12 @@ typedef struct {
 void A1C_Encoder_init(A1C_Encoder *encoder, A1C_Encoder_WriteCallback write,
                       void *opaque);
 
+/// Initializes an encoder like A1C_Encoder_init(), with a non-default
+/// @p config.
+void A1C_Encoder_initWithConfig(A1C_Encoder *encoder,
+                                A1C_Encoder_WriteCallback write, void *opaque,
+                                A1C_EncoderConfig config);
+
 /**
  * Encodes a single A1C_Item into CBOR.
  *
@@ -446,17 +1174,49 @@ void A1C_Encoder_init(A1C_Encoder *encoder, A1C_Encoder_WriteCallback write,
 bool A1C_NODISCARD A1C_Encoder_encode(A1C_Encoder *encoder,
                                       const A1C_Item *item);
 
+/**
+ * Encodes the @p count integers at @p values as a CBOR array, producing the
+ * same bytes as A1C_Encoder_encode() on an array of int64 items, without
+ * building the items. The head widths are classified a group at a time, and
+ * groups of one width are written in bulk.
+ *
+ * To encode the values inside a larger item, reference them with
+ * A1C_Item_packedArray_ref() instead, which uses the same encoding.
+ *
+ * @returns True on success and false on error, like A1C_Encoder_encode().
+ */
+bool A1C_NODISCARD A1C_Encoder_int64Array(A1C_Encoder *encoder,
+                                          const int64_t *values, size_t count);
+
+/// Encodes the @p count float32 values at @p values as a CBOR array, like
+/// A1C_Encoder_int64Array(). Values are narrowed with `preferredFloats`.
+bool A1C_NODISCARD A1C_Encoder_float32Array(A1C_Encoder *encoder,
+                                            const A1C_Float32 *values,
+                                            size_t count);
+
+/// Encodes the @p count float64 values at @p values as a CBOR array, like
+/// A1C_Encoder_int64Array(). Values are narrowed with `preferredFloats`.
+bool A1C_NODISCARD A1C_Encoder_float64Array(A1C_Encoder *encoder,
+                                            const A1C_Float64 *values,
+                                            size_t count);
+
 /**
  * Encodes a single A1C_Item into JSON format. If the CBOR is using non-JSON
  * features, like numeric keys, then this will return invalid JSON. If the CBOR
  * uses only JSON compatible features, it will return valid JSON.
  *
+ * The output is pretty printed with two space indentation, unless the encoder
+ * is configured with `compactJson`.
+ *
  * Limitations:
- * - Fails on non-ascii strings (UTF-8)
+ * - Strings must be valid UTF-8, or encoding fails with
+ *   `A1C_ErrorType_invalidUtf8`
  * - Bytes are base64 encoded
- * - Floating point values are not losslessly encoded in all cases
- * - Tags, float16, and simple types are encoded as objects with the "type" key
- *   denoting the type
+ * - Floats are written as the shortest decimal that reads back as the same
+ *   value, but NaN and infinities are written as nan, inf, and -inf, which
+ *   aren't valid JSON
+ * - Tags and simple types are encoded as objects with the "type" key denoting
+ *   the type
  *
  * @returns True on success and false on error. If the encoding fails, the error
  * information can be retrieved from A1C_Encoder_getError().
@@ -488,6 +1248,46 @@ size_t A1C_NODISCARD A1C_Item_encodedSize(const A1C_Item *item);
 size_t A1C_NODISCARD A1C_Item_encode(const A1C_Item *item, uint8_t *dst,
                                      size_t dstCapacity, A1C_Error *error);
 
+/**
+ * Encodes the @p count integers at @p values as a CBOR array into
+ * [dst, dst + dstCapacity) with A1C_Encoder_int64Array(), and returns the
+ * number of bytes written or 0 on error, like A1C_Item_encode().
+ *
+ * At most 9 * (count + 1) bytes are written.
+ */
+size_t A1C_NODISCARD A1C_encodeInt64Array(const int64_t *values, size_t count,
+                                          uint8_t *dst, size_t dstCapacity,
+                                          A1C_Error *error);
+
+/// Encodes float32 values like A1C_encodeInt64Array(). At most
+/// 5 * count + 9 bytes are written.
+size_t A1C_NODISCARD A1C_encodeFloat32Array(const A1C_Float32 *values,
+                                            size_t count, uint8_t *dst,
+                                            size_t dstCapacity,
+                                            A1C_Error *error);
+
+/// Encodes float64 values like A1C_encodeInt64Array(). At most
+/// 9 * (count + 1) bytes are written.
+size_t A1C_NODISCARD A1C_encodeFloat64Array(const A1C_Float64 *values,
+                                            size_t count, uint8_t *dst,
+                                            size_t dstCapacity,
+                                            A1C_Error *error);
+
+/**
+ * Encodes like A1C_Item_encode(), but when @p item is an array or map its
+ * children are encoded concurrently using @p executor.
+ *
+ * The children are split into ranges, the encoded size of each range is
+ * computed in parallel, and a prefix sum gives each range its offset in
+ * @p dst, where it is then encoded in parallel. The output is byte-identical
+ * to A1C_Item_encode(). On failure @p item is encoded again serially to
+ * report the exact same error.
+ */
+size_t A1C_NODISCARD A1C_Item_encodeParallel(const A1C_Item *item,
+                                             uint8_t *dst, size_t dstCapacity,
+                                             const A1C_Executor *executor,
+                                             A1C_Error *error);
+
 #ifdef __cplusplus
 }
 #endif
@@ -57,6 +57,55 @@ void fail(const char *message, const A1C_Item *item, A1C_Error error) {
   abort();
 }
 
+/// Runs the tasks in order on the calling thread. The input is still split
+/// into tasks, which is what the parallel decoder checks need.
+void serialParallelFor(void *, size_t numTasks, A1C_Executor_TaskCallback task,
+                       void *taskOpaque) {
+  for (size_t i = 0; i < numTasks; ++i) {
+    task(taskOpaque, i);
+  }
+}
+
+/// @returns true if @p a and @p b, which are A1C_Item_eq(), also have the same
+/// item types all the way down, so they were packed the same way.
+bool sameTypes(const A1C_Item *a, const A1C_Item *b) {
+  if (a->type != b->type) {
+    return false;
+  }
+  switch (a->type) {
+  case A1C_ItemType_array:
+    for (size_t i = 0; i < a->array.size; ++i) {
+      if (!sameTypes(&a->array.items[i], &b->array.items[i])) {
+        return false;
+      }
+    }
+    return true;
+  case A1C_ItemType_map:
+    for (size_t i = 0; i < a->map.size; ++i) {
+      if (!sameTypes(&a->map.items[i].key, &b->map.items[i].key) ||
+          !sameTypes(&a->map.items[i].value, &b->map.items[i].value)) {
+        return false;
+      }
+    }
+    return true;
+  case A1C_ItemType_tag:
+    return sameTypes(a->tag.item, b->tag.item);
+  case A1C_ItemType_int64:
+  case A1C_ItemType_bytes:
+  case A1C_ItemType_string:
+  case A1C_ItemType_boolean:
+  case A1C_ItemType_null:
+  case A1C_ItemType_float16:
+  case A1C_ItemType_float32:
+  case A1C_ItemType_float64:
+  case A1C_ItemType_simple:
+  case A1C_ItemType_undefined:
+  case A1C_ItemType_packedArray:
+    return true;
+  }
+  return true;
+}
+
 constexpr size_t kMemLimit = 1024 * 1024;
 
 void *limitedAlloc(size_t size) {
@@ -205,6 +254,22 @@ bool equal(const A1C_Item *a, const cbor_item_t *b) {
       }
     }
     return true;
+  case A1C_ItemType_packedArray:
+    if (!cbor_isa_array(b)) {
+      return false;
+    }
+    if (a->packedArray.size != cbor_array_size(b)) {
+      return false;
+    }
+    for (size_t i = 0; i < a->packedArray.size; ++i) {
+      A1C_Item childA;
+      cbor_item_t *childB = cbor_array_get(b, i);
+      if (!A1C_PackedArray_get(&a->packedArray, i, &childA) ||
+          childB == NULL || !equal(&childA, childB)) {
+        return false;
+      }
+    }
+    return true;
   case A1C_ItemType_map:
     if (!cbor_isa_map(b)) {
       return false;
@@ -301,6 +366,30 @@ extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
     }
   }
 
+  {
+    // Indefinite length containers take a different path without parents
+    Ptrs skipPtrs{};
+    auto skipArena = arena;
+    skipArena.opaque = &skipPtrs;
+    A1C_Decoder skipDecoder;
+    A1C_Decoder_init(&skipDecoder, skipArena,
+                     {.referenceSource = referenceSource, .skipParents = true});
+    auto skipped = A1C_Decoder_decode(&skipDecoder, data, size);
+    if ((skipped == NULL) != (item == NULL)) {
+      fail("Skipping parents changed whether decoding passed", item,
+           skipDecoder.error);
+    }
+    if (skipped == NULL) {
+      if (skipDecoder.error.type != decoder.error.type ||
+          skipDecoder.error.srcPos != decoder.error.srcPos) {
+        fail("Skipping parents changed the error", item, skipDecoder.error);
+      }
+    } else if (!A1C_Item_eq(item, skipped)) {
+      fail("Skipping parents changed the decoded item", item,
+           skipDecoder.error);
+    }
+  }
+
   cbor_load_result result;
   auto ref = cbor_load(data, size, &result);
 
@@ -325,6 +414,46 @@ extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
     }
   }
 
+  {
+    Ptrs packedPtrs{};
+    auto packedArena = arena;
+    packedArena.opaque = &packedPtrs;
+    A1C_Decoder packedDecoder;
+    A1C_Decoder_init(&packedDecoder, packedArena,
+                     {.referenceSource = referenceSource, .packArrays = true});
+    auto packed = A1C_Decoder_decode(&packedDecoder, data, size);
+    if (packed == NULL) {
+      fail("Decoding failed with packed arrays", item, packedDecoder.error);
+    }
+    if (!A1C_Item_eq(item, packed) || !A1C_Item_eq(packed, item)) {
+      fail("Packed arrays changed the decoded item", item, decoder.error);
+    }
+    if (A1C_Item_hash(item, 0) != A1C_Item_hash(packed, 0)) {
+      fail("Packed arrays changed the hash", item, decoder.error);
+    }
+    if (packedPtrs.first > ptrs.first) {
+      fail("Packed arrays used more memory", item, decoder.error);
+    }
+
+    Ptrs parallelPtrs{};
+    auto parallelArena = arena;
+    parallelArena.opaque = &parallelPtrs;
+    A1C_Executor executor = {serialParallelFor, nullptr, 4};
+    A1C_Decoder parallelDecoder;
+    A1C_Decoder_init(&parallelDecoder, parallelArena,
+                     {.referenceSource = referenceSource, .packArrays = true});
+    auto parallel =
+        A1C_Decoder_decodeParallel(&parallelDecoder, data, size, &executor);
+    if (parallel == NULL) {
+      fail("Parallel decoding failed with packed arrays", item,
+           parallelDecoder.error);
+    }
+    if (!A1C_Item_eq(packed, parallel) || !sameTypes(packed, parallel)) {
+      fail("Parallel decoding packed arrays differently", item,
+           parallelDecoder.error);
+    }
+  }
+
   A1C_Encoder encoder;
   std::string str;
   A1C_Encoder_init(&encoder, appendToString, &str);
@@ -334,7 +463,7 @@ extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
 
   A1C_Encoder_init(&encoder, noop, nullptr);
   if (!A1C_Encoder_json(&encoder, item)) {
-    if (encoder.error.type != A1C_ErrorType_jsonUTF8Unsupported) {
+    if (encoder.error.type != A1C_ErrorType_invalidUtf8) {
       fail("JSON failed!", item, encoder.error);
     }
   }
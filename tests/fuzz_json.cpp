@@ -1,4 +1,4 @@
-
+#include <cmath>
 #include <memory>
 #include <vector>
 
@@ -47,54 +47,102 @@ void fail(const char *message, const A1C_Item *item, A1C_Error error) {
   }
   fprintf(stderr, "\nError: type=%s, srcPos=%zu, depth=%zu, file=%s, line=%d\n",
           A1C_ErrorType_getString(error.type), error.srcPos, error.depth,
-          error.file, error.line);
+          error.file != nullptr ? error.file : "", error.line);
   abort();
 }
 
-bool hasNonAscii(const nlohmann::json &a) {
-  if (a.is_string()) {
-    auto aStr = a.get<std::string>();
-    for (auto c : aStr) {
-      if (!isascii(c)) {
-        return true;
-      }
-    }
-    return false;
+bool approxEq(const nlohmann::json &a, const nlohmann::json &b) {
+  if (a == b) {
+    return true;
+  }
+  if (a.is_number_float() && b.is_number()) {
+    return true;
   }
-  if (a.is_array()) {
+  if (a.is_number() && b.is_number_float()) {
+    return true;
+  }
+  if (a.is_array() && b.is_array()) {
+    if (a.size() != b.size()) {
+      return false;
+    }
     for (size_t i = 0; i < a.size(); ++i) {
-      if (hasNonAscii(a[i])) {
-        return true;
+      if (!approxEq(a[i], b[i])) {
+        return false;
       }
     }
-    return false;
+    return true;
   }
-  if (a.is_object()) {
+  if (a.is_object() && b.is_object()) {
+    if (a.size() != b.size()) {
+      return false;
+    }
     for (const auto &it : a.items()) {
-      if (hasNonAscii(it.key()) || hasNonAscii(it.value())) {
-        return true;
+      auto jt = b.find(it.key());
+      if (jt == b.end() || !approxEq(it.value(), jt.value())) {
+        // Key not found or values do not match
+        return false;
       }
     }
-    return false;
+    return true;
   }
   return false;
 }
-bool approxEq(const nlohmann::json &a, const nlohmann::json &b) {
-  if (a == b) {
-    return true;
+
+/// Converts an item decoded by A1C_Decoder_decodeJson() the way nlohmann
+/// parses JSON, where the last of duplicate keys wins.
+nlohmann::json toJson(const A1C_Item *item) {
+  switch (item->type) {
+  case A1C_ItemType_int64:
+    return item->int64;
+  case A1C_ItemType_float64:
+    return item->float64;
+  case A1C_ItemType_boolean:
+    return (bool)item->boolean;
+  case A1C_ItemType_null:
+    return nullptr;
+  case A1C_ItemType_string:
+    return std::string(item->string.data, item->string.size);
+  case A1C_ItemType_array: {
+    auto array = nlohmann::json::array();
+    for (size_t i = 0; i < item->array.size; ++i) {
+      array.push_back(toJson(&item->array.items[i]));
+    }
+    return array;
   }
-  if (a.is_number_float() && b.is_number()) {
-    return true;
+  case A1C_ItemType_map: {
+    auto object = nlohmann::json::object();
+    for (size_t i = 0; i < item->map.size; ++i) {
+      const A1C_Item *key = &item->map.items[i].key;
+      if (key->type != A1C_ItemType_string) {
+        fail("JSON object key is not a string", item, A1C_Error{});
+      }
+      object[std::string(key->string.data, key->string.size)] =
+          toJson(&item->map.items[i].value);
+    }
+    return object;
   }
-  if (a.is_number() && b.is_number_float()) {
-    return true;
+  default:
+    fail("Unexpected item type decoded from JSON", item, A1C_Error{});
+  }
+  return nullptr;
+}
+
+/// @returns true if @p a and @p b are the same, where numbers are compared by
+/// value, as A1C_Decoder_decodeJson() turns integers that don't fit in an
+/// int64_t into doubles.
+bool sameValue(const nlohmann::json &a, const nlohmann::json &b) {
+  if (a.is_number() && b.is_number()) {
+    if (a.is_number_float() || b.is_number_float()) {
+      return a.get<double>() == b.get<double>();
+    }
+    return a == b;
   }
   if (a.is_array() && b.is_array()) {
     if (a.size() != b.size()) {
       return false;
     }
     for (size_t i = 0; i < a.size(); ++i) {
-      if (!approxEq(a[i], b[i])) {
+      if (!sameValue(a[i], b[i])) {
         return false;
       }
     }
@@ -106,21 +154,76 @@ bool approxEq(const nlohmann::json &a, const nlohmann::json &b) {
     }
     for (const auto &it : a.items()) {
       auto jt = b.find(it.key());
-      if (jt == b.end() || !approxEq(it.value(), jt.value())) {
-        // Key not found or values do not match
+      if (jt == b.end() || !sameValue(it.value(), jt.value())) {
         return false;
       }
     }
     return true;
   }
+  return a == b;
+}
+
+/// @returns true if @p json contains a number that overflows a double, which
+/// nlohmann rejects, but A1C_Decoder_decodeJson() decodes as infinity.
+bool hasInfinity(const nlohmann::json &json) {
+  if (json.is_number_float()) {
+    return std::isinf(json.get<double>());
+  }
+  if (json.is_array() || json.is_object()) {
+    for (const auto &value : json) {
+      if (hasInfinity(value)) {
+        return true;
+      }
+    }
+  }
   return false;
 }
+
+/// Checks that A1C_Decoder_decodeJson() accepts and rejects the same inputs as
+/// nlohmann, and decodes the same values.
+void checkDecodeJson(const uint8_t *data, size_t size,
+                     const nlohmann::json &json) {
+  Ptrs ptrs;
+  A1C_Arena arena;
+  arena.calloc = testCalloc;
+  arena.opaque = &ptrs;
+  A1C_Decoder decoder;
+  A1C_DecoderConfig config = {};
+  config.maxDepth = 64;
+  A1C_Decoder_init(&decoder, arena, config);
+  const A1C_Item *item = A1C_Decoder_decodeJson(&decoder, data, size);
+
+  if (item == nullptr) {
+    if (decoder.error.type == A1C_ErrorType_maxDepthExceeded) {
+      return;
+    }
+    if (!json.is_discarded()) {
+      fprintf(stderr, "JSON: %s\n", json.dump(2).c_str());
+      fail("JSON decoding failed", nullptr, decoder.error);
+    }
+    return;
+  }
+  const nlohmann::json decoded = toJson(item);
+  if (json.is_discarded()) {
+    if (!hasInfinity(decoded)) {
+      fprintf(stderr, "Decoded JSON: %s\n", decoded.dump(2).c_str());
+      fail("JSON decoding accepted invalid JSON", item, decoder.error);
+    }
+    return;
+  }
+  if (!sameValue(json, decoded)) {
+    fprintf(stderr, "Original JSON: %s\n", json.dump(2).c_str());
+    fprintf(stderr, "Decoded JSON:  %s\n", decoded.dump(2).c_str());
+    fail("JSON decoding doesn't match", item, decoder.error);
+  }
+}
 } // namespace
 
 extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
   nlohmann::json json;
   json = nlohmann::json::parse((const char *)data, (const char *)data + size,
                                nullptr, false);
+  checkDecodeJson(data, size, json);
   if (json.is_discarded()) {
     return 0;
   }
@@ -161,24 +264,12 @@ extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
 
   str.clear();
   if (!A1C_Encoder_json(&encoder, item)) {
-    if (encoder.error.type == A1C_ErrorType_jsonUTF8Unsupported) {
-      if (!hasNonAscii(json)) {
-        fail("JSON encoding failed due to UTF8 unsupported but no non-ascii "
-             "found",
-             item, encoder.error);
-      }
-    } else {
-      fail("JSON encoding failed!", item, encoder.error);
-    }
+    fail("JSON encoding failed!", item, encoder.error);
   }
 
   auto json3 = nlohmann::json::parse(str.begin(), str.end(), nullptr, false);
 
   if (json3.is_discarded() || !approxEq(json, json3)) {
-    if (hasNonAscii(json)) {
-      // JSON printing is for debugging, we don't get unicode right
-      return 0;
-    }
     fprintf(stderr, "Original JSON: %s\n", json.dump(2).c_str());
     fprintf(stderr, "String JSON:   %s\n", str.c_str());
     fprintf(stderr, "RoundTrip JSON: %s\n", json3.dump(2).c_str());
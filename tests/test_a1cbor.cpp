@@ -1,9 +1,18 @@
 
 #include "../a1cbor.h"
 
+#include <algorithm>
+#include <clocale>
+#include <cmath>
+#include <functional>
+#include <map>
 #include <memory>
+#include <set>
 #include <nlohmann/json.hpp>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <thread>
 
 #include <gtest/gtest.h>
 
@@ -32,6 +41,18 @@ void *testCalloc(void *opaque, size_t bytes) {
   return ptrs->back().get();
 }
 
+/// Runs each task on its own thread.
+void threadParallelFor(void *, size_t numTasks, A1C_Executor_TaskCallback task,
+                       void *taskOpaque) {
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < numTasks; ++i) {
+    threads.emplace_back(task, taskOpaque, i);
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
 size_t appendToString(void *opaque, const uint8_t *data, size_t size) {
   auto str = static_cast<std::string *>(opaque);
   if (size == 0) {
@@ -794,4 +815,2269 @@ TEST_F(A1CBorTest, JsonRoundTrip) {
   auto reencoded = encode(item);
   ASSERT_EQ(encoded.size(), reencoded.size());
   ASSERT_EQ(memcmp(encoded.data(), reencoded.data(), encoded.size()), 0);
-}
\ No newline at end of file
+}
+
+TEST_F(A1CBorTest, CompactJson) {
+  json data;
+  data["key"] = "value";
+  data["array"] = json::array({1, -2, true, nullptr, json::array()});
+  data["nested"] =
+      json::object({{"map", json::object()}, {"x", json::object({{"y", 5}})}});
+
+  auto item = decode(json::to_cbor(data));
+  std::string str;
+  A1C_Encoder encoder;
+  A1C_Encoder_initWithConfig(&encoder, appendToString, &str,
+                             {.compactJson = true});
+  ASSERT_TRUE(A1C_Encoder_json(&encoder, item));
+  EXPECT_EQ(str, data.dump());
+  EXPECT_EQ(json::parse(str), json::parse(encodeJson(item)));
+
+  A1C_Decoder decoder;
+  A1C_Decoder_init(&decoder, arena, {});
+  auto decoded = A1C_Decoder_decodeJson(
+      &decoder, reinterpret_cast<const uint8_t *>(str.data()), str.size());
+  ASSERT_NE(decoded, nullptr);
+  EXPECT_TRUE(A1C_Item_eq(decoded, item));
+}
+
+TEST_F(A1CBorTest, JsonNumbers) {
+  auto item = A1C_Item_root(&arena);
+  auto toJson = [&](void (*set)(A1C_Item *, double), double value) {
+    set(item, value);
+    return encodeJson(item);
+  };
+  auto f64 = [](A1C_Item *i, double v) { A1C_Item_float64(i, v); };
+  auto f32 = [](A1C_Item *i, double v) { A1C_Item_float32(i, (float)v); };
+  auto i64 = [](A1C_Item *i, double v) { A1C_Item_int64(i, (int64_t)v); };
+
+  EXPECT_EQ(toJson(i64, 0), "0");
+  EXPECT_EQ(toJson(i64, -12345), "-12345");
+  A1C_Item_int64(item, INT64_MIN);
+  EXPECT_EQ(encodeJson(item), "-9223372036854775808");
+  A1C_Item_int64(item, INT64_MAX);
+  EXPECT_EQ(encodeJson(item), "9223372036854775807");
+
+  EXPECT_EQ(toJson(f64, 0.0), "0.0");
+  EXPECT_EQ(toJson(f64, -0.0), "-0.0");
+  EXPECT_EQ(toJson(f64, 1.0), "1.0");
+  EXPECT_EQ(toJson(f64, 100.0), "100.0");
+  EXPECT_EQ(toJson(f64, 0.1), "0.1");
+  EXPECT_EQ(toJson(f64, 0.3), "0.3");
+  EXPECT_EQ(toJson(f64, -3.14), "-3.14");
+  EXPECT_EQ(toJson(f64, 1e20), "100000000000000000000.0");
+  EXPECT_EQ(toJson(f64, 1e21), "1e+21");
+  EXPECT_EQ(toJson(f64, 0.000001), "0.000001");
+  EXPECT_EQ(toJson(f64, 1e-7), "1e-7");
+  EXPECT_EQ(toJson(f64, 5e-324), "5e-324");
+  EXPECT_EQ(toJson(f64, 1.7976931348623157e308), "1.7976931348623157e+308");
+  EXPECT_EQ(toJson(f64, INFINITY), "inf");
+  EXPECT_EQ(toJson(f64, -INFINITY), "-inf");
+  EXPECT_EQ(toJson(f64, NAN), "nan");
+
+  // Float32 gets its own shortest representation
+  EXPECT_EQ(toJson(f32, 0.1), "0.1");
+  EXPECT_EQ(toJson(f32, 16777216.0), "16777216.0");
+  EXPECT_EQ(toJson(f32, 3.4028234663852886e38), "3.4028235e+38");
+  EXPECT_EQ(toJson(f32, 1e-45), "1e-45");
+
+  // Every finite value reads back exactly
+  uint64_t state = 0x9E3779B97F4A7C15ull;
+  for (int i = 0; i < 100000; ++i) {
+    state = state * 6364136223846793005ull + 1442695040888963407ull;
+    const uint64_t bits = state ^ (state >> 29);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    if (!std::isfinite(value)) {
+      continue;
+    }
+    A1C_Item_float64(item, value);
+    const auto str = encodeJson(item);
+    ASSERT_EQ(json::parse(str).get<double>(), value) << str;
+
+    float narrow;
+    const uint32_t narrowBits = (uint32_t)(bits >> 32);
+    memcpy(&narrow, &narrowBits, sizeof(narrow));
+    if (!std::isfinite(narrow)) {
+      continue;
+    }
+    A1C_Item_float32(item, narrow);
+    const auto narrowStr = encodeJson(item);
+    ASSERT_EQ(std::strtof(narrowStr.c_str(), nullptr), narrow) << narrowStr;
+  }
+}
+
+TEST_F(A1CBorTest, JsonUtf8) {
+  auto item = A1C_Item_root(&arena);
+  auto check = [&](const std::string &str) {
+    A1C_Item_string_ref(item, str.data(), str.size());
+    const auto encoded = encodeJson(item);
+    EXPECT_EQ(json::parse(encoded).get<std::string>(), str) << encoded;
+    return encoded;
+  };
+  EXPECT_EQ(check("caf\xc3\xa9 \xe2\x82\xac\xf0\x9f\x98\x80"),
+            "\"caf\xc3\xa9 \xe2\x82\xac\xf0\x9f\x98\x80\"");
+  EXPECT_EQ(check("q\" b\\ \b\f\n\r\t \x01\x1f \x7f"),
+            "\"q\\\" b\\\\ \\b\\f\\n\\r\\t \\u0001\\u001f \x7f\"");
+
+  // Specials and multi-byte characters at every offset of the vector paths
+  for (size_t pos = 0; pos < 70; ++pos) {
+    for (const char *special :
+         {"\"", "\\", "\n", "\xc3\xa9", "\xf0\x9f\x98\x80"}) {
+      std::string str(70, 'a');
+      str.insert(pos, special);
+      check(str);
+    }
+  }
+
+  // Invalid UTF-8 is rejected, wherever it is
+  const std::vector<std::string> invalid = {
+      "\xff", "\xc0\x80", "\xed\xa0\x80", "\xf4\x90\x80\x80", "\xe2\x82",
+      "\x80", "\xc3", "\xf0\x9f\x98"};
+  for (size_t pos : {0, 15, 31, 32, 63, 64}) {
+    for (const auto &bad : invalid) {
+      std::string str(70, 'a');
+      str.insert(pos, bad);
+      A1C_Item_string_ref(item, str.data(), str.size());
+      std::string out;
+      A1C_Encoder encoder;
+      A1C_Encoder_init(&encoder, appendToString, &out);
+      ASSERT_FALSE(A1C_Encoder_json(&encoder, item)) << pos;
+      EXPECT_EQ(encoder.error.type, A1C_ErrorType_invalidUtf8);
+      EXPECT_EQ(encoder.error.item, item);
+    }
+  }
+}
+
+TEST_F(A1CBorTest, Base64) {
+  auto encode64 = [](const std::string &data, bool url) {
+    const auto *src = reinterpret_cast<const uint8_t *>(data.data());
+    std::string out(url ? A1C_base64urlEncodedSize(data.size())
+                        : A1C_base64EncodedSize(data.size()),
+                    '\0');
+    const size_t size = url ? A1C_base64urlEncode(&out[0], src, data.size())
+                            : A1C_base64Encode(&out[0], src, data.size());
+    EXPECT_EQ(size, out.size());
+    return out;
+  };
+  auto decode64 = [](const std::string &text, bool url, std::string *out) {
+    std::vector<uint8_t> buffer(A1C_base64DecodedSizeBound(text.size()));
+    size_t size = 0;
+    const bool ok =
+        url ? A1C_base64urlDecode(buffer.data(), &size, text.data(),
+                                  text.size())
+            : A1C_base64Decode(buffer.data(), &size, text.data(), text.size());
+    if (ok) {
+      *out = std::string(buffer.begin(), buffer.begin() + (ptrdiff_t)size);
+    }
+    return ok;
+  };
+
+  // RFC 4648 test vectors
+  const std::vector<std::pair<std::string, std::string>> vectors = {
+      {"", ""},
+      {"f", "Zg=="},
+      {"fo", "Zm8="},
+      {"foo", "Zm9v"},
+      {"foob", "Zm9vYg=="},
+      {"fooba", "Zm9vYmE="},
+      {"foobar", "Zm9vYmFy"},
+  };
+  for (const auto &vector : vectors) {
+    EXPECT_EQ(encode64(vector.first, false), vector.second);
+    std::string decoded;
+    ASSERT_TRUE(decode64(vector.second, false, &decoded));
+    EXPECT_EQ(decoded, vector.first);
+    const std::string unpadded =
+        vector.second.substr(0, vector.second.find('='));
+    EXPECT_EQ(encode64(vector.first, true), unpadded);
+    ASSERT_TRUE(decode64(unpadded, false, &decoded));
+    EXPECT_EQ(decoded, vector.first);
+  }
+  EXPECT_EQ(encode64("\xfb\xff\xfe", false), "+//+");
+  EXPECT_EQ(encode64("\xfb\xff\xfe", true), "-__-");
+
+  // Every length, long enough for the vector paths
+  std::string data;
+  for (size_t i = 0; i < 300; ++i) {
+    for (bool url : {false, true}) {
+      const auto encoded = encode64(data, url);
+      std::string decoded;
+      ASSERT_TRUE(decode64(encoded, url, &decoded)) << i;
+      EXPECT_EQ(decoded, data);
+    }
+    data.push_back((char)(i * 131 + 7));
+  }
+
+  // Invalid characters anywhere, bad padding, and non-zero unused bits
+  const std::string valid = encode64(data, false);
+  for (size_t pos : {0, 31, 32, 100, 390}) {
+    for (char bad : {'-', '_', '=', '\n', ' ', '\x80', '\0'}) {
+      std::string text = valid;
+      text[pos] = bad;
+      std::string decoded;
+      EXPECT_FALSE(decode64(text, false, &decoded)) << pos << " " << bad;
+    }
+  }
+  std::string decoded;
+  for (const char *text : {"Z", "Zg=", "Zg===", "Z===", "Zh==", "Zm9=",
+                           "Zm9v=", "Zm+/"}) {
+    EXPECT_FALSE(decode64(text, true, &decoded)) << text;
+  }
+  EXPECT_TRUE(decode64("Zm-_", true, &decoded));
+  EXPECT_FALSE(decode64("Zm-_", false, &decoded));
+}
+
+TEST_F(A1CBorTest, TypedArray) {
+  auto typedArray = [this](const A1C_Item *item) {
+    A1C_TypedArray array;
+    EXPECT_TRUE(A1C_Item_asTypedArray(item, &arena, &array));
+    return array;
+  };
+  auto rejects = [this](uint64_t tag, const std::vector<uint8_t> &bytes) {
+    auto item = A1C_Item_root(&arena);
+    auto child = A1C_Item_tag(item, tag, &arena);
+    EXPECT_NE(child, nullptr);
+    A1C_Item_bytes_ref(child, bytes.data(), bytes.size());
+    A1C_TypedArray array;
+    return !A1C_Item_asTypedArray(item, &arena, &array);
+  };
+
+  // Round trip through encoding, referencing the data when aligned.
+  {
+    const std::vector<int32_t> values = {1, -2, 0x12345678, INT32_MIN,
+                                         INT32_MAX};
+    auto item = A1C_Item_root(&arena);
+    ASSERT_TRUE(A1C_Item_typedArray_ref(item, A1C_ElementType_int32,
+                                        values.data(), values.size(), &arena));
+    ASSERT_EQ(item->type, A1C_ItemType_tag);
+    ASSERT_EQ(item->tag.item->type, A1C_ItemType_bytes);
+    ASSERT_EQ(item->tag.item->bytes.size, values.size() * sizeof(int32_t));
+
+    auto array = typedArray(item);
+    ASSERT_EQ(array.type, A1C_ElementType_int32);
+    ASSERT_EQ(array.count, values.size());
+    ASSERT_EQ(array.data, values.data());
+
+    auto decoded = decode(encode(item));
+    ASSERT_EQ(*decoded, *item);
+    array = typedArray(decoded);
+    ASSERT_EQ(array.type, A1C_ElementType_int32);
+    ASSERT_EQ(array.count, values.size());
+    ASSERT_EQ(array.data, decoded->tag.item->bytes.data);
+    const auto *data = static_cast<const int32_t *>(array.data);
+    ASSERT_EQ(std::vector<int32_t>(data, data + array.count), values);
+  }
+  // Big endian elements are byte swapped on little endian hosts, and
+  // misaligned elements are copied.
+  {
+    auto decoded = decode(std::vector<uint8_t>{0xd8, 0x41, 0x44, 0x01, 0x02,
+                                               0x03, 0x04});
+    auto array = typedArray(decoded);
+    ASSERT_EQ(array.type, A1C_ElementType_uint16);
+    ASSERT_EQ(array.count, 2u);
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(array.data) % sizeof(uint16_t), 0u);
+    const auto *data = static_cast<const uint16_t *>(array.data);
+    ASSERT_EQ(data[0], 0x0102);
+    ASSERT_EQ(data[1], 0x0304);
+
+    std::vector<double> values;
+    std::vector<uint8_t> buffer = {0xd8, 0x52, 0x59, 0x00, 0x00};
+    for (size_t i = 0; i < 37; ++i) {
+      values.push_back((double)i * -1.25e100);
+      uint64_t bits;
+      memcpy(&bits, &values.back(), sizeof(bits));
+      for (int shift = 56; shift >= 0; shift -= 8) {
+        buffer.push_back((uint8_t)(bits >> shift));
+      }
+    }
+    buffer[4] = (uint8_t)(values.size() * sizeof(double));
+    buffer[3] = (uint8_t)((values.size() * sizeof(double)) >> 8);
+    auto item = decode(buffer, 0, true);
+    array = typedArray(item);
+    ASSERT_EQ(array.type, A1C_ElementType_float64);
+    ASSERT_EQ(array.count, values.size());
+    ASSERT_NE(array.data, item->tag.item->bytes.data);
+    const auto *doubles = static_cast<const double *>(array.data);
+    ASSERT_EQ(std::vector<double>(doubles, doubles + array.count), values);
+
+    // Offset by one from a known alignment, so the data is misaligned.
+    alignas(8) const uint8_t storage[16] = {0, 0, 1, 0, 2, 0, 3, 0, 4};
+    auto misaligned = A1C_Item_root(&arena);
+    ASSERT_TRUE(A1C_Item_typedArray_ref(misaligned, A1C_ElementType_int16,
+                                        storage + 1, 4, &arena));
+    array = typedArray(misaligned);
+    ASSERT_NE(array.data, storage + 1);
+    ASSERT_EQ(memcmp(array.data, storage + 1, 8), 0);
+  }
+  // Single byte elements
+  {
+    auto decoded =
+        decode(std::vector<uint8_t>{0xd8, 0x44, 0x42, 0x00, 0xff});
+    auto array = typedArray(decoded);
+    ASSERT_EQ(array.type, A1C_ElementType_uint8Clamped);
+    ASSERT_EQ(array.count, 2u);
+    decoded = decode(std::vector<uint8_t>{0xd8, 0x48, 0x40});
+    array = typedArray(decoded);
+    ASSERT_EQ(array.type, A1C_ElementType_int8);
+    ASSERT_EQ(array.count, 0u);
+  }
+
+  ASSERT_TRUE(rejects(63, {}));
+  ASSERT_TRUE(rejects(76, {}));
+  ASSERT_TRUE(rejects(83, {}));
+  ASSERT_TRUE(rejects(87, {}));
+  ASSERT_TRUE(rejects(88, {}));
+  ASSERT_TRUE(rejects(65, {1, 2, 3}));
+  ASSERT_TRUE(rejects(86, {1, 2, 3, 4}));
+  ASSERT_FALSE(rejects(86, {1, 2, 3, 4, 5, 6, 7, 8}));
+  {
+    auto item = A1C_Item_root(&arena);
+    A1C_Item_int64(A1C_Item_tag(item, 64, &arena), 0);
+    A1C_TypedArray array;
+    ASSERT_FALSE(A1C_Item_asTypedArray(item, &arena, &array));
+  }
+}
+
+TEST_F(A1CBorTest, PackedArray) {
+  auto decodePacked = [this](const std::string &data, size_t maxDepth = 0) {
+    A1C_Decoder decoder;
+    A1C_DecoderConfig config = {};
+    config.packArrays = true;
+    config.maxDepth = maxDepth;
+    A1C_Decoder_init(&decoder, arena, config);
+    const A1C_Item *item = A1C_Decoder_decode(
+        &decoder, reinterpret_cast<const uint8_t *>(data.data()), data.size());
+    if (item == nullptr) {
+      throw std::runtime_error{printError("Decoding failed", decoder.error)};
+    }
+    return item;
+  };
+  // Packed arrays must behave exactly like the arrays they replace.
+  auto checkPacked = [&](const A1C_Item *item, A1C_ElementType type) {
+    const auto encoded = encode(item);
+    const A1C_Item *packed = decodePacked(encoded);
+    const A1C_Item *unpacked = decode(encoded);
+    ASSERT_EQ(packed->type, A1C_ItemType_packedArray);
+    ASSERT_EQ(packed->packedArray.type, type);
+    ASSERT_EQ(packed->packedArray.size, unpacked->array.size);
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(packed->packedArray.data) %
+                  A1C_ElementType_size(type),
+              0u);
+    for (size_t i = 0; i < unpacked->array.size; ++i) {
+      A1C_Item element;
+      ASSERT_TRUE(A1C_PackedArray_get(&packed->packedArray, i, &element));
+      ASSERT_EQ(element, unpacked->array.items[i]);
+      ASSERT_EQ(element.parent, nullptr);
+    }
+    A1C_Item element;
+    ASSERT_FALSE(A1C_PackedArray_get(&packed->packedArray,
+                                     unpacked->array.size, &element));
+
+    EXPECT_EQ(*packed, *unpacked);
+    EXPECT_EQ(*unpacked, *packed);
+    EXPECT_EQ(A1C_Item_hash(packed, 0), A1C_Item_hash(unpacked, 0));
+    EXPECT_EQ(A1C_Item_compare(packed, unpacked), 0);
+    EXPECT_EQ(encode(packed), encoded);
+    EXPECT_EQ(encodeJson(packed), encodeJson(unpacked));
+
+    const A1C_Item *clone = A1C_Item_clone(packed, &arena);
+    ASSERT_NE(clone, nullptr);
+    EXPECT_EQ(clone->type, A1C_ItemType_packedArray);
+    EXPECT_NE(clone->packedArray.data, packed->packedArray.data);
+    EXPECT_EQ(*clone, *packed);
+    for (auto layout : {A1C_Layout_depthFirst, A1C_Layout_breadthFirst}) {
+      const A1C_Item *compacted = A1C_Item_compact(packed, &arena, layout);
+      ASSERT_NE(compacted, nullptr);
+      EXPECT_EQ(compacted->type, A1C_ItemType_packedArray);
+      EXPECT_EQ(*compacted, *packed);
+    }
+    const A1C_CompactItem *compact = A1C_Item_toCompact(packed, &arena);
+    ASSERT_NE(compact, nullptr);
+    EXPECT_EQ(A1C_CompactItem_type(compact), A1C_ItemType_array);
+    EXPECT_TRUE(A1C_CompactItem_eqItem(compact, packed));
+
+    A1C_Decoder decoder;
+    A1C_Decoder_init(&decoder, arena, {});
+    const A1C_Tape *tape = A1C_Decoder_decodeTape(
+        &decoder, reinterpret_cast<const uint8_t *>(encoded.data()),
+        encoded.size());
+    ASSERT_NE(tape, nullptr);
+    EXPECT_TRUE(A1C_TapeCursor_eqItem(A1C_Tape_root(tape), packed));
+  };
+  auto makeArray = [this](size_t size) {
+    A1C_Item *item = A1C_Item_root(&arena);
+    EXPECT_NE(A1C_Item_array(item, size, &arena), nullptr);
+    return item;
+  };
+
+  // Integers of every width, with runs of small integers long enough for the
+  // vectorized loop.
+  {
+    const std::vector<int64_t> values = {
+        0,        1,         23,         24,         -1,        -24,
+        -25,      255,       256,        -256,       -257,      65535,
+        65536,    -65537,    INT32_MAX,  UINT32_MAX, 1LL << 32, -(1LL << 32),
+        INT64_MAX, INT64_MIN};
+    A1C_Item *item = makeArray(values.size() + 40);
+    A1C_Item *items = const_cast<A1C_Item *>(item->array.items);
+    for (size_t i = 0; i < values.size(); ++i) {
+      A1C_Item_int64(&items[i], values[i]);
+    }
+    for (size_t i = 0; i < 40; ++i) {
+      A1C_Item_int64(&items[values.size() + i], (int64_t)(i * 7 % 48) - 24);
+    }
+    checkPacked(item, A1C_ElementType_int64);
+  }
+  // Floats of each width
+  {
+    A1C_Item *item = makeArray(20);
+    A1C_Item *items = const_cast<A1C_Item *>(item->array.items);
+    for (size_t i = 0; i < 20; ++i) {
+      A1C_Item_float16(&items[i], A1C_Float16_fromFloat32((float)i * 0.5f));
+    }
+    checkPacked(item, A1C_ElementType_float16);
+    for (size_t i = 0; i < 20; ++i) {
+      A1C_Item_float32(&items[i], (float)i * 0.1f);
+    }
+    checkPacked(item, A1C_ElementType_float32);
+    for (size_t i = 0; i < 20; ++i) {
+      A1C_Item_float64(&items[i], (double)i * -1e300);
+    }
+    checkPacked(item, A1C_ElementType_float64);
+  }
+  // Nested packed arrays
+  {
+    const std::vector<uint8_t> data = {0xa1, 0x61, 0x61, 0x82, 0x82,
+                                       0x01, 0x02, 0x81, 0xf9, 0x3c, 0x00};
+    const std::string encoded(data.begin(), data.end());
+    const A1C_Item *packed = decodePacked(encoded);
+    const A1C_Item *value = A1C_Map_get_cstr(&packed->map, "a");
+    ASSERT_NE(value, nullptr);
+    ASSERT_EQ(value->type, A1C_ItemType_array);
+    ASSERT_EQ(value->array.items[0].type, A1C_ItemType_packedArray);
+    ASSERT_EQ(value->array.items[1].type, A1C_ItemType_packedArray);
+    EXPECT_EQ(*packed, *decode(encoded));
+    EXPECT_EQ(encode(packed), encoded);
+  }
+  // Arrays that aren't homogeneous, or are empty, aren't packed.
+  {
+    const std::vector<std::vector<uint8_t>> inputs = {
+        {0x80},
+        {0x82, 0x01, 0xf9, 0x3c, 0x00},
+        {0x82, 0xfa, 0x3f, 0x80, 0x00, 0x00, 0xf9, 0x3c, 0x00},
+        {0x82, 0x01, 0x61, 0x61},
+        {0x82, 0xf4, 0xf5},
+        {0x9f, 0x01, 0x02, 0xff},
+    };
+    for (const auto &input : inputs) {
+      const std::string encoded(input.begin(), input.end());
+      const A1C_Item *item = decodePacked(encoded);
+      EXPECT_EQ(item->type, A1C_ItemType_array);
+      EXPECT_EQ(*item, *decode(encoded));
+    }
+  }
+  // Errors are the same as without packing.
+  {
+    const std::vector<uint8_t> large = {0x82, 0x01, 0x1b, 0xff, 0xff, 0xff,
+                                        0xff, 0xff, 0xff, 0xff, 0xff};
+    A1C_Decoder decoder;
+    A1C_DecoderConfig config = {};
+    config.packArrays = true;
+    A1C_Decoder_init(&decoder, arena, config);
+    EXPECT_EQ(A1C_Decoder_decode(&decoder, large.data(), large.size()),
+              nullptr);
+    EXPECT_EQ(decoder.error.type, A1C_ErrorType_largeIntegersUnsupported);
+
+    const std::vector<uint8_t> truncated = {0x83, 0x01, 0x19, 0x01};
+    EXPECT_EQ(A1C_Decoder_decode(&decoder, truncated.data(), truncated.size()),
+              nullptr);
+    EXPECT_EQ(decoder.error.type, A1C_ErrorType_truncated);
+
+    config.maxDepth = 1;
+    A1C_Decoder_init(&decoder, arena, config);
+    const std::vector<uint8_t> deep = {0x81, 0x01};
+    EXPECT_EQ(A1C_Decoder_decode(&decoder, deep.data(), deep.size()), nullptr);
+    EXPECT_EQ(decoder.error.type, A1C_ErrorType_maxDepthExceeded);
+  }
+
+  // Creation by reference
+  {
+    const double values[] = {1.5, -2.25, 1e100};
+    A1C_Item *item = A1C_Item_root(&arena);
+    ASSERT_FALSE(A1C_Item_packedArray_ref(item, A1C_ElementType_int32, values,
+                                          3));
+    ASSERT_TRUE(A1C_Item_packedArray_ref(item, A1C_ElementType_float64, values,
+                                         3));
+    EXPECT_EQ(item->packedArray.data, values);
+    const A1C_Item *decoded = decode(encode(item));
+    ASSERT_EQ(decoded->type, A1C_ItemType_array);
+    ASSERT_EQ(decoded->array.size, 3u);
+    EXPECT_EQ(decoded->array.items[2].float64, 1e100);
+    EXPECT_EQ(*decoded, *item);
+  }
+}
+
+TEST_F(A1CBorTest, NumericArrays) {
+  // Bulk encodings must match encoding an array of items.
+  auto encodeItems = [this](size_t count, auto setItem,
+                            A1C_EncoderConfig config) {
+    A1C_Item *item = A1C_Item_root(&arena);
+    A1C_Item *items = A1C_Item_array(item, count, &arena);
+    EXPECT_TRUE(count == 0 || items != nullptr);
+    for (size_t i = 0; i < count; ++i) {
+      setItem(&items[i], i);
+    }
+    std::string str;
+    A1C_Encoder encoder;
+    A1C_Encoder_initWithConfig(&encoder, appendToString, &str, config);
+    EXPECT_TRUE(A1C_Encoder_encode(&encoder, item));
+    return str;
+  };
+
+  // Integers with runs of each width, for whole groups of one width, and
+  // mixed groups. Every length up to a few groups checks the tails.
+  std::vector<int64_t> ints;
+  const int64_t limits[] = {23, 255, 65535, UINT32_MAX, INT64_MAX};
+  for (size_t run = 0; run < 10; ++run) {
+    for (size_t i = 0; i < 8; ++i) {
+      const int64_t value = limits[run % 5] - (int64_t)i;
+      ints.push_back(run % 2 == 0 ? value : -1 - value);
+    }
+  }
+  for (size_t i = 0; i < 200; ++i) {
+    const int64_t value = (int64_t)((i * 0x9E3779B97F4A7C15ULL) >> (i % 64));
+    ints.push_back(i % 3 == 0 ? -1 - value : value);
+  }
+  ints.push_back(INT64_MIN);
+  for (size_t count = 0; count <= ints.size(); count += count < 20 ? 1 : 29) {
+    const int64_t *values = ints.data();
+    const std::string expected = encodeItems(
+        count,
+        [&](A1C_Item *item, size_t i) { A1C_Item_int64(item, values[i]); },
+        {});
+    std::string str;
+    A1C_Encoder encoder;
+    A1C_Encoder_init(&encoder, appendToString, &str);
+    ASSERT_TRUE(A1C_Encoder_int64Array(&encoder, values, count));
+    ASSERT_EQ(str, expected);
+    EXPECT_EQ(encoder.bytesWritten, expected.size());
+
+    std::vector<uint8_t> buffer(9 * (count + 1));
+    const size_t size = A1C_encodeInt64Array(values, count, buffer.data(),
+                                             buffer.size(), nullptr);
+    ASSERT_EQ(size, expected.size());
+    EXPECT_EQ(std::string(buffer.begin(), buffer.begin() + (ptrdiff_t)size),
+              expected);
+  }
+
+  // Floats, with and without narrowing.
+  std::vector<float> floats = {0.0f, -0.0f, 1.5f, 0.1f, 65504.0f, 1e-40f,
+                               INFINITY, -INFINITY, NAN};
+  std::vector<double> doubles = {0.0, -0.0, 1.5, 0.1, 1e300, 1e-310,
+                                 (double)0.1f, INFINITY, NAN};
+  for (bool preferredFloats : {false, true}) {
+    A1C_EncoderConfig config = {};
+    config.preferredFloats = preferredFloats;
+    std::string expected = encodeItems(
+        floats.size(),
+        [&](A1C_Item *item, size_t i) { A1C_Item_float32(item, floats[i]); },
+        config);
+    std::string str;
+    A1C_Encoder encoder;
+    A1C_Encoder_initWithConfig(&encoder, appendToString, &str, config);
+    ASSERT_TRUE(
+        A1C_Encoder_float32Array(&encoder, floats.data(), floats.size()));
+    EXPECT_EQ(str, expected);
+
+    expected = encodeItems(
+        doubles.size(),
+        [&](A1C_Item *item, size_t i) { A1C_Item_float64(item, doubles[i]); },
+        config);
+    str.clear();
+    A1C_Encoder_initWithConfig(&encoder, appendToString, &str, config);
+    ASSERT_TRUE(
+        A1C_Encoder_float64Array(&encoder, doubles.data(), doubles.size()));
+    EXPECT_EQ(str, expected);
+  }
+  {
+    std::vector<uint8_t> buffer(5 * floats.size() + 9);
+    size_t size = A1C_encodeFloat32Array(floats.data(), floats.size(),
+                                         buffer.data(), buffer.size(), nullptr);
+    ASSERT_EQ(size, 1 + 5 * floats.size());
+    const A1C_Item *item =
+        decode(std::string(buffer.begin(), buffer.begin() + (ptrdiff_t)size));
+    ASSERT_EQ(item->array.size, floats.size());
+    EXPECT_EQ(item->array.items[3].float32, 0.1f);
+
+    buffer.resize(9 * (doubles.size() + 1));
+    size = A1C_encodeFloat64Array(doubles.data(), doubles.size(),
+                                  buffer.data(), buffer.size(), nullptr);
+    ASSERT_EQ(size, 1 + 9 * doubles.size());
+    item =
+        decode(std::string(buffer.begin(), buffer.begin() + (ptrdiff_t)size));
+    ASSERT_EQ(item->array.size, doubles.size());
+    EXPECT_EQ(item->array.items[4].float64, 1e300);
+  }
+
+  // Too small a buffer fails.
+  {
+    std::vector<uint8_t> buffer(9 * ints.size());
+    A1C_Error error = {};
+    EXPECT_EQ(A1C_encodeInt64Array(ints.data(), ints.size(), buffer.data(),
+                                   100, &error),
+              0u);
+    EXPECT_EQ(error.type, A1C_ErrorType_writeFailed);
+    EXPECT_EQ(error.item, nullptr);
+  }
+}
+
+TEST_F(A1CBorTest, Extract) {
+  json data;
+  data["route"] = "shard-7";
+  data["meta"] = json::object({{"ids", json::array({10, 20, 30})},
+                               {"nested", json::object({{"x", -1}})}});
+  data["payload"] = std::string(1000, 'a');
+  auto encoded = json::to_cbor(data);
+
+  A1C_Item path[3];
+  A1C_Array p = {path, 0};
+  A1C_Extraction out;
+
+  // Empty path returns the root, which isn't a scalar
+  ASSERT_TRUE(A1C_Extract(encoded.data(), encoded.size(), &p, &out));
+  EXPECT_FALSE(out.decoded);
+  EXPECT_EQ(out.encoded.data, encoded.data());
+  EXPECT_EQ(out.encoded.size, encoded.size());
+
+  A1C_Item_string_refCStr(&path[0], "route");
+  p.size = 1;
+  ASSERT_TRUE(A1C_Extract(encoded.data(), encoded.size(), &p, &out));
+  ASSERT_TRUE(out.decoded);
+  ASSERT_EQ(out.item.type, A1C_ItemType_string);
+  EXPECT_EQ(std::string(out.item.string.data, out.item.string.size),
+            "shard-7");
+  EXPECT_GE(out.item.string.data,
+            reinterpret_cast<const char *>(encoded.data()));
+
+  A1C_Item_string_refCStr(&path[0], "meta");
+  A1C_Item_string_refCStr(&path[1], "ids");
+  A1C_Item_int64(&path[2], 2);
+  p.size = 3;
+  ASSERT_TRUE(A1C_Extract(encoded.data(), encoded.size(), &p, &out));
+  ASSERT_TRUE(out.decoded);
+  ASSERT_EQ(out.item.type, A1C_ItemType_int64);
+  EXPECT_EQ(out.item.int64, 30);
+
+  A1C_Item_string_refCStr(&path[1], "nested");
+  A1C_Item_string_refCStr(&path[2], "x");
+  ASSERT_TRUE(A1C_Extract(encoded.data(), encoded.size(), &p, &out));
+  ASSERT_TRUE(out.decoded);
+  EXPECT_EQ(out.item.int64, -1);
+
+  // The span of a container decodes to the same subtree
+  p.size = 2;
+  ASSERT_TRUE(A1C_Extract(encoded.data(), encoded.size(), &p, &out));
+  EXPECT_FALSE(out.decoded);
+  auto nested = decode(std::vector<uint8_t>(
+      out.encoded.data, out.encoded.data + out.encoded.size));
+  ASSERT_EQ(nested->type, A1C_ItemType_map);
+  EXPECT_EQ(A1C_Map_get_cstr(&nested->map, "x")->int64, -1);
+
+  // Missing keys, out of bounds indices, and indexing into scalars
+  A1C_Item_string_refCStr(&path[1], "missing");
+  ASSERT_FALSE(A1C_Extract(encoded.data(), encoded.size(), &p, &out));
+  EXPECT_EQ(out.error.type, A1C_ErrorType_ok);
+  A1C_Item_string_refCStr(&path[1], "ids");
+  A1C_Item_int64(&path[2], 3);
+  p.size = 3;
+  ASSERT_FALSE(A1C_Extract(encoded.data(), encoded.size(), &p, &out));
+  EXPECT_EQ(out.error.type, A1C_ErrorType_ok);
+  A1C_Item_string_refCStr(&path[0], "route");
+  A1C_Item_int64(&path[1], 0);
+  p.size = 2;
+  ASSERT_FALSE(A1C_Extract(encoded.data(), encoded.size(), &p, &out));
+  EXPECT_EQ(out.error.type, A1C_ErrorType_ok);
+
+  // Truncated data is reported as an error
+  A1C_Item_string_refCStr(&path[0], "payload");
+  p.size = 1;
+  ASSERT_FALSE(A1C_Extract(encoded.data(), encoded.size() - 20, &p, &out));
+  EXPECT_EQ(out.error.type, A1C_ErrorType_truncated);
+
+  // Indefinite containers and tags: 0xd8 0x64 tags a map {_ 1: [_ 5, 6]}
+  const uint8_t indefinite[] = {0xd8, 0x64, 0xbf, 0x01, 0x9f,
+                                0x05, 0x06, 0xff, 0xff};
+  A1C_Item_int64(&path[0], 1);
+  A1C_Item_int64(&path[1], 1);
+  p.size = 2;
+  ASSERT_TRUE(A1C_Extract(indefinite, sizeof(indefinite), &p, &out));
+  ASSERT_TRUE(out.decoded);
+  EXPECT_EQ(out.item.int64, 6);
+  A1C_Item_int64(&path[1], 2);
+  ASSERT_FALSE(A1C_Extract(indefinite, sizeof(indefinite), &p, &out));
+  EXPECT_EQ(out.error.type, A1C_ErrorType_ok);
+
+  // Null keys: {null: 1}
+  const uint8_t nullKey[] = {0xa1, 0xf6, 0x01};
+  path[0] = {};
+  A1C_Item_null(&path[0]);
+  p.size = 1;
+  ASSERT_TRUE(A1C_Extract(nullKey, sizeof(nullKey), &p, &out));
+  ASSERT_TRUE(out.decoded);
+  EXPECT_EQ(out.item.int64, 1);
+}
+
+TEST_F(A1CBorTest, CompactItem) {
+  ASSERT_EQ(sizeof(A1C_CompactItem), 16u);
+
+  auto item = A1C_Item_root(&arena);
+  ASSERT_NE(item, nullptr);
+  auto map = A1C_Item_map(item, 3, &arena);
+  ASSERT_NE(map, nullptr);
+  A1C_Item_string_refCStr(&map[0].key, "key");
+  A1C_Item_string_refCStr(&map[0].value, "value");
+  A1C_Item_int64(&map[1].key, 42);
+  A1C_Item_undefined(&map[2].key);
+  A1C_Item_null(&map[2].value);
+  auto array = A1C_Item_array(&map[1].value, 9, &arena);
+  ASSERT_NE(array, nullptr);
+  A1C_Item_int64(array + 0, INT64_MIN);
+  A1C_Item_float16(array + 1, 0x3c00);
+  A1C_Item_float32(array + 2, -3.14f);
+  A1C_Item_float64(array + 3, 3.14);
+  A1C_Item_boolean(array + 4, true);
+  uint8_t bytes[] = {0, 1, 2, 3};
+  A1C_Item_bytes_ref(array + 5, bytes, sizeof(bytes));
+  auto tag = A1C_Item_tag(array + 6, UINT64_MAX, &arena);
+  ASSERT_NE(tag, nullptr);
+  A1C_Item_string_refCStr(tag, "");
+  array[7].type = A1C_ItemType_simple;
+  array[7].simple = 42;
+  ASSERT_NE(A1C_Item_map(array + 8, 0, &arena), nullptr);
+
+  // 1 root + 6 map entries + 9 array entries + 1 tag child, and the data.
+  EXPECT_EQ(A1C_Item_compactSize(item), 17 * 16 + 3 + 5 + 4);
+
+  auto compact = A1C_Item_toCompact(item, &arena);
+  ASSERT_NE(compact, nullptr);
+  ASSERT_TRUE(A1C_CompactItem_eqItem(compact, item));
+  ASSERT_EQ(A1C_CompactItem_type(compact), A1C_ItemType_map);
+  ASSERT_EQ(A1C_CompactItem_size(compact), 3u);
+
+  auto value = A1C_CompactItem_mapGet_cstr(compact, "key");
+  ASSERT_NE(value, nullptr);
+  auto str = A1C_CompactItem_string(value);
+  EXPECT_EQ(std::string(str.data, str.size), "value");
+  EXPECT_NE(str.data, map[0].value.string.data);
+  EXPECT_EQ(A1C_CompactItem_mapGet_cstr(compact, "missing"), nullptr);
+  EXPECT_EQ(A1C_CompactItem_mapKey(compact, 3), nullptr);
+  EXPECT_EQ(A1C_CompactItem_mapValue(compact, 3), nullptr);
+
+  auto a = A1C_CompactItem_mapGet_int(compact, 42);
+  ASSERT_NE(a, nullptr);
+  ASSERT_EQ(A1C_CompactItem_type(a), A1C_ItemType_array);
+  ASSERT_EQ(A1C_CompactItem_size(a), 9u);
+  EXPECT_EQ(A1C_CompactItem_arrayGet(a, 9), nullptr);
+  EXPECT_EQ(A1C_CompactItem_int64(A1C_CompactItem_arrayGet(a, 0)), INT64_MIN);
+  EXPECT_EQ(A1C_CompactItem_float16(A1C_CompactItem_arrayGet(a, 1)), 0x3c00);
+  EXPECT_EQ(A1C_CompactItem_float32(A1C_CompactItem_arrayGet(a, 2)), -3.14f);
+  EXPECT_EQ(A1C_CompactItem_float64(A1C_CompactItem_arrayGet(a, 3)), 3.14);
+  EXPECT_TRUE(A1C_CompactItem_boolean(A1C_CompactItem_arrayGet(a, 4)));
+  auto b = A1C_CompactItem_bytes(A1C_CompactItem_arrayGet(a, 5));
+  ASSERT_EQ(b.size, sizeof(bytes));
+  EXPECT_EQ(memcmp(b.data, bytes, sizeof(bytes)), 0);
+  auto t = A1C_CompactItem_arrayGet(a, 6);
+  EXPECT_EQ(A1C_CompactItem_tag(t), UINT64_MAX);
+  EXPECT_EQ(A1C_CompactItem_string(A1C_CompactItem_tagItem(t)).size, 0u);
+  EXPECT_EQ(A1C_CompactItem_simple(A1C_CompactItem_arrayGet(a, 7)), 42);
+  EXPECT_EQ(A1C_CompactItem_size(A1C_CompactItem_arrayGet(a, 8)), 0u);
+
+  // The tree is position independent
+  const size_t size = A1C_Item_compactSize(item);
+  std::vector<uint64_t> copy((size + 7) / 8);
+  memcpy(copy.data(), compact, size);
+  auto moved = reinterpret_cast<const A1C_CompactItem *>(copy.data());
+  ASSERT_TRUE(A1C_CompactItem_eqItem(moved, item));
+
+  A1C_Item_int64(&map[1].key, 43);
+  ASSERT_FALSE(A1C_CompactItem_eqItem(compact, item));
+
+  // Decoded trees convert as well
+  json data = json::parse(R"({"a": [1, 2.5, "x", null], "b": {"c": false}})");
+  auto decoded = decode(json::to_cbor(data));
+  compact = A1C_Item_toCompact(decoded, &arena);
+  ASSERT_NE(compact, nullptr);
+  ASSERT_TRUE(A1C_CompactItem_eqItem(compact, decoded));
+}
+
+TEST_F(A1CBorTest, SkipParents) {
+  // Definite and indefinite containers, including nested indefinite ones
+  const std::vector<std::vector<uint8_t>> inputs = {
+      {0x83, 0x01, 0x82, 0x02, 0x03, 0xa1, 0x61, 0x61, 0xc1, 0x04},
+      {0x9f, 0x01, 0x9f, 0x02, 0x03, 0xff, 0xbf, 0x61, 0x61, 0x04, 0xff, 0xff},
+      {0xbf, 0x61, 0x61, 0x9f, 0xff, 0x61, 0x62, 0x5f, 0x41, 0x00, 0xff, 0xff},
+      {0x9f, 0xff},
+      {0xc1, 0x9f, 0xc2, 0x01, 0xff},
+  };
+  for (const auto &input : inputs) {
+    const A1C_Item *tracked = decode(input);
+
+    A1C_Decoder decoder;
+    A1C_DecoderConfig config = {};
+    config.skipParents = true;
+    // Indefinite containers are collected on a scratch stack first
+    config.limitBytes = 3 * input.size() * sizeof(A1C_Item);
+    A1C_Decoder_init(&decoder, arena, config);
+    const A1C_Item *skipped =
+        A1C_Decoder_decode(&decoder, input.data(), input.size());
+    ASSERT_NE(skipped, nullptr)
+        << printError("Decoding failed", decoder.error);
+    EXPECT_EQ(*tracked, *skipped);
+    EXPECT_EQ(encode(tracked), encode(skipped));
+
+    std::vector<const A1C_Item *> stack = {skipped};
+    while (!stack.empty()) {
+      const A1C_Item *item = stack.back();
+      stack.pop_back();
+      EXPECT_EQ(item->parent, nullptr);
+      if (item->type == A1C_ItemType_array) {
+        for (size_t i = 0; i < item->array.size; ++i) {
+          stack.push_back(&item->array.items[i]);
+        }
+      } else if (item->type == A1C_ItemType_map) {
+        for (size_t i = 0; i < item->map.size; ++i) {
+          stack.push_back(&item->map.items[i].key);
+          stack.push_back(&item->map.items[i].value);
+        }
+      } else if (item->type == A1C_ItemType_tag) {
+        stack.push_back(item->tag.item);
+      }
+    }
+  }
+
+  // Deeply nested indefinite containers are decoded in a single pass, each
+  // level holding a few integers around the next level.
+  {
+    const size_t depth = 5000;
+    std::vector<uint8_t> input;
+    for (size_t i = 0; i < depth; ++i) {
+      input.insert(input.end(), {0x9f, 0x01, 0x02});
+    }
+    for (size_t i = 0; i < depth; ++i) {
+      input.insert(input.end(), {0x03, 0xff});
+    }
+    for (bool skipParents : {false, true}) {
+      A1C_Decoder decoder;
+      A1C_DecoderConfig config = {};
+      config.skipParents = skipParents;
+      config.maxDepth = depth + 1;
+      config.limitBytes = 3 * input.size() * sizeof(A1C_Item);
+      A1C_Decoder_init(&decoder, arena, config);
+      const A1C_Item *item =
+          A1C_Decoder_decode(&decoder, input.data(), input.size());
+      ASSERT_NE(item, nullptr) << printError("Decoding failed", decoder.error);
+      for (size_t i = 0; i < depth; ++i) {
+        ASSERT_EQ(item->type, A1C_ItemType_array);
+        ASSERT_EQ(item->array.size, i + 1 < depth ? 4u : 3u);
+        EXPECT_EQ(item->array.items[0].int64, 1);
+        EXPECT_EQ(item->array.items[item->array.size - 1].int64, 3);
+        item = &item->array.items[2];
+      }
+      EXPECT_EQ(item->int64, 3);
+    }
+  }
+
+  // Errors report the container being decoded in both modes
+  const std::vector<uint8_t> truncated = {0x82, 0x01, 0x9f, 0x02};
+  for (bool skipParents : {false, true}) {
+    A1C_Decoder decoder;
+    A1C_DecoderConfig config = {};
+    config.skipParents = skipParents;
+    A1C_Decoder_init(&decoder, arena, config);
+    ASSERT_EQ(A1C_Decoder_decode(&decoder, truncated.data(), truncated.size()),
+              nullptr);
+    EXPECT_EQ(decoder.error.type, A1C_ErrorType_truncated);
+    EXPECT_EQ(decoder.error.depth, 2u);
+    EXPECT_NE(decoder.error.item, nullptr);
+  }
+
+  // Truncated right after a key, so the value is pushed with no input left
+  const std::vector<uint8_t> truncatedMap = {0xbf, 0x01};
+  for (bool skipParents : {false, true}) {
+    A1C_Decoder decoder;
+    A1C_DecoderConfig config = {};
+    config.skipParents = skipParents;
+    A1C_Decoder_init(&decoder, arena, config);
+    ASSERT_EQ(A1C_Decoder_decode(&decoder, truncatedMap.data(),
+                                 truncatedMap.size()),
+              nullptr);
+    EXPECT_EQ(decoder.error.type, A1C_ErrorType_truncated);
+    EXPECT_EQ(decoder.error.srcPos, 2u);
+  }
+}
+
+TEST_F(A1CBorTest, ValidateUtf8) {
+  auto decodeWith = [&](const std::vector<uint8_t> &input, bool validate,
+                        bool referenceSource) {
+    A1C_Decoder decoder;
+    A1C_DecoderConfig config = {};
+    config.validateUtf8 = validate;
+    config.referenceSource = referenceSource;
+    A1C_Decoder_init(&decoder, arena, config);
+    auto item = A1C_Decoder_decode(&decoder, input.data(), input.size());
+    return std::make_pair(item, decoder.error);
+  };
+  auto text = [](const std::string &str) {
+    std::vector<uint8_t> out = {0x78, (uint8_t)str.size()};
+    out.insert(out.end(), str.begin(), str.end());
+    return out;
+  };
+
+  for (bool referenceSource : {false, true}) {
+    // Valid text, and invalid bytes, both decode
+    const std::string valid =
+        std::string(40, 'a') + "caf\xc3\xa9 \xe2\x82\xac\xf0\x9f\x98\x80";
+    EXPECT_NE(decodeWith(text(valid), true, referenceSource).first, nullptr);
+    EXPECT_NE(decodeWith({0x42, 0xff, 0xfe}, true, referenceSource).first,
+              nullptr);
+
+    // Invalid text is reported at its first byte, past the 2 byte header
+    for (size_t pos : {0, 1, 31, 32, 33, 64}) {
+      for (const std::string bad :
+           {"\xff", "\x80", "\xc0\x80", "\xed\xa0\x80", "\xe2\x82"}) {
+        std::string str(70, 'a');
+        str.insert(pos, bad);
+        const auto input = text(str);
+        EXPECT_NE(decodeWith(input, false, referenceSource).first, nullptr);
+        const auto result = decodeWith(input, true, referenceSource);
+        ASSERT_EQ(result.first, nullptr);
+        EXPECT_EQ(result.second.type, A1C_ErrorType_invalidUtf8);
+        EXPECT_EQ(result.second.srcPos, 2 + pos);
+      }
+    }
+
+    // Characters can't span the chunks of an indefinite length string
+    const std::vector<uint8_t> chunked = {0x7f, 0x62, 'a', 0xc3, 0x61,
+                                          0xa9, 0xff};
+    EXPECT_NE(decodeWith(chunked, false, referenceSource).first, nullptr);
+    const auto result = decodeWith(chunked, true, referenceSource);
+    ASSERT_EQ(result.first, nullptr);
+    EXPECT_EQ(result.second.type, A1C_ErrorType_invalidUtf8);
+    EXPECT_EQ(result.second.srcPos, 3u);
+  }
+}
+
+TEST_F(A1CBorTest, Tape) {
+  auto item = A1C_Item_root(&arena);
+  ASSERT_NE(item, nullptr);
+  auto map = A1C_Item_map(item, 3, &arena);
+  ASSERT_NE(map, nullptr);
+  A1C_Item_string_refCStr(&map[0].key, "key");
+  A1C_Item_string_refCStr(&map[0].value, "value");
+  A1C_Item_int64(&map[1].key, 42);
+  A1C_Item_undefined(&map[2].key);
+  A1C_Item_null(&map[2].value);
+  auto array = A1C_Item_array(&map[1].value, 9, &arena);
+  ASSERT_NE(array, nullptr);
+  A1C_Item_int64(array + 0, INT64_MIN);
+  A1C_Item_float16(array + 1, 0x3c00);
+  A1C_Item_float32(array + 2, -3.14f);
+  A1C_Item_float64(array + 3, 3.14);
+  A1C_Item_boolean(array + 4, true);
+  uint8_t bytes[] = {0, 1, 2, 3};
+  A1C_Item_bytes_ref(array + 5, bytes, sizeof(bytes));
+  auto tag = A1C_Item_tag(array + 6, UINT64_MAX, &arena);
+  ASSERT_NE(tag, nullptr);
+  A1C_Item_string_refCStr(tag, "");
+  array[7].type = A1C_ItemType_simple;
+  array[7].simple = 42;
+  ASSERT_NE(A1C_Item_map(array + 8, 0, &arena), nullptr);
+
+  const auto encoded = encode(item);
+  A1C_Decoder decoder;
+  A1C_Decoder_init(&decoder, arena, {});
+  auto tape = A1C_Decoder_decodeTape(
+      &decoder, reinterpret_cast<const uint8_t *>(encoded.data()),
+      encoded.size());
+  ASSERT_NE(tape, nullptr) << printError("Decoding failed", decoder.error);
+  // One entry per item, except two for INT64_MIN, 3.14, and the UINT64_MAX tag
+  EXPECT_EQ(tape->numEntries, 20u);
+  EXPECT_EQ(tape->dataSize, 3 + 5 + 4);
+
+  auto root = A1C_Tape_root(tape);
+  ASSERT_TRUE(A1C_TapeCursor_eqItem(root, item));
+  ASSERT_EQ(A1C_TapeCursor_type(root), A1C_ItemType_map);
+  ASSERT_EQ(A1C_TapeCursor_size(root), 3u);
+  EXPECT_EQ(A1C_TapeCursor_next(root).index, tape->numEntries);
+
+  A1C_TapeCursor value;
+  ASSERT_TRUE(A1C_TapeCursor_mapGet_cstr(root, "key", &value));
+  auto str = A1C_TapeCursor_string(value);
+  EXPECT_EQ(std::string(str.data, str.size), "value");
+  EXPECT_FALSE(A1C_TapeCursor_mapGet_cstr(root, "missing", &value));
+
+  A1C_TapeCursor a;
+  ASSERT_TRUE(A1C_TapeCursor_mapGet_int(root, 42, &a));
+  ASSERT_EQ(A1C_TapeCursor_type(a), A1C_ItemType_array);
+  ASSERT_EQ(A1C_TapeCursor_size(a), 9u);
+  A1C_TapeCursor c;
+  EXPECT_FALSE(A1C_TapeCursor_arrayGet(a, 9, &c));
+  ASSERT_TRUE(A1C_TapeCursor_arrayGet(a, 0, &c));
+  EXPECT_EQ(A1C_TapeCursor_int64(c), INT64_MIN);
+  ASSERT_TRUE(A1C_TapeCursor_arrayGet(a, 1, &c));
+  EXPECT_EQ(A1C_TapeCursor_float16(c), 0x3c00);
+  ASSERT_TRUE(A1C_TapeCursor_arrayGet(a, 2, &c));
+  EXPECT_EQ(A1C_TapeCursor_float32(c), -3.14f);
+  ASSERT_TRUE(A1C_TapeCursor_arrayGet(a, 3, &c));
+  EXPECT_EQ(A1C_TapeCursor_float64(c), 3.14);
+  ASSERT_TRUE(A1C_TapeCursor_arrayGet(a, 4, &c));
+  EXPECT_TRUE(A1C_TapeCursor_boolean(c));
+  ASSERT_TRUE(A1C_TapeCursor_arrayGet(a, 5, &c));
+  auto b = A1C_TapeCursor_bytes(c);
+  ASSERT_EQ(b.size, sizeof(bytes));
+  EXPECT_EQ(memcmp(b.data, bytes, sizeof(bytes)), 0);
+  ASSERT_TRUE(A1C_TapeCursor_arrayGet(a, 6, &c));
+  EXPECT_EQ(A1C_TapeCursor_tag(c), UINT64_MAX);
+  EXPECT_EQ(A1C_TapeCursor_string(A1C_TapeCursor_tagItem(c)).size, 0u);
+  ASSERT_TRUE(A1C_TapeCursor_arrayGet(a, 7, &c));
+  EXPECT_EQ(A1C_TapeCursor_simple(c), 42);
+  ASSERT_TRUE(A1C_TapeCursor_arrayGet(a, 8, &c));
+  EXPECT_EQ(A1C_TapeCursor_size(c), 0u);
+
+  // Iterating the children visits every pair in order
+  c = A1C_TapeCursor_child(root);
+  for (size_t i = 0; i < item->map.size; ++i) {
+    EXPECT_TRUE(A1C_TapeCursor_eqItem(c, &item->map.items[i].key));
+    c = A1C_TapeCursor_next(c);
+    EXPECT_TRUE(A1C_TapeCursor_eqItem(c, &item->map.items[i].value));
+    c = A1C_TapeCursor_next(c);
+  }
+  EXPECT_EQ(c.index, tape->numEntries);
+
+  // Indefinite length items
+  const std::vector<uint8_t> indefinite = {0x9f, 0x5f, 0x41, 0x01, 0x42, 0x02,
+                                           0x03, 0xff, 0xbf, 0x61, 0x61, 0x01,
+                                           0xff, 0x7f, 0xff, 0xff};
+  tape = A1C_Decoder_decodeTape(&decoder, indefinite.data(), indefinite.size());
+  ASSERT_NE(tape, nullptr) << printError("Decoding failed", decoder.error);
+  EXPECT_TRUE(A1C_TapeCursor_eqItem(A1C_Tape_root(tape), decode(indefinite)));
+  EXPECT_EQ(tape->dataSize, 4u);
+
+  // Values on both sides of the single entry limits
+  {
+    const int64_t intMax = (int64_t(1) << 55) - 1;
+    json values = json::array({intMax, intMax + 1, -intMax - 1, -intMax - 2,
+                               std::string(65535, 'a'), std::string(65536, 'b'),
+                               json::array(), json::object()});
+    values[6].get_ref<json::array_t &>().resize(65535);
+    values.push_back(json::array());
+    values[8].get_ref<json::array_t &>().resize(65536);
+    values[7]["key"] = 1;
+    values.push_back(json::binary({1, 2}, 65535));
+    values.push_back(json::binary({3}, 65536));
+    const auto input = json::to_cbor(values);
+    tape = A1C_Decoder_decodeTape(&decoder, input.data(), input.size());
+    ASSERT_NE(tape, nullptr) << printError("Decoding failed", decoder.error);
+    root = A1C_Tape_root(tape);
+    EXPECT_TRUE(A1C_TapeCursor_eqItem(root, decode(input)));
+    EXPECT_EQ(tape->numEntries, 1 + 1 + 2 + 1 + 2 + 1 + 2 + (1 + 65535) + 3 +
+                                    (2 + 65536) + (1 + 1) + (2 + 1));
+    c = A1C_TapeCursor_child(root);
+    for (size_t i = 0; i < values.size(); ++i) {
+      if (values[i].is_number()) {
+        EXPECT_EQ(A1C_TapeCursor_int64(c), values[i].get<int64_t>());
+      } else if (values[i].is_string()) {
+        EXPECT_EQ(A1C_TapeCursor_string(c).size,
+                  values[i].get_ref<const std::string &>().size());
+      } else if (values[i].is_binary()) {
+        EXPECT_EQ(A1C_TapeCursor_tag(c), values[i].get_binary().subtype());
+      } else {
+        EXPECT_EQ(A1C_TapeCursor_size(c), values[i].size());
+      }
+      c = A1C_TapeCursor_next(c);
+    }
+    EXPECT_EQ(c.index, tape->numEntries);
+  }
+
+  // Errors match the tree decoder
+  const std::vector<std::vector<uint8_t>> invalid = {
+      {}, {0x82, 0x01}, {0x01, 0x02}, {0x9f, 0x01}, {0x5f, 0x61, 0x61, 0xff},
+      {0xff}, {0x1c},
+  };
+  for (const auto &input : invalid) {
+    A1C_Decoder treeDecoder;
+    A1C_Decoder_init(&treeDecoder, arena, {});
+    ASSERT_EQ(A1C_Decoder_decode(&treeDecoder, input.data(), input.size()),
+              nullptr);
+    ASSERT_EQ(A1C_Decoder_decodeTape(&decoder, input.data(), input.size()),
+              nullptr);
+    EXPECT_EQ(decoder.error.type, treeDecoder.error.type);
+    EXPECT_EQ(decoder.error.srcPos, treeDecoder.error.srcPos);
+  }
+
+  // Limits apply to the tape allocation
+  A1C_Decoder_init(&decoder, arena, {.limitBytes = 64});
+  ASSERT_EQ(A1C_Decoder_decodeTape(
+                &decoder, reinterpret_cast<const uint8_t *>(encoded.data()),
+                encoded.size()),
+            nullptr);
+  EXPECT_EQ(decoder.error.type, A1C_ErrorType_badAlloc);
+}
+
+/// Recomputes the checksum of the image at @p image after its tree was edited,
+/// mirroring A1C_ImageHeader_checksum(), so that the structural validation is
+/// reached.
+static void resealImage(uint8_t *image) {
+  auto rotl = [](uint64_t value, unsigned shift) {
+    return (value << shift) | (value >> (64 - shift));
+  };
+  const uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+  const uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+  auto mix = [&](uint64_t hash, uint64_t word) {
+    hash ^= rotl(word * prime2, 31) * prime1;
+    return rotl(hash, 27) * prime1 + prime2;
+  };
+  uint32_t version;
+  uint64_t treeSize, numItems;
+  memcpy(&version, image + 4, sizeof(version));
+  memcpy(&treeSize, image + 8, sizeof(treeSize));
+  memcpy(&numItems, image + 16, sizeof(numItems));
+  uint64_t hash = mix(mix(mix(prime1, version), treeSize), numItems);
+  const uint8_t *ptr = image + 32;
+  size_t size = treeSize;
+  if (size >= 32) {
+    uint64_t lanes[4] = {hash, hash + prime1, hash + prime2, hash - prime1};
+    for (; size >= 32; ptr += 32, size -= 32) {
+      for (size_t i = 0; i < 4; ++i) {
+        uint64_t word;
+        memcpy(&word, ptr + 8 * i, sizeof(word));
+        lanes[i] = mix(lanes[i], word);
+      }
+    }
+    hash = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) +
+           rotl(lanes[3], 18);
+  }
+  for (; size >= 8; ptr += 8, size -= 8) {
+    uint64_t word;
+    memcpy(&word, ptr, sizeof(word));
+    hash = mix(hash, word);
+  }
+  if (size > 0) {
+    uint64_t word = 0;
+    memcpy(&word, ptr, size);
+    hash = mix(hash, word ^ ((uint64_t)size << 56));
+  }
+  hash ^= hash >> 33;
+  hash *= 0xFF51AFD7ED558CCDULL;
+  hash ^= hash >> 33;
+  hash *= 0xC4CEB9FE1A85EC53ULL;
+  hash ^= hash >> 33;
+  memcpy(image + 24, &hash, sizeof(hash));
+}
+
+TEST_F(A1CBorTest, Image) {
+  json data;
+  data["name"] = "config";
+  data["values"] = json::array({1, -2, 0.1, true, nullptr, "x"});
+  data["nested"] = json::object({{"deep", json::array({json::array({})})}});
+  auto item = decode(json::to_cbor(data));
+
+  const size_t size = A1C_Item_imageSize(item);
+  ASSERT_EQ(size, 32 + A1C_Item_compactSize(item));
+  std::vector<uint64_t> buffer((size + 7) / 8 + 1);
+  auto dst = reinterpret_cast<uint8_t *>(buffer.data());
+  EXPECT_EQ(A1C_Item_writeImage(item, dst, size - 1), 0u);
+  EXPECT_EQ(A1C_Item_writeImage(item, dst + 1, size), 0u);
+  ASSERT_EQ(A1C_Item_writeImage(item, dst, size), size);
+
+  A1C_Error error;
+  auto root = A1C_Image_open(dst, size, &error);
+  ASSERT_NE(root, nullptr) << printError("Open failed", error);
+  EXPECT_TRUE(A1C_CompactItem_eqItem(root, item));
+  auto values = A1C_CompactItem_mapGet_cstr(root, "values");
+  ASSERT_NE(values, nullptr);
+  EXPECT_EQ(A1C_CompactItem_float64(A1C_CompactItem_arrayGet(values, 2)), 0.1);
+
+  // The image is position independent
+  std::vector<uint64_t> copy(buffer.size());
+  memcpy(copy.data(), buffer.data(), size);
+  root = A1C_Image_open(copy.data(), size, &error);
+  ASSERT_NE(root, nullptr) << printError("Open failed", error);
+  EXPECT_TRUE(A1C_CompactItem_eqItem(root, item));
+
+  // Any single bit flip is rejected
+  for (size_t i = 0; i < size; ++i) {
+    dst[i] ^= 0x10;
+    EXPECT_EQ(A1C_Image_open(dst, size, &error), nullptr) << i;
+    EXPECT_EQ(error.type, A1C_ErrorType_invalidImage);
+    dst[i] ^= 0x10;
+  }
+  EXPECT_EQ(A1C_Image_open(dst, size - 1, &error), nullptr);
+  EXPECT_EQ(A1C_Image_open(dst, 16, nullptr), nullptr);
+  EXPECT_EQ(A1C_Image_open(nullptr, 0, &error), nullptr);
+  ASSERT_NE(A1C_Image_open(dst, size, nullptr), nullptr);
+  resealImage(dst);
+  ASSERT_NE(A1C_Image_open(dst, size, &error), nullptr)
+      << printError("Open failed", error);
+
+  // Corrupt offsets with a valid checksum are rejected by validation
+  auto small = decode(json::to_cbor(json::array({"ab"})));
+  const size_t smallSize = A1C_Item_imageSize(small);
+  ASSERT_EQ(A1C_Item_writeImage(small, dst, smallSize), smallSize);
+  const uint64_t treeSize = smallSize - 32;
+  A1C_CompactItem *items = reinterpret_cast<A1C_CompactItem *>(dst + 32);
+  const A1C_CompactItem array = items[0];
+  const A1C_CompactItem string = items[1];
+  const std::vector<std::pair<size_t, A1C_CompactItem>> corrupt = {
+      {1, {string.meta, string.size, treeSize}},
+      {1, {string.meta, string.size, treeSize - 16 - 1}},
+      {1, {string.meta, string.size, UINT64_MAX}},
+      {1, {string.meta, string.size, 0}},
+      {1, {string.meta, UINT32_MAX, string.payload}},
+      {0, {array.meta, array.size, 0}},
+      {0, {array.meta, array.size, 2 * sizeof(A1C_CompactItem)}},
+      {0, {array.meta, 2, array.payload}},
+      {0, {array.meta, array.size, UINT64_MAX - 15}},
+  };
+  for (size_t i = 0; i < corrupt.size(); ++i) {
+    const auto [index, value] = corrupt[i];
+    items[index] = value;
+    resealImage(dst);
+    EXPECT_EQ(A1C_Image_open(dst, smallSize, &error), nullptr) << i;
+    EXPECT_EQ(error.type, A1C_ErrorType_invalidImage) << i;
+    EXPECT_EQ(error.srcPos, 32 + index * sizeof(A1C_CompactItem)) << i;
+    items[0] = array;
+    items[1] = string;
+  }
+  resealImage(dst);
+  ASSERT_NE(A1C_Image_open(dst, smallSize, &error), nullptr)
+      << printError("Open failed", error);
+}
+
+TEST_F(A1CBorTest, DecodeFile) {
+  json data;
+  data["name"] = "snapshot";
+  data["blob"] = std::string(10000, 'z');
+  const auto encoded = json::to_cbor(data);
+
+  char path[] = "/tmp/a1cbor-test-XXXXXX";
+  const int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  FILE *file = fdopen(fd, "wb");
+  ASSERT_NE(file, nullptr);
+  ASSERT_EQ(fwrite(encoded.data(), 1, encoded.size(), file), encoded.size());
+  ASSERT_EQ(fclose(file), 0);
+
+  A1C_Decoder decoder;
+  A1C_Decoder_init(&decoder, arena, {});
+  A1C_FileMapping mapping;
+  auto item = A1C_Decoder_decodeFile(&decoder, path, &mapping);
+  ASSERT_NE(item, nullptr) << printError("Decoding failed", decoder.error);
+  EXPECT_EQ(mapping.size, encoded.size());
+  EXPECT_TRUE(*item == *decode(encoded));
+  EXPECT_FALSE(decoder.referenceSource);
+
+  // Strings reference the mapping
+  auto blob = A1C_Map_get_cstr(&item->map, "blob");
+  ASSERT_NE(blob, nullptr);
+  auto begin = static_cast<const char *>(mapping.data);
+  EXPECT_GE(blob->string.data, begin);
+  EXPECT_LE(blob->string.data + blob->string.size, begin + mapping.size);
+  A1C_FileMapping_unmap(&mapping);
+  EXPECT_EQ(mapping.data, nullptr);
+  A1C_FileMapping_unmap(&mapping);
+
+  // Invalid data fails and unmaps
+  file = fopen(path, "wb");
+  ASSERT_NE(file, nullptr);
+  ASSERT_EQ(fwrite(encoded.data(), 1, encoded.size() - 1, file),
+            encoded.size() - 1);
+  ASSERT_EQ(fclose(file), 0);
+  EXPECT_EQ(A1C_Decoder_decodeFile(&decoder, path, &mapping), nullptr);
+  EXPECT_EQ(decoder.error.type, A1C_ErrorType_truncated);
+  EXPECT_EQ(mapping.data, nullptr);
+
+  // Empty files
+  file = fopen(path, "wb");
+  ASSERT_NE(file, nullptr);
+  ASSERT_EQ(fclose(file), 0);
+  EXPECT_EQ(A1C_Decoder_decodeFile(&decoder, path, &mapping), nullptr);
+  EXPECT_EQ(decoder.error.type, A1C_ErrorType_truncated);
+
+  ASSERT_EQ(remove(path), 0);
+  EXPECT_EQ(A1C_Decoder_decodeFile(&decoder, path, &mapping), nullptr);
+  EXPECT_EQ(decoder.error.type, A1C_ErrorType_fileError);
+}
+
+TEST_F(A1CBorTest, DecodeParallel) {
+  // The arena isn't thread-safe, only the calling thread may use it.
+  A1C_Executor executor = {threadParallelFor, nullptr, 4};
+
+  json records = json::array();
+  for (int i = 0; i < 1000; ++i) {
+    records.push_back(json::object(
+        {{"id", i}, {"name", "record-" + std::to_string(i)},
+         {"tags", json::array({i % 3, i % 5})}}));
+  }
+  json map = json::object();
+  for (int i = 0; i < 100; ++i) {
+    map["key" + std::to_string(i)] = json::array({i, std::to_string(i)});
+  }
+  std::vector<std::vector<uint8_t>> inputs = {
+      json::to_cbor(records), json::to_cbor(map), json::to_cbor(json::array()),
+      json::to_cbor(json::array({1})), json::to_cbor(42)};
+  // Indefinite length top-level array
+  auto indefinite = json::to_cbor(records);
+  indefinite[0] = 0x9f;
+  indefinite.erase(indefinite.begin() + 1, indefinite.begin() + 3);
+  indefinite.push_back(0xff);
+  inputs.push_back(indefinite);
+
+  for (const auto &input : inputs) {
+    for (size_t concurrency : {1, 2, 3, 8, 1000}) {
+      executor.concurrency = concurrency;
+      A1C_Decoder decoder;
+      A1C_Decoder_init(&decoder, arena, {});
+      auto item = A1C_Decoder_decodeParallel(&decoder, input.data(),
+                                             input.size(), &executor);
+      ASSERT_NE(item, nullptr) << printError("Decoding failed", decoder.error);
+      EXPECT_EQ(*item, *decode(input));
+      if (item->type == A1C_ItemType_array) {
+        for (size_t i = 0; i < item->array.size; ++i) {
+          EXPECT_EQ(item->array.items[i].parent, item);
+        }
+      }
+    }
+  }
+
+  // Packed arrays, at the top level and in the children, match the serial
+  // decoder.
+  {
+    json ints = json::array();
+    json floats = json::array();
+    json rows = json::array();
+    for (int i = 0; i < 500; ++i) {
+      ints.push_back(i * 1000 - 7);
+      floats.push_back(i * 0.25);
+      rows.push_back(json::array({i, i + 1, i + 2}));
+    }
+    json mixed = ints;
+    mixed.push_back("end");
+    A1C_DecoderConfig config = {};
+    config.packArrays = true;
+    for (const json &value : {ints, floats, rows, mixed}) {
+      const auto input = json::to_cbor(value);
+      A1C_Decoder serial;
+      A1C_Decoder_init(&serial, arena, config);
+      auto expected = A1C_Decoder_decode(&serial, input.data(), input.size());
+      ASSERT_NE(expected, nullptr);
+
+      A1C_Decoder decoder;
+      A1C_Decoder_init(&decoder, arena, config);
+      auto item = A1C_Decoder_decodeParallel(&decoder, input.data(),
+                                             input.size(), &executor);
+      ASSERT_NE(item, nullptr) << printError("Decoding failed", decoder.error);
+      ASSERT_EQ(item->type, expected->type);
+      EXPECT_EQ(*item, *expected);
+      if (item->type == A1C_ItemType_array) {
+        for (size_t i = 0; i < item->array.size; ++i) {
+          EXPECT_EQ(item->array.items[i].type, expected->array.items[i].type);
+        }
+      }
+      EXPECT_EQ(decoder.limitedArena.allocatedBytes,
+                serial.limitedArena.allocatedBytes);
+    }
+  }
+
+  // Errors and memory limits match the serial decoder
+  auto truncated = inputs[0];
+  truncated.pop_back();
+  auto trailing = inputs[0];
+  trailing.push_back(0);
+  size_t exactLimit;
+  {
+    A1C_Decoder serial;
+    A1C_Decoder_init(&serial, arena, {});
+    ASSERT_NE(A1C_Decoder_decode(&serial, inputs[0].data(), inputs[0].size()),
+              nullptr);
+    exactLimit = serial.limitedArena.allocatedBytes;
+  }
+  for (const auto &input : {truncated, trailing, inputs[0]}) {
+    // The exact limit leaves some tasks too little memory, so the calling
+    // thread finishes their ranges.
+    for (size_t limit : {size_t(0), size_t(1000), size_t(100000), exactLimit,
+                         exactLimit - 1}) {
+      A1C_Decoder serial;
+      A1C_Decoder_init(&serial, arena, {.limitBytes = limit});
+      auto expected = A1C_Decoder_decode(&serial, input.data(), input.size());
+
+      A1C_Decoder decoder;
+      A1C_Decoder_init(&decoder, arena, {.limitBytes = limit});
+      auto item = A1C_Decoder_decodeParallel(&decoder, input.data(),
+                                             input.size(), &executor);
+      ASSERT_EQ(item == nullptr, expected == nullptr);
+      if (item == nullptr) {
+        EXPECT_EQ(decoder.error.type, serial.error.type);
+        EXPECT_EQ(decoder.error.srcPos, serial.error.srcPos);
+      } else {
+        EXPECT_EQ(*item, *expected);
+        EXPECT_EQ(decoder.limitedArena.allocatedBytes,
+                  serial.limitedArena.allocatedBytes);
+      }
+    }
+  }
+}
+
+TEST_F(A1CBorTest, EncodeParallel) {
+  A1C_Executor executor = {threadParallelFor, nullptr, 4};
+
+  json records = json::array();
+  for (int i = 0; i < 1000; ++i) {
+    records.push_back(json::object(
+        {{"id", i}, {"name", "record-" + std::to_string(i)}, {"x", i * 0.5}}));
+  }
+  json map = json::object();
+  for (int i = 0; i < 300; ++i) {
+    map["key" + std::to_string(i)] = std::string(i, 'v');
+  }
+  for (const auto &data :
+       {records, map, json::array(), json::array({1}), json(42)}) {
+    auto item = decode(json::to_cbor(data));
+    const auto expected = encode(item);
+    for (size_t concurrency : {1, 2, 3, 8, 1000}) {
+      executor.concurrency = concurrency;
+      std::vector<uint8_t> dst(expected.size());
+      ASSERT_EQ(A1C_Item_encodeParallel(item, dst.data(), dst.size(),
+                                        &executor, nullptr),
+                expected.size());
+      EXPECT_EQ(std::string(dst.begin(), dst.end()), expected);
+    }
+  }
+
+  // Errors match the serial encoder
+  auto item = decode(json::to_cbor(records));
+  const auto expected = encode(item);
+  std::vector<uint8_t> dst(expected.size());
+  A1C_Error error;
+  A1C_Error serialError;
+  EXPECT_EQ(A1C_Item_encodeParallel(item, dst.data(), dst.size() - 1,
+                                    &executor, &error),
+            0u);
+  EXPECT_EQ(A1C_Item_encode(item, dst.data(), dst.size() - 1, &serialError),
+            0u);
+  EXPECT_EQ(error.type, A1C_ErrorType_writeFailed);
+  EXPECT_EQ(error.srcPos, serialError.srcPos);
+
+  auto root = A1C_Item_root(&arena);
+  auto array = A1C_Item_array(root, 100, &arena);
+  ASSERT_NE(array, nullptr);
+  for (size_t i = 0; i < 100; ++i) {
+    A1C_Item_int64(array + i, 1);
+  }
+  array[70].type = A1C_ItemType_simple;
+  array[70].simple = 25;
+  EXPECT_EQ(A1C_Item_encodeParallel(root, dst.data(), dst.size(), &executor,
+                                    &error),
+            0u);
+  EXPECT_EQ(error.type, A1C_ErrorType_invalidSimpleValue);
+  EXPECT_EQ(error.srcPos, 72u);
+}
+
+TEST_F(A1CBorTest, DecodeBatch) {
+  std::vector<std::vector<uint8_t>> messages;
+  for (int i = 0; i < 100; ++i) {
+    messages.push_back(json::to_cbor(
+        json::object({{"seq", i}, {"body", std::string(i % 7, 'm')}})));
+  }
+  messages[10].pop_back();
+  messages[20].push_back(0);
+  std::vector<A1C_Bytes> spans;
+  for (const auto &message : messages) {
+    spans.push_back({message.data(), message.size()});
+  }
+  spans.push_back({nullptr, 0});
+
+  A1C_Decoder decoder;
+  A1C_Decoder_init(&decoder, arena, {});
+  std::vector<const A1C_Item *> items(spans.size());
+  std::vector<A1C_Error> errors(spans.size());
+  EXPECT_EQ(A1C_Decoder_decodeBatch(&decoder, spans.data(), spans.size(),
+                                    items.data(), errors.data()),
+            spans.size() - 3);
+  for (size_t i = 0; i < spans.size(); ++i) {
+    A1C_Decoder single;
+    A1C_Decoder_init(&single, arena, {});
+    auto expected = A1C_Decoder_decode(&single, spans[i].data, spans[i].size);
+    ASSERT_EQ(items[i] == nullptr, expected == nullptr) << i;
+    EXPECT_EQ(errors[i].type, single.error.type);
+    EXPECT_EQ(errors[i].srcPos, single.error.srcPos);
+    if (expected != nullptr) {
+      EXPECT_EQ(*items[i], *expected);
+    }
+  }
+  EXPECT_EQ(errors[10].type, A1C_ErrorType_truncated);
+  EXPECT_EQ(errors[20].type, A1C_ErrorType_trailingData);
+
+  // The memory limit applies to the whole batch
+  A1C_Decoder_init(&decoder, arena, {.limitBytes = 4096});
+  const size_t decoded = A1C_Decoder_decodeBatch(
+      &decoder, spans.data(), spans.size(), items.data(), nullptr);
+  EXPECT_GT(decoded, 0u);
+  EXPECT_LT(decoded, spans.size() - 3);
+  EXPECT_LE(decoder.limitedArena.allocatedBytes, 4096u);
+}
+
+TEST_F(A1CBorTest, DeterministicEncoding) {
+  auto encodeDeterministic = [&](const A1C_Item *item) {
+    std::string str;
+    A1C_Encoder encoder;
+    A1C_Encoder_initWithConfig(&encoder, appendToString, &str,
+                               {.deterministic = true, .scratchArena = arena});
+    if (!A1C_Encoder_encode(&encoder, item)) {
+      throw std::runtime_error{printError("Encoding failed", encoder.error)};
+    }
+    return str;
+  };
+
+  // Keys in RFC 8949 section 4.2.1 order
+  auto item = A1C_Item_root(&arena);
+  auto map = A1C_Item_map(item, 8, &arena);
+  ASSERT_NE(map, nullptr);
+  A1C_Item_string_refCStr(&map[0].key, "aa");
+  A1C_Item_boolean(&map[1].key, false);
+  A1C_Item_int64(&map[2].key, -1);
+  A1C_Item_string_refCStr(&map[3].key, "z");
+  A1C_Item_int64(&map[4].key, 100);
+  auto nested = A1C_Item_map(&map[4].value, 2, &arena);
+  ASSERT_NE(nested, nullptr);
+  A1C_Item_int64(&nested[0].key, 2);
+  A1C_Item_int64(&nested[1].key, 1);
+  auto keyArray = A1C_Item_array(&map[5].key, 1, &arena);
+  ASSERT_NE(keyArray, nullptr);
+  A1C_Item_int64(keyArray, -1);
+  A1C_Item_int64(&map[6].key, 10);
+  A1C_Item_int64(&map[7].key, 0);
+
+  const auto encoded = encodeDeterministic(item);
+  // Values are all undefined (0xf7)
+  const std::string expected = {
+      '\xa8',                   // map(8)
+      '\x00', '\xf7',           // 0
+      '\x0a', '\xf7',           // 10
+      '\x18', '\x64', '\xa2',   // 100: map(2)
+      '\x01', '\xf7',           //   1
+      '\x02', '\xf7',           //   2
+      '\x20', '\xf7',           // -1
+      '\x61', 'z', '\xf7',      // "z"
+      '\x62', 'a', 'a', '\xf7', // "aa"
+      '\x81', '\x20', '\xf7',   // [-1]
+      '\xf4', '\xf7',           // false
+  };
+  EXPECT_EQ(encoded, expected);
+  // The decoded encoding holds the same pairs as item, in sorted order.
+  const A1C_Item *decoded = decode(encoded);
+  EXPECT_FALSE(A1C_Item_eq(decoded, item));
+  EXPECT_EQ(A1C_Item_compare(decoded, item), 0);
+  EXPECT_EQ(encodeDeterministic(decoded), encoded);
+  EXPECT_EQ(encoded.size(), encode(item).size());
+
+  // Insertion order doesn't matter
+  json a = json::object({{"x", 1}, {"y", json::array({1, 2})}, {"abc", 3}});
+  auto reordered = decode(json::to_cbor(a));
+  std::reverse(const_cast<A1C_Pair *>(reordered->map.items),
+               const_cast<A1C_Pair *>(reordered->map.items) +
+                   reordered->map.size);
+  EXPECT_NE(encode(reordered), encode(decode(json::to_cbor(a))));
+  EXPECT_EQ(encodeDeterministic(reordered),
+            encodeDeterministic(decode(json::to_cbor(a))));
+
+  // Invalid keys and a missing scratch arena are reported
+  map[3].key.type = A1C_ItemType_simple;
+  map[3].key.simple = 25;
+  EXPECT_THROW(encodeDeterministic(item), std::runtime_error);
+  std::string str;
+  A1C_Encoder encoder;
+  A1C_Encoder_initWithConfig(&encoder, appendToString, &str,
+                             {.deterministic = true});
+  EXPECT_FALSE(A1C_Encoder_encode(&encoder, item));
+  EXPECT_EQ(encoder.error.type, A1C_ErrorType_badAlloc);
+}
+
+TEST_F(A1CBorTest, PreferredFloats) {
+  auto encodePreferred = [&](const A1C_Item *item) {
+    std::string str;
+    A1C_Encoder encoder;
+    A1C_Encoder_initWithConfig(&encoder, appendToString, &str,
+                               {.preferredFloats = true});
+    if (!A1C_Encoder_encode(&encoder, item)) {
+      throw std::runtime_error{printError("Encoding failed", encoder.error)};
+    }
+    return str;
+  };
+  auto float64Bits = [&](uint64_t bits) {
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    auto item = A1C_Item_root(&arena);
+    A1C_Item_float64(item, value);
+    return item;
+  };
+  auto float64 = [&](double value) {
+    auto item = A1C_Item_root(&arena);
+    A1C_Item_float64(item, value);
+    return item;
+  };
+
+  // Examples from RFC 8949 Appendix A
+  EXPECT_EQ(encodePreferred(float64(0.0)), std::string("\xf9\x00\x00", 3));
+  EXPECT_EQ(encodePreferred(float64(-0.0)), std::string("\xf9\x80\x00", 3));
+  EXPECT_EQ(encodePreferred(float64(1.0)), std::string("\xf9\x3c\x00", 3));
+  EXPECT_EQ(encodePreferred(float64(1.5)), std::string("\xf9\x3e\x00", 3));
+  EXPECT_EQ(encodePreferred(float64(65504.0)), std::string("\xf9\x7b\xff", 3));
+  EXPECT_EQ(encodePreferred(float64(5.960464477539063e-8)),
+            std::string("\xf9\x00\x01", 3));
+  EXPECT_EQ(encodePreferred(float64(0.00006103515625)),
+            std::string("\xf9\x04\x00", 3));
+  EXPECT_EQ(encodePreferred(float64(-4.0)), std::string("\xf9\xc4\x00", 3));
+  EXPECT_EQ(encodePreferred(float64(100000.0)),
+            std::string("\xfa\x47\xc3\x50\x00", 5));
+  EXPECT_EQ(encodePreferred(float64(3.4028234663852886e+38)),
+            std::string("\xfa\x7f\x7f\xff\xff", 5));
+  EXPECT_EQ(encodePreferred(float64(1.1)),
+            std::string("\xfb\x3f\xf1\x99\x99\x99\x99\x99\x9a", 9));
+  EXPECT_EQ(encodePreferred(float64(1.0e+300)),
+            std::string("\xfb\x7e\x37\xe4\x3c\x88\x00\x75\x9c", 9));
+  EXPECT_EQ(encodePreferred(float64(-4.1)),
+            std::string("\xfb\xc0\x10\x66\x66\x66\x66\x66\x66", 9));
+  EXPECT_EQ(encodePreferred(float64(INFINITY)), std::string("\xf9\x7c\x00", 3));
+  EXPECT_EQ(encodePreferred(float64(-INFINITY)),
+            std::string("\xf9\xfc\x00", 3));
+  EXPECT_EQ(encodePreferred(float64(NAN)), std::string("\xf9\x7e\x00", 3));
+
+  // Float32 subnormals and float16 subnormals that need the low bits
+  EXPECT_EQ(encodePreferred(float64(std::ldexp(1.0, -149))),
+            std::string("\xfa\x00\x00\x00\x01", 5));
+  EXPECT_EQ(encodePreferred(float64(std::ldexp(3.0, -25))),
+            std::string("\xfa\x33\xc0\x00\x00", 5));
+  EXPECT_EQ(encodePreferred(float64(std::ldexp(1.0, -150))).size(), 9u);
+
+  // NaN payloads are only narrowed when they survive
+  EXPECT_EQ(encodePreferred(float64Bits(0x7ff4000000000000ULL)),
+            std::string("\xf9\x7d\x00", 3));
+  EXPECT_EQ(encodePreferred(float64Bits(0x7ff0000020000000ULL)),
+            std::string("\xfa\x7f\x80\x00\x01", 5));
+  EXPECT_EQ(encodePreferred(float64Bits(0x7ff0000000000001ULL)).size(), 9u);
+
+  // Float32 items narrow too, and values round trip
+  auto item = A1C_Item_root(&arena);
+  A1C_Item_float32(item, 0.5f);
+  EXPECT_EQ(encodePreferred(item), std::string("\xf9\x38\x00", 3));
+  A1C_Item_float32(item, 0.1f);
+  EXPECT_EQ(encodePreferred(item), encode(item));
+  for (double value : {0.1, 1.5, -65504.0, 1e-7, 3.0e38, 1e300}) {
+    auto decoded = decode(encodePreferred(float64(value)));
+    switch (decoded->type) {
+    case A1C_ItemType_float16: {
+      // Only normal float16 values are in the list
+      const int exponent = (decoded->float16 >> 10) & 0x1f;
+      const double magnitude =
+          std::ldexp(1024 + (decoded->float16 & 0x3ff), exponent - 25);
+      EXPECT_EQ(decoded->float16 & 0x8000 ? -magnitude : magnitude, value);
+      break;
+    }
+    case A1C_ItemType_float32:
+      EXPECT_EQ((double)decoded->float32, value);
+      break;
+    default:
+      EXPECT_EQ(decoded->float64, value);
+      break;
+    }
+  }
+
+  // Off by default, implied by deterministic encoding
+  EXPECT_EQ(encode(float64(1.0)).size(), 9u);
+  std::string str;
+  A1C_Encoder encoder;
+  A1C_Encoder_initWithConfig(&encoder, appendToString, &str,
+                             {.deterministic = true, .scratchArena = arena});
+  EXPECT_TRUE(A1C_Encoder_encode(&encoder, float64(1.0)));
+  EXPECT_EQ(str, std::string("\xf9\x3c\x00", 3));
+}
+
+TEST_F(A1CBorTest, Float16) {
+  auto bitsOf = [](float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+  };
+  auto fromBits = [](uint32_t bits) {
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+  };
+
+  EXPECT_EQ(A1C_Float16_toFloat32(0x3c00), 1.0f);
+  EXPECT_EQ(A1C_Float16_toFloat32(0xc400), -4.0f);
+  EXPECT_EQ(A1C_Float16_toFloat32(0x7bff), 65504.0f);
+  EXPECT_EQ(A1C_Float16_toFloat32(0x0001), std::ldexp(1.0f, -24));
+  EXPECT_EQ(A1C_Float16_toFloat32(0x03ff), std::ldexp(1023.0f, -24));
+  EXPECT_EQ(A1C_Float16_toFloat32(0x0400), std::ldexp(1.0f, -14));
+  EXPECT_EQ(bitsOf(A1C_Float16_toFloat32(0x8000)), 0x80000000u);
+  EXPECT_EQ(A1C_Float16_toFloat32(0x7c00), INFINITY);
+  EXPECT_EQ(A1C_Float16_toFloat32(0xfc00), -INFINITY);
+  EXPECT_EQ(bitsOf(A1C_Float16_toFloat32(0x7e00)), 0x7fc00000u);
+  EXPECT_EQ(bitsOf(A1C_Float16_toFloat32(0xfd01)), 0xffe02000u);
+
+  // Round to nearest even, overflow, and underflow
+  EXPECT_EQ(A1C_Float16_fromFloat32(1.0f), 0x3c00);
+  EXPECT_EQ(A1C_Float16_fromFloat32(1.0f + std::ldexp(1.0f, -11)), 0x3c00);
+  EXPECT_EQ(A1C_Float16_fromFloat32(1.0f + 3 * std::ldexp(1.0f, -11)), 0x3c02);
+  EXPECT_EQ(A1C_Float16_fromFloat32(std::nextafter(1.0f + std::ldexp(1.0f, -11),
+                                                   2.0f)),
+            0x3c01);
+  EXPECT_EQ(A1C_Float16_fromFloat32(65504.0f), 0x7bff);
+  EXPECT_EQ(A1C_Float16_fromFloat32(65519.0f), 0x7bff);
+  EXPECT_EQ(A1C_Float16_fromFloat32(65520.0f), 0x7c00);
+  EXPECT_EQ(A1C_Float16_fromFloat32(-1e10f), 0xfc00);
+  EXPECT_EQ(A1C_Float16_fromFloat32(std::ldexp(1.0f, -25)), 0x0000);
+  EXPECT_EQ(A1C_Float16_fromFloat32(std::ldexp(3.0f, -26)), 0x0001);
+  EXPECT_EQ(A1C_Float16_fromFloat32(std::ldexp(3.0f, -25)), 0x0002);
+  EXPECT_EQ(A1C_Float16_fromFloat32(std::ldexp(2047.0f, -25)), 0x0400);
+  EXPECT_EQ(A1C_Float16_fromFloat32(-1e-30f), 0x8000);
+  EXPECT_EQ(A1C_Float16_fromFloat32(fromBits(0x7fc00000)), 0x7e00);
+  EXPECT_EQ(A1C_Float16_fromFloat32(fromBits(0xff802000)), 0xfe01);
+  EXPECT_EQ(A1C_Float16_fromFloat32(fromBits(0x7f800001)), 0x7e00);
+
+  // Every half round trips, and the batch paths match the scalar paths
+  std::vector<A1C_Float16> halves(0x10000 + 3);
+  for (size_t i = 0; i < halves.size(); ++i) {
+    halves[i] = (A1C_Float16)i;
+  }
+  std::vector<float> floats(halves.size());
+  A1C_Float16_toFloat32Array(floats.data(), halves.data(), halves.size());
+  std::vector<A1C_Float16> roundTrip(halves.size());
+  A1C_Float16_fromFloat32Array(roundTrip.data(), floats.data(), floats.size());
+  for (size_t i = 0; i < halves.size(); ++i) {
+    const float value = A1C_Float16_toFloat32(halves[i]);
+    ASSERT_EQ(bitsOf(floats[i]), bitsOf(value)) << i;
+    const bool isSignalingNaN =
+        (halves[i] & 0x7c00) == 0x7c00 && (halves[i] & 0x3ff) != 0 &&
+        (halves[i] & 0x200) == 0;
+    if (!isSignalingNaN) {
+      ASSERT_EQ(roundTrip[i], halves[i]) << i;
+    }
+    ASSERT_EQ(roundTrip[i], A1C_Float16_fromFloat32(value)) << i;
+  }
+
+  floats.clear();
+  for (uint64_t bits = 0; bits <= 0xffffffffu; bits += 997) {
+    floats.push_back(fromBits((uint32_t)bits));
+  }
+  halves.resize(floats.size());
+  A1C_Float16_fromFloat32Array(halves.data(), floats.data(), floats.size());
+  for (size_t i = 0; i < floats.size(); ++i) {
+    ASSERT_EQ(halves[i], A1C_Float16_fromFloat32(floats[i])) << floats[i];
+  }
+
+  // JSON emits halves as numbers
+  auto item = A1C_Item_root(&arena);
+  A1C_Item_float16(item, 0x3e00);
+  EXPECT_EQ(encodeJson(item), "1.5");
+}
+
+TEST_F(A1CBorTest, Hash) {
+  json data = json::object({
+      {"array", json::array({1, -2, 3.5, "four", nullptr, true})},
+      {"nested", json::object({{"x", json::array()}, {"y", "z"}})},
+      {"bytes", json::binary({1, 2, 3})},
+      {"long", std::string(100, 'x')},
+  });
+  const auto cbor = json::to_cbor(data);
+  auto a = decode(cbor);
+  auto b = decode(cbor);
+  ASSERT_NE(a, b);
+  EXPECT_EQ(A1C_Item_hash(a, 0), A1C_Item_hash(b, 0));
+  EXPECT_EQ(A1C_Item_hash(a, 42), A1C_Item_hash(b, 42));
+  EXPECT_NE(A1C_Item_hash(a, 0), A1C_Item_hash(a, 42));
+
+  // Maps are order sensitive, like A1C_Item_eq()
+  std::reverse(const_cast<A1C_Pair *>(b->map.items),
+               const_cast<A1C_Pair *>(b->map.items) + b->map.size);
+  EXPECT_FALSE(A1C_Item_eq(a, b));
+  EXPECT_NE(A1C_Item_hash(a, 0), A1C_Item_hash(b, 0));
+
+  // Floats hash by their bits and width
+  auto x = A1C_Item_root(&arena);
+  auto y = A1C_Item_root(&arena);
+  A1C_Item_float64(x, 0.0);
+  A1C_Item_float64(y, -0.0);
+  EXPECT_NE(A1C_Item_hash(x, 0), A1C_Item_hash(y, 0));
+  A1C_Item_float32(y, 0.0f);
+  EXPECT_NE(A1C_Item_hash(x, 0), A1C_Item_hash(y, 0));
+  A1C_Item_float64(x, NAN);
+  A1C_Item_float64(y, NAN);
+  EXPECT_TRUE(A1C_Item_eq(x, y));
+  EXPECT_EQ(A1C_Item_hash(x, 0), A1C_Item_hash(y, 0));
+
+  // Same payload, different types
+  A1C_Item_int64(x, 1);
+  A1C_Item_boolean(y, true);
+  EXPECT_NE(A1C_Item_hash(x, 0), A1C_Item_hash(y, 0));
+  A1C_Item_string_refCStr(x, "ab");
+  A1C_Item_bytes_ref(y, (const uint8_t *)"ab", 2);
+  EXPECT_NE(A1C_Item_hash(x, 0), A1C_Item_hash(y, 0));
+
+  // No collisions on small integers
+  std::set<uint64_t> hashes;
+  for (int64_t i = -1000; i < 1000; ++i) {
+    A1C_Item_int64(x, i);
+    hashes.insert(A1C_Item_hash(x, 0));
+  }
+  EXPECT_EQ(hashes.size(), 2000u);
+}
+
+TEST_F(A1CBorTest, Compare) {
+  auto encodeDeterministic = [&](const A1C_Item *item) {
+    std::string str;
+    A1C_Encoder encoder;
+    A1C_Encoder_initWithConfig(&encoder, appendToString, &str,
+                               {.deterministic = true, .scratchArena = arena});
+    if (!A1C_Encoder_encode(&encoder, item)) {
+      throw std::runtime_error{printError("Encoding failed", encoder.error)};
+    }
+    return str;
+  };
+
+  std::vector<const A1C_Item *> items;
+  for (const json &value : {
+           json(0), json(23), json(24), json(255), json(256), json(65536),
+           json(INT64_MAX), json(-1), json(-24), json(-25), json(-257),
+           json(INT64_MIN), json(1.0), json(1.5), json(-0.0), json(100000.0),
+           json(1.1), json(1e300), json(INFINITY), json(-4.1), json(""),
+           json("a"), json("b"), json("aa"), json(std::string(300, 'x')),
+           json::binary({}), json::binary({1}), json::binary({0, 1}),
+           json::array(), json::array({1}), json::array({1, 2}),
+           json::array({2}), json::array({json::array({1})}),
+           json::object({{"b", 1}, {"a", 2}}), json::object({{"a", 2}}),
+           json::object({{"a", 2}, {"b", 1}, {"aa", 0}}),
+           json::object({{"b", 1}, {"a", 3}}), json(true), json(false),
+           json(nullptr),
+       }) {
+    items.push_back(decode(json::to_cbor(value)));
+  }
+  auto item = A1C_Item_root(&arena);
+  A1C_Item_float32(item, 0.1f);
+  items.push_back(item);
+  item = A1C_Item_root(&arena);
+  A1C_Item_float16(item, 0x7e00);
+  items.push_back(item);
+  item = A1C_Item_root(&arena);
+  A1C_Item_undefined(item);
+  items.push_back(item);
+  item = A1C_Item_root(&arena);
+  auto child = A1C_Item_tag(item, 1, &arena);
+  ASSERT_NE(child, nullptr);
+  A1C_Item_int64(child, 5);
+  items.push_back(item);
+
+  auto sign = [](int x) { return (x > 0) - (x < 0); };
+  for (auto a : items) {
+    const auto aEncoded = encodeDeterministic(a);
+    EXPECT_EQ(A1C_Item_compare(a, a), 0);
+    for (auto b : items) {
+      const auto bEncoded = encodeDeterministic(b);
+      EXPECT_EQ(sign(A1C_Item_compare(a, b)), sign(aEncoded.compare(bEncoded)))
+          << json::from_cbor(aEncoded) << " vs " << json::from_cbor(bEncoded);
+      EXPECT_EQ(sign(A1C_Item_compareWithArena(a, b, &arena)),
+                sign(aEncoded.compare(bEncoded)));
+    }
+  }
+
+  // Floats compare by their narrowest width
+  auto x = A1C_Item_root(&arena);
+  auto y = A1C_Item_root(&arena);
+  A1C_Item_float64(x, 1.0);
+  A1C_Item_float16(y, 0x3c00);
+  EXPECT_FALSE(A1C_Item_eq(x, y));
+  EXPECT_EQ(A1C_Item_compare(x, y), 0);
+
+  // Large unsorted maps, which are sorted once with a scratch arena, and fall
+  // back to the quadratic scan when it can't allocate.
+  {
+    const size_t size = 1000;
+    auto makeMap = [&](size_t stride, int64_t lastValue) {
+      auto map = A1C_Item_root(&arena);
+      auto pairs = A1C_Item_map(map, size, &arena);
+      EXPECT_NE(pairs, nullptr);
+      for (size_t i = 0; i < size; ++i) {
+        const int64_t key = (int64_t)((i * stride) % size);
+        A1C_Item_int64(&pairs[i].key, key);
+        A1C_Item_int64(&pairs[i].value,
+                       key == (int64_t)size - 1 ? lastValue : key);
+      }
+      return map;
+    };
+    auto a = makeMap(7, 0);
+    auto b = makeMap(13, 0);
+    auto c = makeMap(11, 1);
+    A1C_Arena failing = {};
+    failing.calloc = [](void *, size_t) -> void * { return nullptr; };
+    EXPECT_FALSE(A1C_Item_eq(a, b));
+    EXPECT_EQ(A1C_Item_compareWithArena(a, b, &arena), 0);
+    EXPECT_EQ(A1C_Item_compareWithArena(a, b, &failing), 0);
+    EXPECT_EQ(A1C_Item_compare(a, b), 0);
+    EXPECT_LT(A1C_Item_compareWithArena(a, c, &arena), 0);
+    EXPECT_GT(A1C_Item_compareWithArena(c, b, &arena), 0);
+    EXPECT_LT(A1C_Item_compareWithArena(b, c, &failing), 0);
+    EXPECT_LT(encodeDeterministic(a), encodeDeterministic(c));
+  }
+
+  // Usable as a sort order
+  std::sort(items.begin(), items.end(),
+            [](const A1C_Item *a, const A1C_Item *b) {
+              return A1C_Item_compare(a, b) < 0;
+            });
+  for (size_t i = 1; i < items.size(); ++i) {
+    EXPECT_LE(encodeDeterministic(items[i - 1]), encodeDeterministic(items[i]));
+  }
+}
+
+TEST_F(A1CBorTest, Clone) {
+  json data = json::object({
+      {"array", json::array({1, -2, 3.5, "four", nullptr, true})},
+      {"nested", json::object({{"x", json::array()}, {"y", "z"}})},
+      {"bytes", json::binary({1, 2, 3})},
+      {"empty", ""},
+  });
+  auto cbor = json::to_cbor(data);
+  cbor.insert(cbor.begin(), {0xc1}); // tag(1)
+  const auto expected = decode(cbor);
+
+  // Decode into a short-lived arena that references the source
+  auto requestPtrs = std::make_unique<Ptrs>();
+  A1C_Arena requestArena = {testCalloc, requestPtrs.get()};
+  A1C_Decoder decoder;
+  A1C_Decoder_init(&decoder, requestArena, {.referenceSource = true});
+  const A1C_Item *item = A1C_Decoder_decode(&decoder, cbor.data(), cbor.size());
+  ASSERT_NE(item, nullptr);
+
+  Ptrs cachePtrs;
+  A1C_Arena cacheArena = {testCalloc, &cachePtrs};
+  const A1C_Item *clone = A1C_Item_clone(item->tag.item, &cacheArena);
+  ASSERT_NE(clone, nullptr);
+  EXPECT_EQ(cachePtrs.size(), 1u);
+
+  // The clone survives the request arena and the source
+  requestPtrs.reset();
+  std::fill(cbor.begin(), cbor.end(), 0xff);
+  EXPECT_TRUE(A1C_Item_eq(clone, expected->tag.item));
+  EXPECT_EQ(clone->parent, nullptr);
+
+  // Everything lives in the single allocation, with parents rewritten
+  const uint8_t *begin = reinterpret_cast<const uint8_t *>(clone);
+  std::function<void(const A1C_Item *)> check = [&](const A1C_Item *node) {
+    EXPECT_GE(reinterpret_cast<const uint8_t *>(node), begin);
+    if (node->type == A1C_ItemType_string && node->string.size > 0) {
+      EXPECT_GE(reinterpret_cast<const uint8_t *>(node->string.data), begin);
+    }
+    if (node->type == A1C_ItemType_array) {
+      for (size_t i = 0; i < node->array.size; ++i) {
+        EXPECT_EQ(node->array.items[i].parent, node);
+        check(&node->array.items[i]);
+      }
+    } else if (node->type == A1C_ItemType_map) {
+      for (size_t i = 0; i < node->map.size; ++i) {
+        EXPECT_EQ(node->map.items[i].key.parent, node);
+        EXPECT_EQ(node->map.items[i].value.parent, node);
+        check(&node->map.items[i].key);
+        check(&node->map.items[i].value);
+      }
+    }
+  };
+  check(clone);
+
+  // Tags and scalars
+  auto tagged = A1C_Item_clone(expected, &arena);
+  ASSERT_NE(tagged, nullptr);
+  EXPECT_TRUE(A1C_Item_eq(tagged, expected));
+  EXPECT_EQ(tagged->tag.item->parent, tagged);
+  auto scalar = A1C_Item_root(&arena);
+  A1C_Item_int64(scalar, 5);
+  auto scalarClone = A1C_Item_clone(scalar, &arena);
+  ASSERT_NE(scalarClone, nullptr);
+  EXPECT_TRUE(A1C_Item_eq(scalar, scalarClone));
+
+  // Allocation failures are reported
+  A1C_LimitedArena limited = A1C_LimitedArena_init(arena, 16);
+  A1C_Arena limitedArena = A1C_LimitedArena_arena(&limited);
+  EXPECT_EQ(A1C_Item_clone(expected, &limitedArena), nullptr);
+}
+
+TEST_F(A1CBorTest, CompactTree) {
+  // Build a scattered tree: {"a": [1, "xy", [2]], "b": {"c": "long string"}}
+  auto root = A1C_Item_root(&arena);
+  auto pairs = A1C_Item_map(root, 2, &arena);
+  ASSERT_NE(pairs, nullptr);
+  ASSERT_TRUE(A1C_Item_string_cstr(&pairs[0].key, "a", &arena));
+  auto array = A1C_Item_array(&pairs[0].value, 3, &arena);
+  ASSERT_NE(array, nullptr);
+  ASSERT_TRUE(A1C_Item_string_cstr(&pairs[1].key, "b", &arena));
+  auto inner = A1C_Item_map(&pairs[1].value, 1, &arena);
+  ASSERT_NE(inner, nullptr);
+  A1C_Item_int64(&array[0], 1);
+  ASSERT_TRUE(A1C_Item_string_cstr(&array[1], "xy", &arena));
+  auto nested = A1C_Item_array(&array[2], 1, &arena);
+  ASSERT_NE(nested, nullptr);
+  A1C_Item_int64(nested, 2);
+  ASSERT_TRUE(A1C_Item_string_cstr(&inner[0].key, "c", &arena));
+  A1C_Item_string_refCStr(&inner[0].value, "long string");
+  auto empty = A1C_Item_root(&arena);
+  ASSERT_NE(A1C_Item_array(empty, 0, &arena), nullptr);
+
+  auto addr = [](const void *ptr) { return reinterpret_cast<uintptr_t>(ptr); };
+  std::map<const A1C_Item *, int> depths;
+  std::function<void(const A1C_Item *, int)> check = [&](const A1C_Item *item,
+                                                         int depth) {
+    depths[item] = depth;
+    size_t count = 0;
+    const A1C_Item *children = nullptr;
+    if (item->type == A1C_ItemType_array) {
+      count = item->array.size;
+      children = item->array.items;
+    } else if (item->type == A1C_ItemType_map) {
+      count = 2 * item->map.size;
+      children = &item->map.items[0].key;
+    }
+    for (size_t i = 0; i < count; ++i) {
+      const A1C_Item *child = &children[i];
+      EXPECT_EQ(child->parent, item);
+      EXPECT_GT(addr(child), addr(item));
+      if (child->type == A1C_ItemType_string) {
+        // Strings follow their block
+        EXPECT_GE(addr(child->string.data), addr(children + count));
+        EXPECT_LT(addr(child->string.data), addr(children + count) + 64);
+      }
+      check(child, depth + 1);
+    }
+  };
+
+  for (auto layout : {A1C_Layout_depthFirst, A1C_Layout_breadthFirst}) {
+    Ptrs compactPtrs;
+    A1C_Arena compactArena = {testCalloc, &compactPtrs};
+    const A1C_Item *compact = A1C_Item_compact(root, &compactArena, layout);
+    ASSERT_NE(compact, nullptr);
+    EXPECT_EQ(compactPtrs.size(), 1u);
+    EXPECT_EQ(compact->parent, nullptr);
+    EXPECT_TRUE(A1C_Item_eq(compact, root));
+    EXPECT_EQ(encode(compact), encode(root));
+
+    depths.clear();
+    check(compact, 0);
+    // Breadth first places shallower items first, depth first doesn't
+    bool levelOrder = true;
+    for (auto a : depths) {
+      for (auto b : depths) {
+        if (a.second < b.second && addr(a.first) > addr(b.first)) {
+          levelOrder = false;
+        }
+      }
+    }
+    EXPECT_EQ(levelOrder, layout == A1C_Layout_breadthFirst);
+
+    auto compactEmpty = A1C_Item_compact(empty, &compactArena, layout);
+    ASSERT_NE(compactEmpty, nullptr);
+    EXPECT_TRUE(A1C_Item_eq(compactEmpty, empty));
+  }
+
+  A1C_LimitedArena limited = A1C_LimitedArena_init(arena, 16);
+  A1C_Arena limitedArena = A1C_LimitedArena_arena(&limited);
+  EXPECT_EQ(A1C_Item_compact(root, &limitedArena, A1C_Layout_depthFirst),
+            nullptr);
+}
+
+TEST_F(A1CBorTest, DecodeJson) {
+  auto decodeJson = [&](const std::string &text, A1C_DecoderConfig config =
+                                                     A1C_DecoderConfig{}) {
+    A1C_Decoder decoder;
+    A1C_Decoder_init(&decoder, arena, config);
+    const A1C_Item *item = A1C_Decoder_decodeJson(
+        &decoder, reinterpret_cast<const uint8_t *>(text.data()), text.size());
+    if (item == nullptr) {
+      throw std::runtime_error{printError("JSON decoding failed",
+                                          decoder.error)};
+    }
+    return item;
+  };
+  auto decodeJsonError = [&](const std::string &text, size_t maxDepth = 0) {
+    A1C_Decoder decoder;
+    A1C_Decoder_init(&decoder, arena, {.maxDepth = maxDepth});
+    const A1C_Item *item = A1C_Decoder_decodeJson(
+        &decoder, reinterpret_cast<const uint8_t *>(text.data()), text.size());
+    EXPECT_EQ(item, nullptr) << text;
+    return decoder.error;
+  };
+  auto toJson = [&](const A1C_Item *item) {
+    return json::from_cbor(encode(item));
+  };
+
+  const std::string text = R"( {
+    "string": "hello",
+    "escapes": "q\" b\\ s\/ \b\f\n\r\t \u00e9 \u20AC \ud83d\ude00",
+    "utf8": "caf\u00e9 \u00e9\u20ac\ud83d\ude00 na\u00efve",
+    "long": "this string is long enough to cover the vector paths \" and more",
+    "empty": "",
+    "numbers": [0, -0, 1, -1, 123456789012345678, 9223372036854775807,
+                -9223372036854775808, 9223372036854775808, 0.5, -2.25, 1e10,
+                1.5E-7, 3.141592653589793, 0.30000000000000004441,
+                1234567890123456789012345, 5e-324, 1.7976931348623157e308],
+    "literals": [true, false, null],
+    "nested": {"a": [[], {}, [{"b": [1, [2, [3]]]}]]},
+    "dup": 1, "dup": 2
+  } )";
+  auto item = decodeJson(text);
+  EXPECT_EQ(toJson(item), json::parse(text));
+  EXPECT_EQ(A1C_Map_get_cstr(&item->map, "dup")->int64, 1);
+  EXPECT_EQ(item->map.size, 10u);
+
+  // Integers that fit stay integers, everything else is a double
+  auto numbers = &A1C_Map_get_cstr(&item->map, "numbers")->array;
+  EXPECT_EQ(numbers->items[4].type, A1C_ItemType_int64);
+  EXPECT_EQ(numbers->items[5].int64, INT64_MAX);
+  EXPECT_EQ(numbers->items[6].int64, INT64_MIN);
+  EXPECT_EQ(numbers->items[7].type, A1C_ItemType_float64);
+  EXPECT_EQ(numbers->items[7].float64, 9223372036854775808.0);
+  EXPECT_EQ(numbers->items[13].float64, 0.30000000000000004);
+  EXPECT_EQ(numbers->items[15].float64, 5e-324);
+
+  // Numbers off the fast path are correctly rounded, in any locale
+  const std::vector<std::pair<std::string, double>> floats = {
+      {"9007199254740993.0", 9007199254740992.0},
+      {"9007199254740995.0", 9007199254740996.0},
+      {"9007199254740993.00000000000000000000001", 9007199254740994.0},
+      {"2.2250738585072011e-308", 2.2250738585072011e-308},
+      {"2.4703282292062327e-324", 0.0},
+      {"2.4703282292062328e-324", 5e-324},
+      {"1.7976931348623158e308", 1.7976931348623157e308},
+      {"1.7976931348623159e308", INFINITY},
+      {"-1e-400", -0.0},
+      {"1" + std::string(1000, '0') + "e-1000", 1.0},
+      {"0." + std::string(1000, '0') + "1e1001", 1.0},
+  };
+  const std::string locale = setlocale(LC_NUMERIC, nullptr);
+  for (const char *name : {"C", "de_DE.UTF-8", "fr_FR.UTF-8"}) {
+    if (setlocale(LC_NUMERIC, name) == nullptr) {
+      continue;
+    }
+    for (const auto &[input, expected] : floats) {
+      auto number = decodeJson(input);
+      ASSERT_EQ(number->type, A1C_ItemType_float64) << input;
+      EXPECT_EQ(number->float64, expected) << input << " " << name;
+      EXPECT_EQ(std::signbit(number->float64), std::signbit(expected)) << input;
+    }
+  }
+  setlocale(LC_NUMERIC, locale.c_str());
+
+  // Unescaped UTF-8 passes through, and escapes produce UTF-8
+  auto utf8 = A1C_Map_get_cstr(&item->map, "utf8");
+  auto raw = decodeJson("\"caf\xc3\xa9 \xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80 "
+                        "na\xc3\xafve\"");
+  EXPECT_TRUE(A1C_Item_eq(utf8, raw));
+
+  // Parents are set, unless skipped
+  std::function<void(const A1C_Item *)> checkParents =
+      [&](const A1C_Item *node) {
+        if (node->type == A1C_ItemType_array) {
+          for (size_t i = 0; i < node->array.size; ++i) {
+            EXPECT_EQ(node->array.items[i].parent, node);
+            checkParents(&node->array.items[i]);
+          }
+        } else if (node->type == A1C_ItemType_map) {
+          for (size_t i = 0; i < node->map.size; ++i) {
+            EXPECT_EQ(node->map.items[i].key.parent, node);
+            EXPECT_EQ(node->map.items[i].value.parent, node);
+            checkParents(&node->map.items[i].value);
+          }
+        }
+      };
+  checkParents(item);
+  EXPECT_EQ(item->parent, nullptr);
+  auto noParents = decodeJson(text, {.skipParents = true});
+  EXPECT_TRUE(A1C_Item_eq(noParents, item));
+  EXPECT_EQ(noParents->map.items[0].key.parent, nullptr);
+
+  // Strings without escapes can reference the source
+  const std::string refText = R"(["abc", "a\nb"])";
+  auto ref = decodeJson(refText, {.referenceSource = true});
+  EXPECT_EQ(ref->array.items[0].string.data, refText.data() + 2);
+  EXPECT_EQ(std::string(ref->array.items[1].string.data,
+                        ref->array.items[1].string.size),
+            "a\nb");
+
+  // Matches nlohmann::json on a generated document
+  json big = json::array();
+  for (int i = 0; i < 1000; ++i) {
+    big.push_back({{"id", i},
+                   {"name", "item \"" + std::to_string(i) + "\"\n"},
+                   {"value", i * 0.25},
+                   {"tags", json::array({"x", i % 2 == 0, nullptr})}});
+  }
+  EXPECT_EQ(toJson(decodeJson(big.dump())), big);
+  EXPECT_EQ(toJson(decodeJson(big.dump(2))), big);
+
+  // Errors
+  struct ErrorCase {
+    std::string text;
+    A1C_ErrorType type;
+    size_t srcPos;
+  };
+  for (const auto &c : std::vector<ErrorCase>{
+           {"", A1C_ErrorType_truncated, 0},
+           {"  ", A1C_ErrorType_truncated, 2},
+           {"[1,]", A1C_ErrorType_invalidJson, 3},
+           {"[1 2]", A1C_ErrorType_invalidJson, 3},
+           {"[1", A1C_ErrorType_truncated, 2},
+           {"{\"a\" 1}", A1C_ErrorType_invalidJson, 5},
+           {"{1: 2}", A1C_ErrorType_invalidJson, 1},
+           {"{\"a\": 1,}", A1C_ErrorType_invalidJson, 8},
+           {"01", A1C_ErrorType_trailingData, 1},
+           {"1 2", A1C_ErrorType_trailingData, 2},
+           {"-", A1C_ErrorType_truncated, 1},
+           {"-a", A1C_ErrorType_invalidJson, 1},
+           {"1.", A1C_ErrorType_truncated, 2},
+           {"1.e5", A1C_ErrorType_invalidJson, 2},
+           {"1e+", A1C_ErrorType_truncated, 3},
+           {"+1", A1C_ErrorType_invalidJson, 0},
+           {"tru", A1C_ErrorType_truncated, 3},
+           {"trux", A1C_ErrorType_invalidJson, 0},
+           {"nul", A1C_ErrorType_truncated, 3},
+           {"\"abc", A1C_ErrorType_truncated, 4},
+           {"\"ab\\", A1C_ErrorType_truncated, 4},
+           {"\"a\x01\"", A1C_ErrorType_invalidJson, 2},
+           {"\"a\\x\"", A1C_ErrorType_invalidJson, 2},
+           {"\"\\u12\"", A1C_ErrorType_invalidJson, 1},
+           {"\"\\ud800\"", A1C_ErrorType_invalidJson, 1},
+           {"\"\\ud800\\u0041\"", A1C_ErrorType_invalidJson, 1},
+           {"\"\\udc00\"", A1C_ErrorType_invalidJson, 1},
+           {"\"a\xff\"", A1C_ErrorType_invalidUtf8, 2},
+           {"\"\xc0\x80\"", A1C_ErrorType_invalidUtf8, 1},
+           {"\"\xed\xa0\x80\"", A1C_ErrorType_invalidUtf8, 1},
+           {"\"\xf4\x90\x80\x80\"", A1C_ErrorType_invalidUtf8, 1},
+           {"\"\xe2\x82\"", A1C_ErrorType_invalidUtf8, 1},
+           {std::string(40, ' ') + "\"" + std::string(40, 'a') + "\x80\"",
+            A1C_ErrorType_invalidUtf8, 81},
+       }) {
+    auto error = decodeJsonError(c.text);
+    EXPECT_EQ(error.type, c.type) << c.text;
+    EXPECT_EQ(error.srcPos, c.srcPos) << c.text;
+  }
+  EXPECT_EQ(decodeJsonError("[[[1]]]", 3).type,
+            A1C_ErrorType_maxDepthExceeded);
+  EXPECT_NE(decodeJson("[[1]]", {.maxDepth = 3}), nullptr);
+  A1C_Decoder decoder;
+  A1C_Decoder_init(&decoder, arena, {.limitBytes = 64});
+  EXPECT_EQ(A1C_Decoder_decodeJson(
+                &decoder, reinterpret_cast<const uint8_t *>(text.data()),
+                text.size()),
+            nullptr);
+  EXPECT_EQ(decoder.error.type, A1C_ErrorType_badAlloc);
+}